@@ -0,0 +1,300 @@
+/**
+ * @file kernel_benchmarks.cpp
+ * @brief Throughput of the hot kernels on synthetic inputs: the box and
+ * triangle tests, the BVH build and traversal, the discrete sampling, the
+ * texture lookups, the BSDFs and the film splatting. The inputs are drawn
+ * ahead of the timed loops, which cycle through them.
+ */
+#include <benchmark/benchmark.h>
+
+#include "rdr/bsdf.h"
+#include "rdr/bvh_accel.h"
+#include "rdr/film.h"
+#include "rdr/interaction.h"
+#include "rdr/mipmap.h"
+#include "rdr/properties.h"
+#include "rdr/ray.h"
+#include "rdr/sampler.h"
+#include "rdr/shape.h"
+#include "rdr/texture.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+/// The number of inputs drawn ahead, a power of two
+static constexpr int N_INPUTS = 1 << 12;
+
+/// Rays from a sphere around the unit cube, aimed into it
+static vector<Ray> MakeRandomRays(Sampler &sampler) {
+  vector<Ray> rays;
+  for (int i = 0; i < N_INPUTS; ++i) {
+    const Vec3f origin = 3.0_F * UniformSampleSphere(sampler.get2D());
+    const Vec3f target(sampler.get1D() - 0.5_F, sampler.get1D() - 0.5_F,
+        sampler.get1D() - 0.5_F);
+    rays.emplace_back(origin, Normalize(target - origin));
+  }
+  return rays;
+}
+
+/* ===================================================================== *
+ *
+ * Intersection
+ *
+ * ===================================================================== */
+
+static void BM_AABBIntersect(benchmark::State &state) {
+  Sampler sampler;
+  const vector<Ray> rays = MakeRandomRays(sampler);
+  const AABB aabb(Vec3f(-0.5_F), Vec3f(0.5_F));
+
+  int i = 0;
+  for (auto _ : state) {
+    Float t_in, t_out;
+    benchmark::DoNotOptimize(
+        aabb.intersect(rays[i++ & (N_INPUTS - 1)], &t_in, &t_out));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AABBIntersect);
+
+static void BM_TriangleIntersect(benchmark::State &state) {
+  Sampler sampler;
+  const vector<Ray> rays = MakeRandomRays(sampler);
+  // Large triangles, so that a fair share of the tests hit
+  const auto mesh = MakeTriangleSoup(sampler, N_INPUTS, 1.0_F);
+
+  int i = 0;
+  for (auto _ : state) {
+    const int index = i++ & (N_INPUTS - 1);
+    Ray ray         = rays[index];
+    SurfaceInteraction interaction;
+    benchmark::DoNotOptimize(TriangleIntersect(ray, index, mesh, interaction));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TriangleIntersect);
+
+using TriangleBVH = BVHTree<detail_::BVHTriangleNode>;
+
+static void FillTriangleBVH(TriangleBVH &tree,
+    const ref<TriangleMeshResource> &mesh, EBVHHeuristicProfile profile) {
+  tree.clear();
+  tree.setHeuristicProfile(profile);
+  const int n_triangles = static_cast<int>(mesh->v_indices.size() / 3);
+  for (int i = 0; i < n_triangles; ++i)
+    tree.push_back(detail_::BVHTriangleNode(detail_::Triangle(i, mesh)));
+}
+
+/// Args: the number of triangles, and the EBVHHeuristicProfile
+static void BM_BVHBuild(benchmark::State &state) {
+  Sampler sampler;
+  const auto mesh    = MakeTriangleSoup(sampler, state.range(0), 0.02_F);
+  const auto profile = static_cast<EBVHHeuristicProfile>(state.range(1));
+
+  TriangleBVH tree;
+  for (auto _ : state) {
+    state.PauseTiming();
+    FillTriangleBVH(tree, mesh, profile);
+    state.ResumeTiming();
+    tree.build();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BVHBuild)
+    ->ArgsProduct({{1 << 10, 1 << 14, 1 << 17}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+/// Args: the number of triangles, and the EBVHHeuristicProfile
+static void BM_BVHIntersect(benchmark::State &state) {
+  Sampler sampler;
+  const vector<Ray> rays = MakeRandomRays(sampler);
+  const auto mesh        = MakeTriangleSoup(sampler, state.range(0), 0.02_F);
+
+  TriangleBVH tree;
+  FillTriangleBVH(
+      tree, mesh, static_cast<EBVHHeuristicProfile>(state.range(1)));
+  tree.build();
+
+  int i      = 0;
+  int n_hits = 0;
+  for (auto _ : state) {
+    Ray ray = rays[i++ & (N_INPUTS - 1)];
+    SurfaceInteraction interaction;
+    n_hits += tree.intersect(ray,
+        [&interaction](Ray &internal_ray, const detail_::Triangle &triangle) {
+          return triangle.intersect(internal_ray, interaction);
+        });
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["hit_rate"] =
+      static_cast<double>(n_hits) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_BVHIntersect)->ArgsProduct({{1 << 10, 1 << 14, 1 << 17}, {0, 1}});
+
+/* ===================================================================== *
+ *
+ * Sampling and Texturing
+ *
+ * ===================================================================== */
+
+/// Arg: the number of entries
+static void BM_Distribution1DSampleDiscrete(benchmark::State &state) {
+  Sampler sampler;
+  vector<Float> weights(state.range(0));
+  for (auto &weight : weights) weight = sampler.get1D();
+  const Distribution1D distribution(
+      weights.data(), static_cast<int>(weights.size()));
+  vector<Float> us(N_INPUTS);
+  for (auto &u : us) u = sampler.get1D();
+
+  int i = 0;
+  for (auto _ : state) {
+    Float pdf;
+    benchmark::DoNotOptimize(
+        distribution.sampleDiscrete(us[i++ & (N_INPUTS - 1)], &pdf));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Distribution1DSampleDiscrete)
+    ->RangeMultiplier(16)
+    ->Range(16, 1 << 20);
+
+/// Args: the MIPMap::LookUpMethod and the MIPMap::TexelFormat
+static void BM_MIPMapLookUp(benchmark::State &state) {
+  Sampler sampler;
+  const Vec2u resolution(1024, 1024);
+  vector<Float> texels(4 * resolution[0] * resolution[1]);
+  for (auto &texel : texels) texel = sampler.get1D();
+  const MIPMap mipmap(resolution, texels,
+      static_cast<MIPMap::LookUpMethod>(state.range(0)),
+      MIPMap::ImageWrap::Repeat,
+      static_cast<MIPMap::TexelFormat>(state.range(1)));
+
+  // Anisotropic footprints of a few texels
+  vector<Vec2f> st(N_INPUTS);
+  for (auto &coordinate : st) coordinate = sampler.get2D();
+  const Vec2f dstdx(4.0_F / resolution[0], 0);
+  const Vec2f dstdy(0, 1.0_F / resolution[1]);
+
+  int i = 0;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        mipmap.LookUp(st[i++ & (N_INPUTS - 1)], dstdx, dstdy));
+  state.SetItemsProcessed(state.iterations());
+  state.counters["bytes"] = static_cast<double>(mipmap.MemoryUsage());
+}
+BENCHMARK(BM_MIPMapLookUp)
+    ->ArgsProduct(
+        {{static_cast<int>(MIPMap::LookUpMethod::TriLinearInterpolation),
+             static_cast<int>(MIPMap::LookUpMethod::EWA)},
+            {static_cast<int>(MIPMap::TexelFormat::Single),
+                static_cast<int>(MIPMap::TexelFormat::Half)}});
+
+/* ===================================================================== *
+ *
+ * BSDF
+ *
+ * ===================================================================== */
+
+/// A BSDF configured as in a scene, over a white constant texture
+template <typename BSDFType>
+static ref<BSDFType> MakeBSDF() {
+  Properties texture_props;
+  texture_props.setProperty("color", Vec3f(1.0_F));
+  CrossConfigurationContext context;
+  context.textures["white"] = make_ref<ConstantTexture>(texture_props);
+
+  Properties props;
+  props.setProperty("texture_name", std::string("white"));
+  props.setProperty("alpha", 0.2_F);
+  auto bsdf = make_ref<BSDFType>(props);
+  bsdf->crossConfiguration(context);
+  return bsdf;
+}
+
+/// Interactions on the xy-plane, seen from the upper hemisphere
+static vector<SurfaceInteraction> MakeInteractions(Sampler &sampler) {
+  vector<SurfaceInteraction> interactions(N_INPUTS);
+  for (auto &interaction : interactions) {
+    interaction.setGeneral(Vec3f(0.0_F), Vec3f(0, 0, 1));
+    interaction.wo = CosineSampleHemisphere(sampler.get2D());
+    interaction.wi = CosineSampleHemisphere(sampler.get2D());
+  }
+  return interactions;
+}
+
+template <typename BSDFType>
+static void BM_BSDFSample(benchmark::State &state) {
+  Sampler sampler;
+  const auto bsdf   = MakeBSDF<BSDFType>();
+  auto interactions = MakeInteractions(sampler);
+
+  int i = 0;
+  for (auto _ : state) {
+    Float pdf;
+    benchmark::DoNotOptimize(
+        bsdf->sample(interactions[i++ & (N_INPUTS - 1)], sampler, &pdf));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_BSDFSample, IdealDiffusion);
+BENCHMARK_TEMPLATE(BM_BSDFSample, MicrofacetReflection);
+BENCHMARK_TEMPLATE(BM_BSDFSample, Glass);
+
+template <typename BSDFType>
+static void BM_BSDFEvaluate(benchmark::State &state) {
+  Sampler sampler;
+  const auto bsdf   = MakeBSDF<BSDFType>();
+  auto interactions = MakeInteractions(sampler);
+
+  int i = 0;
+  for (auto _ : state) {
+    auto &interaction = interactions[i++ & (N_INPUTS - 1)];
+    benchmark::DoNotOptimize(bsdf->evaluate(interaction));
+    benchmark::DoNotOptimize(bsdf->pdf(interaction));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_BSDFEvaluate, IdealDiffusion);
+BENCHMARK_TEMPLATE(BM_BSDFEvaluate, MicrofacetReflection);
+
+/* ===================================================================== *
+ *
+ * Film
+ *
+ * ===================================================================== */
+
+/// Splat directly into the film, i.e. the locked accumulation
+static void BM_FilmCommitSample(benchmark::State &state) {
+  Sampler sampler;
+  const auto film = MakeFilm("locked", Vec2i(256, 256));
+  vector<Vec2f> positions(N_INPUTS);
+  for (auto &position : positions)
+    position = sampler.get2D() * Cast<Float>(film->getResolution());
+
+  int i = 0;
+  for (auto _ : state)
+    film->commitSample(positions[i++ & (N_INPUTS - 1)], Vec3f(1.0_F));
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FilmCommitSample);
+
+/// Splat into a tile of the film, as the integrators do
+static void BM_FilmTileCommitSample(benchmark::State &state) {
+  Sampler sampler;
+  const auto film = MakeFilm("tiled", Vec2i(256, 256));
+  const Vec2i low_bnd(64, 64), upper_bnd(80, 80);
+  FilmTile film_tile(*film, low_bnd, upper_bnd);
+  vector<Vec2f> positions(N_INPUTS);
+  for (auto &position : positions)
+    position = Cast<Float>(low_bnd) +
+               sampler.get2D() * Cast<Float>(upper_bnd - low_bnd);
+
+  int i = 0;
+  for (auto _ : state)
+    film_tile.commitSample(positions[i++ & (N_INPUTS - 1)], Vec3f(1.0_F));
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FilmTileCommitSample);
+
+BENCHMARK_MAIN();
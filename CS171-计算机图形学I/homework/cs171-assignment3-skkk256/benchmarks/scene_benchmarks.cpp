@@ -0,0 +1,104 @@
+/**
+ * @file scene_benchmarks.cpp
+ * @brief Throughput of the whole pipeline on the bundled scenes of data/, at a
+ * low resolution and sample count. Loading, i.e. initialize and preprocess,
+ * is timed apart from rendering. Pass the scene files to run other scenes.
+ */
+#include <benchmark/benchmark.h>
+
+#include <fstream>
+
+#include "nlohmann/json.hpp"
+#include "rdr/render.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+/// Downscale the scene to keep an iteration short
+static Properties LoadScene(const fs::path &path) {
+  std::ifstream fin(path);
+  if (!fin.is_open())
+    Exception_("Can not open the JSON file [ {} ]", path.string());
+  nlohmann::json root_json;
+  fin >> root_json;
+  root_json["film"]["resolution"] = {128, 128};
+  root_json["integrator"]["spp"]  = 4;
+  return Properties(root_json);
+}
+
+/// Report a scene that fails to load, e.g. with missing assets, as skipped
+/// instead of aborting the other benchmarks
+template <typename Func>
+static void RunOrSkip(benchmark::State &state, Func func) {
+  try {
+    func();
+  } catch (const std::exception &e) {
+    state.SkipWithError(e.what());
+  }
+}
+
+static void BM_SceneLoad(benchmark::State &state, const fs::path &path) {
+  RunOrSkip(state, [&] {
+    FileResolver::setBasePath(path.parent_path());
+    const Properties props = LoadScene(path);
+    for (auto _ : state) {
+      ref<RenderInterface> render = make_ref<NativeRender>(props);
+      render->initialize();
+      render->preprocess();
+
+      state.PauseTiming();
+      render->clearRuntimeInfo();
+      state.ResumeTiming();
+    }
+  });
+}
+
+static void BM_SceneRender(benchmark::State &state, const fs::path &path) {
+  RunOrSkip(state, [&] {
+    FileResolver::setBasePath(path.parent_path());
+    const Properties props = LoadScene(path);
+    for (auto _ : state) {
+      state.PauseTiming();
+      ref<RenderInterface> render = make_ref<NativeRender>(props);
+      render->initialize();
+      render->preprocess();
+      state.ResumeTiming();
+
+      render->render();
+
+      state.PauseTiming();
+      render->clearRuntimeInfo();
+      state.ResumeTiming();
+    }
+  });
+
+  // 128 x 128 pixels at 4 spp, see LoadScene
+  state.counters["samples_per_second"] = benchmark::Counter(
+      128 * 128 * 4, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+int main(int argc, char *argv[]) {
+  spdlog::set_level(spdlog::level::err);
+  Factory::doRegisterAllClasses();
+
+  benchmark::Initialize(&argc, argv);
+  vector<fs::path> scenes;
+  for (int i = 1; i < argc; ++i) scenes.emplace_back(argv[i]);
+  if (scenes.empty()) {
+    for (const char *name : {"cbox.json", "veach.json", "matpreview.json"})
+      scenes.push_back(fs::path(RDR_DATA_DIR) / name);
+  }
+
+  for (const auto &scene : scenes) {
+    const std::string name = scene.stem().string();
+    benchmark::RegisterBenchmark(("BM_SceneLoad/" + name).c_str(),
+        BM_SceneLoad, fs::absolute(scene))
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("BM_SceneRender/" + name).c_str(),
+        BM_SceneRender, fs::absolute(scene))
+        ->Unit(benchmark::kMillisecond);
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -9,6 +9,77 @@ RDR_NAMESPACE_BEGIN
 bool TriangleIntersect(Ray &ray, const uint32_t &triangle_index,
     const ref<TriangleMeshResource> &mesh, SurfaceInteraction &interaction);
 
+/**
+ * @brief The per-ray constants of the watertight ray-triangle test [Woop et
+ * al. 2013]. The ray is permuted and sheared into the +z axis, after which the
+ * test reduces to 2D edge functions that agree exactly on shared edges.
+ */
+struct WatertightRay {
+  WatertightRay() = default;
+  explicit WatertightRay(const Ray &ray);
+
+  Vec3f origin;
+  int kx, ky, kz;    //<! The axis permutation, kz is the dominant one
+  Float sx, sy, sz;  //<! The shear constants
+};
+
+/**
+ * @brief Watertight, single-sided intersection in single precision, where
+ * only the triangles facing the ray are hit. On a hit within [t_min, t_max],
+ * the distance and the barycentric coordinates of p0, p1, p2 are written.
+ */
+bool WatertightTriangleIntersect(const WatertightRay &ray, const Vec3f &p0,
+    const Vec3f &p1, const Vec3f &p2, Float t_min, Float t_max, Float *t,
+    Vec3f *barycentric);
+
+/// The closest hit found so far during traversal. The surface interaction is
+/// constructed from it only once the traversal ends
+struct TriangleHit {
+  uint32_t triangle_index{std::numeric_limits<uint32_t>::max()};
+  Vec3f barycentric{};
+};
+
+/**
+ * @brief The triangle positions gathered from the mesh, so that the
+ * intersector reads them contiguously instead of through v_indices. Four
+ * triangles share a 16-byte aligned block in structure of arrays layout.
+ */
+class TriangleSoA {
+public:
+  struct alignas(16) Block {
+    Float p[3][3][4];  // [vertex][axis][triangle]
+  };
+
+  void build(const TriangleMeshResource &mesh);
+  size_t size() const { return n_triangles; }
+
+  Vec3f getVertex(uint32_t triangle_index, int vertex) const {
+    const Block &block  = blocks[triangle_index / 4];
+    const uint32_t lane = triangle_index % 4;
+    return {block.p[vertex][0][lane], block.p[vertex][1][lane],
+        block.p[vertex][2][lane]};
+  }
+
+  /// On a hit, shrink ray.t_max and record the hit. The interaction is not
+  /// touched.
+  bool intersect(const WatertightRay &watertight_ray, Ray &ray,
+      uint32_t triangle_index, TriangleHit &hit) const;
+
+  /// Whether the ray hits the triangle within its time range
+  bool occluded(const WatertightRay &watertight_ray, const Ray &ray,
+      uint32_t triangle_index) const;
+
+  /// intersect for the rays of packet in mask, reading the triangle once.
+  /// Return the bitmask of the rays hit
+  uint32_t intersectPacket(const WatertightRay *watertight_rays,
+      RayPacket &packet, uint32_t mask, uint32_t triangle_index,
+      TriangleHit *hits) const;
+
+private:
+  vector<Block> blocks;
+  size_t n_triangles{0};
+};
+
 /**
  * @brief The bounding box
  */
@@ -104,12 +175,17 @@ struct AABB : public TAABB<Vec3f> {
 /**
  * @brief Acceleration structure for ray-geometry intersection. Support triangle
  * mesh only. This is the base class for all acceleration structures such as
- * BVH/KD-Tree/Octree.
+ * BVH/KD-Tree/Octree. The base class itself performs brute-force intersection.
+ * @see bvh_accel.h for the factory
  */
-class Accel {
+class Accel : public ConfigurableObject {
 public:
-  Accel()          = default;
-  virtual ~Accel() = default;
+  Accel()           = default;
+  ~Accel() override = default;
+
+  // ++ Required by ConfigurableObject
+  Accel(const Properties &props) : ConfigurableObject(props) {}
+  // --
 
   /// Set the triangle mesh to be intersected.
   virtual void setTriangleMesh(const ref<TriangleMeshResource> &mesh);
@@ -132,10 +208,33 @@ public:
    */
   virtual bool intersect(Ray &ray, SurfaceInteraction &interaction) const;
 
+  /// Whether the ray hits anything within its time range. Any hit terminates
+  /// the query, and no interaction is constructed.
+  virtual bool occluded(const Ray &ray) const;
+
+  /// Intersect the rays of packet in mask, where interactions[i] is filled as
+  /// by intersect on a hit of packet.rays[i]. Return the bitmask of the rays
+  /// hit. Defaults to intersecting the rays one by one
+  virtual uint32_t intersectPacket(RayPacket &packet, uint32_t mask,
+      SurfaceInteraction *interactions) const;
+
+  /// Append the built structure to data, to be cached along with the mesh.
+  /// Return false if the structure can not be cached
+  virtual bool serialize(vector<uint8_t> &data) const;
+
+  /// Restore the structure from the bytes of serialize in place of build(),
+  /// after setTriangleMesh. Return false to reject the bytes, in which case
+  /// the structure is left to be built
+  virtual bool deserialize(const uint8_t *data, size_t size);
+
 protected:
   ref<TriangleMeshResource>
       mesh{};  //<! The triangle mesh's underlying data to be intersected.
   AABB bound;  //<! The bounding box of the structure in its space.
+  TriangleSoA triangles;  //<! Set along with the mesh
+
+  /// Construct the interaction of the closest hit after the traversal
+  void commitHit(const TriangleHit &hit, SurfaceInteraction &interaction) const;
 };
 
 RDR_NAMESPACE_END
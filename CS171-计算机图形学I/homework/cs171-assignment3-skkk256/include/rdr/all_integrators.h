@@ -1,4 +1,8 @@
+#include "rdr/bdpt.h"
+#include "rdr/guiding.h"
 #include "rdr/integrator.h"
+#include "rdr/photon.h"
+#include "rdr/wavefront.h"
 
 RDR_NAMESPACE_BEGIN
 
@@ -6,18 +10,17 @@ RDR_REGISTER_FACTORY(Integrator, [](const Properties &props) -> Integrator * {
   auto type = props.getProperty<std::string>("type", "path");
   if (type == "path") {
     return Memory::alloc<IncrementalPathIntegrator>(props);
+  } else if (type == "wavefront") {
+    return Memory::alloc<WavefrontPathIntegrator>(props);
   } else if (type == "photon") {
-    // possibly your final project?
-    UNIMPLEMENTED;
+    return Memory::alloc<PhotonMappingIntegrator>(props);
   } else if (type == "sppm") {
-    // possibly your final project?
-    UNIMPLEMENTED;
+    return Memory::alloc<StochasticProgressivePhotonMappingIntegrator>(
+        props);
   } else if (type == "guided") {
-    // possibly your final project?
-    UNIMPLEMENTED;
+    return Memory::alloc<GuidedPathIntegrator>(props);
   } else if (type == "bdpt") {
-    // possibly your final project?
-    UNIMPLEMENTED;
+    return Memory::alloc<BidirectionalPathIntegrator>(props);
   } else {
     Exception_("Integrator type {} not found", type);
   }
@@ -0,0 +1,233 @@
+/**
+ * @file bdpt.h
+ * @brief Bidirectional path tracing [Veach 1997]. Every sample traces a camera
+ * subpath and a light subpath, and connects every prefix of the one to every
+ * prefix of the other. The strategies producing the same path are combined by
+ * the power heuristic. Connections to the camera land on any pixel, so they
+ * are splatted into the light image of the film.
+ */
+#ifndef __BDPT_H__
+#define __BDPT_H__
+
+#include "rdr/integrator.h"
+
+RDR_NAMESPACE_BEGIN
+
+enum class EVertexType {
+  ECamera  = 0,
+  ELight   = 1,  //<! The first vertex of a light subpath
+  ESurface = 2,  //<! Including the lights hit by a camera subpath
+};
+
+/**
+ * @brief A vertex of a subpath. The pdfs are in area measure, except at a
+ * vertex on the infinite light, where they are in solid angle measure.
+ */
+class Vertex {
+public:
+  EVertexType type{EVertexType::ESurface};
+  /// The interaction of a camera vertex only holds the position and the
+  /// forward direction of the camera
+  SurfaceInteraction interaction;
+  const Camera *camera{nullptr};
+
+  /// The throughput of the subpath up to this vertex
+  Vec3f beta{0.0};
+  /// The pdf of sampling this vertex from the previous one on the subpath, and
+  /// from the next one, i.e. by the subpath of the other direction
+  Float pdf_fwd{0}, pdf_rev{0};
+  /// Whether the vertex scatters by a delta BSDF
+  bool delta{false};
+
+  static Vertex CreateCamera(const Camera &camera, const Vec3f &beta);
+  static Vertex CreateLight(
+      const SurfaceInteraction &interaction, const Vec3f &beta, Float pdf);
+  /// pdf is the solid angle pdf of sampling the vertex from prev
+  static Vertex CreateSurface(const SurfaceInteraction &interaction,
+      const Vec3f &beta, Float pdf, const Vertex &prev);
+
+  Vec3f p() const { return interaction.p; }
+
+  bool isLight() const {
+    return type == EVertexType::ELight ||
+           (type == EVertexType::ESurface && interaction.isLight());
+  }
+  bool isInfiniteLight() const { return isLight() && interaction.isInfLight(); }
+  bool isOnSurface() const {
+    return type != EVertexType::ECamera && !isInfiniteLight();
+  }
+  /// Whether a strategy may connect this vertex to the other subpath
+  bool isConnectible() const {
+    switch (type) {
+      case EVertexType::ECamera:
+        return true;
+      case EVertexType::ELight:
+        return !isInfiniteLight();
+      case EVertexType::ESurface:
+        return !delta && !interaction.isLight();
+    }
+    return false;
+  }
+
+  /// The unit direction from this vertex towards next
+  Vec3f directionTo(const Vertex &next) const;
+
+  /**
+   * @brief The BSDF between the direction this vertex was reached from and
+   * next. The directions are swapped on a light subpath, so that wi always
+   * points towards the light.
+   */
+  Vec3f f(const Vertex &next) const;
+
+  /// The emitted radiance towards the previous vertex of a camera subpath
+  Vec3f Le() const;
+
+  /// Convert a solid angle pdf of sampling next from this vertex to area
+  Float convertDensity(Float pdf, const Vertex &next) const;
+
+  /// The area pdf of sampling next from this vertex, having arrived from prev
+  Float pdf(const Vertex *prev, const Vertex &next) const;
+
+  /// The area pdf of emitting towards next from this vertex on a light
+  Float pdfLight(const Vertex &next) const;
+
+  /// The pdf of starting a light subpath at this vertex on a light
+  Float pdfLightOrigin(const Scene &scene) const;
+};
+
+/**
+ * @brief A camera or a light subpath over a buffer of vertices owned by the
+ * worker, so no allocation happens per sample. estimate() is the contribution
+ * of a camera subpath ending on a light by itself.
+ */
+class SubPath final : public PathInterface<SubPath> {
+public:
+  using Super = PathInterface<SubPath>;
+
+  SubPath(const Ray &ray, const PathIntegrator *integrator, Vertex *vertices,
+      int capacity)
+      : Super(ray, integrator), vertices(vertices), capacity(capacity) {}
+
+  /// Append a vertex, which must fit in the buffer
+  Vertex &addVertex(const Vertex &vertex) {
+    assert(!isFull());
+    vertices[n_vertices] = vertex;
+    return vertices[n_vertices++];
+  }
+
+  /// @see PathInterface::addInteraction
+  SubPath &addInteraction(const SurfaceInteraction &interaction) override {
+    Vertex vertex;
+    vertex.interaction = interaction;
+    addVertex(vertex);
+    return *this;
+  }
+
+  /// @see PathInterface::estimate
+  Vec3f estimate() const override;
+
+  /// @see PathInterface::verify
+  bool verify() const override;
+
+  /// @see PathInterface::length
+  int length() const override { return n_vertices; }
+
+  /// @see PathInterface::setMisWeight
+  void setMisWeight(Float weight) override { mis_weight = weight; }
+
+  /// @see PathInterface::setRrWeight
+  void setRrWeight(Float weight) override { rr_weight = weight; }
+
+  /// @see PathInterface::toString
+  std::string toString() const override;
+
+  bool isFull() const { return n_vertices == capacity; }
+
+  Vertex &operator[](int i) { return vertices[i]; }
+  const Vertex &operator[](int i) const { return vertices[i]; }
+
+private:
+  Vertex *vertices;
+  int capacity;
+  int n_vertices{0};
+
+  Float mis_weight{1};  //<! The weight of this path in MIS
+  Float rr_weight{1};   //<! The weight of this path by rr(correction)
+};
+
+class BidirectionalPathIntegrator final : public PathIntegrator {
+public:
+  BidirectionalPathIntegrator(const Properties &props)
+      : PathIntegrator(props),
+        rr_threshold(props.getProperty<Float>("rr_threshold", 0.1)) {}
+
+  /**
+   * @brief Render as PathIntegrator does, where the connections to the camera
+   * are splatted into the light image. In the progressive mode, the light
+   * image is rescaled by the samples drawn once the rendering ends, so the
+   * checkpoints written before are not.
+   * @see PathIntegrator::render
+   */
+  void render(ref<Camera> camera, ref<Scene> scene) override;
+
+  /// @see PathIntegrator::Li
+  Vec3f Li(
+      ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const override;
+
+  /// @see PathIntegrator::Li
+  Vec3f Li(ref<Scene> scene, DifferentialRay &ray, Sampler &sampler,
+      bool intersected, const SurfaceInteraction &interaction) const override;
+
+  // ++ Required by Object
+  std::string toString() const override {
+    return format(
+        "BidirectionalPathIntegrator[\n"
+        "  max_depth    = {}\n"
+        "  spp          = {}\n"
+        "  rr_threshold = {}\n"
+        "  sampler      = {}\n"
+        "]",
+        max_depth, spp, rr_threshold, sampler_type);
+  }
+  // --
+
+private:
+  Float rr_threshold;
+
+  /// The camera and the film rendered by the current call of render
+  const Camera *camera{nullptr};
+  Film *film{nullptr};
+
+  /**
+   * @brief Extend path, whose last vertex has been placed, by sampling the
+   * BSDFs from ray until the path is full. pdf is the solid angle pdf of ray,
+   * and interaction is its first hit if intersected.
+   */
+  void randomWalk(const Scene &scene, Ray ray, Sampler &sampler, Vec3f beta,
+      Float pdf, ETransportMode mode, SubPath &path, bool intersected,
+      const SurfaceInteraction &interaction) const;
+
+  void generateLightSubpath(
+      const Scene &scene, Sampler &sampler, SubPath &path) const;
+
+  /**
+   * @brief The contribution of the strategy with s light vertices and t
+   * camera vertices, weighted by MIS. The contribution of t = 1 goes to the
+   * light image at once, so zero is returned.
+   */
+  Vec3f connect(const Scene &scene, SubPath &light_path, SubPath &camera_path,
+      int s, int t, Sampler &sampler) const;
+
+  /**
+   * @brief The power heuristic weight of the strategy (s, t), where sampled
+   * replaces the endpoint of the subpath of length one if s or t is one.
+   */
+  Float misWeight(const Scene &scene, SubPath &light_path,
+      SubPath &camera_path, const Vertex &sampled, int s, int t) const;
+};
+
+RDR_REGISTER_CLASS(BidirectionalPathIntegrator)
+
+RDR_NAMESPACE_END
+
+#endif
@@ -33,6 +33,8 @@ public:
     return TriangleIntersect(ray, triangle_index, mesh.get(), interaction);
   }
 
+  int getIndex() const { return triangle_index; }
+
   AABB getBound() const {
     assert(mesh.get() != nullptr);
     const auto &v0 = mesh->getVertex(triangle_index * 3 + 0);
@@ -69,6 +71,76 @@ class BVHAccel final : public Accel {
 public:
   ~BVHAccel() override = default;
 
+  // ++ Required by ConfigurableObject
+  BVHAccel(const Properties &props = Properties{});
+  // --
+
+  /// @see Accel::setTriangleMesh
+  void setTriangleMesh(const ref<TriangleMeshResource> &mesh) override;
+
+  /// @see Accel::build
+  void build() override;
+
+  /// @see Accel::getBound
+  AABB getBound() const override;
+
+  /// @see Accel::intersect
+  bool intersect(Ray &ray, SurfaceInteraction &interaction) const override;
+
+  /// @see Accel::occluded
+  bool occluded(const Ray &ray) const override;
+
+  /// @see Accel::intersectPacket
+  uint32_t intersectPacket(RayPacket &packet, uint32_t mask,
+      SurfaceInteraction *interactions) const override;
+
+  /// @see Accel::serialize
+  bool serialize(vector<uint8_t> &data) const override;
+
+  /// @see Accel::deserialize
+  bool deserialize(const uint8_t *data, size_t size) override;
+
+private:
+  /// Identifies the serialized BVHAccel, "BVH2"
+  constexpr static uint32_t SERIAL_TAG = 0x32485642;
+
+  BVHTree<detail_::BVHTriangleNode> triangle_tree;
+};
+
+namespace detail_ {
+/**
+ * @brief A node of the wide BVH. The bounds of the children are stored as
+ * structure of arrays, so that all of them are tested at once with SIMD.
+ */
+template <int Width>
+struct alignas(64) WideBVHNode {
+  /// Bounds of the children, in the order of low x/y/z and upper x/y/z. Empty
+  /// slots have inverted infinite bounds, which never intersect
+  float bounds[6][Width];
+  /// Wide node index of an interior child, or the first triangle of a leaf
+  int32_t child[Width];
+  /// Number of triangles of a leaf child, 0 for interior children
+  uint32_t n_triangles[Width];
+};
+}  // namespace detail_
+
+/**
+ * @brief A BVH with Width children per node (4 or 8), collapsed from the binary
+ * BVHTree. Children are tested with SSE (4-wide) or AVX2 (8-wide) when the
+ * compiler targets them, and with a scalar loop otherwise.
+ */
+template <int Width>
+class WideBVHAccel final : public Accel {
+public:
+  static_assert(Width == 4 || Width == 8, "Wide BVH supports width 4 or 8");
+  using NodeType = detail_::WideBVHNode<Width>;
+
+  ~WideBVHAccel() override = default;
+
+  // ++ Required by ConfigurableObject
+  WideBVHAccel(const Properties &props);
+  // --
+
   /// @see Accel::setTriangleMesh
   void setTriangleMesh(const ref<TriangleMeshResource> &mesh) override;
 
@@ -81,14 +153,39 @@ public:
   /// @see Accel::intersect
   bool intersect(Ray &ray, SurfaceInteraction &interaction) const override;
 
+  /// @see Accel::occluded
+  bool occluded(const Ray &ray) const override;
+
+  /// @see Accel::serialize
+  bool serialize(vector<uint8_t> &data) const override;
+
+  /// @see Accel::deserialize
+  bool deserialize(const uint8_t *data, size_t size) override;
+
 private:
+  /// Identifies the serialized WideBVHAccel of the width, "WVH4" or "WVH8"
+  constexpr static uint32_t SERIAL_TAG = 0x30485657 + (Width << 24);
+
+  /// The binary tree to be collapsed, released after build()
   BVHTree<detail_::BVHTriangleNode> triangle_tree;
+
+  vector<NodeType> nodes;
+  vector<uint32_t> triangle_indices;  //<! The triangles referred by the leaves
+
+  /// Collapse the binary subtree rooted at index into wide nodes, return the
+  /// index of the wide node
+  int collapse(int index);
+
+  /// Front-to-back traversal shared by intersect and occluded. Terminates on
+  /// the first hit if AnyHit, otherwise records the closest one
+  template <bool AnyHit>
+  bool traverse(Ray &ray, TriangleHit &hit) const;
 };
 
 #ifdef USE_EMBREE
 class ExternalBVHAccel final : public Accel {
 public:
-  ExternalBVHAccel();
+  ExternalBVHAccel(const Properties &props);
   ~ExternalBVHAccel() override;
 
   /// @see Accel::setTriangleMesh
@@ -103,6 +200,9 @@ public:
   /// @see Accel::intersect
   bool intersect(Ray &ray, SurfaceInteraction &interaction) const override;
 
+  /// @see Accel::occluded
+  bool occluded(const Ray &ray) const override;
+
 private:
   /// Embree properties
   RTCDevice device;
@@ -113,6 +213,42 @@ private:
 };
 #endif  // USE_EMBREE
 
+RDR_REGISTER_FACTORY(Accel, [](const Properties &props) -> Accel * {
+#ifdef USE_EMBREE
+  auto type = props.getProperty<std::string>("type", "embree");
+#else
+  auto type = props.getProperty<std::string>("type", "bvh");
+#endif
+  if (type == "bvh") {
+    return Memory::alloc<BVHAccel>(props);
+  } else if (type == "wide_bvh") {
+#ifdef __AVX2__
+    constexpr int default_width = 8;
+#else
+    constexpr int default_width = 4;
+#endif
+    const int width = props.getProperty<int>("width", default_width);
+    if (width == 8) {
+#ifndef __AVX2__
+      Warn_("8-wide BVH is built without AVX2; consider width = 4");
+#endif
+      return Memory::alloc<WideBVHAccel<8>>(props);
+    } else if (width == 4) {
+      return Memory::alloc<WideBVHAccel<4>>(props);
+    } else {
+      Exception_("Wide BVH width {} not supported; use 4 or 8", width);
+    }
+#ifdef USE_EMBREE
+  } else if (type == "embree") {
+    return Memory::alloc<ExternalBVHAccel>(props);
+#endif
+  } else {
+    Exception_("Accel type {} not supported", type);
+  }
+
+  return nullptr;
+})
+
 RDR_NAMESPACE_END
 
 #endif
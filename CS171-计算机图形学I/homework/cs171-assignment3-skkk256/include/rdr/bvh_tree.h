@@ -5,12 +5,184 @@
 #ifndef __BVH_TREE_H__
 #define __BVH_TREE_H__
 
+#include <array>
+#include <future>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #include "rdr/accel.h"
+#include "rdr/parallel.h"
 #include "rdr/primitive.h"
 #include "rdr/ray.h"
+#include "rdr/stats.h"
 
 RDR_NAMESPACE_BEGIN
 
+/// The splitting strategy of BVHTree::build
+enum class EBVHHeuristicProfile {
+  EMedianHeuristic      = 0,  ///<! use centroid[dim]
+  ESurfaceAreaHeuristic = 1,  ///<! use binned SAH (see PBRT)
+};
+
+/// Parse the "heuristic" entry of an "accel" JSON object
+inline EBVHHeuristicProfile ParseBVHHeuristicProfile(const std::string &name) {
+  if (name == "median") return EBVHHeuristicProfile::EMedianHeuristic;
+  if (name == "sah") return EBVHHeuristicProfile::ESurfaceAreaHeuristic;
+  Exception_("BVH heuristic {} not supported; use median or sah", name);
+}
+
+namespace detail_ {
+/**
+ * @brief The rays of a packet in structure of arrays layout, for testing a box
+ * against all of them at once. The packet is coherent if its directions agree
+ * in sign on every axis, so that all rays enter a box through the same planes.
+ * The interval bounds of the origins and inverse directions then bound the
+ * slab distances of every ray, which culls a box for the whole packet.
+ */
+struct alignas(32) RayPacketContext {
+  constexpr static int SIZE = RayPacket::SIZE;
+
+  float origin[3][SIZE];
+  float inverse_direction[3][SIZE];
+  float t_min[SIZE];
+  float t_max[SIZE];
+
+  bool is_coherent{true};
+  bool dir_is_neg[3]{};
+
+  /// The intervals over the rays of the packet
+  Float origin_low[3], origin_upper[3];
+  Float inverse_low[3], inverse_upper[3];
+  Float t_min_low{Float_INF}, t_max_upper{Float_MINUS_INF};
+
+  RayPacketContext(const RayPacket &packet, uint32_t mask) {
+    // Inactive lanes have an empty time range, which never hits
+    for (int i = 0; i < SIZE; ++i) {
+      for (int d = 0; d < 3; ++d) origin[d][i] = inverse_direction[d][i] = 0;
+      t_min[i] = Float_INF;
+      t_max[i] = Float_MINUS_INF;
+    }
+
+    for (int d = 0; d < 3; ++d) {
+      origin_low[d] = inverse_low[d] = Float_INF;
+      origin_upper[d] = inverse_upper[d] = Float_MINUS_INF;
+    }
+
+    bool is_first = true;
+    for (int i = 0; i < packet.n_rays; ++i) {
+      if (!(mask & (uint32_t(1) << i))) continue;
+      const Ray &ray = packet.rays[i];
+      for (int d = 0; d < 3; ++d) {
+        origin[d][i]            = ray.origin[d];
+        inverse_direction[d][i] = ray.safe_inverse_direction[d];
+        const bool is_neg       = inverse_direction[d][i] < 0;
+        if (is_first) dir_is_neg[d] = is_neg;
+        is_coherent &= is_neg == dir_is_neg[d];
+
+        origin_low[d]    = min(origin_low[d], origin[d][i]);
+        origin_upper[d]  = max(origin_upper[d], origin[d][i]);
+        inverse_low[d]   = min(inverse_low[d], inverse_direction[d][i]);
+        inverse_upper[d] = max(inverse_upper[d], inverse_direction[d][i]);
+      }
+      t_min[i]  = ray.t_min;
+      t_max[i]  = ray.t_max;
+      t_min_low = min(t_min_low, t_min[i]);
+      is_first  = false;
+    }
+    updateTimeMax(packet, mask);
+  }
+
+  /// Read back the t_max of the rays, which shrink on closer hits
+  void updateTimeMax(const RayPacket &packet, uint32_t mask) {
+    t_max_upper = Float_MINUS_INF;
+    for (int i = 0; i < packet.n_rays; ++i) {
+      if (mask & (uint32_t(1) << i)) t_max[i] = packet.rays[i].t_max;
+      t_max_upper = max(t_max_upper, t_max[i]);
+    }
+  }
+
+  /// Whether the box misses every ray of a coherent packet, by interval
+  /// arithmetic on the slab distances
+  bool isCulled(const AABB &aabb) const {
+    Float t_in  = t_min_low;
+    Float t_out = t_max_upper;
+    for (int d = 0; d < 3; ++d) {
+      const Float near = dir_is_neg[d] ? aabb.upper_bnd[d] : aabb.low_bnd[d];
+      const Float far  = dir_is_neg[d] ? aabb.low_bnd[d] : aabb.upper_bnd[d];
+
+      // The lower bound of the entry and the upper bound of the exit
+      const Float near_low   = near - origin_upper[d];
+      const Float near_upper = near - origin_low[d];
+      const Float far_low    = far - origin_upper[d];
+      const Float far_upper  = far - origin_low[d];
+      t_in = max(t_in,
+          min(min(near_low * inverse_low[d], near_low * inverse_upper[d]),
+              min(near_upper * inverse_low[d], near_upper * inverse_upper[d])));
+      t_out = min(t_out,
+          max(max(far_low * inverse_low[d], far_low * inverse_upper[d]),
+              max(far_upper * inverse_low[d], far_upper * inverse_upper[d])));
+    }
+    return t_in > t_out;
+  }
+
+  /// Test the box against every ray of a coherent packet. Return the bitmask
+  /// of the rays hitting it within their time range
+  uint32_t intersect(const AABB &aabb) const {
+#if defined(__AVX2__)
+    __m256 t_in  = _mm256_load_ps(t_min);
+    __m256 t_out = _mm256_load_ps(t_max);
+    for (int d = 0; d < 3; ++d) {
+      const __m256 near = _mm256_set1_ps(
+          dir_is_neg[d] ? aabb.upper_bnd[d] : aabb.low_bnd[d]);
+      const __m256 far = _mm256_set1_ps(
+          dir_is_neg[d] ? aabb.low_bnd[d] : aabb.upper_bnd[d]);
+      const __m256 o       = _mm256_load_ps(origin[d]);
+      const __m256 inverse = _mm256_load_ps(inverse_direction[d]);
+      t_in  = _mm256_max_ps(
+          t_in, _mm256_mul_ps(_mm256_sub_ps(near, o), inverse));
+      t_out = _mm256_min_ps(
+          t_out, _mm256_mul_ps(_mm256_sub_ps(far, o), inverse));
+    }
+    return _mm256_movemask_ps(_mm256_cmp_ps(t_in, t_out, _CMP_LE_OQ));
+#elif defined(__SSE2__)
+    uint32_t mask = 0;
+    for (int k = 0; k < SIZE; k += 4) {
+      __m128 t_in  = _mm_load_ps(t_min + k);
+      __m128 t_out = _mm_load_ps(t_max + k);
+      for (int d = 0; d < 3; ++d) {
+        const __m128 near = _mm_set1_ps(
+            dir_is_neg[d] ? aabb.upper_bnd[d] : aabb.low_bnd[d]);
+        const __m128 far = _mm_set1_ps(
+            dir_is_neg[d] ? aabb.low_bnd[d] : aabb.upper_bnd[d]);
+        const __m128 o       = _mm_load_ps(origin[d] + k);
+        const __m128 inverse = _mm_load_ps(inverse_direction[d] + k);
+        t_in  = _mm_max_ps(t_in, _mm_mul_ps(_mm_sub_ps(near, o), inverse));
+        t_out = _mm_min_ps(t_out, _mm_mul_ps(_mm_sub_ps(far, o), inverse));
+      }
+      mask |= _mm_movemask_ps(_mm_cmple_ps(t_in, t_out)) << k;
+    }
+    return mask;
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < SIZE; ++i) {
+      Float t_in  = t_min[i];
+      Float t_out = t_max[i];
+      for (int d = 0; d < 3; ++d) {
+        const Float near = dir_is_neg[d] ? aabb.upper_bnd[d] : aabb.low_bnd[d];
+        const Float far  = dir_is_neg[d] ? aabb.low_bnd[d] : aabb.upper_bnd[d];
+        t_in  = max(t_in, (near - origin[d][i]) * inverse_direction[d][i]);
+        t_out = min(t_out, (far - origin[d][i]) * inverse_direction[d][i]);
+      }
+      if (t_in <= t_out) mask |= uint32_t(1) << i;
+    }
+    return mask;
+#endif
+  }
+};
+}  // namespace detail_
+
 template <typename DataType_>
 class BVHNodeInterface {
 public:
@@ -39,10 +211,17 @@ public:
   constexpr static int INVALID_INDEX = -1;
   constexpr static int CUTOFF_DEPTH  = 22;
 
-  enum class EHeuristicProfile {
-    EMedianHeuristic      = 0,  ///<! use centroid[dim]
-    ESurfaceAreaHeuristic = 1,  ///<! use SAH (see PBRT)
-  };
+  using EHeuristicProfile = EBVHHeuristicProfile;
+
+  // Binned SAH parameters. The costs are relative to one data intersection
+  constexpr static int SAH_BIN_COUNT        = 16;
+  constexpr static int SAH_MAX_LEAF_SIZE    = 4;
+  constexpr static Float SAH_TRAVERSAL_COST = 0.125;
+
+  // Spans at least this large are reduced in parallel, chunk by chunk. Spans
+  // larger than a chunk fork their subtrees near the root
+  constexpr static int PARALLEL_THRESHOLD  = 1 << 16;
+  constexpr static int PARALLEL_CHUNK_SIZE = 1 << 14;
 
   // The actual node that represents the tree structure
   struct InternalNode {
@@ -55,9 +234,56 @@ public:
     IndexType right_index{INVALID_INDEX};
     IndexType span_left{INVALID_INDEX};
     IndexType span_right{INVALID_INDEX};  // nodes[span_left, span_right)
+    int axis{0};                          // The split axis
     AABB aabb{};                          // The bounding box of the node
   };
 
+  /**
+   * @brief The flattened node used during traversal, laid out in depth-first
+   * order. The first child of an interior node directly follows it, so only
+   * the index of the second child is stored. Exactly 32 bytes, i.e. two nodes
+   * per cache line.
+   */
+  struct alignas(32) LinearNode {
+    AABB aabb{};  // The bounding box of the node
+    union {
+      IndexType span_left;           // leaf: first data node
+      IndexType second_child_index;  // interior: index of the second child
+    };
+    uint16_t n_data{0};  // 0 for interior nodes
+    uint8_t axis{0};     // split axis of interior nodes
+    uint8_t pad_{0};
+
+    bool isLeaf() const { return n_data > 0; }
+  };
+  static_assert(sizeof(LinearNode) == 32, "LinearNode should be 32 bytes");
+
+  /// The maximum number of data nodes referenced by a leaf
+  constexpr static int MAX_LEAF_SIZE = std::numeric_limits<uint16_t>::max();
+  /// Depth of the traversal stack
+  constexpr static int STACK_SIZE = 64;
+  /// Past this depth the spans are split at the median. Halving at most 2^31
+  /// data nodes leaves 2^15 of them in 16 levels, which fit in a leaf, so no
+  /// path is deeper than STACK_SIZE - 1 by construction
+  constexpr static int MEDIAN_DEPTH =
+      STACK_SIZE - 1 - (std::numeric_limits<IndexType>::digits - 15);
+  static_assert(MEDIAN_DEPTH > CUTOFF_DEPTH && MAX_LEAF_SIZE >= (1 << 15),
+      "The median splits should leave spans that fit in a leaf");
+
+  /// Per-data-node information cached during the build
+  struct BuildItem {
+    AABB aabb;
+    Vec3f centroid;
+    IndexType index;
+  };
+
+  /// A centroid bin of the SAH builder
+  struct Bin {
+    AABB aabb;
+    IndexType count{0};
+  };
+  using Bins = std::array<Bin, SAH_BIN_COUNT>;
+
   BVHTree()  = default;
   ~BVHTree() = default;
   /// General Interface
@@ -65,7 +291,9 @@ public:
 
   /// Nodes might be re-ordered
   void push_back(const NodeType &node) { nodes.push_back(node); }
-  const AABB &getAABB() const { return internal_nodes[root_index].aabb; }
+  AABB getAABB() const {
+    return linear_nodes.empty() ? AABB{} : linear_nodes.front().aabb;
+  }
 
   /// reset build status
   void clear();
@@ -73,31 +301,108 @@ public:
   /// *Can* be executed not only once
   void build();
 
+  /// Take the flattened tree of an earlier build in place of build(), where
+  /// the data nodes are pushed in the order the tree refers to. Return false
+  /// and leave the tree unbuilt if the nodes are inconsistent
+  bool restore(vector<LinearNode> tree);
+
+  /// Select the splitting strategy, which takes effect on the next build
+  void setHeuristicProfile(EHeuristicProfile profile) { hprofile = profile; }
+
+  /// Set the number of build workers, where non-positive means all hardware
+  /// threads. The built tree does not depend on this number
+  void setNumWorkers(int workers) { n_workers = workers; }
+
+  /// The flattened tree and the reordered data nodes it refers to
+  const vector<LinearNode> &getLinearNodes() const { return linear_nodes; }
+  const vector<NodeType> &getNodes() const { return nodes; }
+
+  /// The SAH cost of the built tree, i.e. the expected number of node
+  /// traversals and data intersections for a random ray hitting the root
+  Float getSAHCost() const;
+
   template <typename Callback>
   bool intersect(Ray &ray, Callback callback) const {
-    if (!is_built) return false;
-    return intersect(ray, root_index, callback);
+    if (!is_built || linear_nodes.empty()) return false;
+    return traverse<false>(ray, callback);
+  }
+
+  /// Any-hit variant of intersect, which returns on the first data node the
+  /// callback reports a hit for
+  template <typename Callback>
+  bool occluded(const Ray &ray, Callback callback) const {
+    if (!is_built || linear_nodes.empty()) return false;
+    Ray local_ray = ray;
+    return traverse<true>(local_ray, callback);
+  }
+
+  /**
+   * @brief Closest-hit traversal of the rays of packet in mask. The callback
+   * has the signature uint32_t(RayPacket&, uint32_t mask, const DataType&),
+   * and returns the bitmask of the rays in mask it hit, shrinking their t_max.
+   * Incoherent packets fall back to single-ray traversal.
+   * @return the bitmask of the rays that hit anything
+   */
+  template <typename Callback>
+  uint32_t intersectPacket(
+      RayPacket &packet, uint32_t mask, Callback callback) const {
+    if (!is_built || linear_nodes.empty() || mask == 0) return 0;
+    return traversePacket(packet, mask, callback);
   }
 
 private:
   EHeuristicProfile hprofile{EHeuristicProfile::EMedianHeuristic};
-//  EHeuristicProfile hprofile{EHeuristicProfile::ESurfaceAreaHeuristic};
-
+  int n_workers{0};
 
   bool is_built{false};
   IndexType root_index{INVALID_INDEX};
 
   vector<NodeType> nodes{};               /// The data nodes
-  vector<InternalNode> internal_nodes{};  /// The internal nodes
-
-  /// Internal build
-  IndexType build(
-      int depth, const IndexType &span_left, const IndexType &span_right);
+  vector<InternalNode> internal_nodes{};  /// The internal nodes (build only)
+  vector<LinearNode> linear_nodes{};      /// The flattened tree
+
+  /// The state shared by the build tasks
+  struct BuildContext {
+    vector<BuildItem> items;
+    std::atomic<IndexType> n_internal_nodes{0};
+    int fork_depth{0};  // subtrees above this depth are built concurrently
+    int n_workers{1};
+  };
 
-  /// Internal intersect
+  /// Internal build over items[span_left, span_right). Subtrees may be built
+  /// concurrently, so the node indices depend on the schedule, but the
+  /// structure of the tree does not
+  IndexType build(BuildContext &context, int depth, const IndexType &span_left,
+      const IndexType &span_right);
+
+  /// Find the binned SAH split of items[span_left, span_right) and partition
+  /// them accordingly. Return span_left if a leaf is cheaper, and
+  /// INVALID_INDEX if the centroids cannot be binned
+  IndexType splitSAH(BuildContext &context, const AABB &aabb,
+      const IndexType &span_left, const IndexType &span_right, int *dim) const;
+
+  /// Reduce visitor(T &, index) over [span_left, span_right). Large spans are
+  /// cut into fixed chunks reduced in parallel, which are then merged in
+  /// order, so the result does not depend on the number of workers
+  template <typename T, typename Visitor, typename Merger>
+  static T reduce(const BuildContext &context, const IndexType &span_left,
+      const IndexType &span_right, const T &init, Visitor visitor,
+      Merger merger);
+
+  /// Flatten the subtree rooted at node_index into linear_nodes in depth-first
+  /// order, return its index in linear_nodes
+  IndexType flatten(const IndexType &node_index);
+
+  /// Internal intersect, iterative over linear_nodes. Terminates on the first
+  /// hit if AnyHit
+  template <bool AnyHit, typename Callback>
+  bool traverse(Ray &ray, Callback callback) const;
+
+  /// Internal intersectPacket. A node is visited once for all rays, and
+  /// culled for the packet before its box is tested against each ray
   template <typename Callback>
-  bool intersect(
-      Ray &ray, const IndexType &node_index, Callback callback) const;
+  uint32_t traversePacket(
+      RayPacket &packet, uint32_t mask, Callback callback) const;
 };
 
 /* ===================================================================== *
@@ -110,6 +415,7 @@ template <typename NodeType>
 void BVHTree<NodeType>::clear() {
   nodes.clear();
   internal_nodes.clear();
+  linear_nodes.clear();
   is_built = false;
 }
 
@@ -117,31 +423,175 @@ template <typename NodeType>
 void BVHTree<NodeType>::build() {
   if (is_built) return;
 
-  // pre-allocate memory
-  internal_nodes.reserve(2 * nodes.size());
-  root_index = build(0, 0, nodes.size());
-  is_built   = true;
+  const IndexType count = nodes.size();
+  BuildContext context;
+  context.n_workers  = GetNumWorkers(n_workers);
+  context.fork_depth = 0;
+  while ((1 << context.fork_depth) < 4 * context.n_workers &&
+         context.n_workers > 1)
+    ++context.fork_depth;
+
+  // Cache the bounds, since they might be expensive to obtain
+  context.items.resize(count);
+  const int n_chunks = (count + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+  ParallelFor(
+      n_chunks,
+      [&](int chunk, int) {
+        const IndexType begin = chunk * PARALLEL_CHUNK_SIZE;
+        const IndexType end   = std::min(begin + PARALLEL_CHUNK_SIZE, count);
+        for (IndexType i = begin; i < end; ++i) {
+          BuildItem &item = context.items[i];
+          item.aabb       = nodes[i].getAABB();
+          item.centroid   = item.aabb.getCenter();
+          item.index      = i;
+        }
+      },
+      context.n_workers);
+
+  // A binary tree has at most 2n - 1 nodes, allocated by an atomic counter
+  internal_nodes.resize(2 * count);
+  root_index = build(context, 0, 0, count);
+
+  // Reorder the data nodes to match the spans of the leaves
+  vector<NodeType> ordered_nodes;
+  ordered_nodes.reserve(count);
+  for (const auto &item : context.items)
+    ordered_nodes.push_back(nodes[item.index]);
+  nodes.swap(ordered_nodes);
+
+  // The pointer-chasing layout is only needed during construction. Flattening
+  // in depth-first order makes the layout independent of the schedule
+  linear_nodes.clear();
+  linear_nodes.reserve(context.n_internal_nodes);
+  if (root_index != INVALID_INDEX) flatten(root_index);
+  internal_nodes.clear();
+  internal_nodes.shrink_to_fit();
+  is_built = true;
+}
+
+template <typename NodeType>
+bool BVHTree<NodeType>::restore(vector<LinearNode> tree) {
+  const IndexType count   = nodes.size();
+  const IndexType n_nodes = tree.size();
+  if ((count == 0) != (n_nodes == 0)) return false;
+
+  // The children follow their parent in depth-first order, and no path may
+  // overflow the traversal stack
+  vector<int> depths(n_nodes, 0);
+  for (IndexType i = 0; i < n_nodes; ++i) {
+    const LinearNode &node = tree[i];
+    if (depths[i] >= STACK_SIZE) return false;
+    if (node.isLeaf()) {
+      if (node.span_left < 0 || node.span_left > count - node.n_data)
+        return false;
+    } else {
+      if (node.axis > 2 || node.second_child_index <= i + 1 ||
+          node.second_child_index >= n_nodes)
+        return false;
+      depths[i + 1]                   = depths[i] + 1;
+      depths[node.second_child_index] = depths[i] + 1;
+    }
+  }
+
+  internal_nodes.clear();
+  linear_nodes = std::move(tree);
+  is_built     = true;
+  return true;
+}
+
+template <typename NodeType>
+Float BVHTree<NodeType>::getSAHCost() const {
+  if (linear_nodes.empty()) return 0;
+  const Float root_area = linear_nodes.front().aabb.getSurfaceArea();
+  if (root_area <= 0) return 0;
+
+  Float cost = 0;
+  for (const auto &node : linear_nodes) {
+    const Float area = node.aabb.getSurfaceArea() / root_area;
+    cost += node.isLeaf() ? area * node.n_data : area * SAH_TRAVERSAL_COST;
+  }
+  return cost;
+}
+
+template <typename NodeType>
+typename BVHTree<NodeType>::IndexType BVHTree<NodeType>::flatten(
+    const IndexType &node_index) {
+  const InternalNode &node = internal_nodes[node_index];
+  const IndexType index    = linear_nodes.size();
+  linear_nodes.emplace_back();
+  linear_nodes[index].aabb = node.aabb;
+  if (node.is_leaf) {
+    const IndexType count = node.span_right - node.span_left;
+    assert(0 < count && count <= MAX_LEAF_SIZE);
+    linear_nodes[index].span_left = node.span_left;
+    linear_nodes[index].n_data    = static_cast<uint16_t>(count);
+  } else {
+    linear_nodes[index].axis = static_cast<uint8_t>(node.axis);
+    flatten(node.left_index);
+    linear_nodes[index].second_child_index = flatten(node.right_index);
+  }
+  return index;
+}
+
+template <typename NodeType>
+template <typename T, typename Visitor, typename Merger>
+T BVHTree<NodeType>::reduce(const BuildContext &context,
+    const IndexType &span_left, const IndexType &span_right, const T &init,
+    Visitor visitor, Merger merger) {
+  const IndexType count = span_right - span_left;
+  T result              = init;
+  if (count < PARALLEL_THRESHOLD || context.n_workers == 1) {
+    for (IndexType i = span_left; i < span_right; ++i) visitor(result, i);
+    return result;
+  }
+
+  const int n_chunks = (count + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+  vector<T> partial_results(n_chunks, init);
+  ParallelFor(
+      n_chunks,
+      [&](int chunk, int) {
+        const IndexType begin = span_left + chunk * PARALLEL_CHUNK_SIZE;
+        const IndexType end = std::min(begin + PARALLEL_CHUNK_SIZE, span_right);
+        for (IndexType i = begin; i < end; ++i)
+          visitor(partial_results[chunk], i);
+      },
+      context.n_workers);
+  for (const auto &partial_result : partial_results)
+    merger(result, partial_result);
+  return result;
 }
 
 template <typename NodeType>
 typename BVHTree<NodeType>::IndexType BVHTree<NodeType>::build(
-    int depth, const IndexType &span_left, const IndexType &span_right) {
+    BuildContext &context, int depth, const IndexType &span_left,
+    const IndexType &span_right) {
   if (span_left >= span_right) return INVALID_INDEX;
+  auto &items = context.items;
 
   // early calculate bound
-  AABB prebuilt_aabb;
-  for (IndexType span_index = span_left; span_index < span_right; ++span_index)
-    prebuilt_aabb.unionWith(nodes[span_index].getAABB());
+  const AABB prebuilt_aabb = reduce(
+      context, span_left, span_right, AABB{},
+      [&](AABB &aabb, IndexType i) { aabb.unionWith(items[i].aabb); },
+      [](AABB &aabb, const AABB &other) { aabb.unionWith(other); });
+
+  auto allocate_node = [&](const InternalNode &node) -> IndexType {
+    const IndexType index = context.n_internal_nodes.fetch_add(1);
+    assert(index < static_cast<IndexType>(internal_nodes.size()));
+    internal_nodes[index] = node;
+    return index;
+  };
 
-  if (depth >= CUTOFF_DEPTH || span_left + 1 == span_right) {
-    // Leaf node
-    const auto &node = nodes[span_left];
+  auto make_leaf = [&]() -> IndexType {
     InternalNode result(span_left, span_right);
     result.is_leaf = true;
     result.aabb    = prebuilt_aabb;
-    internal_nodes.push_back(result);
-    return internal_nodes.size() - 1;
-  }
+    return allocate_node(result);
+  };
+
+  const IndexType count = span_right - span_left;
+  assert(depth < STACK_SIZE);
+  if ((depth >= CUTOFF_DEPTH && count <= MAX_LEAF_SIZE) || count == 1)
+    return make_leaf();
 
   // You'll notice that the implementation here is different from the KD-Tree
   // ones, which re-use the node for both data-storing and organizing the real
@@ -150,128 +600,234 @@ typename BVHTree<NodeType>::IndexType BVHTree<NodeType>::build(
   // not need to be aware of the tree structure.
   InternalNode result(span_left, span_right);
 
-//#if 0
-//  // Or probably...?
-//  const int &dim = depth % 3;
-//#endif
-  const int &dim  = ArgMax(prebuilt_aabb.getExtent());
-  IndexType count = span_right - span_left;
+  int dim         = ArgMax(prebuilt_aabb.getExtent());
   IndexType split = INVALID_INDEX;
 
-  if (hprofile == EHeuristicProfile::EMedianHeuristic) {
-use_median_heuristic:
-    // TODO: fill in your implementation here.
-    // 1. Calculate the split point with `split` and `count`.
-    // 2. Use `std::nth_element` to "sort" `this->nodes` with a criterion such
-    // that their AABB center (obtained possibly by
-    // `NodeType.getAABB().getCenter()[dim]`?).
-    // 3. Export the `split` variable for later calculation
-    std::nth_element(nodes.begin() + span_left, nodes.begin() + span_left + count / 2, nodes.begin() + span_right,
-                     [dim](const NodeType &a, const NodeType &b) {
-                       return a.getAABB().getCenter()[dim] < b.getAABB().getCenter()[dim];
-                     });
+  // Deep spans are split at the median, as unbalanced SAH splits could
+  // otherwise overflow the traversal stack
+  if (hprofile == EHeuristicProfile::ESurfaceAreaHeuristic &&
+      depth < MEDIAN_DEPTH) {
+    split = splitSAH(context, prebuilt_aabb, span_left, span_right, &dim);
+    // A leaf is cheaper than any split
+    if (split == span_left) return make_leaf();
+  }
+
+  if (split == INVALID_INDEX) {
+    // Median heuristic, also the fallback when the centroids coincide
     split = span_left + count / 2;
-  } else if (hprofile == EHeuristicProfile::ESurfaceAreaHeuristic) {
-    use_surface_area_heuristic:
-    // TODO(bonus): fill in your implementation here.
-    // Implement the surface area heuristic. The result might be surprisingly
-    // good.
-    std::vector<AABB> left_aabbs(count), right_aabbs(count);
-    split = span_left;
-    Float min_cost = Float_INF;
-
-    // Sort nodes by the center of AABB in the selected dimension
-    std::sort(nodes.begin() + span_left, nodes.begin() + span_right,
-              [dim](const NodeType &a, const NodeType &b) {
-                return a.getAABB().getCenter()[dim] < b.getAABB().getCenter()[dim];
-              });
-
-//    AABB total;
-//    for (int i = 0; i < count; ++i) {
-//      if (i == 0) {
-//        total = nodes[span_left+i].getAABB();
-//      }
-//      else{
-//        total.unionWith(nodes[span_left+i].getAABB());
-//      }
-//    }
-//    Float SN = total.getSurfaceArea();
-
-    for (int i = 1; i < count; ++i) {
-      auto beginning = nodes.begin() + span_left;
-      auto middling = nodes.begin() + span_left + i;
-      auto ending = nodes.begin() + span_right;
-      auto leftshapes = std::vector<NodeType>(beginning, middling);
-      auto rightshapes = std::vector<NodeType>(middling, ending);
-//      Info_("leftshapes size: {}, rightshapes size: {}", leftshapes.size(), rightshapes.size());
-
-      AABB left_aabb = leftshapes[0].getAABB();
-      AABB right_aabb =  rightshapes[0].getAABB();
-      for (int k = 1; k < leftshapes.size(); ++k)
-        left_aabb.unionWith(leftshapes[k].getAABB());
-      for (int k = 1; k < rightshapes.size(); ++k)
-        right_aabb.unionWith(rightshapes[k].getAABB());
-      float SA = left_aabb.getSurfaceArea(); //SA
-      float SB = right_aabb.getSurfaceArea(); //SB
-      float cost = leftshapes.size() * SA + rightshapes.size() * SB;
-//      Info_("cost: {}, min_cost: {}", cost, min_cost);
-      if (cost < min_cost)
-      {
-        min_cost = cost;
-        split = i + span_left;
-      }
-    }
-//    Info_("split: {}", split);
-//    Info_("------------------------");
+    std::nth_element(items.begin() + span_left, items.begin() + split,
+        items.begin() + span_right,
+        [dim](const BuildItem &a, const BuildItem &b) {
+          return a.centroid[dim] < b.centroid[dim];
+        });
+  }
+
+  // Build the left and right subtree, concurrently near the root
+  result.axis = dim;
+  if (depth < context.fork_depth && count >= PARALLEL_CHUNK_SIZE) {
+    auto left_task = std::async(std::launch::async,
+        [&]() { return build(context, depth + 1, span_left, split); });
+    result.right_index = build(context, depth + 1, split, span_right);
+    result.left_index  = left_task.get();
+  } else {
+    result.left_index  = build(context, depth + 1, span_left, split);
+    result.right_index = build(context, depth + 1, split, span_right);
   }
-  // Build the left and right subtree
-  result.left_index  = build(depth + 1, span_left, split);
-  result.right_index = build(depth + 1, split, span_right);
 
   // Iterative merge
   result.aabb = prebuilt_aabb;
+  return allocate_node(result);
+}
+
+template <typename NodeType>
+typename BVHTree<NodeType>::IndexType BVHTree<NodeType>::splitSAH(
+    BuildContext &context, const AABB &aabb, const IndexType &span_left,
+    const IndexType &span_right, int *dim) const {
+  auto &items           = context.items;
+  const IndexType count = span_right - span_left;
+
+  // Bin along the axis where the centroids spread the most
+  const AABB centroid_aabb = reduce(
+      context, span_left, span_right, AABB{},
+      [&](AABB &aabb, IndexType i) { aabb.unionWith(items[i].centroid); },
+      [](AABB &aabb, const AABB &other) { aabb.unionWith(other); });
+  *dim               = ArgMax(centroid_aabb.getExtent());
+  const Float low    = centroid_aabb.low_bnd[*dim];
+  const Float extent = centroid_aabb.getDist(*dim);
+  if (!(extent > 0)) return INVALID_INDEX;
+
+  auto bin_of = [&](const BuildItem &item) {
+    const int bin = static_cast<int>(
+        SAH_BIN_COUNT * ((item.centroid[*dim] - low) / extent));
+    return std::clamp(bin, 0, SAH_BIN_COUNT - 1);
+  };
+
+  const Bins bins = reduce(
+      context, span_left, span_right, Bins{},
+      [&](Bins &bins, IndexType i) {
+        Bin &bin = bins[bin_of(items[i])];
+        bin.aabb.unionWith(items[i].aabb);
+        ++bin.count;
+      },
+      [](Bins &bins, const Bins &other) {
+        for (int i = 0; i < SAH_BIN_COUNT; ++i) {
+          bins[i].aabb.unionWith(other[i].aabb);
+          bins[i].count += other[i].count;
+        }
+      });
+  // Suffix sweep: area and count of the right side when splitting after bin i
+  Float right_area[SAH_BIN_COUNT - 1];
+  IndexType right_count[SAH_BIN_COUNT - 1];
+  AABB right_aabb;
+  IndexType right_accumulated = 0;
+  for (int i = SAH_BIN_COUNT - 1; i > 0; --i) {
+    right_aabb.unionWith(bins[i].aabb);
+    right_accumulated += bins[i].count;
+    right_area[i - 1]  = right_aabb.getSurfaceArea();
+    right_count[i - 1] = right_accumulated;
+  }
 
-  internal_nodes.push_back(result);
-  return internal_nodes.size() - 1;
+  // Prefix sweep, evaluating the cost on the way
+  const Float area     = aabb.getSurfaceArea();
+  const Float inv_area = area > 0 ? 1 / area : 1;
+  Float min_cost       = Float_INF;
+  int min_bin          = -1;
+  AABB left_aabb;
+  IndexType left_count = 0;
+  for (int i = 0; i < SAH_BIN_COUNT - 1; ++i) {
+    left_aabb.unionWith(bins[i].aabb);
+    left_count += bins[i].count;
+    if (left_count == 0 || right_count[i] == 0) continue;
+    const Float cost = SAH_TRAVERSAL_COST +
+                       (left_count * left_aabb.getSurfaceArea() +
+                           right_count[i] * right_area[i]) *
+                           inv_area;
+    if (cost < min_cost) {
+      min_cost = cost;
+      min_bin  = i;
+    }
+  }
+
+  // Terminate with a leaf when intersecting all of the data is cheaper
+  assert(min_bin >= 0);
+  if (count <= SAH_MAX_LEAF_SIZE && count <= min_cost) return span_left;
+
+  const auto middle = std::partition(items.begin() + span_left,
+      items.begin() + span_right,
+      [&](const BuildItem &item) { return bin_of(item) <= min_bin; });
+  return static_cast<IndexType>(middle - items.begin());
 }
 
 template <typename NodeType>
-template <typename Callback>
-bool BVHTree<NodeType>::intersect(
-    Ray &ray, const IndexType &node_index, Callback callback) const {
-  bool result              = false;
-  const InternalNode &node = internal_nodes[node_index];
+template <bool AnyHit, typename Callback>
+bool BVHTree<NodeType>::traverse(Ray &ray, Callback callback) const {
+  bool result = false;
+  const int dir_is_neg[3] = {ray.direction.x < 0, ray.direction.y < 0,
+      ray.direction.z < 0};
+
+  // The far children to be visited
+  IndexType stack[STACK_SIZE];
+  int stack_top     = 0;
+  IndexType current = 0;
+  // Counted locally, and added to the statistics once per traversal
+  uint64_t n_visited = 0;
+  while (true) {
+    const LinearNode &node = linear_nodes[current];
+    ++n_visited;
+
+    // The box test considers ray.t_max, which shrinks along the traversal, so
+    // the nodes behind the closest hit found so far are culled here
+    Float t_in  = NAN;
+    Float t_out = NAN;
+    if (node.aabb.intersect(ray, &t_in, &t_out)) {
+      if (node.isLeaf()) {
+        // The callback has the signature bool(Ray&, const DataType&). It
+        // shrinks ray.t_max on a closer hit
+        for (IndexType i = node.span_left; i < node.span_left + node.n_data;
+             ++i) {
+          if (!callback(ray, this->nodes[i].getData())) continue;
+          if constexpr (AnyHit) {
+            RDR_STAT_ADD(EBVHNodesVisited, n_visited);
+            return true;
+          }
+          result = true;
+        }
+      } else {
+        // Visit the child closer to the ray origin first
+        assert(stack_top < STACK_SIZE);
+        if (dir_is_neg[node.axis]) {
+          stack[stack_top++] = current + 1;
+          current            = node.second_child_index;
+        } else {
+          stack[stack_top++] = node.second_child_index;
+          current            = current + 1;
+        }
+        continue;
+      }
+    }
 
-  // Perform the actual pruning
-  Float t_in  = NAN;
-  Float t_out = NAN;
-  if (!node.aabb.intersect(ray, &t_in, &t_out)) return result;
+    if (stack_top == 0) break;
+    current = stack[--stack_top];
+  }
 
-  if (node.is_leaf) {
-    // TODO: fill in your implementation here.
-    // The callback function has the following signature: bool(Ray&, const
-    // DataType&). Accepting a reference to the ray(because ray.tMax it to be
-    // modified and considered along the way) and the data stored in the node.
-    // The callback will return a boolean value indicating whether the ray(with
-    // tMin and tMax considered) is intersecting with the data.
-    //
-    // You should invoke the
-    // 1. Iterate over the data in the span and call the callback function on
-    // `this->node`.
-    // 2. Return the result (intersect or not).
-    for (IndexType i = node.span_left; i < node.span_right; i++) {
-      if (callback(ray, this->nodes[i].getData())) {
-        result = true;
+  RDR_STAT_ADD(EBVHNodesVisited, n_visited);
+  return result;
+}
+
+template <typename NodeType>
+template <typename Callback>
+uint32_t BVHTree<NodeType>::traversePacket(
+    RayPacket &packet, uint32_t mask, Callback callback) const {
+  detail_::RayPacketContext context(packet, mask);
+  uint32_t result = 0;
+  if (!context.is_coherent) {
+    // The rays do not share the traversal order, nor a useful frustum
+    for (int i = 0; i < packet.n_rays; ++i) {
+      const uint32_t lane = uint32_t(1) << i;
+      if (!(mask & lane)) continue;
+      if (traverse<false>(packet.rays[i],
+              [&](Ray &, const auto &data) -> bool {
+                return callback(packet, lane, data) != 0;
+              }))
+        result |= lane;
+    }
+    return result;
+  }
+
+  IndexType stack[STACK_SIZE];
+  int stack_top      = 0;
+  IndexType current  = 0;
+  uint64_t n_visited = 0;
+  while (true) {
+    const LinearNode &node = linear_nodes[current];
+    ++n_visited;
+    const uint32_t node_mask =
+        context.isCulled(node.aabb) ? 0 : context.intersect(node.aabb) & mask;
+    if (node_mask != 0) {
+      if (node.isLeaf()) {
+        for (IndexType i = node.span_left; i < node.span_left + node.n_data;
+             ++i)
+          result |= callback(packet, node_mask, this->nodes[i].getData());
+        context.updateTimeMax(packet, node_mask);
+      } else {
+        // All rays share the direction signs, hence the closer child
+        assert(stack_top < STACK_SIZE);
+        if (context.dir_is_neg[node.axis]) {
+          stack[stack_top++] = current + 1;
+          current            = node.second_child_index;
+        } else {
+          stack[stack_top++] = node.second_child_index;
+          current            = current + 1;
+        }
+        continue;
       }
     }
-  } else {
-    // TODO: fill in your implementation here.
-    // 1. Recurse to the left and right subtree.
-    // 2. Return the result (intersect or not).
-    bool left = intersect(ray, node.left_index, callback);
-    bool right = intersect(ray, node.right_index, callback);
-    result = left || right;
+
+    if (stack_top == 0) break;
+    current = stack[--stack_top];
   }
+
+  RDR_STAT_ADD(EBVHNodesVisited, n_visited);
   return result;
 }
 
@@ -10,9 +10,34 @@
 
 RDR_NAMESPACE_BEGIN
 
+/**
+ * @brief How the samples of parallel workers are accumulated.
+ * - ELocked: Every sample locks the blocks covered by its filter footprint
+ * - ETiled: Every tile accumulates into a private FilmTile without locking,
+ *   which is merged into the film with atomic adds once the tile is done
+ */
+enum class EFilmAccumulation {
+  ELocked = 0,
+  ETiled  = 1,
+};
+
+/**
+ * @brief The running statistics of the luminance of the samples drawn for a
+ * pixel, regardless of the filter, to estimate the error of its mean.
+ */
+struct PixelStatistics {
+  Double sum{0}, square_sum{0};
+  int n_samples{0};
+
+  /// The standard error of the mean relative to the mean. Dark pixels are
+  /// measured against epsilon, so that they do not attract all samples
+  Float getRelativeError(Float epsilon = 1e-3) const;
+};
+
 class Film : public ConfigurableObject {
 public:
   friend class FilmBlockView;
+  friend class FilmTile;
 
   // ++ Required by ConfigurableObject
   Film(const Properties &props);
@@ -46,6 +71,18 @@ public:
   void commitLightImageSplat(
       const Vec2f &sample_pos, const Vec3f &measurement);
 
+  /// Reduce the samples of a tile into the film. Thread-safe and lock-free
+  void mergeTile(const FilmTile &tile);
+
+  /// Record the luminance of a sample drawn for the pixel. Not thread-safe;
+  /// only the worker rendering the pixel may record its samples
+  void commitPixelStatistics(const Vec2i &pixel, Float luminance);
+  const PixelStatistics &getPixelStatistics(int x, int y) const {
+    return statistics[x + resolution.x * y];
+  }
+
+  EFilmAccumulation getAccumulation() const { return accumulation; }
+
   Vec3f &getPixel(int x, int y);
   const Vec3f &getPixel(int x, int y) const;
   const vector<Vec3f> &getRawData() const { return data; }
@@ -53,9 +90,11 @@ public:
 
 private:
   ref<ReconstructionFilter> filter{nullptr};
+  EFilmAccumulation accumulation{EFilmAccumulation::ETiled};
   Vec2i resolution;
   vector<Vec3f> data, light_data;
   vector<Double> weight;
+  vector<PixelStatistics> statistics;
 
   // blockview-related
   uint32_t block_side_length;
@@ -76,6 +115,38 @@ private:
 
   template <typename T>
   void blockVisitor(const Vec2f &sample_pos, T visitor);
+
+  /// Call visitor(pixel_index, weight) on the pixels within the filter radius
+  /// of the sample, including the ones outside of the film
+  template <typename T>
+  void footprintVisitor(const Vec2f &sample_pos, T visitor) const;
+};
+
+/**
+ * @brief The samples of one image tile, accumulated into a private buffer that
+ * covers the tile and the filter footprint around it, so that no lock is taken
+ * per sample. In the locked mode the samples are forwarded to the film.
+ */
+class FilmTile {
+public:
+  /// The tile covers the pixels in [low_bnd, upper_bnd)
+  FilmTile(Film &film, const Vec2i &low_bnd, const Vec2i &upper_bnd);
+
+  /// Commit the sample to the tile. Samples outside of the tile are committed
+  /// to the film directly
+  void commitSample(const Vec2f &sample_pos, const Vec3f &measurement);
+
+private:
+  friend class Film;
+
+  Film &film;
+  bool forward;
+
+  /// The tile itself and the buffer bound, both exclusive on the upper side
+  Vec2i tile_low_bnd, tile_upper_bnd;
+  Vec2i low_bnd, upper_bnd;
+  vector<Vec3f> data;
+  vector<Double> weight;
 };
 
 /// A subspan of Film. Can be used to commit samples or add lock
@@ -168,6 +239,20 @@ void Film::blockVisitor(const Vec2f &sample_pos, T visitor) {
   }
 }
 
+template <typename T>
+void Film::footprintVisitor(const Vec2f &sample_pos, T visitor) const {
+  const int &discrete_radius = std::ceil(filter->getRadius() - 0.5);
+  const Vec2i pixel_index(std::floor(sample_pos.x), std::floor(sample_pos.y));
+  for (int x = -discrete_radius; x <= discrete_radius; ++x) {
+    for (int y = -discrete_radius; y <= discrete_radius; ++y) {
+      const Vec2i &current_pixel_index = pixel_index + Vec2i(x, y);
+      const Vec2f relative_pos =
+          sample_pos - Cast<Float>(current_pixel_index) - 0.5_F;
+      visitor(current_pixel_index, filter->evaluate(relative_pos));
+    }
+  }
+}
+
 RDR_REGISTER_CLASS(Film)
 
 RDR_NAMESPACE_END
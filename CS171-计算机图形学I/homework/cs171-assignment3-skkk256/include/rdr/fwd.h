@@ -24,13 +24,16 @@ struct CrossConfigurationContext;
 class Light;
 class AreaLight;
 class InfiniteAreaLight;
+class BVHLightSampler;
 class BSDF;
 class Camera;
 class ReconstructionFilter;
 class Film;  // for saving
 class FilmBlockView;
+class FilmTile;
 struct Ray;
 struct DifferentialRay;
+struct RayPacket;
 struct SurfaceInteraction;
 
 template <typename _PointType>
@@ -66,6 +69,8 @@ class PathIntegrator;
 class PhotonMappingIntegratorBase;
 class PhotonMappingIntegrator;
 class StochasticProgressivePhotonMappingIntegrator;
+class BidirectionalPathIntegrator;
+class GuidedPathIntegrator;
 
 /// Texture
 class Texture;  // for loading
@@ -0,0 +1,191 @@
+/**
+ * @file guiding.h
+ * @brief Practical path guiding [Müller et al. 2017]. The incident radiance is
+ * learnt in an SD-tree, i.e. a binary tree over the scene whose leaves hold a
+ * quadtree over the directions, through training passes of doubling sample
+ * counts. The directions are drawn from the BSDF or from the learnt radiance,
+ * combined by one-sample MIS.
+ */
+#ifndef __GUIDING_H__
+#define __GUIDING_H__
+
+#include <atomic>
+
+#include "rdr/accel.h"
+#include "rdr/integrator.h"
+
+RDR_NAMESPACE_BEGIN
+
+/**
+ * @brief A quadtree over the unit square, onto which the directions are
+ * mapped by the area preserving cylindrical coordinates. Every node holds the
+ * energy of its four quadrants, so the energy of a quadrant is the total of
+ * its child. Recording is lock-free, so any number of workers may record
+ * while the structure stays the same.
+ */
+class DirectionalQuadTree {
+public:
+  struct Node {
+    Float sum[4]{0, 0, 0, 0};
+    /// The child of each quadrant, where 0 means a leaf
+    int child[4]{0, 0, 0, 0};
+  };
+
+  DirectionalQuadTree() : nodes(1) {}
+
+  /// The unit square of a direction, and back
+  static Vec2f DirectionToCanonical(const Vec3f &direction);
+  static Vec3f CanonicalToDirection(const Vec2f &canonical);
+
+  /// Add value to the leaf containing direction and to all of its ancestors.
+  /// Thread-safe
+  void record(const Vec3f &direction, Float value);
+
+  /// Sample a direction in proportion to the energy, or uniformly if there is
+  /// none
+  Vec3f sample(Vec2f u) const;
+
+  /// The solid angle pdf of sample
+  Float pdf(const Vec3f &direction) const;
+
+  Float getTotal() const {
+    const Node &root = nodes[0];
+    return root.sum[0] + root.sum[1] + root.sum[2] + root.sum[3];
+  }
+
+  int getNumNodes() const { return static_cast<int>(nodes.size()); }
+
+  /**
+   * @brief Rebuild the structure from the energy of other, subdividing the
+   * quadrants holding more than threshold of its total up to max_depth
+   * levels, and pruning the others. The energy is cleared.
+   */
+  void refine(
+      const DirectionalQuadTree &other, Float threshold, int max_depth = 20);
+
+private:
+  vector<Node> nodes;
+};
+
+/// The directional distributions of a leaf of the SD-tree
+struct GuidingRegion {
+  GuidingRegion() = default;
+  GuidingRegion(const GuidingRegion &other)
+      : sampling(other.sampling),
+        recording(other.recording),
+        n_records(other.n_records.load(std::memory_order_relaxed)) {}
+  GuidingRegion(GuidingRegion &&other) noexcept
+      : sampling(std::move(other.sampling)),
+        recording(std::move(other.recording)),
+        n_records(other.n_records.load(std::memory_order_relaxed)) {}
+
+  /// Sampled during a pass
+  DirectionalQuadTree sampling;
+  /// Recorded into during a pass, to be sampled in the next
+  DirectionalQuadTree recording;
+  /// The number of records in recording, counted by all of the workers
+  std::atomic<uint64_t> n_records{0};
+};
+
+/**
+ * @brief The spatial binary tree of the SD-tree, over the cube around the
+ * scene. Each node halves its cube along the axis after that of its parent.
+ */
+class SDTree {
+public:
+  explicit SDTree(const AABB &scene_bound);
+
+  /// The leaf containing p
+  GuidingRegion &getRegion(const Vec3f &p);
+  const GuidingRegion &getRegion(const Vec3f &p) const;
+
+  int getNumRegions() const { return static_cast<int>(regions.size()); }
+
+  /**
+   * @brief End a pass. The leaves with more than spatial_threshold records
+   * are split until they have no more, then the recordings turn into the
+   * sampling distributions, and the recordings are refined by
+   * DirectionalQuadTree::refine with directional_threshold.
+   */
+  void refine(Float spatial_threshold, Float directional_threshold,
+      int n_workers = 0);
+
+private:
+  struct Node {
+    int axis{0};
+    /// The first of the two children, where 0 means a leaf
+    int child{0};
+    int region{0};
+  };
+
+  Vec3f low_bnd;
+  Float size;
+  vector<Node> nodes;
+  vector<GuidingRegion> regions;
+
+  int getLeaf(const Vec3f &p) const;
+};
+
+/**
+ * @brief A path tracer, as IncrementalPathIntegrator with NEE and MIS, which
+ * learns where the light comes from. n_training_iterations passes of 1, 2,
+ * 4, ... samples per pixel train the SD-tree in parallel, then the image is
+ * rendered with spp samples per pixel. On every non-specular surface the BSDF
+ * is sampled with probability bsdf_fraction, and the SD-tree otherwise.
+ */
+class GuidedPathIntegrator final : public PathIntegrator {
+public:
+  GuidedPathIntegrator(const Properties &props);
+
+  /// @see PathIntegrator::render
+  void render(ref<Camera> camera, ref<Scene> scene) override;
+
+  /// @see PathIntegrator::Li
+  Vec3f Li(
+      ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const override;
+
+  /// @see PathIntegrator::Li
+  Vec3f Li(ref<Scene> scene, DifferentialRay &ray, Sampler &sampler,
+      bool intersected, const SurfaceInteraction &interaction) const override;
+
+  // ++ Required by Object
+  std::string toString() const override {
+    return format(
+        "GuidedPathIntegrator[\n"
+        "  max_depth             = {}\n"
+        "  spp                   = {}\n"
+        "  rr_threshold          = {}\n"
+        "  n_training_iterations = {}\n"
+        "  bsdf_fraction         = {}\n"
+        "  spatial_threshold     = {}\n"
+        "  directional_threshold = {}\n"
+        "  sampler               = {}\n"
+        "]",
+        max_depth, spp, rr_threshold, n_training_iterations, bsdf_fraction,
+        spatial_threshold, directional_threshold, sampler_type);
+  }
+  // --
+
+private:
+  using IntegratorProfile = IncrementalPathIntegrator::IntegratorProfile;
+
+  Float rr_threshold;
+  IntegratorProfile profile;
+
+  int n_training_iterations;
+  Float bsdf_fraction;
+  /// A leaf is split once it has spatial_threshold * sqrt(2^iteration)
+  /// records, i.e. in proportion to the square root of the samples
+  Float spatial_threshold;
+  Float directional_threshold;
+
+  ref<SDTree> sd_tree;
+  /// Whether Li records into sd_tree
+  bool training{false};
+};
+
+RDR_REGISTER_CLASS(GuidedPathIntegrator)
+
+RDR_NAMESPACE_END
+
+#endif
@@ -14,9 +14,33 @@
 
 #include "rdr/interaction.h"
 #include "rdr/path.h"
+#include "rdr/sampler.h"
 
 RDR_NAMESPACE_BEGIN
 
+/**
+ * @brief The settings of the progressive mode, read from the "progressive"
+ * properties of an integrator. Pixels are rendered in passes of pass_spp
+ * samples until their relative error reaches target_error, or they have spp
+ * samples, or time_budget seconds have passed. A non-positive time_budget
+ * means no deadline.
+ */
+struct ProgressiveSettings {
+  ProgressiveSettings() = default;
+  explicit ProgressiveSettings(const Properties &props);
+
+  bool enabled{false};
+  int pass_spp{4};
+  /// Every pixel takes at least min_spp samples before its error is trusted
+  int min_spp{16};
+  Float target_error{0.01};
+  Float time_budget{0};
+  /// The running image is written to checkpoint after the first pass ending
+  /// checkpoint_interval seconds after the last write, unless it is empty
+  std::string checkpoint;
+  Float checkpoint_interval{30};
+};
+
 class Integrator : public ConfigurableObject {
 public:
   Integrator(const Properties &props) : ConfigurableObject(props) {}
@@ -31,11 +55,36 @@ public:
   PathIntegrator(const Properties &props)
       : Integrator(props),
         max_depth(props.getProperty<int>("max_depth", 12)),
-        spp(props.getProperty<int>("spp", 32)) {}
+        spp(props.getProperty<int>("spp", 32)),
+        threads(props.getProperty<int>("threads", 0)),
+        tile_size(props.getProperty<int>("tile_size", 16)),
+        ray_packets(props.getProperty<bool>("ray_packets", true)),
+        sampler_type(props.getProperty<Properties>("sampler", Properties{})
+                         .getProperty<std::string>("type", "independent")),
+        sampler(CreateSampler(
+            props.getProperty<Properties>("sampler", Properties{}), spp)) {
+    if (tile_size <= 0) Exception_("tile_size should be greater than 0");
+    if (props.hasProperty("progressive"))
+      progressive =
+          ProgressiveSettings(props.getProperty<Properties>("progressive"));
+  }
 
-  /// @see Integrator::render
+  /**
+   * @brief Render the image tile by tile on a pool of workers. Tiles are
+   * distributed with work stealing, and each worker owns a clone of the
+   * sampler, which is restarted per pixel sample so that the result does not
+   * depend on the scheduling. In the progressive mode, spp is the maximum
+   * number of samples per pixel.
+   * @see Integrator::render
+   */
   void render(ref<Camera> camera, ref<Scene> scene) override;
 
+  /// Draw the samples [begin, end) of the pixel into the tile, and record
+  /// their statistics on the film
+  void renderPixel(const Camera &camera, const ref<Scene> &scene, Film &film,
+      FilmTile &film_tile, Sampler &sampler, const Vec2i &pixel, int begin,
+      int end) const;
+
   /**
    * @brief The core function of path tracing. Perform Monte Carlo integration
    * given a ray, estimate the radiance as definition.
@@ -43,16 +92,47 @@ public:
   virtual Vec3f Li(  // NOLINT
       ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const = 0;
 
+  /**
+   * @brief Li, where the first intersection of the ray has been found, e.g.
+   * within a ray packet. interaction is ignored unless intersected. Defaults
+   * to intersecting again.
+   */
+  virtual Vec3f Li(ref<Scene> scene, DifferentialRay &ray,  // NOLINT
+      Sampler &sampler, bool intersected,
+      const SurfaceInteraction &interaction) const {
+    return Li(scene, ray, sampler);
+  }
+
   std::string toString() const override {
     std::ostringstream ss;
     ss << "PathIntegrator[\n"
        << format("  max_depth = {}\n", max_depth) << format("  spp = {}\n", spp)
-       << "]";
+       << format("  threads = {}\n", threads)
+       << format("  tile_size = {}\n", tile_size)
+       << format("  ray_packets = {}\n", ray_packets)
+       << format("  sampler = {}\n", sampler_type)
+       << format("  progressive = {}\n", progressive.enabled) << "]";
     return ss.str();
   }
 
 protected:
   int max_depth, spp;
+
+  /// Number of workers, where non-positive means all hardware threads
+  int threads;
+  /// Side length of the square tiles distributed to the workers
+  int tile_size;
+  /// Whether the camera rays of a pixel are intersected as packets
+  bool ray_packets;
+
+  /// The prototype cloned for each worker
+  std::string sampler_type;
+  ref<Sampler> sampler;
+
+  ProgressiveSettings progressive;
+
+  /// Render in passes over the pixels that have not converged yet
+  void renderProgressive(ref<Camera> camera, ref<Scene> scene);
 };
 
 /**
@@ -85,28 +165,37 @@ public:
       : PathIntegrator(props),
         rr_threshold(props.getProperty<Float>("rr_threshold", 0.1)) {
     // might be necessary to understand? just a json object.
-    auto profile_name = props.getProperty<std::string>("profile", "NEE");
+    profile = ParseProfile(props.getProperty<std::string>("profile", "NEE"));
+  }
+
+  /// Parse the "profile" property, shared with the other path tracers
+  static IntegratorProfile ParseProfile(const std::string &profile_name) {
     if (profile_name == "RW" || profile_name == "RandomWalk") {
-      profile = IntegratorProfile::ERandomWalk;
+      return IntegratorProfile::ERandomWalk;
     } else if (profile_name == "NEE" || profile_name == "NextEventEstimation") {
-      profile = IntegratorProfile::ENextEventEstimation;
+      return IntegratorProfile::ENextEventEstimation;
     } else if (profile_name == "MIS" ||
                profile_name == "MultipleImportanceSampling") {
-      profile = IntegratorProfile::EMultipleImportanceSampling;
+      return IntegratorProfile::EMultipleImportanceSampling;
     } else {
       Exception_("Profile name {} not supported; use MIS", profile_name);
-      profile = IntegratorProfile::EMultipleImportanceSampling;
+      return IntegratorProfile::EMultipleImportanceSampling;
     }
   }
 
-  /// @see Integrator::Li
+  /// @see PathIntegrator::Li
   template <typename PathType>
-  Vec3f Li(ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const;
+  Vec3f Li(ref<Scene> scene, DifferentialRay &ray, Sampler &sampler,
+      bool intersected, const SurfaceInteraction &interaction) const;
 
-  /// @see Integrator::Li
+  /// @see PathIntegrator::Li
   Vec3f Li(
-      ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const override {
-    return Li<Path>(scene, ray, sampler);
+      ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const override;
+
+  /// @see PathIntegrator::Li
+  Vec3f Li(ref<Scene> scene, DifferentialRay &ray, Sampler &sampler,
+      bool intersected, const SurfaceInteraction &interaction) const override {
+    return Li<Path>(scene, ray, sampler, intersected, interaction);
   }
 
   // ++ Required by Object
@@ -1,11 +1,34 @@
 #ifndef __LIGHT_H__
 #define __LIGHT_H__
 
+#include "rdr/accel.h"
 #include "rdr/interaction.h"
 #include "rdr/rdr.h"
 
 RDR_NAMESPACE_BEGIN
 
+/**
+ * @brief Conservative bounds of where and in which directions a light emits,
+ * used by the light BVH to estimate its contribution to a point [pbrt-v4].
+ * The emitting normals lie in cone, and the emission spreads up to acos(
+ * cos_theta_e) beyond them.
+ */
+struct LightBounds {
+  AABB bounds;
+  Float phi{0};
+  DirectionCone cone;
+  Float cos_theta_e{1};
+  bool two_sided{false};
+
+  Vec3f getCentroid() const { return bounds.getCenter(); }
+
+  /// Estimate the contribution to the point p with normal n, where a zero n
+  /// stands for a point in a medium. Never underestimates a zero
+  Float importance(const Vec3f &p, const Vec3f &n) const;
+};
+
+LightBounds Union(const LightBounds &a, const LightBounds &b);
+
 /**
  * @brief The general interface of light source.
  */
@@ -63,6 +86,12 @@ public:
    * @brief Calculate the energy emitted by this light.
    */
   virtual Float energy() const = 0;
+
+  /**
+   * @brief Fill the bounds of the emission. Return false for the lights
+   * without a finite bound, e.g. InfiniteAreaLight.
+   */
+  virtual bool getLightBounds(LightBounds &light_bounds) const { return false; }
 };
 
 /**
@@ -99,6 +128,9 @@ public:
   /// @see Light::energy
   Float energy() const override;
 
+  /// @see Light::getLightBounds
+  bool getLightBounds(LightBounds &light_bounds) const override;
+
   /// @see Light::sampleDirection
   Vec3f sampleDirection(const SurfaceInteraction &interaction, Sampler &sampler,
       Float &pdf) const override;
@@ -207,8 +239,13 @@ private:
     return tmp.xyz() / tmp.w;
   }
 
+  /// The PDF w.r.t. solid angle of sampling the direction w towards the light
+  Float pdfIncomingDirection(const Vec3f &w) const;
+
   ref<Texture> texture{nullptr};
-  // ref<Distribution2D> distribution{nullptr};
+  /// Luminance * sin(theta) on the (phi, theta) grid of an image texture, or
+  /// nullptr when the sphere is sampled uniformly
+  ref<Distribution2D> distribution{nullptr};
 
   Vec3f scene_center{0.0};
   Float radius{1e3};
@@ -0,0 +1,72 @@
+/**
+ * @file light_sampler.h
+ * @brief Choose one light among many for a shading point, in proportion to
+ * an estimate of its contribution rather than its power alone.
+ */
+#ifndef __LIGHT_SAMPLER_H__
+#define __LIGHT_SAMPLER_H__
+
+#include "rdr/light.h"
+
+RDR_NAMESPACE_BEGIN
+
+/**
+ * @brief A BVH over the LightBounds of the bounded lights [pbrt-v4]. A light
+ * is sampled by descending from the root, choosing each child in proportion to
+ * its importance for the shading point. The lights without bounds, i.e. the
+ * infinite ones, are sampled uniformly with the probability of one subtree.
+ */
+class BVHLightSampler {
+public:
+  explicit BVHLightSampler(const vector<ref<Light>> &lights);
+
+  /**
+   * @brief Sample a light for the point and normal of interaction with the
+   * sample u. Return nullptr only if there is no light with a positive power.
+   */
+  ref<Light> sample(
+      const SurfaceInteraction &interaction, Float u, Float *pmf) const;
+
+  /// The probability of sampling light for interaction
+  Float pmf(const SurfaceInteraction &interaction, const Light *light) const;
+
+private:
+  /// Interior nodes have their first child next to them
+  struct Node {
+    LightBounds light_bounds;
+    int child_or_light_index;
+    bool is_leaf;
+  };
+
+  /// Build the subtree of lights [begin, end), whose root is reached by the
+  /// branches in bit_trail, and return the index of its root
+  int build(vector<std::pair<int, LightBounds>> &bvh_lights, int begin,
+      int end, uint64_t bit_trail, int depth);
+
+  /// The probability of descending into the first child of an interior node
+  Float getFirstChildProbability(
+      int node_index, const Vec3f &p, const Vec3f &n) const;
+
+  /// The cost of a split candidate, the surface area orientation heuristic
+  Float evaluateCost(const LightBounds &light_bounds, const AABB &bounds,
+      int dim) const;
+
+  /// The probability of choosing the infinite lights
+  Float getInfiniteProbability() const {
+    if (infinite_lights.empty()) return 0;
+    return static_cast<Float>(infinite_lights.size()) /
+           (infinite_lights.size() + (nodes.empty() ? 0 : 1));
+  }
+
+  vector<ref<Light>> bounded_lights;
+  vector<ref<Light>> infinite_lights;
+  vector<Node> nodes;
+
+  /// The branches from the root to the leaf of each bounded light, one bit per
+  /// level with 1 for the second child
+  std::map<const Light *, uint64_t> bit_trails;
+};
+
+RDR_NAMESPACE_END
+
+#endif
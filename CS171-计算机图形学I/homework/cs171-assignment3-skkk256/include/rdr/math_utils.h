@@ -18,6 +18,7 @@
 #include "rdr/canary.h"
 #include "rdr/math_aliases.h"
 #include "rdr/platform.h"
+#include "rdr/std.h"
 
 #include <iostream>
 
@@ -169,6 +170,46 @@ struct Frame {
   Vec3f n, x, y;
 };
 
+/// A cone of directions around w, with half angle acos(cos_theta). The
+/// default cone is empty [pbrt-v4]
+struct DirectionCone {
+  DirectionCone() = default;
+  DirectionCone(const Vec3f &w, Float cos_theta)
+      : w(Normalize(w)), cos_theta(cos_theta) {}
+  explicit DirectionCone(const Vec3f &w) : DirectionCone(w, 1) {}
+
+  static DirectionCone EntireSphere() { return {Vec3f(0, 0, 1), -1}; }
+
+  bool isEmpty() const { return cos_theta == Float_INF; }
+
+  Vec3f w{0, 0, 1};
+  Float cos_theta{Float_INF};
+};
+
+/// The smallest cone containing both cones
+RDR_FORCEINLINE DirectionCone Union(
+    const DirectionCone &a, const DirectionCone &b) {
+  if (a.isEmpty()) return b;
+  if (b.isEmpty()) return a;
+
+  // Return either cone if it contains the other
+  const Float theta_a = std::acos(std::clamp(a.cos_theta, -1.0F, 1.0F));
+  const Float theta_b = std::acos(std::clamp(b.cos_theta, -1.0F, 1.0F));
+  const Float theta_d = std::acos(std::clamp(Dot(a.w, b.w), -1.0F, 1.0F));
+  if (std::min(theta_d + theta_b, PI) <= theta_a) return a;
+  if (std::min(theta_d + theta_a, PI) <= theta_b) return b;
+
+  // Rotate a.w towards b.w to the center of the spread
+  const Float theta_o = (theta_a + theta_d + theta_b) / 2;
+  if (theta_o >= PI) return DirectionCone::EntireSphere();
+  const Vec3f axis = Cross(a.w, b.w);
+  if (SquareNorm(axis) == 0) return DirectionCone::EntireSphere();
+  const Float theta_r = theta_o - theta_a;
+  const Vec3f w       = a.w * std::cos(theta_r) +
+                        Cross(Normalize(axis), a.w) * std::sin(theta_r);
+  return {w, std::cos(theta_o)};
+}
+
 /// Definitions for OffsetRayOrigin
 namespace detail_ {
 RDR_FORCEINLINE float __host_int_as_float(int a) {
@@ -247,6 +288,11 @@ RDR_FORCEINLINE T Mod(T a, T b) {
   }
 }
 
+/// The luminance Y of a linear sRGB color
+RDR_FORCEINLINE Float Luminance(const Vec3f &rgb) {
+  return 0.2126_F * rgb.x + 0.7152_F * rgb.y + 0.0722_F * rgb.z;
+}
+
 RDR_FORCEINLINE uint8_t GammaCorrection(float radiance) {
   /// This with result in different result from mitsuba 0.6, whose tone mapper
   /// is really complex. So if you want to precisely debug the renderer, use
@@ -272,10 +318,30 @@ RDR_FORCEINLINE Vec3f DeNan(const Vec3f &vec, float val) {
  *
  * ===================================================================== */
 
+/**
+ * @brief The basic sampler, drawing from a std::mt19937 stream. Its samples
+ * depend on the history of the stream.
+ * @see sampler.h for the samplers selectable by the integrators, which derive
+ * their samples from the pixel, the sample index and the dimension only
+ */
 class Sampler {
 public:
   virtual ~Sampler() = default;
 
+  /// Start the sample_index-th sample of the pixel, where the dimension is
+  /// reset. The base sampler only records the pixel
+  virtual void startPixelSample(const Vec2i &pixel, int sample_index) {
+    setPixelIndex2D(pixel);
+  }
+
+  /// The number of dimensions consumed since startPixelSample. Samples of
+  /// different dimensions are independent
+  virtual int getDimension() const { return 0; }
+  virtual void setDimension(int dimension) {}
+
+  /// A copy for another thread
+  virtual ref<Sampler> clone() const { return make_ref<Sampler>(*this); }
+
   RDR_FORCEINLINE virtual bool resetAfterIteration() { return true; }
   RDR_FORCEINLINE virtual Float get1D() { return Clamp01(dis(engine)); }
   RDR_FORCEINLINE virtual Vec2f get2D() { return {get1D(), get1D()}; }
@@ -471,6 +537,66 @@ private:
   }
 };
 
+/**
+ * @brief A piecewise-constant distribution on [0, 1]^2 over an nu x nv grid,
+ * sampled by the marginal distribution of the rows and then the conditional
+ * distribution within the row, both by binary search [pbrt-v3].
+ */
+struct Distribution2D {
+  /// func is nv rows of nu values
+  Distribution2D(const Float *func, int nu, int nv)
+      : conditional(BuildConditional(func, nu, nv)),
+        marginal(BuildMarginal(conditional)) {}
+
+  /// Sample a point with the density pdf w.r.t. the area of [0, 1]^2
+  Vec2f sampleContinuous(const Vec2f &u, Float *pdf) const {
+    Float pdfs[2];
+    int offsets[2];
+    Float d1 = marginal.sampleContinuous(u[1], &pdfs[1], &offsets[1]);
+    Float d0 = conditional[offsets[1]].sampleContinuous(
+        u[0], &pdfs[0], &offsets[0]);
+    *pdf = pdfs[0] * pdfs[1];
+    // Rounding may push the point onto the next cell, where pdf() disagrees
+    while (static_cast<int>(d0 * conditional[0].size()) > offsets[0])
+      d0 = std::nextafter(d0, 0.0F);
+    while (static_cast<int>(d1 * marginal.size()) > offsets[1])
+      d1 = std::nextafter(d1, 0.0F);
+    return {d0, d1};
+  }
+
+  /// The density of sampleContinuous at p
+  Float pdf(const Vec2f &p) const {
+    const int nu = conditional[0].size();
+    const int nv = marginal.size();
+    const int iu = std::clamp(static_cast<int>(p[0] * nu), 0, nu - 1);
+    const int iv = std::clamp(static_cast<int>(p[1] * nv), 0, nv - 1);
+    if (marginal.getIntegral() == 0) return 0;
+    return conditional[iv].func[iu] / marginal.getIntegral();
+  }
+
+  Float getIntegral() const { return marginal.getIntegral(); }
+
+private:
+  static vector<Distribution1D> BuildConditional(
+      const Float *func, int nu, int nv) {
+    vector<Distribution1D> result;
+    result.reserve(nv);
+    for (int v = 0; v < nv; ++v) result.emplace_back(func + v * nu, nu);
+    return result;
+  }
+
+  static Distribution1D BuildMarginal(
+      const vector<Distribution1D> &conditional) {
+    vector<Float> integrals;
+    integrals.reserve(conditional.size());
+    for (const auto &row : conditional) integrals.push_back(row.getIntegral());
+    return {integrals.data(), static_cast<int>(integrals.size())};
+  }
+
+  vector<Distribution1D> conditional;
+  Distribution1D marginal;
+};
+
 /* ===================================================================== *
  *
  * Photon-mapping related Kernels
@@ -0,0 +1,193 @@
+/**
+ * @file mesh_cache.h
+ * @brief A versioned binary cache of the loaded triangle meshes, i.e. the
+ * transformed geometry, the area of each triangle and the built acceleration
+ * structure, so that later runs skip both the OBJ parsing and the BVH build.
+ * The cache is keyed by the hash of the source file and of the configuration
+ * it was built with, and is memory-mapped on load.
+ */
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include <cstring>
+
+#include "rdr/rdr.h"
+
+RDR_NAMESPACE_BEGIN
+
+/// A read-only mapping of a whole file, which is empty if it fails to open
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const fs::path &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &)            = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool isOpen() const { return data != nullptr; }
+  const uint8_t *getData() const { return data; }
+  size_t getSize() const { return size; }
+
+private:
+  const uint8_t *data{nullptr};
+  size_t size{0};
+#if defined(_WIN32)
+  HANDLE file{INVALID_HANDLE_VALUE};
+  HANDLE mapping{nullptr};
+#endif
+};
+
+/// 64-bit FNV-1a hash of the bytes, chained through seed
+uint64_t HashBytes(const void *data, size_t size,
+    uint64_t seed = 0xcbf29ce484222325ULL);
+
+/// Appends trivially copyable values to a byte buffer
+class BinaryWriter {
+public:
+  explicit BinaryWriter(vector<uint8_t> &buffer) : buffer(buffer) {}
+
+  template <typename T>
+  void write(const T &value) {
+    writeArray(&value, 1);
+  }
+
+  template <typename T>
+  void writeArray(const T *values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto *bytes = reinterpret_cast<const uint8_t *>(values);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T) * count);
+  }
+
+private:
+  vector<uint8_t> &buffer;
+};
+
+/// Reads the values of BinaryWriter back, failing instead of reading past the
+/// end of the bytes
+class BinaryReader {
+public:
+  BinaryReader(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+  template <typename T>
+  bool read(T &value) {
+    return readArray(&value, 1);
+  }
+
+  template <typename T>
+  bool readArray(T *values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (count > (size - offset) / sizeof(T)) return false;
+    std::memcpy(values, data + offset, sizeof(T) * count);
+    offset += sizeof(T) * count;
+    return true;
+  }
+
+  template <typename T>
+  bool readVector(vector<T> &values, size_t count) {
+    if (count > (size - offset) / sizeof(T)) return false;
+    values.resize(count);
+    return readArray(values.data(), count);
+  }
+
+  bool isEnd() const { return offset == size; }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t offset{0};
+};
+
+/// Identifies the mesh held by a cache
+struct MeshCacheKey {
+  uint64_t source_hash{0};  //<! Hash of the source file
+  uint64_t config_hash{0};  //<! Hash of whatever the cached data depends on
+};
+
+/**
+ * @brief A mapped mesh cache file. The file starts with a fixed header and a
+ * section table, followed by the sections, each aligned to a cache line:
+ *
+ *   vertices | normals | texture coordinates | vertex indices |
+ *   normal indices | texture coordinate indices | areas | accel
+ *
+ * where the accel section holds the bytes of Accel::serialize. A file of
+ * another version, layout or key is treated as missing.
+ */
+class MeshCache {
+public:
+  /// Bumped whenever the layout of the file or of a serialized accel changes
+  constexpr static uint32_t VERSION = 1;
+
+  enum class ESection : int {
+    EVertices = 0,
+    ENormals,
+    ETextureCoordinates,
+    EVertexIndices,
+    ENormalIndices,
+    ETextureCoordinateIndices,
+    EAreas,
+    EAccel,
+    ECount,
+  };
+  constexpr static int N_SECTIONS = static_cast<int>(ESection::ECount);
+
+  /// Map the cache at path, which is valid if it holds the mesh of key
+  MeshCache(const fs::path &path, const MeshCacheKey &key);
+
+  bool isValid() const { return valid; }
+
+  /// Copy the cached geometry and areas. The cache must be valid
+  void getMesh(TriangleMeshResource &mesh, vector<Float> &areas) const;
+
+  /// The bytes of Accel::serialize, empty if the accel was not cached
+  const uint8_t *getAccelData() const;
+  size_t getAccelSize() const;
+
+  /// Write the cache of the mesh to path, replacing the file atomically so
+  /// that concurrent readers never see a partial cache
+  static void Save(const fs::path &path, const MeshCacheKey &key,
+      const TriangleMeshResource &mesh, const vector<Float> &areas,
+      const Accel &accel);
+
+  /// The key of the mesh loaded from source with the configuration bytes
+  static MeshCacheKey ComputeKey(
+      const fs::path &source, const vector<uint8_t> &config);
+
+private:
+  struct Section {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;  // sizes of the cached types, see GetLayout
+    MeshCacheKey key;
+    uint32_t has_normal;
+    uint32_t has_texture;
+    Section sections[N_SECTIONS];
+  };
+
+  /// Identifies the sizes of the cached types and the byte order
+  static uint32_t GetLayout();
+
+  MappedFile file;
+  Header header{};
+  bool valid{false};
+
+  const Section &getSection(ESection section) const;
+
+  /// Whether the sections of the header agree with each other, and every
+  /// index refers to an element of its attribute
+  bool isConsistent() const;
+
+  /// Copy the section into values, which holds a multiple of T
+  template <typename T>
+  void readSection(ESection section, vector<T> &values) const;
+};
+
+RDR_NAMESPACE_END
+
+#endif
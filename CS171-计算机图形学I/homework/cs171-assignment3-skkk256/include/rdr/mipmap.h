@@ -21,34 +21,73 @@
 RDR_NAMESPACE_BEGIN
 
 /**
- * @brief  The format of the MIPMap subimage is:
+ * @brief  The format of the input image is:
  * - 32-bit float
  * - 4 channels (RGBA)
  * - (0, 0) corresponds to the upper-left corner
  * - (1, 0) corresponds to the right of the upper-left corner, etc.
  * - data is stored in row-major order, i.e. elements in the same row are
  *  continuous in memory
+ *
+ * The levels are stored one after another with 3 channels (RGB), in tiles of
+ * TILE_SIZE x TILE_SIZE texels, so that the footprint of a lookup spans a few
+ * cache lines instead of a few rows. The tiles, and the texels in a tile, are
+ * in row-major order. Levels smaller than a tile take a single smaller tile.
  */
 class MIPMap {
 public:
   enum class ImageWrap { Repeat, Black, Clamp };
   enum class LookUpMethod { EWA, TriLinearInterpolation };
+  /// Precision of the stored texels. Half floats take half the memory
+  enum class TexelFormat { Single, Half };
   MIPMap() = default;
   MIPMap(const Vec2u &in_resolution, const vector<Float> &in_data,
       LookUpMethod in_method = LookUpMethod::TriLinearInterpolation,
-      ImageWrap in_wrap_mode = ImageWrap::Repeat);
-  uint32_t Width() const { return resolution.front()[0]; }
-  uint32_t Height() const { return resolution.front()[1]; }
-  uint32_t Level() const noexcept { return resolution.size(); }
+      ImageWrap in_wrap_mode = ImageWrap::Repeat,
+      TexelFormat in_format = TexelFormat::Single);
+  uint32_t Width() const { return levels.front().resolution[0]; }
+  uint32_t Height() const { return levels.front().resolution[1]; }
+  uint32_t Level() const noexcept { return levels.size(); }
   Vec3f Texel(uint32_t l, uint32_t s, uint32_t t) const;
   Vec3f LookUp(const Vec2f &st, Float width = 0.f) const noexcept;
   Vec3f LookUp(const Vec2f &st, Vec2f dstdx, Vec2f dstdy) const noexcept;
+  /// Bytes taken by the texels of all levels
+  size_t MemoryUsage() const noexcept {
+    return data.size() * sizeof(Float) + half_data.size() * sizeof(uint16_t);
+  }
+
+  static constexpr uint32_t TILE_SIZE = 8;
 
 private:
+  /// Where the texels of a level are stored, see TexelIndex
+  struct LevelLayout {
+    Vec2u resolution;
+    uint32_t offset;         // index of the first texel of the level
+    uint32_t tile_shift[2];  // log2 of the width and height of a tile
+    uint32_t row_shift;      // log2 of the number of tiles in a row
+  };
+
   Vec3f TriTexel(uint32_t l, const Vec2f &st) const noexcept;
   Vec3f EWA(uint32_t l, const Vec2f &st, const Vec2f &dst0,
       const Vec2f &dst1) const noexcept;
 
+  /// Index of the texel (s, t) of the level, which must be in bound
+  RDR_FORCEINLINE uint32_t TexelIndex(
+      const LevelLayout &level, uint32_t s, uint32_t t) const noexcept {
+    const uint32_t tile = ((t >> level.tile_shift[1]) << level.row_shift) +
+                          (s >> level.tile_shift[0]);
+    const uint32_t s_in_tile = s & ((1u << level.tile_shift[0]) - 1);
+    const uint32_t t_in_tile = t & ((1u << level.tile_shift[1]) - 1);
+    return level.offset +
+           (tile << (level.tile_shift[0] + level.tile_shift[1])) +
+           (t_in_tile << level.tile_shift[0]) + s_in_tile;
+  }
+
+  /// Decode the texel of the index from the half floats
+  Vec3f FetchHalf(uint32_t index) const noexcept;
+
+  // Bilinear interpolation on a row-major RGBA image, only used to build the
+  // levels
   RDR_FORCEINLINE Vec3f GetOne(
       const Float *data, const Vec2u &res, const Vec2u &st) const noexcept {
     return Vec3f(&data[4 * (res[0] * std::min(st[1], res[1] - 1) +
@@ -71,10 +110,13 @@ private:
 
   const LookUpMethod method{LookUpMethod::TriLinearInterpolation};
   const ImageWrap wrap_mode{ImageWrap::Repeat};
+  const TexelFormat format{TexelFormat::Single};
+  /// Identifies the texels of this MIPMap in the per-thread texel cache
+  uint32_t uid{0};
 
-  vector<Vec2u> resolution;
-  vector<uint32_t> offset;
-  vector<Float> data;
+  vector<LevelLayout> levels;
+  vector<Float> data;          // 3 channels per texel for TexelFormat::Single
+  vector<uint16_t> half_data;  // 3 channels per texel for TexelFormat::Half
 
   static constexpr Float maxAnisotropy = 8.f;
   static constexpr uint32_t WeightSize = 128;
@@ -14,6 +14,7 @@ struct CrossConfigurationContext {
   using MaterialMapType   = std::map<std::string, ref<BSDF>>;
   using TextureMapType    = std::map<std::string, ref<Texture>>;
   using PrimitiveListType = vector<ref<Primitive>>;
+  using MeshMapType       = std::map<std::string, ref<TriangleMesh>>;
 
   ref<Film> film;
   ref<ReconstructionFilter> filter;
@@ -24,6 +25,7 @@ struct CrossConfigurationContext {
   MaterialMapType materials;
   TextureMapType textures;
   PrimitiveListType primitives;
+  MeshMapType meshes;  //<! Shared meshes referred by the instances
 
   ref<InfiniteAreaLight> environment_map;
 
@@ -0,0 +1,61 @@
+/**
+ * @file parallel.h
+ * @brief Minimal parallel primitives used by the integrators. Work is split
+ * into contiguous per-worker ranges, and idle workers steal from the ranges of
+ * the others, so neighbouring work items tend to stay on the same thread. The
+ * workers are kept in a persistent pool and reused across calls.
+ */
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <type_traits>
+
+#include "rdr/math_aliases.h"
+
+RDR_NAMESPACE_BEGIN
+
+/// Resolve the number of workers to use. Non-positive values mean "use all
+/// hardware threads".
+int GetNumWorkers(int requested);
+
+/**
+ * @brief Execute func(index, worker_index) for every index in [0, count) on
+ * n_workers threads. The calling thread participates as worker 0, the others
+ * are taken from the pool. Calls may be nested or made from several threads at
+ * once. Exceptions thrown by any worker are re-thrown on the calling thread
+ * after all workers have finished.
+ */
+void ParallelFor(int count, const std::function<void(int, int)> &func,
+    int n_workers = 0);
+
+/// 2D variant of ParallelFor over the tiles of an image. func receives the
+/// tile's lower and upper (exclusive) pixel bound and the worker index.
+void ParallelForTiles(const Vec2i &resolution, int tile_size,
+    const std::function<void(const Vec2i &, const Vec2i &, int)> &func,
+    int n_workers = 0);
+
+/**
+ * @brief Atomically add value to a plain Float or Double with a
+ * compare-and-swap loop, for buffers that are only occasionally shared
+ * between workers. std::atomic_ref is C++20; std::atomic<T> is a plain T on
+ * the supported platforms, which is checked here.
+ */
+template <typename T>
+RDR_FORCEINLINE void AtomicAdd(T &target, T value) {
+  static_assert(std::is_floating_point_v<T>);
+  static_assert(sizeof(std::atomic<T>) == sizeof(T) &&
+                alignof(std::atomic<T>) == alignof(T) &&
+                std::atomic<T>::is_always_lock_free);
+  auto &atomic = reinterpret_cast<std::atomic<T> &>(target);
+  T expected   = atomic.load(std::memory_order_relaxed);
+  while (!atomic.compare_exchange_weak(
+      expected, expected + value, std::memory_order_relaxed)) {
+  }
+}
+
+RDR_NAMESPACE_END
+
+#endif
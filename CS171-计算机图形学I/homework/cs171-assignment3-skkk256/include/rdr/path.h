@@ -103,9 +103,19 @@ public:
   using Super = PathInterface<Path>;
   using Super::toPdfMeasure;
 
-  /// Construct with the first ray.
+  /// Construct with the first ray. The interactions are drawn from the
+  /// ScratchArena of the worker, so a path must not outlive its pixel sample
   Path(const Ray &ray, const PathIntegrator *integrator)
-      : Super(ray, integrator) {}
+      : Super(ray, integrator), interactions(&ScratchArena::ThreadLocal()) {}
+
+  /// A copy draws from the arena of other, where std::pmr would fall back to
+  /// the default resource
+  Path(const Path &other)
+      : Super(other),
+        mis_weight(other.mis_weight),
+        rr_weight(other.rr_weight),
+        interactions(other.interactions, other.interactions.get_allocator()) {}
+  Path &operator=(const Path &other) = default;
 
   /// @see PathInterface::addInteraction
   Path &addInteraction(const SurfaceInteraction &interaction) override {
@@ -135,9 +145,9 @@ public:
 private:
   Float mis_weight{1};  //<! The weight of this path in MIS
   Float rr_weight{1};   //<! The weight of this path by rr(correction)
-  vector<SurfaceInteraction>
-      interactions{};  //<! The interactions along the path, might include light
-                       // source
+  std::pmr::vector<SurfaceInteraction>
+      interactions;  //<! The interactions along the path, might include light
+                     // source
 };
 
 RDR_NAMESPACE_END
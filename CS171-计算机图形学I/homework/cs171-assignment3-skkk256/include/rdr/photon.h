@@ -0,0 +1,323 @@
+/**
+ * @file photon.h
+ * @brief Photon mapping [Jensen 2001] and its stochastic progressive variant
+ * [Hachisuka and Jensen 2009]. Photons are traced from the lights to the
+ * diffuse surfaces they reach after at least one bounce. The camera paths are
+ * followed through the specular surfaces, and on the first non-specular one
+ * the direct light is sampled while the indirect light is estimated from the
+ * density of the photons around.
+ */
+#ifndef __PHOTON_H__
+#define __PHOTON_H__
+
+#include <atomic>
+
+#include "rdr/accel.h"
+#include "rdr/integrator.h"
+
+RDR_NAMESPACE_BEGIN
+
+/**
+ * @brief A photon in 20 bytes. The power is stored in the shared exponent
+ * RGBE format, and the incident direction as quantised spherical angles.
+ */
+struct Photon {
+  Vec3f position;
+  uint8_t power[4];    //<! RGB mantissas and the shared exponent
+  uint8_t theta, phi;  //<! The quantised direction towards the light
+  uint8_t axis;        //<! The split axis in the kd-tree
+  uint8_t pad_{0};
+
+  Vec3f getPower() const;
+  void setPower(const Vec3f &in_power);
+
+  /// The direction towards where the photon came from, i.e. the wo of its hit
+  Vec3f getDirection() const;
+  void setDirection(const Vec3f &direction);
+};
+static_assert(sizeof(Photon) == 20, "Photon should be 20 bytes");
+
+/**
+ * @brief The photons in a balanced kd-tree without pointers. The subtree over
+ * photons[begin, end) is rooted at the median (begin + end) / 2, whose axis
+ * splits the two halves, so that every subtree is contiguous in memory.
+ */
+class PhotonMap {
+public:
+  /// A photon found by a query, and its squared distance to the query point
+  struct NearPhoton {
+    Float distance2;
+    const Photon *photon;
+
+    bool operator<(const NearPhoton &other) const {
+      return distance2 < other.distance2;
+    }
+  };
+
+  /// Take the photons and balance the tree over them
+  void build(vector<Photon> in_photons);
+
+  size_t size() const { return photons.size(); }
+  const vector<Photon> &getPhotons() const { return photons; }
+
+  /**
+   * @brief Find the k nearest photons to p within sqrt(max_distance2). The
+   * result is a max-heap on the distance, i.e. the front is the farthest
+   * photon found. The result is cleared first, so it may be reused as scratch.
+   */
+  void getNearestPhotons(const Vec3f &p, int k, Float max_distance2,
+      vector<NearPhoton> &result) const;
+
+private:
+  vector<Photon> photons;
+
+  /// Balance photons[begin, end)
+  void build(int begin, int end);
+
+  void getNearestPhotons(int begin, int end, const Vec3f &p, int k,
+      Float &max_distance2, vector<NearPhoton> &result) const;
+};
+
+namespace detail_ {
+/// The state of a pixel over the iterations of SPPM
+struct SPPMPixel {
+  Float radius{0};
+  /// The flux accumulated over the photon passes, and the photon count, i.e.
+  /// tau and N in [Hachisuka and Jensen 2009]
+  Vec3f tau{0.0};
+  Float n{0};
+
+  /// The visible point of the current iteration, with the throughput of the
+  /// camera path to it. A zero beta means there is no visible point
+  SurfaceInteraction interaction;
+  Vec3f beta{0.0};
+
+  /// The flux and the number of photons of the current photon pass, which
+  /// are accumulated by all of the workers
+  Vec3f phi{0.0};
+  std::atomic<int> m{0};
+
+  /// Fold the photons of the current pass into tau, shrinking the radius so
+  /// that the fraction alpha of them is kept, and clear the pass along with
+  /// the visible point
+  void update(Float alpha);
+
+  /// The indirect radiance of the photons of n_iterations passes over the
+  /// final disk
+  Vec3f getIndirectRadiance(int n_iterations) const {
+    if (!(radius > 0)) return Vec3f(0.0);
+    return tau / (n_iterations * PI * radius * radius);
+  }
+};
+
+/**
+ * @brief A uniform grid over the visible points, hashed into a fixed number of
+ * buckets. Each bucket heads a singly linked list of the pixels overlapping
+ * its cells, which the workers push onto lock-free. The nodes of all lists
+ * are counted first and stored in one array, so the memory only depends on
+ * the visible points of the current iteration.
+ */
+class SPPMGrid {
+public:
+  explicit SPPMGrid(int n_buckets) : heads(n_buckets) {}
+
+  void build(const vector<SPPMPixel> &pixels, int threads);
+
+  /// Call func(pixel_index) once on every pixel whose disk overlaps the cell
+  /// of p, which includes the pixels whose disks cover p. The nodes of the
+  /// other cells sharing the bucket are skipped
+  template <typename F>
+  void forEachPixel(const Vec3f &p, const F &func) const {
+    if (nodes.empty() || !bounds.isInside(p)) return;
+    const Vec3i cell = getCell(p);
+    for (int i = heads[hash(cell)].load(std::memory_order_relaxed); i != -1;
+         i = nodes[i].next)
+      if (nodes[i].cell == cell) func(nodes[i].pixel);
+  }
+
+private:
+  struct Node {
+    int pixel;
+    int next;
+    Vec3i cell;
+  };
+
+  AABB bounds;
+  Vec3i resolution;
+  vector<std::atomic<int>> heads;
+  vector<Node> nodes;
+  /// The first node of each pixel, with the total number of nodes at the end
+  vector<int> offsets;
+
+  Vec3i getCell(const Vec3f &p) const {
+    const Vec3f extent = bounds.getExtent();
+    Vec3i cell;
+    for (int i = 0; i < 3; ++i) {
+      cell[i] = std::clamp(
+          static_cast<int>((p[i] - bounds.low_bnd[i]) / extent[i] *
+                           resolution[i]),
+          0, resolution[i] - 1);
+    }
+    return cell;
+  }
+
+  size_t hash(const Vec3i &cell) const {
+    return ((static_cast<uint32_t>(cell.x) * 73856093U) ^
+               (static_cast<uint32_t>(cell.y) * 19349663U) ^
+               (static_cast<uint32_t>(cell.z) * 83492791U)) %
+           heads.size();
+  }
+};
+}  // namespace detail_
+
+/**
+ * @brief The properties, the photon tracing and the camera paths shared by the
+ * photon mapping integrators.
+ */
+class PhotonMappingIntegratorBase : public Integrator {
+public:
+  /// spp samples per pixel are drawn in each iteration
+  PhotonMappingIntegratorBase(
+      const Properties &props, int spp, int default_n_iterations);
+
+protected:
+  int max_depth, spp;
+  Float rr_threshold;
+
+  /// Number of photons emitted per iteration
+  int n_photons;
+  int n_iterations;
+
+  /// Number of workers, where non-positive means all hardware threads
+  int threads;
+  /// Side length of the square tiles distributed to the workers
+  int tile_size;
+
+  std::string sampler_type;
+  ref<Sampler> sampler;
+
+  /**
+   * @brief Trace n_photons photons from the lights, calling
+   * deposit(chunk, interaction, beta) on every non-specular surface a photon
+   * reaches after at least one bounce, where beta is the power it carries
+   * there. Photons are traced in parallel over fixed chunks, whose samplers
+   * are seeded by the chunk and the iteration, so the photons do not depend
+   * on the number of workers.
+   */
+  template <typename Deposit>
+  void tracePhotons(
+      const ref<Scene> &scene, int iteration, const Deposit &deposit) const;
+
+  /**
+   * @brief Follow the specular chain of ray, and return the light seen
+   * through it. If the chain ends on a non-specular surface, that surface is
+   * returned in interaction with the throughput to it in beta; otherwise beta
+   * is zero.
+   */
+  Vec3f traceSpecularChain(const ref<Scene> &scene, DifferentialRay &ray,
+      Sampler &sampler, SurfaceInteraction &interaction, Vec3f &beta) const;
+
+  /// Sample the direct light at a non-specular interaction
+  static Vec3f estimateDirect(const ref<Scene> &scene,
+      const SurfaceInteraction &interaction, Sampler &sampler);
+};
+
+class PhotonMappingIntegrator final : public PhotonMappingIntegratorBase {
+public:
+  PhotonMappingIntegrator(const Properties &props);
+
+  /**
+   * @brief Render in n_iterations, each of which traces n_photons photons into
+   * a fresh photon map and draws spp samples per pixel with it. The samples
+   * of all iterations are averaged.
+   * @see Integrator::render
+   */
+  void render(ref<Camera> camera, ref<Scene> scene) override;
+
+  // ++ Required by Object
+  std::string toString() const override {
+    return format(
+        "PhotonMappingIntegrator[\n"
+        "  max_depth      = {}\n"
+        "  spp            = {}\n"
+        "  rr_threshold   = {}\n"
+        "  n_photons      = {}\n"
+        "  n_iterations   = {}\n"
+        "  n_near_photons = {}\n"
+        "  max_radius     = {}\n"
+        "  sampler        = {}\n"
+        "]",
+        max_depth, spp, rr_threshold, n_photons, n_iterations, n_near_photons,
+        max_radius, sampler_type);
+  }
+  // --
+
+private:
+  /// Number of photons in the density estimation, i.e. k of the k-NN
+  int n_near_photons;
+  /// The radius of the density estimation never exceeds max_radius, where a
+  /// non-positive value means no limit
+  Float max_radius;
+
+  PhotonMap photon_map;
+
+  /// Trace the photons of an iteration into the photon map
+  void emitPhotons(const ref<Scene> &scene, int iteration);
+
+  /// The radiance along ray, where near_photons is the scratch of the worker
+  Vec3f Li(const ref<Scene> &scene, DifferentialRay &ray,  // NOLINT
+      Sampler &sampler, vector<PhotonMap::NearPhoton> &near_photons) const;
+
+  /// Estimate the indirect light at a non-specular interaction from the
+  /// density of the nearest photons
+  Vec3f estimateIndirect(const SurfaceInteraction &interaction,
+      vector<PhotonMap::NearPhoton> &near_photons) const;
+};
+
+/**
+ * @brief Stochastic progressive photon mapping. Every iteration traces one
+ * camera path per pixel to its visible point, i.e. its first non-specular
+ * surface, then a pass of photons is splatted onto the visible points within
+ * the radius of their pixels through a hashed grid. The radius of a pixel
+ * shrinks with the photons it receives, so the estimate converges, while the
+ * memory stays the same for any number of iterations.
+ */
+class StochasticProgressivePhotonMappingIntegrator final
+    : public PhotonMappingIntegratorBase {
+public:
+  StochasticProgressivePhotonMappingIntegrator(const Properties &props);
+
+  /// @see Integrator::render
+  void render(ref<Camera> camera, ref<Scene> scene) override;
+
+  // ++ Required by Object
+  std::string toString() const override {
+    return format(
+        "StochasticProgressivePhotonMappingIntegrator[\n"
+        "  max_depth      = {}\n"
+        "  rr_threshold   = {}\n"
+        "  n_photons      = {}\n"
+        "  n_iterations   = {}\n"
+        "  initial_radius = {}\n"
+        "  alpha          = {}\n"
+        "  sampler        = {}\n"
+        "]",
+        max_depth, rr_threshold, n_photons, n_iterations, initial_radius,
+        alpha, sampler_type);
+  }
+  // --
+
+private:
+  /// The radius of every pixel in the first iteration, where a non-positive
+  /// value means 1% of the diagonal of the scene
+  Float initial_radius;
+  /// The fraction of the new photons kept by the radius reduction
+  Float alpha;
+};
+
+RDR_REGISTER_CLASS(PhotonMappingIntegrator)
+RDR_REGISTER_CLASS(StochasticProgressivePhotonMappingIntegrator)
+
+RDR_NAMESPACE_END
+
+#endif
@@ -38,6 +38,15 @@ public:
    */
   virtual bool intersect(Ray &ray, SurfaceInteraction &interaction) const;
 
+  /// Whether the ray hits the primitive within its time range. Nothing but
+  /// the underlying shape's any-hit query is performed
+  virtual bool occluded(const Ray &ray) const;
+
+  /// Intersect the rays of packet in mask with the primitive, filling
+  /// interactions[i] as intersect does. Return the bitmask of the rays hit
+  virtual uint32_t intersectPacket(RayPacket &packet, uint32_t mask,
+      SurfaceInteraction *interactions) const;
+
   /// Return the bounding box of the primitive
   virtual AABB getBound() const;
 
@@ -54,6 +63,9 @@ private:
   ref<Shape> shape{nullptr};
   ref<BSDF> bsdf{nullptr};
   ref<AreaLight> area_light{nullptr};
+
+  /// Fill the terms of a hit of the shape that belong to the primitive
+  void commitInteraction(const Ray &ray, SurfaceInteraction &interaction) const;
 };
 
 RDR_REGISTER_CLASS(Primitive)
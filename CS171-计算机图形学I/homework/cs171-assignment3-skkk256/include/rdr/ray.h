@@ -186,6 +186,20 @@ private:
   detail_::InternalDifferentialRay differential_internal;
 };
 
+/**
+ * @brief Up to SIZE rays traversing the BVHs together, e.g. the camera rays of
+ * a pixel. Lanes are addressed by bitmasks, where bit i stands for rays[i].
+ */
+struct RayPacket {
+  constexpr static int SIZE = 8;
+
+  Ray rays[SIZE];
+  int n_rays{0};
+
+  /// The bitmask of all rays in the packet
+  uint32_t getMask() const { return (uint32_t(1) << n_rays) - 1; }
+};
+
 RDR_NAMESPACE_END
 
 #endif
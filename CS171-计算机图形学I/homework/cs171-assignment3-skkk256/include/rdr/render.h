@@ -99,7 +99,14 @@ public:
   /// itself is properly initialized. To be refractored into member function.
   static Film prepareDebugCanvas(const Vec2i &resolution);
 
+  /// The objects created by initialize()
+  const CrossConfigurationContext &getContext() const { return cross_context; }
+
 private:
+  /// Where the JSON of the statistics is written, given by the optional root
+  /// property "statistics"; empty if there is none. Only used with USE_STATS
+  fs::path getStatisticsPath() const;
+
   CrossConfigurationContext cross_context{};
   PreprocessContext preprocess_context{};
   vector<ConfigurableObject *> global_context{};
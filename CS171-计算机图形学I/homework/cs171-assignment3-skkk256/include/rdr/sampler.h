@@ -0,0 +1,174 @@
+/**
+ * @file sampler.h
+ * @brief The samplers selectable by the integrators. All of them derive a
+ * sample from the pixel, the sample index and the dimension only, so the
+ * image does not depend on the order in which pixels are rendered, and each
+ * pixel is decorrelated from its neighbours by a per-pixel scramble.
+ */
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include "rdr/rdr.h"
+
+RDR_NAMESPACE_BEGIN
+
+/* ===================================================================== *
+ *
+ * Hashing
+ *
+ * ===================================================================== */
+
+/// A 64-bit finalizer with good avalanche [Stafford's Mix13]
+RDR_FORCEINLINE uint64_t MixBits(uint64_t v) {
+  v ^= (v >> 31);
+  v *= 0x7fb5d329728ea185ULL;
+  v ^= (v >> 27);
+  v *= 0x81dadef4bc2dd44dULL;
+  v ^= (v >> 33);
+  return v;
+}
+
+/// Hash an arbitrary number of integers
+template <typename... Args>
+RDR_FORCEINLINE uint64_t Hash(Args... args) {
+  uint64_t result = 0x9e3779b97f4a7c15ULL;
+  ((result = MixBits(result ^ static_cast<uint64_t>(args))), ...);
+  return result;
+}
+
+/// Map the top 24 bits to a Float in [0, 1)
+RDR_FORCEINLINE Float BitsToFloat(uint32_t bits) {
+  return static_cast<Float>(bits >> 8) * 0x1p-24F;
+}
+
+/// The i-th element of a random permutation of [0, n) determined by seed,
+/// without storing it [Kensler 2013]
+uint32_t PermutationElement(uint32_t i, uint32_t n, uint32_t seed);
+
+/// Owen scrambling of a 32-bit fixed point number in base 2 [Burley 2020]
+uint32_t NestedUniformScramble(uint32_t x, uint32_t seed);
+
+/// The dimension-th component of the index-th point of the Sobol sequence,
+/// as 32-bit fixed point. Four dimensions are supported
+uint32_t SobolSample(uint32_t index, int dimension);
+
+/// The radical inverse of a in the base_index-th prime base, with a random
+/// digit permutation per prefix determined by seed [pbrt-v4]
+Float OwenScrambledRadicalInverse(int base_index, uint64_t a, uint32_t seed);
+
+/* ===================================================================== *
+ *
+ * Samplers
+ *
+ * ===================================================================== */
+
+/// The shared bookkeeping of the deterministic samplers
+class PixelSampler : public Sampler {
+public:
+  explicit PixelSampler(int seed) : seed(seed) {}
+
+  void startPixelSample(const Vec2i &pixel, int in_sample_index) override {
+    setPixelIndex2D(pixel);
+    pixel_hash   = Hash(pixel.x, pixel.y, seed);
+    sample_index = in_sample_index;
+    dimension    = 0;
+  }
+
+  int getDimension() const override { return dimension; }
+  void setDimension(int in_dimension) override { dimension = in_dimension; }
+
+  /// Seeds the scrambles globally, e.g. to render decorrelated images
+  void setSeed(int in_seed) override { seed = in_seed; }
+
+protected:
+  int seed;
+  uint64_t pixel_hash{0};
+  int sample_index{0};
+  int dimension{0};
+};
+
+/// Uniform random samples hashed from (pixel, sample index, dimension)
+class IndependentSampler final : public PixelSampler {
+public:
+  explicit IndependentSampler(int seed = 0) : PixelSampler(seed) {}
+
+  Float get1D() override {
+    return BitsToFloat(static_cast<uint32_t>(
+        Hash(pixel_hash, sample_index, dimension++) >> 32));
+  }
+
+  ref<Sampler> clone() const override {
+    return make_ref<IndependentSampler>(*this);
+  }
+};
+
+/**
+ * @brief Jittered stratification of every dimension into spp strata, and of
+ * each 2D pair into an x_samples * y_samples grid. The strata are visited in
+ * a random order per pixel and dimension, so the dimensions are not
+ * correlated [pbrt-v4]. Samples beyond spp restart with new permutations.
+ */
+class StratifiedSampler final : public PixelSampler {
+public:
+  StratifiedSampler(int spp, int seed = 0);
+
+  Float get1D() override;
+  Vec2f get2D() override;
+
+  ref<Sampler> clone() const override {
+    return make_ref<StratifiedSampler>(*this);
+  }
+
+private:
+  int x_samples, y_samples;
+};
+
+/**
+ * @brief The Halton sequence with Owen scrambling, seeded per pixel and
+ * dimension. The i-th dimension uses the i-th prime as base; dimensions past
+ * the prime table fall back to independent samples.
+ */
+class HaltonSampler final : public PixelSampler {
+public:
+  explicit HaltonSampler(int seed = 0) : PixelSampler(seed) {}
+
+  /// The number of dimensions with a prime base
+  static constexpr int MAX_DIMENSION = 128;
+
+  Float get1D() override;
+
+  ref<Sampler> clone() const override {
+    return make_ref<HaltonSampler>(*this);
+  }
+};
+
+/**
+ * @brief Owen-scrambled, shuffled Sobol sequence [Burley 2020]. Dimensions
+ * are padded in groups of four, each group drawn from the 4D Sobol sequence
+ * with an index shuffle and scramble seeded by the pixel and the group.
+ */
+class SobolSampler final : public PixelSampler {
+public:
+  explicit SobolSampler(int seed = 0) : PixelSampler(seed) {}
+
+  Float get1D() override;
+  Vec2f get2D() override;
+
+  ref<Sampler> clone() const override {
+    return make_ref<SobolSampler>(*this);
+  }
+
+private:
+  /// The component of the 4D point of the current group
+  uint32_t sample(int group, int component) const;
+};
+
+/**
+ * @brief Create a sampler from the "sampler" properties of an integrator, i.e.
+ * type = "independent" | "stratified" | "halton" | "sobol", and the seed.
+ */
+ref<Sampler> CreateSampler(const Properties &props, int spp);
+
+RDR_NAMESPACE_END
+
+#endif
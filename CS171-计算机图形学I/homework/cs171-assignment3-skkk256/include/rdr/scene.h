@@ -10,6 +10,10 @@
 
 RDR_NAMESPACE_BEGIN
 
+/// The strategies of choosing a light in direct lighting. EPower ignores the
+/// reference point and chooses in proportion to the power of the lights
+enum class ELightSampler { EPower = 0, EBVH };
+
 namespace detail_ {
 class BVHPrimitiveNode final : BVHNodeInterface<ref<Primitive>> {
   using DataType = ref<Primitive>;
@@ -70,9 +74,17 @@ public:
     return infinite_light;
   }
 
+  /// Whether the shadow ray is blocked, using the any-hit occluded query
   bool isBlocked(const Ray &shadow_ray) const;
   bool isBlocked(const Ray &shadow_ray, SurfaceInteraction &interaction) const;
 
+  /// \brief The any-hit counterpart of intersect.
+  ///
+  /// Return whether the ray(within its tMin/tMax) intersects with any
+  /// primitive. The traversal terminates on the first hit found, and no
+  /// interaction is constructed.
+  bool occluded(const Ray &ray) const;
+
   /// \brief The main ray-primitive intersection routine.
   ///
   /// This accepts a ray and consider its tMin/tMax. If the ray(within this
@@ -80,14 +92,34 @@ public:
   /// Otherwise the function will do nothing.
   bool intersect(const Ray &ray, SurfaceInteraction &interaction) const;
 
+  /// \brief intersect for the rays of a packet, which are traced together
+  /// while they are coherent.
+  ///
+  /// interactions[i] is filled on a hit of packet.rays[i], and left untouched
+  /// otherwise. Return the bitmask of the rays hit.
+  uint32_t intersectPacket(
+      const RayPacket &packet, SurfaceInteraction *interactions) const;
+
   /// Given a surface interaction, return the PDF of sampling this interaction
   /// by light sampling
   Float pdfEmitterDiscrete(const SurfaceInteraction &interaction) const;
   Float pdfEmitterDirect(const SurfaceInteraction &interaction) const;
 
+  /// The PDF of sampling interaction by light sampling from the reference
+  /// point ref, which the light BVH depends on
+  Float pdfEmitterDiscrete(const SurfaceInteraction &ref,
+      const SurfaceInteraction &interaction) const;
+  Float pdfEmitterDirect(const SurfaceInteraction &ref,
+      const SurfaceInteraction &interaction) const;
+
   /// Sample light sources
   ref<Light> sampleEmitterDiscrete(Sampler &sampler, Float *pmf) const;
 
+  /// Sample light sources for the reference point ref, with the light
+  /// sampler selected by the scene
+  ref<Light> sampleEmitterDiscrete(
+      const SurfaceInteraction &ref, Sampler &sampler, Float *pmf) const;
+
   /**
    * @brief Sample a single light-source, fill the reference SurfaceInteraction
    * and return the sampled light interaction.
@@ -106,9 +138,11 @@ public:
   std::string toString() const override {
     return format(
         "Scene [\n"
-        "  has_infinite = {}\n"
+        "  has_infinite  = {}\n"
+        "  light_sampler = {}\n"
         "]",
-        infinite_light != nullptr);
+        infinite_light != nullptr,
+        light_sampler == ELightSampler::EBVH ? "bvh" : "power");
   }
   // --
 
@@ -118,12 +152,19 @@ private:
   ref<InfiniteAreaLight> infinite_light{nullptr};
   ref<Distribution1D> lights_dist;
 
+  /// How the lights are chosen for a reference point
+  ELightSampler light_sampler{ELightSampler::EPower};
+  ref<BVHLightSampler> light_tree{nullptr};
+
   // For interface coherency, let's now use an extra map to maintain the mapping
   // between lights and their Index
   std::map<const Light *, size_t> lights_map;
 
   /// Scene level accelerator
   BVHTree<detail_::BVHPrimitiveNode> primitive_tree;
+
+  /// intersect, without counting the ray in the statistics
+  bool traverse(const Ray &ray, SurfaceInteraction &interaction) const;
 };
 
 RDR_REGISTER_CLASS(Scene)
@@ -3,6 +3,7 @@
 
 #include <memory>
 
+#include "rdr/accel.h"
 #include "rdr/rdr.h"
 
 RDR_NAMESPACE_BEGIN
@@ -26,6 +27,16 @@ public:
   /// for correctness. Note that interaction.dist is taken into account.
   virtual bool intersect(Ray &ray, SurfaceInteraction &interaction) const = 0;
 
+  /// Whether the ray hits the shape within its time range, without filling
+  /// any interaction. Defaults to intersect
+  virtual bool occluded(const Ray &ray) const;
+
+  /// Intersect the rays of packet in mask, where interactions[i] is filled as
+  /// by intersect on a hit of packet.rays[i]. Return the bitmask of the rays
+  /// hit. Defaults to intersecting the rays one by one
+  virtual uint32_t intersectPacket(RayPacket &packet, uint32_t mask,
+      SurfaceInteraction *interactions) const;
+
   /// Calculate the surface area of the shape to calculate PDF.
   virtual Float area() const = 0;
 
@@ -38,6 +49,12 @@ public:
   /// Return the PDF of the given Interaction on the shape with a certain
   /// measure.
   virtual Float pdf(const SurfaceInteraction &interaction) const = 0;
+
+  /// Return a cone containing the normals of the sampled points. Defaults to
+  /// the entire sphere
+  virtual DirectionCone getNormalCone() const {
+    return DirectionCone::EntireSphere();
+  }
 };
 
 class Sphere final : public Shape {
@@ -51,6 +68,9 @@ public:
   /// @see Shape::intersect
   bool intersect(Ray &ray, SurfaceInteraction &interaction) const override;
 
+  /// @see Shape::occluded
+  bool occluded(const Ray &ray) const override;
+
   /// @see Shape::area
   Float area() const override;
 
@@ -66,6 +86,9 @@ public:
 private:
   Vec3f center;
   Float radius;
+
+  /// Solve for the nearest hit distance within the ray's time range
+  bool intersectDistance(const Ray &ray, Double *t) const;
 };
 
 /**
@@ -106,6 +129,13 @@ public:
   /// @see Shape::intersect
   bool intersect(Ray &ray, SurfaceInteraction &interaction) const override;
 
+  /// @see Shape::occluded
+  bool occluded(const Ray &ray) const override;
+
+  /// @see Shape::intersectPacket
+  uint32_t intersectPacket(RayPacket &packet, uint32_t mask,
+      SurfaceInteraction *interactions) const override;
+
   /// @see Shape::area
   Float area() const override;
 
@@ -118,6 +148,12 @@ public:
   /// @see Shape::pdf
   Float pdf(const SurfaceInteraction &interaction) const override;
 
+  /// @see Shape::getNormalCone
+  DirectionCone getNormalCone() const override;
+
+  /// The underlying triangle data, shared with the instances
+  const ref<TriangleMeshResource> &getResource() const { return mesh; }
+
 protected:
   ref<Accel> accel;  //<! Any acceleration structure. Will not fully
                      // fill the interaction structure.
@@ -129,6 +165,73 @@ protected:
   vector<Float> areas;       //<! Area of each triangle. Will be
                              // calculated on construction.
   Float total_area{};        //<! Total area of the mesh.
+
+  /// Load the mesh from the OBJ file at path into the object space, and
+  /// calculate the areas
+  void loadObj(
+      const std::string &path, const Mat4f &transform, const Vec3f &translate);
+};
+
+/**
+ * @brief An instance of a shared TriangleMesh declared in the root "meshes"
+ * map, placed by its own transform. The mesh and its acceleration structure
+ * (the bottom level) are shared by all instances, while the scene's
+ * primitive_tree serves as the top level. Rays are transformed into the
+ * object space on the fly.
+ */
+class TriangleMeshInstance final : public Shape {
+public:
+  ~TriangleMeshInstance() override = default;
+
+  // ++ Required by ConfigurableObject
+  TriangleMeshInstance(const Properties &props);
+  void crossConfiguration(const CrossConfigurationContext &context) override;
+  // --
+
+  /// @see Shape::intersect
+  bool intersect(Ray &ray, SurfaceInteraction &interaction) const override;
+
+  /// @see Shape::occluded
+  bool occluded(const Ray &ray) const override;
+
+  /// @see Shape::area
+  Float area() const override;
+
+  /// @see Shape::sample
+  SurfaceInteraction sample(Sampler &sampler) const override;
+
+  /// @see Shape::getBound
+  AABB getBound() const override;
+
+  /// @see Shape::pdf
+  Float pdf(const SurfaceInteraction &interaction) const override;
+
+private:
+  ref<TriangleMesh> instanced_mesh;  //<! Resolved from mesh_name
+
+  Mat4f object_to_world;
+  Mat4f world_to_object;
+  Mat4f normal_to_world;  //<! Inverse transpose of object_to_world
+
+  AABB bound;          //<! The world space bound
+  Float total_area{};  //<! The world space area
+
+  /// Transform the ray into the object space. Return the ratio between the
+  /// object and world space distance along the ray
+  Float toObject(const Ray &ray, Ray &object_ray) const;
+
+  Vec3f pointToWorld(const Vec3f &p) const {
+    const Vec4f result = Mul(object_to_world, Vec4f(p, 1));
+    return Vec3f(result.xyz()) / result.w;
+  }
+
+  Vec3f vectorToWorld(const Vec3f &v) const {
+    return Mul(object_to_world, Vec4f(v, 0)).xyz();
+  }
+
+  Vec3f normalToWorld(const Vec3f &n) const {
+    return Mul(normal_to_world, Vec4f(n, 0)).xyz();
+  }
 };
 
 RDR_REGISTER_CLASS(Sphere)
@@ -140,6 +243,8 @@ RDR_REGISTER_FACTORY(Shape, [](const Properties &props) -> Shape * {
     return Memory::alloc<TriangleMesh>(props);
   } else if (type == "sphere") {
     return Memory::alloc<Sphere>(props);
+  } else if (type == "instance") {
+    return Memory::alloc<TriangleMeshInstance>(props);
   } else {
     Exception_("Shape type {} not supported", type);
   }
@@ -0,0 +1,164 @@
+/**
+ * @file stats.h
+ * @brief Counters and phase timers of the renderer, e.g. the rays traced and
+ * the BVH nodes visited, to compare the accelerators and the integrators.
+ * Every thread counts into its own StatCounters without synchronization, and
+ * the counters are summed when the statistics are gathered. The RDR_STAT_*
+ * macros compile to nothing unless USE_STATS is defined.
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "rdr/rdr.h"
+
+RDR_NAMESPACE_BEGIN
+
+enum class EStatCounter : int {
+  ERays = 0,           ///< Closest hit queries, including the packet lanes
+  EShadowRays,         ///< Occlusion queries
+  EShadowRaysBlocked,  ///< Occlusion queries that are blocked
+  EBVHNodesVisited,    ///< BVH nodes whose box is tested
+  ETriangleTests,      ///< Ray-triangle tests
+  ECount,
+};
+
+enum class EStatPhase : int {
+  EInitialize = 0,
+  EPreprocess,
+  ERender,
+  EExport,
+  ECount,
+};
+
+/// The counters of a thread, or their sum
+struct StatCounters {
+  static constexpr int N_COUNTERS = static_cast<int>(EStatCounter::ECount);
+  static constexpr int N_PHASES   = static_cast<int>(EStatPhase::ECount);
+  /// The lengths of the paths from 0 to MAX_PATH_LENGTH; the longer ones are
+  /// binned into the last bucket
+  static constexpr int MAX_PATH_LENGTH = 64;
+
+  std::array<uint64_t, N_COUNTERS> counters{};
+  std::array<uint64_t, MAX_PATH_LENGTH + 2> path_lengths{};
+  /// In seconds
+  std::array<Double, N_PHASES> phase_times{};
+
+  void add(EStatCounter counter, uint64_t value) {
+    counters[static_cast<int>(counter)] += value;
+  }
+
+  void addPathLength(int length) {
+    path_lengths[std::clamp(length, 0, MAX_PATH_LENGTH + 1)] += 1;
+  }
+
+  uint64_t get(EStatCounter counter) const {
+    return counters[static_cast<int>(counter)];
+  }
+
+  void merge(const StatCounters &other);
+};
+
+class Statistics {
+public:
+  /// The counters of the calling thread, which are merged into the retired
+  /// counters when the thread exits
+  static StatCounters &Local();  // NOLINT
+
+  static void addPhaseTime(EStatPhase phase, Double seconds);
+
+  /// The sum of the counters of all threads. The workers must not be counting
+  /// meanwhile, i.e. call it between the phases
+  static StatCounters gather();
+
+  /// Reset all counters, of the live threads included
+  static void clear();
+
+  /// A human-readable summary
+  static std::string toString(const StatCounters &stats);
+
+  /// A summary as a JSON object, e.g. for the regression tests
+  static std::string toJson(const StatCounters &stats);
+
+  /// Log the summary, and write its JSON to json_path if it is not empty
+  static void report(const fs::path &json_path = {});
+
+  static const char *GetCounterName(EStatCounter counter);
+  static const char *GetPhaseName(EStatPhase phase);
+
+private:
+  /// Registers the counters of a thread for the lifetime of the thread
+  struct LocalCounters {
+    LocalCounters();
+    ~LocalCounters();
+    StatCounters counters;
+  };
+
+  static Statistics &Instance() {  // NOLINT
+    static Statistics instance;
+    return instance;
+  }
+
+  std::mutex mutex;
+  vector<LocalCounters *> live;
+  /// Of the exited threads and the phase timers
+  StatCounters retired;
+};
+
+/// Add the time from construction to destruction to a phase
+class ScopedPhaseTimer {
+public:
+  explicit ScopedPhaseTimer(EStatPhase phase)
+      : phase(phase), start(std::chrono::steady_clock::now()) {}
+  ~ScopedPhaseTimer() {
+    const std::chrono::duration<Double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    Statistics::addPhaseTime(phase, elapsed.count());
+  }
+
+  ScopedPhaseTimer(const ScopedPhaseTimer &)            = delete;
+  ScopedPhaseTimer &operator=(const ScopedPhaseTimer &) = delete;
+
+private:
+  EStatPhase phase;
+  std::chrono::steady_clock::time_point start;
+};
+
+#define RDR_STAT_CONCAT_IMPL(a, b) a##b
+#define RDR_STAT_CONCAT(a, b)      RDR_STAT_CONCAT_IMPL(a, b)
+
+#ifdef USE_STATS
+#define RDR_STAT_ADD(counter, value)                           \
+  do {                                                         \
+    ::RDR_NAMESPACE_NAME::Statistics::Local().add(             \
+        ::RDR_NAMESPACE_NAME::EStatCounter::counter, (value)); \
+  } while (false)
+#define RDR_STAT_PATH_LENGTH(length)                                 \
+  do {                                                               \
+    ::RDR_NAMESPACE_NAME::Statistics::Local().addPathLength(length); \
+  } while (false)
+#define RDR_STAT_PHASE(phase)                             \
+  ::RDR_NAMESPACE_NAME::ScopedPhaseTimer RDR_STAT_CONCAT( \
+      stat_phase_timer_, __LINE__)(::RDR_NAMESPACE_NAME::EStatPhase::phase)
+#else
+// sizeof keeps the accumulators of the callers used without evaluating them
+#define RDR_STAT_ADD(counter, value) \
+  do {                               \
+    (void)sizeof(value);             \
+  } while (false)
+#define RDR_STAT_PATH_LENGTH(length) \
+  do {                               \
+    (void)sizeof(length);            \
+  } while (false)
+#define RDR_STAT_PHASE(phase)
+#endif
+
+#define RDR_STAT_INC(counter) RDR_STAT_ADD(counter, 1)
+
+RDR_NAMESPACE_END
+
+#endif
@@ -1,7 +1,11 @@
 #ifndef __STD_H__
 #define __STD_H__
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <memory_resource>
+#include <vector>
 
 #include "rdr/platform.h"
 
@@ -139,6 +143,92 @@ private:
   }
 };
 
+/**
+ * @brief A bump allocator for the temporaries of a pixel sample, e.g. the
+ * interactions of the paths. Deallocation does nothing, and reset() releases
+ * everything at once while keeping the blocks, so a worker stops allocating
+ * from upstream once it has drawn its largest sample. Not thread-safe; every
+ * worker has its own through ThreadLocal().
+ */
+class ScratchArena final : public std::pmr::memory_resource {
+public:
+  explicit ScratchArena(size_t block_size = 64 * 1024,
+      std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+      : upstream(upstream), block_size(block_size) {}
+  ~ScratchArena() override {
+    for (const auto &block : blocks)
+      upstream->deallocate(block.data, block.size, alignof(std::max_align_t));
+  }
+
+  ScratchArena(const ScratchArena &)            = delete;
+  ScratchArena &operator=(const ScratchArena &) = delete;
+
+  /// The arena of the calling thread
+  static ScratchArena &ThreadLocal() {  // NOLINT
+    thread_local ScratchArena arena;
+    return arena;
+  }
+
+  /// Release everything allocated since the last reset
+  void reset() {
+    current = 0;
+    offset  = 0;
+  }
+
+  /// The number of blocks taken from upstream, which is constant in the steady
+  /// state
+  size_t getNumUpstreamAllocations() const { return blocks.size(); }
+
+  size_t getFootprint() const {
+    size_t footprint = 0;
+    for (const auto &block : blocks) footprint += block.size;
+    return footprint;
+  }
+
+private:
+  struct Block {
+    std::byte *data;
+    size_t size;
+  };
+
+  std::pmr::memory_resource *upstream;
+  size_t block_size;
+  std::vector<Block> blocks;
+  /// The block being bumped, and the bytes used in it
+  size_t current{0}, offset{0};
+
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    while (true) {
+      // The blocks are reused in order; the rest of a block too small for the
+      // request is skipped
+      for (; current < blocks.size(); ++current, offset = 0) {
+        const Block &block = blocks[current];
+        const auto address =
+            reinterpret_cast<std::uintptr_t>(block.data) + offset;
+        const size_t padding = (alignment - address % alignment) % alignment;
+        if (offset + padding + bytes > block.size) continue;
+
+        void *result = block.data + offset + padding;
+        offset += padding + bytes;
+        return result;
+      }
+
+      const size_t size = std::max(block_size, bytes + alignment);
+      blocks.push_back({static_cast<std::byte *>(upstream->allocate(
+                            size, alignof(std::max_align_t))),
+          size});
+      offset = 0;
+    }
+  }
+
+  void do_deallocate(void *, size_t, size_t) override {}
+
+  bool do_is_equal(
+      const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
 // A naive implementation
 // ref means that the lifetime of the object is guaranteed if you owns
 // this ref<T>. In our case, it is implemented with a global memory pool for
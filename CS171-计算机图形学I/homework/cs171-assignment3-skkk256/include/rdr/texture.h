@@ -132,6 +132,8 @@ private:
  * - (1, 0) corresponds to the right of the upper-left corner, etc.
  * - data is stored in row-major order, i.e. elements in the same row are
  *  continuous in memory
+ *
+ * The texels are only kept by the MIPMap, in half floats if "half" is set.
  */
 class ImageTexture final : public Texture {
 public:
@@ -152,7 +154,6 @@ public:
   // --
 
   virtual ~ImageTexture() = default;
-  const Float *getData() const { return data.data(); }
 
   int getWidth() const { return width; }
   int getHeight() const { return height; }
@@ -164,7 +165,6 @@ public:
 protected:
   int width, height;
 
-  vector<Float> data;
   ref<MIPMap> mipmap;
   ref<TexCoordinateGenerator> texmap;
 };
@@ -0,0 +1,131 @@
+/**
+ * @file wavefront.h
+ * @brief A path tracer that advances a wave of paths stage by stage instead of
+ * tracing each path to its end. The stages run over coherent batches, i.e.
+ * all rays of a bounce are intersected together, and the hits are shaded
+ * material by material.
+ */
+#ifndef __WAVEFRONT_H__
+#define __WAVEFRONT_H__
+
+#include "rdr/integrator.h"
+
+RDR_NAMESPACE_BEGIN
+
+/**
+ * @brief The states of the paths in a wave, as a structure of arrays indexed
+ * by the path. Only the arrays touched by a stage are brought into cache.
+ */
+struct WavefrontPathStates {
+  void resize(int n_paths);
+
+  /// The pixel, the sample index and the next sampler dimension, from which
+  /// the sampler of a path is restored in every stage
+  vector<Vec2i> pixel;
+  vector<int> sample_index;
+  vector<int> dimension;
+  vector<Vec2f> pixel_sample;
+
+  /// The ray to intersect, and the vertex it leaves from
+  vector<DifferentialRay> ray;
+  vector<SurfaceInteraction> interaction;
+  vector<int> bounces;
+  vector<Float> bsdf_pdf;
+
+  /// The throughput, including the Russian roulette weight, and the radiance
+  vector<Vec3f> beta;
+  vector<Vec3f> L;  // NOLINT
+
+  /// The next event estimation pending on a shadow test
+  vector<Ray> shadow_ray;
+  vector<Vec3f> shadow_L;  // NOLINT
+
+  /// Whether the path stays in the queue built from the stage
+  vector<uint8_t> active;
+};
+
+/**
+ * @brief The wavefront counterpart of IncrementalPathIntegrator, with the same
+ * properties and estimator. wave_size paths are in flight at a time, and each
+ * bounce runs the stages
+ * - intersect: all rays of the wave, handling the emitters hit
+ * - shade: the hits sorted by material; Russian roulette, light sampling and
+ *   BSDF sampling, which produce the shadow rays and the next rays
+ * - shadow: all shadow rays of the wave
+ * followed by accumulating the wave into the film, tile by tile in parallel.
+ * The samples of each path are drawn in the same order as by
+ * IncrementalPathIntegrator.
+ */
+class WavefrontPathIntegrator final : public Integrator {
+public:
+  using IntegratorProfile = IncrementalPathIntegrator::IntegratorProfile;
+
+  WavefrontPathIntegrator(const Properties &props);
+
+  /// @see Integrator::render
+  void render(ref<Camera> camera, ref<Scene> scene) override;
+
+  // ++ Required by Object
+  std::string toString() const override {
+    return format(
+        "WavefrontPathIntegrator[\n"
+        "  max_depth    = {}\n"
+        "  spp          = {}\n"
+        "  rr_threshold = {}\n"
+        "  wave_size    = {}\n"
+        "  sampler      = {}\n"
+        "]",
+        max_depth, spp, rr_threshold, wave_size, sampler_type);
+  }
+  // --
+
+private:
+  int max_depth, spp;
+  Float rr_threshold;
+  IntegratorProfile profile;
+
+  /// Side length of the FilmTiles a wave is accumulated in
+  constexpr static int FILM_TILE_SIZE = 16;
+
+  /// Number of workers, where non-positive means all hardware threads
+  int threads;
+  /// The number of paths in flight
+  int wave_size;
+
+  std::string sampler_type;
+  ref<Sampler> sampler;
+
+  WavefrontPathStates states;
+
+  /// The paths processed by the next stage
+  vector<int> ray_queue, hit_queue, shadow_queue;
+
+  /// Start the paths [begin, begin + n) of the whole image, and fill the ray
+  /// queue with their camera rays
+  void generateCameraRays(const Camera &camera, const Vec2i &resolution,
+      int64_t begin, int n, vector<ref<Sampler>> &samplers);
+
+  /// Intersect the rays of ray_queue; the paths hitting a non-emitter are
+  /// moved to hit_queue
+  void intersect(const ref<Scene> &scene, bool camera_rays);
+
+  /// Shade the hits of hit_queue; the continuing paths are moved to ray_queue,
+  /// and the light samples to shadow_queue
+  void shade(const ref<Scene> &scene, vector<ref<Sampler>> &samplers);
+
+  /// Add the light samples of shadow_queue that are not occluded
+  void traceShadowRays(const ref<Scene> &scene);
+
+  /// Accumulate the paths [begin, begin + n) of the whole image into the film.
+  /// The paths of a pixel are committed in the order of their samples
+  void commitWave(Film &film, const Vec2i &resolution, int64_t begin, int n);
+
+  /// Move the paths of queue with the active flag to target, in order
+  void compact(const vector<int> &queue, vector<int> &target) const;
+};
+
+RDR_REGISTER_CLASS(WavefrontPathIntegrator)
+
+RDR_NAMESPACE_END
+
+#endif
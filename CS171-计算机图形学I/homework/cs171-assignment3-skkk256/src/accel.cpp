@@ -4,7 +4,9 @@
 #include "rdr/interaction.h"
 #include "rdr/math_aliases.h"
 #include "rdr/platform.h"
+#include "rdr/ray.h"
 #include "rdr/shape.h"
+#include "rdr/stats.h"
 
 RDR_NAMESPACE_BEGIN
 
@@ -55,70 +57,151 @@ bool AABB::intersect(const Ray &ray, Float *t_in, Float *t_out) const {
  *
  * ===================================================================== */
 
+WatertightRay::WatertightRay(const Ray &ray) : origin(ray.origin) {
+  const Vec3f &d = ray.direction;
+  kz = ArgMax(Vec3f(abs(d.x), abs(d.y), abs(d.z)));
+  kx = (kz + 1) % 3;
+  ky = (kx + 1) % 3;
+  // Mirroring z below flips the winding; swap x and y to flip it back
+  if (d[kz] < 0) std::swap(kx, ky);
+  sx = d[kx] / d[kz];
+  sy = d[ky] / d[kz];
+  sz = 1 / d[kz];
+}
+
+bool WatertightTriangleIntersect(const WatertightRay &ray, const Vec3f &p0,
+    const Vec3f &p1, const Vec3f &p2, Float t_min, Float t_max, Float *t,
+    Vec3f *barycentric) {
+  RDR_STAT_INC(ETriangleTests);
+
+  // Translate to the ray origin, then shear the ray direction into +z
+  const Vec3f a = p0 - ray.origin;
+  const Vec3f b = p1 - ray.origin;
+  const Vec3f c = p2 - ray.origin;
+  const Float ax = a[ray.kx] - ray.sx * a[ray.kz];
+  const Float ay = a[ray.ky] - ray.sy * a[ray.kz];
+  const Float bx = b[ray.kx] - ray.sx * b[ray.kz];
+  const Float by = b[ray.ky] - ray.sy * b[ray.kz];
+  const Float cx = c[ray.kx] - ray.sx * c[ray.kz];
+  const Float cy = c[ray.ky] - ray.sy * c[ray.kz];
+
+  // The scaled barycentric coordinates are the 2D edge functions. A
+  // neighbouring triangle evaluates its shared edge with the same operands, so
+  // the ray cannot slip through between them
+  Float u = cx * by - cy * bx;
+  Float v = ax * cy - ay * cx;
+  Float w = bx * ay - by * ax;
+  if (u == 0 || v == 0 || w == 0) {
+    // Exactly on an edge; fall back to double to break the tie consistently
+    u = static_cast<Float>(Double(cx) * by - Double(cy) * bx);
+    v = static_cast<Float>(Double(ax) * cy - Double(ay) * cx);
+    w = static_cast<Float>(Double(bx) * ay - Double(by) * ax);
+  }
+
+  // Single-sided: the back faces and the triangles seen edge-on are culled
+  if (u < 0 || v < 0 || w < 0) return false;
+  const Float det = u + v + w;
+  if (det <= 0) return false;
+
+  const Float az    = ray.sz * a[ray.kz];
+  const Float bz    = ray.sz * b[ray.kz];
+  const Float cz    = ray.sz * c[ray.kz];
+  const Float inv   = 1 / det;
+  const Float t_hit = (u * az + v * bz + w * cz) * inv;
+  if (t_hit < t_min || t_hit > t_max) return false;
+
+  *t           = t_hit;
+  *barycentric = Vec3f(u * inv, v * inv, w * inv);
+  return true;
+}
+
 bool TriangleIntersect(Ray &ray, const uint32_t &triangle_index,
     const ref<TriangleMeshResource> &mesh, SurfaceInteraction &interaction) {
-  using InternalScalarType = Double;
-  using InternalVecType    = Vec<InternalScalarType, 3>;
-
   AssertAllValid(ray.direction, ray.origin);
   AssertAllNormalized(ray.direction);
 
-  const auto &vertices = mesh->vertices;
   const Vec3u v_idx(&mesh->v_indices[3 * triangle_index]);
   assert(v_idx.x < mesh->vertices.size());
   assert(v_idx.y < mesh->vertices.size());
   assert(v_idx.z < mesh->vertices.size());
 
-  InternalVecType dir = Cast<InternalScalarType>(ray.direction);
-  InternalVecType v0  = Cast<InternalScalarType>(vertices[v_idx[0]]);
-  InternalVecType v1  = Cast<InternalScalarType>(vertices[v_idx[1]]);
-  InternalVecType v2  = Cast<InternalScalarType>(vertices[v_idx[2]]);
-
-  // TODO: fill in your implementation here.
-  // Some of the code is already provided for you. You are free to discard them.
-  // Calculate these scalars from the above information.
-  // You can replace `InternalScalarType`, etc. with, for example, float or
-  // double.
-  InternalScalarType u, v, t /* fill them with correct values */;
-  // Calculate the determinant of the matrix
-  InternalVecType O = Cast<InternalScalarType>(ray.origin);
-  InternalVecType T = O - v0;
-  InternalVecType E1 = v1 - v0;
-  InternalVecType E2 = v2 - v0;
-  InternalVecType P = Cross(dir, E2);
-  InternalVecType Q = Cross(T, E1);
-  InternalScalarType det = Dot(P, E1);
-
-  if (det < 0.00000001) {
+  Float t;
+  Vec3f barycentric;
+  if (!WatertightTriangleIntersect(WatertightRay(ray),
+          mesh->vertices[v_idx[0]], mesh->vertices[v_idx[1]],
+          mesh->vertices[v_idx[2]], ray.t_min, ray.t_max, &t, &barycentric))
     return false;
-  }
 
-  InternalScalarType ndet = 1.0 / det;
-
-  t = ndet * Dot(Q, E2);
-  u = ndet * Dot(P, T);
-  v = ndet * Dot(Q, dir);
-
-  // Termination conditions
-  if (u < 0 || u > 1) return false;
-  if (v < 0 || u + v > 1) return false;
-  if (t < ray.t_min || t > ray.t_max) return false;
-
-  // Export related information
-  // 1. If mesh->has_texture, calculate the texture coordinates
-  // 2. If mesh->has_normal, calculate the normal
-  // you don't have to consider this part.
-  CalculateTriangleDifferentials(interaction,
-      {static_cast<Float>(1 - u - v), static_cast<Float>(u),
-          static_cast<Float>(v)},
-      mesh, triangle_index);
+  CalculateTriangleDifferentials(
+      interaction, barycentric, mesh, triangle_index);
   AssertNear(interaction.p, ray(t));
   assert(ray.withinTimeRange(t));
-  ray.setTimeMax(static_cast<Float>(t));
+  ray.setTimeMax(t);
 
   return true;
 }
 
+void TriangleSoA::build(const TriangleMeshResource &mesh) {
+  assert(mesh.v_indices.size() % 3 == 0);
+  n_triangles = mesh.v_indices.size() / 3;
+  blocks.assign((n_triangles + 3) / 4, Block{});
+  for (size_t i = 0; i < n_triangles; ++i) {
+    Block &block = blocks[i / 4];
+    for (int k = 0; k < 3; ++k) {
+      const Vec3f &vertex = mesh.vertices[mesh.v_indices[3 * i + k]];
+      for (int d = 0; d < 3; ++d) block.p[k][d][i % 4] = vertex[d];
+    }
+  }
+}
+
+bool TriangleSoA::intersect(const WatertightRay &watertight_ray, Ray &ray,
+    uint32_t triangle_index, TriangleHit &hit) const {
+  assert(triangle_index < n_triangles);
+  Float t;
+  if (!WatertightTriangleIntersect(watertight_ray,
+          getVertex(triangle_index, 0), getVertex(triangle_index, 1),
+          getVertex(triangle_index, 2), ray.t_min, ray.t_max, &t,
+          &hit.barycentric))
+    return false;
+
+  hit.triangle_index = triangle_index;
+  ray.setTimeMax(t);
+  return true;
+}
+
+bool TriangleSoA::occluded(const WatertightRay &watertight_ray,
+    const Ray &ray, uint32_t triangle_index) const {
+  assert(triangle_index < n_triangles);
+  Float t;
+  Vec3f barycentric;
+  return WatertightTriangleIntersect(watertight_ray,
+      getVertex(triangle_index, 0), getVertex(triangle_index, 1),
+      getVertex(triangle_index, 2), ray.t_min, ray.t_max, &t, &barycentric);
+}
+
+uint32_t TriangleSoA::intersectPacket(const WatertightRay *watertight_rays,
+    RayPacket &packet, uint32_t mask, uint32_t triangle_index,
+    TriangleHit *hits) const {
+  assert(triangle_index < n_triangles);
+  const Vec3f p0  = getVertex(triangle_index, 0);
+  const Vec3f p1  = getVertex(triangle_index, 1);
+  const Vec3f p2  = getVertex(triangle_index, 2);
+  uint32_t result = 0;
+  for (int i = 0; i < packet.n_rays; ++i) {
+    const uint32_t lane = uint32_t(1) << i;
+    if (!(mask & lane)) continue;
+    Ray &ray = packet.rays[i];
+    Float t;
+    if (!WatertightTriangleIntersect(watertight_rays[i], p0, p1, p2,
+            ray.t_min, ray.t_max, &t, &hits[i].barycentric))
+      continue;
+    hits[i].triangle_index = triangle_index;
+    ray.setTimeMax(t);
+    result |= lane;
+  }
+  return result;
+}
+
 void Accel::setTriangleMesh(const ref<TriangleMeshResource> &mesh) {
   // Build the bounding box
   AABB bound(Vec3f(Float_INF, Float_INF, Float_INF),
@@ -130,19 +213,55 @@ void Accel::setTriangleMesh(const ref<TriangleMeshResource> &mesh) {
 
   this->mesh  = mesh;   // set the pointer
   this->bound = bound;  // set the bounding box
+  triangles.build(*mesh);
+}
+
+void Accel::commitHit(
+    const TriangleHit &hit, SurfaceInteraction &interaction) const {
+  CalculateTriangleDifferentials(
+      interaction, hit.barycentric, mesh, hit.triangle_index);
 }
 
 void Accel::build() {}
 
+bool Accel::serialize(vector<uint8_t> &data) const {
+  return false;
+}
+
+bool Accel::deserialize(const uint8_t *data, size_t size) {
+  return false;
+}
+
 AABB Accel::getBound() const {
   return bound;
 }
 
 bool Accel::intersect(Ray &ray, SurfaceInteraction &interaction) const {
+  const WatertightRay watertight_ray(ray);
+  TriangleHit hit;
   bool success = false;
-  for (int i = 0; i < mesh->v_indices.size() / 3; i++)
-    success |= TriangleIntersect(ray, i, mesh, interaction);
+  for (uint32_t i = 0; i < triangles.size(); i++)
+    success |= triangles.intersect(watertight_ray, ray, i, hit);
+  if (success) commitHit(hit, interaction);
   return success;
 }
 
+bool Accel::occluded(const Ray &ray) const {
+  const WatertightRay watertight_ray(ray);
+  for (uint32_t i = 0; i < triangles.size(); i++)
+    if (triangles.occluded(watertight_ray, ray, i)) return true;
+  return false;
+}
+
+uint32_t Accel::intersectPacket(RayPacket &packet, uint32_t mask,
+    SurfaceInteraction *interactions) const {
+  uint32_t result = 0;
+  for (int i = 0; i < packet.n_rays; ++i) {
+    const uint32_t lane = uint32_t(1) << i;
+    if ((mask & lane) && intersect(packet.rays[i], interactions[i]))
+      result |= lane;
+  }
+  return result;
+}
+
 RDR_NAMESPACE_END
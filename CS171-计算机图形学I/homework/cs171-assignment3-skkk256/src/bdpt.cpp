@@ -0,0 +1,487 @@
+#include "rdr/bdpt.h"
+
+#include "rdr/bsdf.h"
+#include "rdr/camera.h"
+#include "rdr/film.h"
+#include "rdr/light.h"
+#include "rdr/properties.h"
+#include "rdr/scene.h"
+
+RDR_NAMESPACE_BEGIN
+
+namespace detail_ {
+/// Replace *target by value, and restore it when going out of scope. Nothing
+/// is replaced if target is nullptr
+template <typename T>
+class ScopedAssignment {
+public:
+  ScopedAssignment(T *target, const T &value) : target(target) {
+    if (target == nullptr) return;
+    backup  = *target;
+    *target = value;
+  }
+  ~ScopedAssignment() {
+    if (target != nullptr) *target = backup;
+  }
+
+  ScopedAssignment(const ScopedAssignment &)            = delete;
+  ScopedAssignment &operator=(const ScopedAssignment &) = delete;
+
+private:
+  T *target;
+  T backup;
+};
+
+/// The vertex buffers of the subpaths of a worker, which only grow
+struct BDPTArena {
+  vector<Vertex> camera_vertices, light_vertices;
+};
+
+static BDPTArena &GetBDPTArena(int max_depth) {
+  thread_local BDPTArena arena;
+  if (static_cast<int>(arena.camera_vertices.size()) < max_depth + 1) {
+    arena.camera_vertices.resize(max_depth + 1);
+    arena.light_vertices.resize(max_depth);
+  }
+  return arena;
+}
+
+/// The geometry term between a and b, where b may be on the infinite light.
+/// The cosine at the camera is left to its importance
+static Float G(const Vertex &a, const Vertex &b) {
+  const Vec3f w = a.directionTo(b);
+  Float g       = b.isInfiniteLight() ? 1 : 1 / SquareNorm(b.p() - a.p());
+  if (a.isOnSurface()) g *= std::abs(Dot(a.interaction.shading.n, w));
+  if (b.isOnSurface()) g *= std::abs(Dot(b.interaction.shading.n, w));
+  return g;
+}
+
+/// Map the zero pdfs of the delta vertices to one, so they cancel out
+static Float Remap0(Float pdf) { return pdf != 0 ? pdf : 1; }
+}  // namespace detail_
+
+/* ===================================================================== *
+ *
+ * Vertex
+ *
+ * ===================================================================== */
+
+Vertex Vertex::CreateCamera(const Camera &camera, const Vec3f &beta) {
+  Vertex vertex;
+  vertex.type   = EVertexType::ECamera;
+  vertex.camera = &camera;
+  vertex.beta   = beta;
+  vertex.interaction.setGeneral(camera.position, Normalize(camera.forward));
+  return vertex;
+}
+
+Vertex Vertex::CreateLight(
+    const SurfaceInteraction &interaction, const Vec3f &beta, Float pdf) {
+  Vertex vertex;
+  vertex.type        = EVertexType::ELight;
+  vertex.interaction = interaction;
+  vertex.beta        = beta;
+  vertex.pdf_fwd     = pdf;
+  return vertex;
+}
+
+Vertex Vertex::CreateSurface(const SurfaceInteraction &interaction,
+    const Vec3f &beta, Float pdf, const Vertex &prev) {
+  Vertex vertex;
+  vertex.interaction = interaction;
+  vertex.beta        = beta;
+  vertex.pdf_fwd     = prev.convertDensity(pdf, vertex);
+  return vertex;
+}
+
+Vec3f Vertex::directionTo(const Vertex &next) const {
+  // The infinite light only has the direction it is seen from
+  if (next.isInfiniteLight()) return -next.interaction.wo;
+  return Normalize(next.p() - p());
+}
+
+Vec3f Vertex::f(const Vertex &next) const {
+  auto scattering = interaction;
+  if (interaction.isRadiance()) {
+    scattering.wi = directionTo(next);
+  } else {
+    scattering.wi = interaction.wo;
+    scattering.wo = directionTo(next);
+  }
+  return scattering.bsdf->evaluate(scattering);
+}
+
+Vec3f Vertex::Le() const {
+  if (!isLight()) return Vec3f(0.0);
+  return interaction.light->Le(interaction, interaction.wo);
+}
+
+Float Vertex::convertDensity(Float pdf, const Vertex &next) const {
+  if (next.isInfiniteLight()) return pdf;
+  const Vec3f w         = next.p() - p();
+  const Float distance2 = SquareNorm(w);
+  if (distance2 == 0) return 0;
+  if (next.isOnSurface())
+    pdf *= std::abs(Dot(next.interaction.normal, w)) / std::sqrt(distance2);
+  return pdf / distance2;
+}
+
+Float Vertex::pdf(const Vertex *prev, const Vertex &next) const {
+  if (isLight()) return pdfLight(next);
+
+  const Vec3f w = directionTo(next);
+  Float pdf_dir = 0;
+  if (type == EVertexType::ECamera) {
+    camera->pdf(Ray(p(), w), nullptr, &pdf_dir);
+  } else {
+    auto scattering = interaction;
+    if (prev != nullptr) scattering.wo = directionTo(*prev);
+    scattering.wi = w;
+    pdf_dir       = scattering.bsdf->pdf(scattering);
+  }
+  return convertDensity(pdf_dir, next);
+}
+
+Float Vertex::pdfLight(const Vertex &next) const {
+  // The infinite light starts no light subpath
+  if (isInfiniteLight()) return 0;
+  const Vec3f w         = next.p() - p();
+  const Float distance2 = SquareNorm(w);
+  if (distance2 == 0) return 0;
+  const Vec3f direction = w / std::sqrt(distance2);
+  Float pdf = interaction.light->pdfDirection(interaction, direction) /
+              distance2;
+  if (next.isOnSurface())
+    pdf *= std::abs(Dot(next.interaction.normal, direction));
+  return pdf;
+}
+
+Float Vertex::pdfLightOrigin(const Scene &scene) const {
+  return scene.pdfEmitterDiscrete(interaction) *
+         interaction.light->pdf(interaction);
+}
+
+/* ===================================================================== *
+ *
+ * SubPath
+ *
+ * ===================================================================== */
+
+Vec3f SubPath::estimate() const {
+  if (n_vertices < 2) return Vec3f(0.0);
+  const Vertex &light = vertices[n_vertices - 1];
+  return light.beta * light.Le() * mis_weight * rr_weight;
+}
+
+bool SubPath::verify() const {
+  bool result = true;
+  for (int i = 1; i < n_vertices - 1; ++i) {
+    const auto &interaction = vertices[i].interaction;
+    result &= interaction.bsdf != nullptr;
+    result &= AllClose(interaction.wi, -vertices[i + 1].interaction.wo);
+  }
+  return result;
+}
+
+std::string SubPath::toString() const {
+  std::ostringstream ss;
+  ss << "SubPath[";
+  for (int i = 0; i < n_vertices; ++i) {
+    const Vertex &vertex = vertices[i];
+    if (vertex.type == EVertexType::ECamera) {
+      ss << "E";
+    } else if (vertex.isLight()) {
+      ss << (vertex.isInfiniteLight() ? "IL" : "L");
+    } else {
+      ss << (vertex.delta ? "S" : "D");
+    }
+
+    ss << "[p" << ToString(vertex.p()) << ", ";
+    ss << "beta" << ToString(vertex.beta) << "]";
+    if (i < n_vertices - 1) ss << " -> ";
+  }
+
+  ss << "]";
+  return ss.str();
+}
+
+/* ===================================================================== *
+ *
+ * BidirectionalPathIntegrator
+ *
+ * ===================================================================== */
+
+void BidirectionalPathIntegrator::render(
+    ref<Camera> in_camera, ref<Scene> scene) {
+  camera = in_camera.get();
+  film   = in_camera->getFilm().get();
+  PathIntegrator::render(in_camera, scene);
+  if (!progressive.enabled) return;
+
+  // The splats are scaled for spp samples in every pixel, while the pixels
+  // have taken any number of samples
+  const Vec2i resolution = film->getResolution();
+  int64_t n_samples      = 0;
+  for (int y = 0; y < resolution.y; ++y)
+    for (int x = 0; x < resolution.x; ++x)
+      n_samples += film->getPixelStatistics(x, y).n_samples;
+  if (n_samples == 0) return;
+
+  const Float scale = static_cast<Float>(spp) * resolution.x * resolution.y /
+                      static_cast<Float>(n_samples);
+  for (int y = 0; y < resolution.y; ++y)
+    for (int x = 0; x < resolution.x; ++x) film->getLightPixel(x, y) *= scale;
+}
+
+Vec3f BidirectionalPathIntegrator::Li(  // NOLINT
+    ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const {
+  return Li(scene, ray, sampler, false, SurfaceInteraction());
+}
+
+Vec3f BidirectionalPathIntegrator::Li(ref<Scene> scene,  // NOLINT
+    DifferentialRay &ray, Sampler &sampler, bool intersected,
+    const SurfaceInteraction &interaction) const {
+  auto &arena = detail_::GetBDPTArena(max_depth);
+  SubPath camera_path(ray, this, arena.camera_vertices.data(), max_depth + 1);
+  SubPath light_path(ray, this, arena.light_vertices.data(), max_depth);
+
+  // The camera ray carries the importance of the pixel as a whole
+  Float pdf_dir = 0;
+  camera->pdf(ray, nullptr, &pdf_dir);
+  camera_path.addVertex(Vertex::CreateCamera(*camera, Vec3f(1.0)));
+  randomWalk(*scene, ray, sampler, Vec3f(1.0), pdf_dir,
+      ETransportMode::ERadiance, camera_path, intersected, interaction);
+  generateLightSubpath(*scene, sampler, light_path);
+
+  Vec3f L(0.0);  // NOLINT
+  const int n_camera = camera_path.length();
+  if (camera_path[n_camera - 1].isLight()) {
+    camera_path.setMisWeight(
+        misWeight(*scene, light_path, camera_path, Vertex(), 0, n_camera));
+    L += camera_path.estimate();
+  }
+
+  // A light is sampled for s = 1 even if the light subpath is empty, which
+  // happens when it would start on the infinite light
+  const int n_light = std::max(light_path.length(), 1);
+  for (int t = 1; t <= n_camera; ++t) {
+    for (int s = 1; s <= n_light; ++s) {
+      // The vertices after the camera are bounded by max_depth, as in Path
+      if ((s == 1 && t == 1) || s + t - 1 > max_depth) continue;
+      L += connect(*scene, light_path, camera_path, s, t, sampler);
+    }
+  }
+
+  return L;
+}
+
+void BidirectionalPathIntegrator::randomWalk(const Scene &scene, Ray ray,
+    Sampler &sampler, Vec3f beta, Float pdf, ETransportMode mode,
+    SubPath &path, bool intersected,
+    const SurfaceInteraction &interaction) const {
+  Float pdf_fwd = pdf;
+  for (int bounce = 0; !path.isFull(); ++bounce) {
+    Vertex &prev = path[path.length() - 1];
+
+    SurfaceInteraction hit;
+    if (bounce == 0 && intersected) {
+      hit = interaction;
+    } else if (!scene.intersect(ray, hit)) {
+      // Only the camera subpaths reach the infinite light
+      if (mode == ETransportMode::ERadiance && scene.hasInfiniteLight()) {
+        const auto light_interaction =
+            scene.getInfiniteLight()->sampleFromOutgoingDirection(
+                -ray.direction);
+        path.addVertex(
+            Vertex::CreateSurface(light_interaction, beta, pdf_fwd, prev));
+      }
+      break;
+    }
+
+    if (!hit.isLight() && !hit.isValid()) break;
+    // The emission of a light hit by a light subpath is never connected
+    if (hit.isLight() && mode == ETransportMode::EImportance) break;
+
+    hit.mode       = mode;
+    Vertex &vertex = path.addVertex(
+        Vertex::CreateSurface(hit, beta, pdf_fwd, prev));
+    if (hit.isLight() || path.isFull()) break;
+
+    SurfaceInteraction &scattering = vertex.interaction;
+    const Vec3f f = scattering.bsdf->sample(scattering, sampler, &pdf_fwd);
+    if (SquareNorm(f) < EPS || !(pdf_fwd > 0)) break;
+    beta *= f * std::abs(scattering.cosThetaI()) / pdf_fwd;
+
+    // The pdf of sampling the other way round, i.e. towards prev
+    Float pdf_rev = 0;
+    if (scattering.isSpecular()) {
+      vertex.delta = true;
+      pdf_fwd      = 0;
+    } else {
+      auto reversed = scattering;
+      reversed.wi   = scattering.wo;
+      reversed.wo   = scattering.wi;
+      pdf_rev       = reversed.bsdf->pdf(reversed);
+    }
+    prev.pdf_rev = vertex.convertDensity(pdf_rev, prev);
+
+    if (bounce > 0) {
+      if (sampler.get1D() < rr_threshold) break;
+      beta /= 1.0_F - rr_threshold;
+    }
+    ray = scattering.spawnRay(scattering.wi);
+  }
+}
+
+void BidirectionalPathIntegrator::generateLightSubpath(
+    const Scene &scene, Sampler &sampler, SubPath &path) const {
+  // Choose a light by its power, then a point and a direction on it, as the
+  // photons are. The infinite light is left to the camera subpaths
+  Float light_pmf = 0;
+  auto light      = scene.sampleEmitterDiscrete(sampler, &light_pmf);
+  if (light.get() == scene.getInfiniteLight().get()) return;
+
+  const SurfaceInteraction light_interaction = light->sample(sampler);
+  Float direction_pdf = 0;
+  const Vec3f direction =
+      light->sampleDirection(light_interaction, sampler, direction_pdf);
+  const Float pdf = light_pmf * light_interaction.pdf;
+  if (!(pdf > 0) || !(direction_pdf > 0)) return;
+
+  const Vec3f Le = light->Le(light_interaction, direction);  // NOLINT
+  path.addVertex(Vertex::CreateLight(light_interaction, Le / pdf, pdf));
+  const Vec3f beta = Le * std::abs(Dot(direction, light_interaction.normal)) /
+                     (pdf * direction_pdf);
+  randomWalk(scene, light_interaction.spawnRay(direction), sampler, beta,
+      direction_pdf, ETransportMode::EImportance, path, false,
+      SurfaceInteraction());
+}
+
+Vec3f BidirectionalPathIntegrator::connect(const Scene &scene,
+    SubPath &light_path, SubPath &camera_path, int s, int t,
+    Sampler &sampler) const {
+  Vertex sampled;
+  if (t == 1) {
+    // Connect the light subpath to the camera, landing on some pixel
+    const Vertex &qs = light_path[s - 1];
+    if (!qs.isConnectible()) return Vec3f(0.0);
+
+    Vec2f pixel;
+    Float pdf_w    = 0;
+    const Vec3f We = camera->sampleWithRef(qs.p(), &pixel, &pdf_w);  // NOLINT
+    if (!(pdf_w > 0) || SquareNorm(We) == 0) return Vec3f(0.0);
+    sampled = Vertex::CreateCamera(*camera, We / pdf_w);
+
+    const Vec3f L = qs.beta * qs.f(sampled) * sampled.beta *  // NOLINT
+                    std::abs(Dot(qs.interaction.shading.n,
+                        qs.directionTo(sampled)));
+    if (SquareNorm(L) == 0) return Vec3f(0.0);
+    if (scene.isBlocked(qs.interaction.spawnRayTo(sampled.p())))
+      return Vec3f(0.0);
+
+    const Float weight =
+        misWeight(scene, light_path, camera_path, sampled, s, t);
+    film->commitLightImageSplat(pixel, L * weight / spp);
+    return Vec3f(0.0);
+  }
+
+  const Vertex &pt = camera_path[t - 1];
+  if (!pt.isConnectible()) return Vec3f(0.0);
+  if (s == 1) {
+    // Sample a point on a light instead of taking the first light vertex
+    Float light_pmf = 0;
+    auto light      = scene.sampleEmitterDiscrete(sampler, &light_pmf);
+    auto ref_interaction = pt.interaction;
+    const SurfaceInteraction light_interaction =
+        light->sample(ref_interaction, sampler);
+    const Float pdf = light_pmf * light_interaction.pdf;
+    if (!(pdf > 0)) return Vec3f(0.0);
+    sampled = Vertex::CreateLight(light_interaction,
+        light->Le(light_interaction, light_interaction.wo) / pdf, pdf);
+  } else if (!light_path[s - 1].isConnectible()) {
+    return Vec3f(0.0);
+  }
+
+  const Vertex &qs = s == 1 ? sampled : light_path[s - 1];
+  Vec3f L = pt.beta * pt.f(qs) * qs.beta;  // NOLINT
+  if (s > 1) L *= qs.f(pt);
+  if (SquareNorm(L) == 0) return Vec3f(0.0);
+  L *= detail_::G(pt, qs);
+
+  const Ray shadow_ray = qs.isInfiniteLight()
+                           ? pt.interaction.spawnRay(pt.directionTo(qs))
+                           : pt.interaction.spawnRayTo(qs.p());
+  if (scene.isBlocked(shadow_ray)) return Vec3f(0.0);
+  return L * misWeight(scene, light_path, camera_path, sampled, s, t);
+}
+
+Float BidirectionalPathIntegrator::misWeight(const Scene &scene,
+    SubPath &light_path, SubPath &camera_path, const Vertex &sampled, int s,
+    int t) const {
+  using detail_::Remap0;
+  using detail_::ScopedAssignment;
+  if (s + t == 2) return 1;
+
+  Vertex *qs       = s > 0 ? &light_path[s - 1] : nullptr;
+  Vertex *pt       = &camera_path[t - 1];
+  Vertex *qs_minus = s > 1 ? &light_path[s - 2] : nullptr;
+  Vertex *pt_minus = t > 1 ? &camera_path[t - 2] : nullptr;
+
+  // The paths on the infinite light are only found by the camera subpaths
+  // reaching it and by sampling it at s = 1
+  if (s == 0 && pt->isInfiniteLight()) {
+    if (pt_minus->type == EVertexType::ECamera || pt_minus->delta) return 1;
+    const Float pdf_light = pt->pdfLightOrigin(scene);
+    return pt->pdf_fwd * pt->pdf_fwd /
+           (pt->pdf_fwd * pt->pdf_fwd + pdf_light * pdf_light);
+  }
+  if (s == 1 && sampled.isInfiniteLight()) {
+    const Float pdf_bsdf = pt->pdf(pt_minus, sampled);
+    return sampled.pdf_fwd * sampled.pdf_fwd /
+           (sampled.pdf_fwd * sampled.pdf_fwd + pdf_bsdf * pdf_bsdf);
+  }
+
+  // Turn the subpaths into those of this strategy until returning, i.e.
+  // replace the resampled endpoint, and update the pdfs of the vertices
+  // around the connection, which is never delta
+  ScopedAssignment<Vertex> endpoint(
+      s == 1 ? qs : (t == 1 ? pt : nullptr), sampled);
+  ScopedAssignment<bool> pt_delta(&pt->delta, false);
+  ScopedAssignment<bool> qs_delta(qs != nullptr ? &qs->delta : nullptr, false);
+  ScopedAssignment<Float> pt_rev(&pt->pdf_rev,
+      s > 0 ? qs->pdf(qs_minus, *pt) : pt->pdfLightOrigin(scene));
+  ScopedAssignment<Float> pt_minus_rev(
+      pt_minus != nullptr ? &pt_minus->pdf_rev : nullptr,
+      pt_minus == nullptr ? 0
+      : s > 0             ? pt->pdf(qs, *pt_minus)
+                          : pt->pdfLight(*pt_minus));
+  ScopedAssignment<Float> qs_rev(qs != nullptr ? &qs->pdf_rev : nullptr,
+      qs != nullptr ? pt->pdf(pt_minus, *qs) : 0);
+  ScopedAssignment<Float> qs_minus_rev(
+      qs_minus != nullptr ? &qs_minus->pdf_rev : nullptr,
+      qs_minus != nullptr ? qs->pdf(pt, *qs_minus) : 0);
+
+  // The ratios of the pdfs of the other strategies to this one, by moving the
+  // connection towards the camera, then towards the light
+  Float sum = 0, ratio = 1;
+  for (int i = t - 1; i > 0; --i) {
+    const Float r =
+        Remap0(camera_path[i].pdf_rev) / Remap0(camera_path[i].pdf_fwd);
+    ratio *= r * r;
+    if (!camera_path[i].delta && !camera_path[i - 1].delta) sum += ratio;
+  }
+
+  ratio = 1;
+  for (int i = s - 1; i >= 0; --i) {
+    const Float r =
+        Remap0(light_path[i].pdf_rev) / Remap0(light_path[i].pdf_fwd);
+    ratio *= r * r;
+    // No area light is delta
+    const bool delta_prev = i > 0 && light_path[i - 1].delta;
+    if (!light_path[i].delta && !delta_prev) sum += ratio;
+  }
+
+  return 1 / (1 + sum);
+}
+
+RDR_NAMESPACE_END
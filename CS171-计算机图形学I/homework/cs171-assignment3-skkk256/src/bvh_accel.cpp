@@ -8,15 +8,23 @@
 #include <embree4/rtcore_scene.h>
 #endif
 
+#include <chrono>
 #include <cstdlib>
 
 #include "rdr/interaction.h"
+#include "rdr/mesh_cache.h"
 #include "rdr/ray.h"
 #include "rdr/shape.h"
 
 RDR_NAMESPACE_BEGIN
 
+BVHAccel::BVHAccel(const Properties &props) : Accel(props) {
+  triangle_tree.setHeuristicProfile(ParseBVHHeuristicProfile(
+      props.getProperty<std::string>("heuristic", "median")));
+}
+
 void BVHAccel::setTriangleMesh(const ref<TriangleMeshResource> &mesh) {
+  Accel::setTriangleMesh(mesh);
   // extract information from mesh
   const uint32_t &num_triangles = mesh->v_indices.size() / 3;
   assert(mesh->v_indices.size() % 3 == 0);
@@ -25,7 +33,13 @@ void BVHAccel::setTriangleMesh(const ref<TriangleMeshResource> &mesh) {
 }
 
 void BVHAccel::build() {
+  const auto start = std::chrono::steady_clock::now();
   triangle_tree.build();
+  const auto end = std::chrono::steady_clock::now();
+  Info_("BVH built over {} triangles in {:.2f} ms, SAH cost {:.2f}",
+      triangle_tree.size(),
+      std::chrono::duration<double, std::milli>(end - start).count(),
+      triangle_tree.getSAHCost());
 }
 
 AABB BVHAccel::getBound() const {
@@ -33,14 +47,96 @@ AABB BVHAccel::getBound() const {
 }
 
 bool BVHAccel::intersect(Ray &ray, SurfaceInteraction &interaction) const {
+  const WatertightRay watertight_ray(ray);
+  TriangleHit hit;
   bool intersected = triangle_tree.intersect(ray,
-      [&interaction](Ray &local_ray, const detail_::Triangle &triangle)
-          -> bool { return triangle.intersect(local_ray, interaction); });
+      [&](Ray &local_ray, const detail_::Triangle &triangle) -> bool {
+        return triangles.intersect(
+            watertight_ray, local_ray, triangle.getIndex(), hit);
+      });
+  if (intersected) commitHit(hit, interaction);
   return intersected;
 }
 
+bool BVHAccel::occluded(const Ray &ray) const {
+  const WatertightRay watertight_ray(ray);
+  return triangle_tree.occluded(
+      ray, [&](Ray &local_ray, const detail_::Triangle &triangle) -> bool {
+        return triangles.occluded(
+            watertight_ray, local_ray, triangle.getIndex());
+      });
+}
+
+uint32_t BVHAccel::intersectPacket(RayPacket &packet, uint32_t mask,
+    SurfaceInteraction *interactions) const {
+  // The per-ray constants are computed once for the whole traversal
+  WatertightRay watertight_rays[RayPacket::SIZE];
+  TriangleHit hits[RayPacket::SIZE];
+  for (int i = 0; i < packet.n_rays; ++i)
+    if (mask & (uint32_t(1) << i))
+      watertight_rays[i] = WatertightRay(packet.rays[i]);
+
+  const uint32_t result = triangle_tree.intersectPacket(packet, mask,
+      [&](RayPacket &local_packet, uint32_t local_mask,
+          const detail_::Triangle &triangle) -> uint32_t {
+        return triangles.intersectPacket(watertight_rays, local_packet,
+            local_mask, triangle.getIndex(), hits);
+      });
+  for (int i = 0; i < packet.n_rays; ++i)
+    if (result & (uint32_t(1) << i)) commitHit(hits[i], interactions[i]);
+  return result;
+}
+
+bool BVHAccel::serialize(vector<uint8_t> &data) const {
+  const auto &data_nodes   = triangle_tree.getNodes();
+  const auto &linear_nodes = triangle_tree.getLinearNodes();
+  BinaryWriter writer(data);
+  writer.write(SERIAL_TAG);
+  writer.write(static_cast<uint32_t>(data_nodes.size()));
+  writer.write(static_cast<uint32_t>(linear_nodes.size()));
+  // The triangles in the order the leaves refer to
+  for (const auto &node : data_nodes)
+    writer.write(static_cast<uint32_t>(node.getData().getIndex()));
+  writer.writeArray(linear_nodes.data(), linear_nodes.size());
+  return true;
+}
+
+bool BVHAccel::deserialize(const uint8_t *data, size_t size) {
+  using LinearNode = BVHTree<detail_::BVHTriangleNode>::LinearNode;
+  const uint32_t num_triangles = mesh->v_indices.size() / 3;
+
+  BinaryReader reader(data, size);
+  uint32_t tag, n_triangles, n_nodes;
+  vector<uint32_t> order;
+  vector<LinearNode> tree;
+  if (!reader.read(tag) || tag != SERIAL_TAG || !reader.read(n_triangles) ||
+      n_triangles != num_triangles || !reader.read(n_nodes) ||
+      !reader.readVector(order, n_triangles) ||
+      !reader.readVector(tree, n_nodes) || !reader.isEnd())
+    return false;
+
+  // The order is a permutation of the triangles
+  vector<bool> visited(num_triangles, false);
+  for (const uint32_t index : order) {
+    if (index >= num_triangles || visited[index]) return false;
+    visited[index] = true;
+  }
+
+  triangle_tree.clear();
+  for (const uint32_t index : order)
+    triangle_tree.push_back(detail_::Triangle(index, mesh));
+  if (!triangle_tree.restore(std::move(tree))) {
+    // Back to the state of setTriangleMesh
+    triangle_tree.clear();
+    for (uint32_t i = 0; i < num_triangles; ++i)
+      triangle_tree.push_back(detail_::Triangle(i, mesh));
+    return false;
+  }
+  return true;
+}
+
 #ifdef USE_EMBREE
-ExternalBVHAccel::ExternalBVHAccel() {
+ExternalBVHAccel::ExternalBVHAccel(const Properties &props) : Accel(props) {
   // Initialize Embree
   device = rtcNewDevice(nullptr);
   if (!device) Exception_("Cannot create Embree device");
@@ -141,6 +237,26 @@ bool ExternalBVHAccel::intersect(
   ray.setTimeMax(rayhit.ray.tfar);
   return true;
 }
+
+bool ExternalBVHAccel::occluded(const Ray &ray) const {
+  RTCRay shadow_ray;
+  shadow_ray.org_x = ray.origin.x;
+  shadow_ray.org_y = ray.origin.y;
+  shadow_ray.org_z = ray.origin.z;
+  shadow_ray.dir_x = ray.direction.x;
+  shadow_ray.dir_y = ray.direction.y;
+  shadow_ray.dir_z = ray.direction.z;
+  shadow_ray.tnear = ray.t_min;
+  shadow_ray.tfar  = ray.t_max;
+  shadow_ray.mask  = -1;
+  shadow_ray.flags = 0;
+
+  AssertAllNormalized(ray.direction);
+  rtcOccluded1(scene, &shadow_ray);
+
+  // tfar is set to -inf on a hit
+  return shadow_ray.tfar < 0;
+}
 #endif  // USE_EMBREE
 
 RDR_NAMESPACE_END
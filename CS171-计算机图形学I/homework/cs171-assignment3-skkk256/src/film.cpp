@@ -1,5 +1,6 @@
 #include "rdr/film.h"
 
+#include "rdr/parallel.h"
 #include "rdr/platform.h"
 
 /// Do not change the order of these includes
@@ -100,10 +101,22 @@ Film::Film(const Properties &props)
     block_side_length(props.getProperty<int>("block_side_length", 16)),
     data(resolution.x * resolution.y),
     weight(resolution.x * resolution.y),
-    light_data(resolution.x * resolution.y) {
+    light_data(resolution.x * resolution.y),
+    statistics(resolution.x * resolution.y) {
   if (block_side_length <= 0) {
     Exception_("block side length should be greater equal than 1");
   }
+
+  auto accumulation_name =
+      props.getProperty<std::string>("accumulation", "tiled");
+  if (accumulation_name == "locked") {
+    accumulation = EFilmAccumulation::ELocked;
+  } else if (accumulation_name == "tiled") {
+    accumulation = EFilmAccumulation::ETiled;
+  } else {
+    Exception_("Film accumulation {} not supported; use locked or tiled",
+        accumulation_name);
+  }
 }
 
 void Film::crossConfiguration(const CrossConfigurationContext &context) {
@@ -150,6 +163,7 @@ void Film::clear() {
   std::fill(data.begin(), data.end(), Vec3f(0.0));
   std::fill(weight.begin(), weight.end(), 0.0);
   std::fill(light_data.begin(), light_data.end(), Vec3f(0.0));
+  std::fill(statistics.begin(), statistics.end(), PixelStatistics{});
 }
 
 void Film::exportImageToArray(vector<Vec3f> &result) const {
@@ -239,6 +253,16 @@ void Film::commitSample(const Vec2f &sample_pos, const Vec3f &measurement) {
 void Film::commitLightImageSplat(
     const Vec2f &sample_pos, const Vec3f &measurement) {
   if (!isInside(sample_pos)) return;
+  if (accumulation == EFilmAccumulation::ETiled) {
+    // Splats land anywhere on the image, which a private tile cannot hold
+    const Vec2i pixel_index(std::floor(sample_pos.x), std::floor(sample_pos.y));
+    Vec3f &pixel = getLightPixel(pixel_index.x, pixel_index.y);
+    AtomicAdd(pixel.x, measurement.x);
+    AtomicAdd(pixel.y, measurement.y);
+    AtomicAdd(pixel.z, measurement.z);
+    return;
+  }
+
   const Vec2i block_index_2d(std::floor(sample_pos.x / block_side_length),
       std::floor(sample_pos.y / block_side_length));
   const int &block_index =
@@ -246,6 +270,43 @@ void Film::commitLightImageSplat(
   block_views[block_index].commitLightImageSplat(sample_pos, measurement);
 }
 
+void Film::mergeTile(const FilmTile &tile) {
+  if (tile.forward) return;
+  const Vec2i size = tile.upper_bnd - tile.low_bnd;
+  for (int y = 0; y < size.y; ++y) {
+    for (int x = 0; x < size.x; ++x) {
+      const int index = x + y * size.x;
+      if (tile.weight[index] == 0) continue;
+      // Only the pixels of the footprint margin are shared with other tiles,
+      // so the atomics hardly ever contend
+      const Vec2i pixel_index = tile.low_bnd + Vec2i(x, y);
+      Vec3f &pixel            = getPixel(pixel_index.x, pixel_index.y);
+      AtomicAdd(pixel.x, tile.data[index].x);
+      AtomicAdd(pixel.y, tile.data[index].y);
+      AtomicAdd(pixel.z, tile.data[index].z);
+      AtomicAdd(getWeight(pixel_index.x, pixel_index.y), tile.weight[index]);
+    }
+  }
+}
+
+void Film::commitPixelStatistics(const Vec2i &pixel, Float luminance) {
+  assert(isInside(pixel));
+  auto &pixel_statistics = statistics[pixel.x + resolution.x * pixel.y];
+  pixel_statistics.sum += luminance;
+  pixel_statistics.square_sum += static_cast<Double>(luminance) * luminance;
+  ++pixel_statistics.n_samples;
+}
+
+Float PixelStatistics::getRelativeError(Float epsilon) const {
+  if (n_samples < 2) return Float_INF;
+  const Double mean = sum / n_samples;
+  // The unbiased sample variance, clamped against the cancellation
+  const Double variance =
+      std::max(0.0, (square_sum - sum * mean) / (n_samples - 1));
+  return static_cast<Float>(
+      std::sqrt(variance / n_samples) / std::max<Double>(mean, epsilon));
+}
+
 // =======================================================================
 // FilmBlockView Implementation
 // =======================================================================
@@ -256,28 +317,14 @@ void FilmBlockView::commitSample(
   // lock the local block when committing the sample
   std::scoped_lock<std::mutex> lock(*local_lock);
 
-  const auto &filter         = film.filter;
-  const Float &filter_radius = filter->getRadius();
-  const int &discrete_radius = std::ceil(filter_radius - 0.5);
-
-  // Find the corresponding pixel
-  AssertAllNonNegative(sample_pos.x, sample_pos.y);
-  const Vec2i pixel_index(std::floor(sample_pos.x), std::floor(sample_pos.y));
-
   // traverse the pixels in the filter window
-  for (int x = -discrete_radius; x <= discrete_radius; ++x) {
-    for (int y = -discrete_radius; y <= discrete_radius; ++y) {
-      const Vec2i &current_pixel_index = pixel_index + Vec2i(x, y);
-      if (!isInside(current_pixel_index)) continue;
-      const Vec2f &relative_pos = sample_pos -
-                                  Cast<Float>(current_pixel_index) -
-                                  static_cast<Float>(0.5);
-      const Float &weight = filter->evaluate(relative_pos);
-      film.getWeight(current_pixel_index.x, current_pixel_index.y) += weight;
-      film.getPixel(current_pixel_index.x, current_pixel_index.y) +=
-          measurement * weight;
-    }
-  }
+  AssertAllNonNegative(sample_pos.x, sample_pos.y);
+  film.footprintVisitor(
+      sample_pos, [&](const Vec2i &pixel_index, Float weight) {
+        if (!isInside(pixel_index)) return;
+        film.getWeight(pixel_index.x, pixel_index.y) += weight;
+        film.getPixel(pixel_index.x, pixel_index.y) += measurement * weight;
+      });
 }
 
 void FilmBlockView::commitLightImageSplat(
@@ -290,4 +337,45 @@ void FilmBlockView::commitLightImageSplat(
   // unlocked
 }
 
+// =======================================================================
+// FilmTile Implementation
+// =======================================================================
+
+FilmTile::FilmTile(Film &film, const Vec2i &low_bnd, const Vec2i &upper_bnd)
+    : film(film),
+      forward(film.getAccumulation() == EFilmAccumulation::ELocked),
+      tile_low_bnd(low_bnd),
+      tile_upper_bnd(upper_bnd) {
+  if (forward) return;
+
+  // Pad the tile by the pixels a sample inside of it can reach
+  const int discrete_radius = std::ceil(film.filter->getRadius() - 0.5);
+  this->low_bnd   = Max(low_bnd - discrete_radius, Vec2i(0, 0));
+  this->upper_bnd = Min(upper_bnd + discrete_radius, film.getResolution());
+  const Vec2i size = this->upper_bnd - this->low_bnd;
+  data.resize(size.x * size.y, Vec3f(0.0));
+  weight.resize(size.x * size.y, 0.0);
+}
+
+void FilmTile::commitSample(const Vec2f &sample_pos, const Vec3f &measurement) {
+  if (forward || sample_pos.x < tile_low_bnd.x ||
+      sample_pos.y < tile_low_bnd.y || sample_pos.x >= tile_upper_bnd.x ||
+      sample_pos.y >= tile_upper_bnd.y) {
+    film.commitSample(sample_pos, measurement);
+    return;
+  }
+
+  const int width = upper_bnd.x - low_bnd.x;
+  film.footprintVisitor(
+      sample_pos, [&](const Vec2i &pixel_index, Float pixel_weight) {
+        if (pixel_index.x < low_bnd.x || pixel_index.y < low_bnd.y ||
+            pixel_index.x >= upper_bnd.x || pixel_index.y >= upper_bnd.y)
+          return;
+        const int index =
+            (pixel_index.x - low_bnd.x) + (pixel_index.y - low_bnd.y) * width;
+        weight[index] += pixel_weight;
+        data[index] += measurement * pixel_weight;
+      });
+}
+
 RDR_NAMESPACE_END
@@ -0,0 +1,489 @@
+#include "rdr/guiding.h"
+
+#include <algorithm>
+
+#include "rdr/bsdf.h"
+#include "rdr/camera.h"
+#include "rdr/film.h"
+#include "rdr/light.h"
+#include "rdr/parallel.h"
+#include "rdr/properties.h"
+#include "rdr/scene.h"
+
+RDR_NAMESPACE_BEGIN
+
+namespace detail_ {
+/// The power heuristic of IncrementalPathIntegrator
+RDR_FORCEINLINE Float PowerHeuristic(Float pdf_a, Float pdf_b) {
+  pdf_a *= pdf_a;
+  pdf_b *= pdf_b;
+  return pdf_a / (pdf_a + pdf_b);
+}
+
+/// Keep u in [0, 1) after rescaling
+RDR_FORCEINLINE Float ClampBelowOne(Float u) {
+  return std::min(u, 1.0_F - Float_EPSILON);
+}
+
+/// A non-specular vertex of a training path, whose incident radiance along wi
+/// is recorded when the path ends
+struct GuidingVertex {
+  GuidingRegion *region;
+  Vec3f wi;
+  /// The throughput of the path after sampling wi
+  Vec3f beta;
+  /// The pdf wi was sampled with
+  Float pdf;
+  Vec3f radiance;
+
+  /// Add a contribution to the path, where the throughput of the path up to
+  /// here is divided out
+  void addRadiance(const Vec3f &contribution) {
+    for (int k = 0; k < 3; ++k)
+      if (beta[k] > 0) radiance[k] += contribution[k] / beta[k];
+  }
+};
+
+/// The vertices of the training paths of a worker, which only grow
+static vector<GuidingVertex> &GetGuidingVertices(int max_depth) {
+  thread_local vector<GuidingVertex> vertices;
+  if (static_cast<int>(vertices.size()) < max_depth)
+    vertices.resize(max_depth);
+  return vertices;
+}
+}  // namespace detail_
+
+/* ===================================================================== *
+ *
+ * DirectionalQuadTree
+ *
+ * ===================================================================== */
+
+Vec2f DirectionalQuadTree::DirectionToCanonical(const Vec3f &direction) {
+  const Float cos_theta = std::clamp(direction.z, -1.0_F, 1.0_F);
+  Float phi             = std::atan2(direction.y, direction.x);
+  if (phi < 0) phi += 2 * PI;
+  return {detail_::ClampBelowOne((cos_theta + 1) / 2),
+      detail_::ClampBelowOne(phi / (2 * PI))};
+}
+
+Vec3f DirectionalQuadTree::CanonicalToDirection(const Vec2f &canonical) {
+  const Float cos_theta = 2 * canonical.x - 1;
+  const Float sin_theta = std::sqrt(std::max(0.0_F, 1 - cos_theta * cos_theta));
+  const Float phi       = 2 * PI * canonical.y;
+  return {sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+}
+
+void DirectionalQuadTree::record(const Vec3f &direction, Float value) {
+  Vec2f p  = DirectionToCanonical(direction);
+  int node = 0;
+  while (true) {
+    const int x = p.x >= 0.5_F, y = p.y >= 0.5_F;
+    const int q = x + 2 * y;
+    AtomicAdd(nodes[node].sum[q], value);
+    if (nodes[node].child[q] == 0) return;
+    node = nodes[node].child[q];
+    p    = p * 2.0_F - Vec2f(x, y);
+  }
+}
+
+Vec3f DirectionalQuadTree::sample(Vec2f u) const {
+  if (!(getTotal() > 0)) return UniformSampleSphere(u);
+
+  Vec2f origin(0.0);
+  Float size = 1;
+  int node   = 0;
+  while (true) {
+    const Float *sum  = nodes[node].sum;
+    const Float left  = sum[0] + sum[2];
+    const Float total = left + sum[1] + sum[3];
+    if (!(total > 0)) break;
+
+    // Choose the column, then the quadrant within it
+    int x           = 0;
+    const Float p_x = left / total;
+    if (u.x < p_x) {
+      u.x = detail_::ClampBelowOne(u.x / p_x);
+    } else {
+      x   = 1;
+      u.x = detail_::ClampBelowOne((u.x - p_x) / (1 - p_x));
+    }
+
+    int y           = 0;
+    const Float p_y = sum[x] / (sum[x] + sum[x + 2]);
+    if (u.y < p_y) {
+      u.y = detail_::ClampBelowOne(u.y / p_y);
+    } else {
+      y   = 1;
+      u.y = detail_::ClampBelowOne((u.y - p_y) / (1 - p_y));
+    }
+
+    size /= 2;
+    origin += Vec2f(x, y) * size;
+    const int child = nodes[node].child[x + 2 * y];
+    if (child == 0) break;
+    node = child;
+  }
+
+  return CanonicalToDirection(origin + u * size);
+}
+
+Float DirectionalQuadTree::pdf(const Vec3f &direction) const {
+  const Float total = getTotal();
+  if (!(total > 0)) return 1 / (4 * PI);
+
+  // Each level multiplies the density over the unit square by the share of
+  // the quadrant over its quarter of the area
+  Vec2f p       = DirectionToCanonical(direction);
+  Float density = 1;
+  int node      = 0;
+  while (true) {
+    const Float *sum       = nodes[node].sum;
+    const Float node_total = sum[0] + sum[1] + sum[2] + sum[3];
+    const int x = p.x >= 0.5_F, y = p.y >= 0.5_F;
+    const int q = x + 2 * y;
+    if (!(sum[q] > 0)) return 0;
+    density *= 4 * sum[q] / node_total;
+    if (nodes[node].child[q] == 0) break;
+    node = nodes[node].child[q];
+    p    = p * 2.0_F - Vec2f(x, y);
+  }
+
+  // The cylindrical mapping stretches the unit square over 4 PI steradians
+  return density / (4 * PI);
+}
+
+void DirectionalQuadTree::refine(
+    const DirectionalQuadTree &other, Float threshold, int max_depth) {
+  nodes.assign(1, Node{});
+  const Float total = other.getTotal();
+  if (!(total > 0)) return;
+
+  // A node of the new tree, the node of other over the same area if any, and
+  // the energy of the area, which is spread evenly below the leaves of other
+  struct Item {
+    int node, other_node;
+    Float energy;
+    int depth;
+  };
+  vector<Item> stack{{0, 0, total, 1}};
+  while (!stack.empty()) {
+    const Item item = stack.back();
+    stack.pop_back();
+    if (item.depth >= max_depth) continue;
+
+    for (int q = 0; q < 4; ++q) {
+      const bool has_other = item.other_node >= 0;
+      const Float energy =
+          has_other ? other.nodes[item.other_node].sum[q] : item.energy / 4;
+      if (energy / total <= threshold) continue;
+
+      const int other_child =
+          has_other && other.nodes[item.other_node].child[q] != 0
+              ? other.nodes[item.other_node].child[q]
+              : -1;
+      const int child           = static_cast<int>(nodes.size());
+      nodes[item.node].child[q] = child;
+      nodes.emplace_back();
+      stack.push_back({child, other_child, energy, item.depth + 1});
+    }
+  }
+}
+
+/* ===================================================================== *
+ *
+ * SDTree
+ *
+ * ===================================================================== */
+
+SDTree::SDTree(const AABB &scene_bound) : nodes(1), regions(1) {
+  // A slightly larger cube, so no point of the scene is on its boundary
+  const Vec3f extent = scene_bound.getExtent();
+  size    = ReduceMax(extent) * 1.01_F + EPS;
+  low_bnd = scene_bound.getCenter() - Vec3f(size / 2);
+}
+
+int SDTree::getLeaf(const Vec3f &p) const {
+  Vec3f x  = (p - low_bnd) / size;
+  int node = 0;
+  while (nodes[node].child != 0) {
+    const int axis = nodes[node].axis;
+    const int side = x[axis] >= 0.5_F;
+    x[axis]        = x[axis] * 2 - side;
+    node           = nodes[node].child + side;
+  }
+  return node;
+}
+
+GuidingRegion &SDTree::getRegion(const Vec3f &p) {
+  return regions[nodes[getLeaf(p)].region];
+}
+
+const GuidingRegion &SDTree::getRegion(const Vec3f &p) const {
+  return regions[nodes[getLeaf(p)].region];
+}
+
+void SDTree::refine(Float spatial_threshold, Float directional_threshold,
+    int n_workers) {
+  // The children are appended, hence split in turn within the same loop. Both
+  // take a copy of the distributions and half of the records
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].child != 0) continue;
+    const int region = nodes[i].region;
+    const uint64_t n_records =
+        regions[region].n_records.load(std::memory_order_relaxed);
+    if (!(n_records > spatial_threshold)) continue;
+
+    regions[region].n_records.store(n_records / 2, std::memory_order_relaxed);
+    GuidingRegion copy = regions[region];
+    regions.push_back(std::move(copy));
+    const int axis = (nodes[i].axis + 1) % 3;
+    nodes[i].child = static_cast<int>(nodes.size());
+    nodes.push_back({axis, 0, region});
+    nodes.push_back({axis, 0, static_cast<int>(regions.size()) - 1});
+  }
+
+  ParallelFor(
+      static_cast<int>(regions.size()),
+      [&](int index, int) {
+        GuidingRegion &region = regions[index];
+        region.sampling       = region.recording;
+        region.recording.refine(region.sampling, directional_threshold);
+        region.n_records.store(0, std::memory_order_relaxed);
+      },
+      n_workers);
+}
+
+/* ===================================================================== *
+ *
+ * GuidedPathIntegrator
+ *
+ * ===================================================================== */
+
+GuidedPathIntegrator::GuidedPathIntegrator(const Properties &props)
+    : PathIntegrator(props),
+      rr_threshold(props.getProperty<Float>("rr_threshold", 0.1)),
+      profile(IncrementalPathIntegrator::ParseProfile(
+          props.getProperty<std::string>("profile", "MIS"))),
+      n_training_iterations(props.getProperty<int>("n_training_iterations", 6)),
+      bsdf_fraction(props.getProperty<Float>("bsdf_fraction", 0.5)),
+      spatial_threshold(props.getProperty<Float>("spatial_threshold", 12000)),
+      directional_threshold(
+          props.getProperty<Float>("directional_threshold", 0.01)) {
+  if (n_training_iterations < 0)
+    Exception_("n_training_iterations should not be negative");
+  if (bsdf_fraction < 0 || bsdf_fraction > 1)
+    Exception_("bsdf_fraction should be in [0, 1]");
+}
+
+void GuidedPathIntegrator::render(ref<Camera> camera, ref<Scene> scene) {
+  ref<Film> film          = camera->getFilm();
+  const Vec2i &resolution = film->getResolution();
+  const int n_workers     = GetNumWorkers(threads);
+  sd_tree                 = make_ref<SDTree>(scene->getBound());
+
+  vector<ref<Sampler>> samplers(n_workers);
+  for (auto &worker_sampler : samplers) worker_sampler = this->sampler->clone();
+
+  training = true;
+  for (int iteration = 0; iteration < n_training_iterations; ++iteration) {
+    // Training samples take the indices past spp, so they are independent of
+    // the samples of the image
+    const int pass_spp = 1 << iteration;
+    const int begin    = spp + pass_spp - 1;
+    ParallelForTiles(
+        resolution, tile_size,
+        [&](const Vec2i &low_bnd, const Vec2i &upper_bnd, int worker_index) {
+          Sampler &sampler = *samplers[worker_index];
+          for (int y = low_bnd.y; y < upper_bnd.y; ++y) {
+            for (int x = low_bnd.x; x < upper_bnd.x; ++x) {
+              for (int s = begin; s < begin + pass_spp; ++s) {
+                sampler.startPixelSample(Vec2i(x, y), s);
+                const Vec2f sample = sampler.getPixelSample();
+                DifferentialRay ray =
+                    camera->generateDifferentialRay(sample.x, sample.y);
+                Li(scene, ray, sampler);
+              }
+            }
+          }
+          sampler.resetAfterIteration();
+        },
+        n_workers);
+
+    sd_tree->refine(spatial_threshold * std::sqrt(static_cast<Float>(pass_spp)),
+        directional_threshold, n_workers);
+    Info_("Training pass {} with {} spp, {} region(s)", iteration, pass_spp,
+        sd_tree->getNumRegions());
+  }
+  training = false;
+
+  PathIntegrator::render(camera, scene);
+}
+
+Vec3f GuidedPathIntegrator::Li(  // NOLINT
+    ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const {
+  SurfaceInteraction interaction{};
+  const bool intersected = scene->intersect(ray, interaction);
+  return Li(scene, ray, sampler, intersected, interaction);
+}
+
+Vec3f GuidedPathIntegrator::Li(ref<Scene> scene,  // NOLINT
+    DifferentialRay &ray, Sampler &sampler, bool first_intersected,
+    const SurfaceInteraction &first_interaction) const {
+  const bool nee = profile >= IntegratorProfile::ENextEventEstimation;
+  const bool mis = profile >= IntegratorProfile::EMultipleImportanceSampling;
+  const bool random_walk = profile == IntegratorProfile::ERandomWalk;
+
+  auto &vertices = detail_::GetGuidingVertices(max_depth);
+  int n_vertices = 0;
+
+  Vec3f L(0.0);  // NOLINT
+  Vec3f beta(1.0);
+  auto add_radiance = [&](const Vec3f &contribution) {
+    L += contribution;
+    for (int k = 0; k < n_vertices; ++k) vertices[k].addRadiance(contribution);
+  };
+
+  // Le(p1 -> p0) of the emitters seen directly
+  if (!first_intersected) {
+    if (scene->hasInfiniteLight()) {
+      const auto light_interaction =
+          scene->getInfiniteLight()->sampleFromOutgoingDirection(
+              -ray.direction);
+      L += light_interaction.light->Le(light_interaction, light_interaction.wo);
+    }
+    return L;
+  }
+  if (first_interaction.isLight())
+    return first_interaction.light->Le(first_interaction, first_interaction.wo);
+
+  SurfaceInteraction interaction = first_interaction;
+  interaction.setPdf(1.0, EMeasure::EUnknownMeasure);
+  interaction.CalculateRayDifferentials(ray);
+
+  for (int bounces = 1; bounces < max_depth; ++bounces) {
+    if (!interaction.isValid()) break;
+    if (sampler.get1D() < rr_threshold) break;
+    beta /= 1.0_F - rr_threshold;
+
+    // The delta BSDFs are never guided
+    GuidingRegion *region =
+        interaction.isSpecular() ? nullptr : &sd_tree->getRegion(interaction.p);
+    auto mixture_pdf = [&](const Vec3f &wi, Float bsdf_pdf) {
+      if (region == nullptr) return bsdf_pdf;
+      return bsdf_fraction * bsdf_pdf +
+             (1 - bsdf_fraction) * region->sampling.pdf(wi);
+    };
+
+    // Sample a light, weighted against the mixture of the BSDF and the guide
+    auto ref_interaction = interaction;
+    auto light_interaction =
+        scene->sampleEmitterDirect(ref_interaction, sampler);
+    if (nee && light_interaction.cosThetaO() > 0) {
+      const Ray shadow_ray =
+          light_interaction.isInfLight()
+              ? ref_interaction.spawnRay(ref_interaction.wi)
+              : ref_interaction.spawnRayTo(light_interaction);
+      if (!scene->isBlocked(shadow_ray)) {
+        Float weight = 1;
+        if (mis) {
+          const Float light_pdf = Path::toPdfMeasure(
+              light_interaction, ref_interaction, EMeasure::ESolidAngle);
+          const Float bsdf_pdf = ref_interaction.bsdf->pdf(ref_interaction);
+          weight               = detail_::PowerHeuristic(
+              light_pdf, mixture_pdf(ref_interaction.wi, bsdf_pdf));
+        }
+
+        // The same estimate as Path::estimate on the last two vertices
+        const Float G = std::abs(ref_interaction.cosThetaI()) *
+                        std::abs(light_interaction.cosThetaO()) /
+                        SquareNorm(light_interaction.p - ref_interaction.p);
+        const Float light_pdf = Path::toPdfMeasure(
+            light_interaction, ref_interaction, EMeasure::EArea);
+        const Vec3f f  = ref_interaction.bsdf->evaluate(ref_interaction);
+        const Vec3f Le = light_interaction.light->Le(  // NOLINT
+            light_interaction, light_interaction.wo);
+        add_radiance(beta * f * G / light_pdf * Le * weight);
+      }
+    }
+
+    // Sample the next direction from the BSDF or the guide
+    Float bsdf_pdf = 0;
+    Vec3f f;
+    if (region != nullptr && sampler.get1D() >= bsdf_fraction) {
+      interaction.wi = region->sampling.sample(sampler.get2D());
+      f              = interaction.bsdf->evaluate(interaction);
+      bsdf_pdf       = interaction.bsdf->pdf(interaction);
+    } else {
+      f = interaction.bsdf->sample(interaction, sampler, &bsdf_pdf);
+    }
+    const Float pdf = mixture_pdf(interaction.wi, bsdf_pdf);
+    if (SquareNorm(f) < EPS || !(pdf > 0)) break;
+    ray = interaction.spawnRay(interaction.wi);
+    if (!ray.isValid()) break;
+    if (interaction.isSpecular()) interaction.setBSDFCache(f);
+    beta *= f * std::abs(interaction.cosThetaI()) / pdf;
+
+    const bool recorded = training && region != nullptr;
+    if (recorded)
+      vertices[n_vertices++] = {region, interaction.wi, beta, pdf, Vec3f(0.0)};
+
+    SurfaceInteraction new_interaction{};
+    if (scene->intersect(ray, new_interaction)) {
+      new_interaction.setPdf(pdf, EMeasure::ESolidAngle);
+    } else if (scene->hasInfiniteLight()) {
+      new_interaction = scene->getInfiniteLight()->sampleFromOutgoingDirection(
+          -ray.direction);
+      new_interaction.setPdf(pdf, EMeasure::ESolidAngle);
+    } else {
+      break;
+    }
+
+    if (new_interaction.isLight()) {
+      if (!random_walk && !mis && !interaction.isSpecular()) break;
+
+      Float weight = 1;
+      if (mis) {
+        Float emitter_pdf =
+            interaction.isSpecular()
+                ? 0
+                : scene->pdfEmitterDirect(interaction, new_interaction);
+
+        // Convert area light's area PDF to solid angle PDF
+        if (!new_interaction.isInfLight()) {
+          auto query_interaction = new_interaction;
+          query_interaction.setPdf(emitter_pdf, EMeasure::EArea);
+          emitter_pdf = Path::toPdfMeasure(
+              query_interaction, interaction, EMeasure::ESolidAngle);
+        }
+        weight = detail_::PowerHeuristic(pdf, emitter_pdf);
+      }
+
+      // The light seen from the last vertex is learnt in full, as it is only
+      // weighted against the light sampled from there
+      const Vec3f Le =  // NOLINT
+          new_interaction.light->Le(new_interaction, new_interaction.wo);
+      add_radiance(beta * Le * weight);
+      if (recorded)
+        vertices[n_vertices - 1].addRadiance(beta * Le * (1 - weight));
+      break;
+    }
+
+    new_interaction.CalculateRayDifferentials(ray);
+    interaction = new_interaction;
+  }
+
+  // Record the incident radiance divided by its pdf, so the energy of a
+  // quadrant estimates the integral of the radiance over it
+  for (int k = 0; k < n_vertices; ++k) {
+    const auto &vertex = vertices[k];
+    const Float value  = Luminance(vertex.radiance) / vertex.pdf;
+    if (!std::isfinite(value)) continue;
+    vertex.region->recording.record(vertex.wi, value);
+    vertex.region->n_records.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return L;
+}
+
+RDR_NAMESPACE_END
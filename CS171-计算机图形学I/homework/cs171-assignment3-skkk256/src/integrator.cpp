@@ -1,47 +1,189 @@
 #include "rdr/integrator.h"
 
-//#include <omp.h>
+#include <atomic>
+#include <chrono>
 
 #include "rdr/bsdf.h"
 #include "rdr/camera.h"
 #include "rdr/film.h"
 #include "rdr/light.h"
+#include "rdr/parallel.h"
 #include "rdr/properties.h"
 #include "rdr/ray.h"
 #include "rdr/scene.h"
+#include "rdr/stats.h"
 
 RDR_NAMESPACE_BEGIN
 
-void PathIntegrator::render(ref<Camera> camera, ref<Scene> scene) {
-  std::atomic<int> cnt    = 0;
-  const Vec2i &resolution = camera->getFilm()->getResolution();
-  // TODO: fill your implementation here
-  // Necessary functions:
-  // 1. sampler.setPixelIndex2D (think of how a sampler should be initialized)
-  // 2. sampler.getPixelSample (get a pixel sample from the sampler)
-  // 3. camera->generateDifferentialRay (don't have to understand)
-  // 4. camera->getFilm()->commitSample (commit a sample to the film, remember
-  // this understanding)
-  // 5. sampler.resetAfterIteration() (not necessary in this sampler
-  // 6. Li (don't need to explain, invoke and write its result into the film)
-  // implementation, but is indeed necessary in other samplers. If you are
-  // interested, go search for Halton and Sobol sampler, they will increase the
-  // convergence rate of your renderer by an INCREDIBLE amount almost for free.)
-  Sampler sampler;
-  for (int x = 0; x < resolution.x; ++x) {
-    for (int y = 0; y < resolution.y; ++y) {
-      sampler.setPixelIndex2D(Vec2i(x, y));
-      for (int s = 0; s < this->spp; ++s) {
-        Vec2f sample = sampler.getPixelSample();
-        DifferentialRay ray = camera->generateDifferentialRay(sample.x, sample.y);
-        Vec3f Li = this->Li(scene, ray, sampler);
-        camera->getFilm()->commitSample(sample, Li);
-      }
+ProgressiveSettings::ProgressiveSettings(const Properties &props)
+    : enabled(true),
+      pass_spp(props.getProperty<int>("pass_spp", 4)),
+      min_spp(props.getProperty<int>("min_spp", 16)),
+      target_error(props.getProperty<Float>("target_error", 0.01)),
+      time_budget(props.getProperty<Float>("time_budget", 0)),
+      checkpoint(props.getProperty<std::string>("checkpoint", "")),
+      checkpoint_interval(props.getProperty<Float>("checkpoint_interval", 30)) {
+  if (pass_spp <= 0) Exception_("pass_spp should be greater than 0");
+  if (min_spp < 2) Exception_("min_spp should be at least 2 to estimate error");
+}
+
+void PathIntegrator::renderPixel(const Camera &camera, const ref<Scene> &scene,
+    Film &film, FilmTile &film_tile, Sampler &sampler, const Vec2i &pixel,
+    int begin, int end) const {
+  if (!ray_packets) {
+    for (int s = begin; s < end; ++s) {
+      // Samples only depend on the pixel and the sample index
+      sampler.startPixelSample(pixel, s);
+      const Vec2f sample  = sampler.getPixelSample();
+      DifferentialRay ray = camera.generateDifferentialRay(sample.x, sample.y);
+      const Vec3f Li      = this->Li(scene, ray, sampler);  // NOLINT
+      film_tile.commitSample(sample, Li);
+      film.commitPixelStatistics(pixel, Luminance(Li));
+      ScratchArena::ThreadLocal().reset();
+    }
+    sampler.resetAfterIteration();
+    return;
+  }
+
+  constexpr int SIZE = RayPacket::SIZE;
+  for (int s = begin; s < end; s += SIZE) {
+    // The camera rays of a pixel are coherent, hence intersected together
+    RayPacket packet;
+    packet.n_rays = std::min(SIZE, end - s);
+    Vec2f samples[SIZE];
+    int dimensions[SIZE];
+    DifferentialRay rays[SIZE];
+    for (int i = 0; i < packet.n_rays; ++i) {
+      sampler.startPixelSample(pixel, s + i);
+      samples[i]    = sampler.getPixelSample();
+      dimensions[i] = sampler.getDimension();
+      rays[i] = camera.generateDifferentialRay(samples[i].x, samples[i].y);
+      packet.rays[i] = rays[i];
+    }
+    SurfaceInteraction interactions[SIZE];
+    const uint32_t hits = scene->intersectPacket(packet, interactions);
+
+    // Each path then continues on its own, from where its sampler stopped
+    for (int i = 0; i < packet.n_rays; ++i) {
+      sampler.startPixelSample(pixel, s + i);
+      sampler.setDimension(dimensions[i]);
+      const Vec3f Li = this->Li(scene, rays[i], sampler,  // NOLINT
+          (hits >> i) & 1, interactions[i]);
+      film_tile.commitSample(samples[i], Li);
+      film.commitPixelStatistics(pixel, Luminance(Li));
+      ScratchArena::ThreadLocal().reset();
     }
   }
   sampler.resetAfterIteration();
 }
 
+void PathIntegrator::render(ref<Camera> camera, ref<Scene> scene) {
+  if (progressive.enabled) {
+    renderProgressive(camera, scene);
+    return;
+  }
+
+  ref<Film> film          = camera->getFilm();
+  const Vec2i &resolution = film->getResolution();
+  const int n_workers     = GetNumWorkers(threads);
+  Info_("Rendering {}x{} with {} worker(s) on {}x{} tiles", resolution.x,
+      resolution.y, n_workers, tile_size, tile_size);
+
+  // Samplers are never shared between workers
+  vector<ref<Sampler>> samplers(n_workers);
+  for (auto &worker_sampler : samplers) worker_sampler = this->sampler->clone();
+  ParallelForTiles(
+      resolution, tile_size,
+      [&](const Vec2i &low_bnd, const Vec2i &upper_bnd, int worker_index) {
+        Sampler &sampler = *samplers[worker_index];
+        FilmTile film_tile(*film, low_bnd, upper_bnd);
+        for (int y = low_bnd.y; y < upper_bnd.y; ++y)
+          for (int x = low_bnd.x; x < upper_bnd.x; ++x)
+            renderPixel(*camera, scene, *film, film_tile, sampler, Vec2i(x, y),
+                0, this->spp);
+        film->mergeTile(film_tile);
+      },
+      n_workers);
+}
+
+void PathIntegrator::renderProgressive(ref<Camera> camera, ref<Scene> scene) {
+  using Clock = std::chrono::steady_clock;
+  auto seconds_since = [](Clock::time_point start) {
+    return std::chrono::duration<Float>(Clock::now() - start).count();
+  };
+
+  ref<Film> film          = camera->getFilm();
+  const Vec2i &resolution = film->getResolution();
+  const int n_workers     = GetNumWorkers(threads);
+  Info_("Rendering {}x{} progressively with {} worker(s), up to {} spp, "
+        "target error {}, time budget {}s",
+      resolution.x, resolution.y, n_workers, spp, progressive.target_error,
+      progressive.time_budget);
+
+  // Whether the pixel takes another pass, given its statistics
+  auto is_active = [&](const PixelStatistics &statistics) {
+    if (statistics.n_samples >= spp) return false;
+    if (statistics.n_samples < progressive.min_spp) return true;
+    return statistics.getRelativeError() > progressive.target_error;
+  };
+  auto is_out_of_time = [&](Clock::time_point start) {
+    return progressive.time_budget > 0 &&
+           seconds_since(start) >= progressive.time_budget;
+  };
+
+  vector<ref<Sampler>> samplers(n_workers);
+  for (auto &worker_sampler : samplers) worker_sampler = this->sampler->clone();
+
+  const auto start     = Clock::now();
+  auto last_checkpoint = start;
+  int64_t n_active     = resolution.x * resolution.y;
+  for (int pass = 0; n_active > 0 && !is_out_of_time(start); ++pass) {
+    std::atomic<int64_t> n_samples{0};
+    ParallelForTiles(
+        resolution, tile_size,
+        [&](const Vec2i &low_bnd, const Vec2i &upper_bnd, int worker_index) {
+          // Tiles are skipped past the deadline, so a pass never overruns
+          // the budget by more than a tile
+          if (is_out_of_time(start)) return;
+          Sampler &sampler = *samplers[worker_index];
+          FilmTile film_tile(*film, low_bnd, upper_bnd);
+          for (int y = low_bnd.y; y < upper_bnd.y; ++y) {
+            for (int x = low_bnd.x; x < upper_bnd.x; ++x) {
+              const auto &statistics = film->getPixelStatistics(x, y);
+              if (!is_active(statistics)) continue;
+              // Sample indices continue over the passes, which keeps the
+              // low-discrepancy sequences well distributed
+              const int begin = statistics.n_samples;
+              const int end   = std::min(begin + progressive.pass_spp, spp);
+              renderPixel(*camera, scene, *film, film_tile, sampler,
+                  Vec2i(x, y), begin, end);
+              n_samples += end - begin;
+            }
+          }
+          film->mergeTile(film_tile);
+        },
+        n_workers);
+
+    n_active = 0;
+    for (int y = 0; y < resolution.y; ++y)
+      for (int x = 0; x < resolution.x; ++x)
+        n_active += is_active(film->getPixelStatistics(x, y));
+    Info_("Pass {} drew {} samples in {:.2f}s, {} pixel(s) left", pass,
+        n_samples.load(), seconds_since(start), n_active);
+
+    if (!progressive.checkpoint.empty() &&
+        seconds_since(last_checkpoint) >= progressive.checkpoint_interval) {
+      film->exportImageToFile(
+          FileResolver::resolveToAbs(progressive.checkpoint));
+      last_checkpoint = Clock::now();
+    }
+  }
+
+  if (n_active > 0)
+    Info_("Time budget exhausted with {} pixel(s) above the target error",
+        n_active);
+}
+
 /* ===================================================================== *
  *
  * New Integrator's Implementation
@@ -51,16 +193,25 @@ void PathIntegrator::render(ref<Camera> camera, ref<Scene> scene) {
 // Instantiate template
 // clang-format off
 template Vec3f
-IncrementalPathIntegrator::Li<Path>(ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const;
+IncrementalPathIntegrator::Li<Path>(ref<Scene> scene, DifferentialRay &ray, Sampler &sampler, bool intersected, const SurfaceInteraction &interaction) const;
 // clang-format on
 
+Vec3f IncrementalPathIntegrator::Li(  // NOLINT
+    ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const {
+  SurfaceInteraction interaction{};
+  const bool intersected = scene->intersect(ray, interaction);
+  return Li<Path>(scene, ray, sampler, intersected, interaction);
+}
+
 // This is exactly a way to separate dec and def
 template <typename PathType>
 Vec3f IncrementalPathIntegrator::Li(  // NOLINT
-    ref<Scene> scene, DifferentialRay &ray, Sampler &sampler) const {
+    ref<Scene> scene, DifferentialRay &ray, Sampler &sampler,
+    bool first_intersected, const SurfaceInteraction &first_interaction) const {
   AssertAllNormalized(ray.direction);
   assert(ray.isValid());
-  vector<PathType> paths{};
+  // Released with the ScratchArena of the worker after the pixel sample
+  std::pmr::vector<PathType> paths{&ScratchArena::ThreadLocal()};
 
   Float rr_weight = 1.0;
   Float last_pdf  = 1.0;
@@ -83,9 +234,9 @@ Vec3f IncrementalPathIntegrator::Li(  // NOLINT
    * Construct First Interaction
    * =====================================================================
    */
-  SurfaceInteraction interaction{};
+  SurfaceInteraction interaction = first_interaction;
 
-  bool intersected = scene->intersect(ray, interaction);
+  bool intersected = first_intersected;
   interaction.setPdf(1.0, EMeasure::EUnknownMeasure);
 
   // Speical judge for light: Le(p1 -> p0)
@@ -136,8 +287,7 @@ Vec3f IncrementalPathIntegrator::Li(  // NOLINT
                        ? ref_interaction.spawnRay(ref_interaction.wi)
                        : ref_interaction.spawnRayTo(light_interaction);
 
-    SurfaceInteraction shadow_interaction{};
-    bool is_blocked = scene->isBlocked(shadow_ray, shadow_interaction);
+    bool is_blocked = scene->isBlocked(shadow_ray);
 
     if (!is_blocked && nextEventEstimation()) {
       // Add the light interaction to the path
@@ -221,9 +371,10 @@ before_trace:
 
         if (multipleImportanceSampling()) {
           const Float bsdf_pdf = last_pdf;
-          Float emitter_pdf    = interaction.isSpecular()
-                                   ? 0
-                                   : scene->pdfEmitterDirect(new_interaction);
+          Float emitter_pdf =
+              interaction.isSpecular()
+                  ? 0
+                  : scene->pdfEmitterDirect(interaction, new_interaction);
 
           // Convert area light's area PDF to solid angle PDF
           if (!new_interaction.isInfLight()) {
@@ -255,6 +406,9 @@ before_trace:
     ++bounces;
   }
 
+  // The vertices after the camera; a camera ray escaping the scene has none
+  RDR_STAT_PATH_LENGTH(first_intersected ? bounces : 0);
+
   /* ===================================================================== *
    * Path Summary (if deferred estimate is enabled)
    * =====================================================================
@@ -8,6 +8,93 @@
 
 RDR_NAMESPACE_BEGIN
 
+/* ===================================================================== *
+ *
+ * LightBounds
+ *
+ * ===================================================================== */
+
+namespace detail_ {
+/// cos(max(theta_a - theta_b, 0)) and sin(max(theta_a - theta_b, 0))
+RDR_FORCEINLINE Float CosSubClamped(
+    Float sin_a, Float cos_a, Float sin_b, Float cos_b) {
+  return cos_a > cos_b ? 1 : cos_a * cos_b + sin_a * sin_b;
+}
+
+RDR_FORCEINLINE Float SinSubClamped(
+    Float sin_a, Float cos_a, Float sin_b, Float cos_b) {
+  return cos_a > cos_b ? 0 : sin_a * cos_b - cos_a * sin_b;
+}
+
+RDR_FORCEINLINE Float SafeSqrt(Float x) {
+  return std::sqrt(std::max(x, 0.0F));
+}
+}  // namespace detail_
+
+Float LightBounds::importance(const Vec3f &p, const Vec3f &n) const {
+  using detail_::CosSubClamped;
+  using detail_::SafeSqrt;
+  using detail_::SinSubClamped;
+
+  // The distance to the center, clamped for the points inside of the bounds
+  const Vec3f center = bounds.getCenter();
+  const Float d2 =
+      std::max(SquareNorm(p - center), Norm(bounds.getExtent()) / 2);
+
+  // The angle between the cone axis and the direction to p
+  const Vec3f wi    = Normalize(p - center);
+  Float cos_theta_w = Dot(cone.w, wi);
+  if (two_sided) cos_theta_w = std::abs(cos_theta_w);
+  const Float sin_theta_w = SafeSqrt(1 - cos_theta_w * cos_theta_w);
+
+  // The angle subtended by the bounding sphere of the bounds seen from p
+  const Float radius2 = SquareNorm(bounds.getExtent()) / 4;
+  const Float dist2   = SquareNorm(p - center);
+  const Float cos_theta_b =
+      dist2 < radius2 ? -1 : SafeSqrt(1 - radius2 / dist2);
+  const Float sin_theta_b = SafeSqrt(1 - cos_theta_b * cos_theta_b);
+
+  // The smallest angle between the emitting normals and any direction from
+  // the bounds to p, beyond which nothing is emitted
+  const Float cos_theta_o = cone.cos_theta;
+  const Float sin_theta_o = SafeSqrt(1 - cos_theta_o * cos_theta_o);
+  const Float cos_theta_x =
+      CosSubClamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+  const Float sin_theta_x =
+      SinSubClamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+  const Float cos_theta_p =
+      CosSubClamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+  if (cos_theta_p <= cos_theta_e) return 0;
+
+  Float result = phi * cos_theta_p / d2;
+  if (SquareNorm(n) != 0) {
+    // The smallest incident angle on the surface at p
+    const Float cos_theta_i = std::abs(Dot(wi, n));
+    const Float sin_theta_i = SafeSqrt(1 - cos_theta_i * cos_theta_i);
+    result *=
+        CosSubClamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+  }
+  return std::max(result, 0.0F);
+}
+
+LightBounds Union(const LightBounds &a, const LightBounds &b) {
+  if (a.phi == 0) return b;
+  if (b.phi == 0) return a;
+  LightBounds result;
+  result.bounds      = AABB(a.bounds, b.bounds);
+  result.phi         = a.phi + b.phi;
+  result.cone        = Union(a.cone, b.cone);
+  result.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+  result.two_sided   = a.two_sided || b.two_sided;
+  return result;
+}
+
+/* ===================================================================== *
+ *
+ * AreaLight
+ *
+ * ===================================================================== */
+
 AreaLight::AreaLight(const Properties &props)
     : Light(props),
       radiance(props.getProperty<Vec3f>("radiance", Vec3f(1, 1, 1))) {}
@@ -76,6 +163,16 @@ Float AreaLight::energy() const {
   return 2 * PI * shape->area() * (radiance.x + radiance.y + radiance.z) / 3;
 }
 
+bool AreaLight::getLightBounds(LightBounds &light_bounds) const {
+  // One-sided emission, spreading over the hemisphere of the normal
+  light_bounds.bounds      = shape->getBound();
+  light_bounds.phi         = energy();
+  light_bounds.cone        = shape->getNormalCone();
+  light_bounds.cos_theta_e = 0;
+  light_bounds.two_sided   = false;
+  return true;
+}
+
 void InfiniteAreaLight::crossConfiguration(
     const CrossConfigurationContext &context) {
   auto texture_name = properties.getProperty<std::string>("texture_name");
@@ -107,8 +204,21 @@ Vec3f InfiniteAreaLight::Le(
   return texture->evaluate(new_interaction) * scale;
 }
 
-Float InfiniteAreaLight::pdf(const SurfaceInteraction &) const {
-  return 1.0 / (4.0 * PI);
+Float InfiniteAreaLight::pdf(const SurfaceInteraction &interaction) const {
+  // wo points from the light towards the scene
+  return pdfIncomingDirection(-interaction.wo);
+}
+
+Float InfiniteAreaLight::pdfIncomingDirection(const Vec3f &w) const {
+  if (distribution == nullptr) return 1.0 / (4.0 * PI);
+
+  const Vec2f scoord    = InverseSphericalDirection(dirWorldToLocal(w));
+  const Float sin_theta = std::sin(scoord[0]);
+  if (sin_theta == 0) return 0;
+
+  // The Jacobian from uv to solid angle is 2 * PI * PI * sin(theta)
+  const Vec2f uv(scoord[1] / (2.0 * PI), scoord[0] / PI);
+  return distribution->pdf(uv) / (2 * PI * PI * sin_theta);
 }
 
 Float InfiniteAreaLight::pdfDirection(
@@ -118,9 +228,24 @@ Float InfiniteAreaLight::pdfDirection(
 
 SurfaceInteraction InfiniteAreaLight::sample(
     SurfaceInteraction &interaction, Sampler &sampler) const {
-  const Vec3f &w         = UniformSampleSphere(sampler.get2D());
+  Vec3f w;
+  Float w_pdf = 1.0 / (4.0 * PI);
+  if (distribution == nullptr) {
+    w = UniformSampleSphere(sampler.get2D());
+  } else {
+    Float uv_pdf   = 0;
+    const Vec2f uv = distribution->sampleContinuous(sampler.get2D(), &uv_pdf);
+
+    const Float theta = uv[1] * PI;
+    const Float phi   = uv[0] * 2 * PI;
+    w                 = dirLocalToWorld(SphericalDirection(theta, phi));
+
+    const Float sin_theta = std::sin(theta);
+    w_pdf = sin_theta == 0 ? 0 : uv_pdf / (2 * PI * PI * sin_theta);
+  }
+
   auto light_interaction = sampleFromOutgoingDirection(-w);
-  light_interaction.setPdf(pdf(light_interaction), EMeasure::ESolidAngle);
+  light_interaction.setPdf(w_pdf, EMeasure::ESolidAngle);
   interaction.wi = w;
   return light_interaction;
 }
@@ -159,6 +284,40 @@ void InfiniteAreaLight::preprocess(const PreprocessContext &context) {
   scene_center      = bound.getCenter();
   radius            = 2 * Max(Norm(bound.upper_bnd - scene_center),
                               Norm(bound.low_bnd - scene_center), radius);
+
+  // Only image textures are importance sampled, at their own resolution so
+  // that the brightest texels are not blurred into their neighbours. Uniform
+  // sampling is already optimal for constant textures
+  const auto *image = dynamic_cast<const ImageTexture *>(texture.get());
+  if (image == nullptr) return;
+  const Vec2i resolution(image->getWidth(), image->getHeight());
+
+  // Le is interpolated bilinearly, so a bright texel also lights up the
+  // neighbouring cells. Integrate the interpolant over each cell exactly with
+  // its values at the center, the edge midpoints and the corners
+  constexpr Float CELL_WEIGHTS[3] = {0.25_F, 0.5_F, 0.25_F};
+  vector<Float> func(resolution.x * resolution.y);
+  SurfaceInteraction interaction;
+  for (int v = 0; v < resolution.y; ++v) {
+    // Weight by sin(theta) for the area distortion of the (phi, theta) mapping
+    const Float sin_theta = std::sin(PI * (v + 0.5_F) / resolution.y);
+    for (int u = 0; u < resolution.x; ++u) {
+      Float luminance = 0;
+      for (int j = 0; j < 3; ++j) {
+        for (int i = 0; i < 3; ++i) {
+          interaction.setUV(Vec2f((u + 0.5_F * i) / resolution.x,
+              (v + 0.5_F * j) / resolution.y));
+          luminance += CELL_WEIGHTS[i] * CELL_WEIGHTS[j] *
+                       Luminance(texture->evaluate(interaction));
+        }
+      }
+      func[u + v * resolution.x] = max(luminance, 0) * sin_theta;
+    }
+  }
+
+  distribution =
+      make_ref<Distribution2D>(func.data(), resolution.x, resolution.y);
+  if (distribution->getIntegral() == 0) distribution = nullptr;
 }
 
 RDR_NAMESPACE_END
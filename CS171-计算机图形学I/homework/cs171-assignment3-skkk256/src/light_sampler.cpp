@@ -0,0 +1,211 @@
+#include "rdr/light_sampler.h"
+
+#include <algorithm>
+
+#include "rdr/interaction.h"
+
+RDR_NAMESPACE_BEGIN
+
+BVHLightSampler::BVHLightSampler(const vector<ref<Light>> &lights) {
+  vector<std::pair<int, LightBounds>> bvh_lights;
+  for (const auto &light : lights) {
+    LightBounds light_bounds;
+    if (!light->getLightBounds(light_bounds)) {
+      infinite_lights.push_back(light);
+    } else if (light_bounds.phi > 0) {
+      bvh_lights.emplace_back(
+          static_cast<int>(bounded_lights.size()), light_bounds);
+      bounded_lights.push_back(light);
+    }
+  }
+
+  if (!bvh_lights.empty())
+    build(bvh_lights, 0, static_cast<int>(bvh_lights.size()), 0, 0);
+  Info_("Light BVH built over {} bounded and {} infinite light(s), {} nodes",
+      bounded_lights.size(), infinite_lights.size(), nodes.size());
+}
+
+int BVHLightSampler::build(vector<std::pair<int, LightBounds>> &bvh_lights,
+    int begin, int end, uint64_t bit_trail, int depth) {
+  if (depth >= 64) Exception_("Light BVH is too deep");
+  const int node_index = static_cast<int>(nodes.size());
+  if (end - begin == 1) {
+    const auto &[light_index, light_bounds] = bvh_lights[begin];
+    nodes.push_back({light_bounds, light_index, true});
+    bit_trails[bounded_lights[light_index].get()] = bit_trail;
+    return node_index;
+  }
+
+  AABB bounds, centroid_bounds;
+  for (int i = begin; i < end; ++i) {
+    bounds.unionWith(bvh_lights[i].second.bounds);
+    centroid_bounds.unionWith(bvh_lights[i].second.getCentroid());
+  }
+
+  // Find the bucketed split of the least cost over all dimensions
+  constexpr int N_BUCKETS = 12;
+  Float min_cost          = Float_INF;
+  int min_bucket = -1, min_dim = -1;
+  for (int dim = 0; dim < 3; ++dim) {
+    if (centroid_bounds.getDist(dim) <= 0) continue;
+
+    LightBounds bucket_bounds[N_BUCKETS];
+    for (int i = begin; i < end; ++i) {
+      const auto &light_bounds = bvh_lights[i].second;
+      const int bucket = std::min(N_BUCKETS - 1,
+          static_cast<int>(N_BUCKETS *
+                           (light_bounds.getCentroid()[dim] -
+                               centroid_bounds.low_bnd[dim]) /
+                           centroid_bounds.getDist(dim)));
+      bucket_bounds[bucket] = Union(bucket_bounds[bucket], light_bounds);
+    }
+
+    for (int split = 0; split < N_BUCKETS - 1; ++split) {
+      LightBounds below, above;
+      for (int b = 0; b <= split; ++b)
+        below = Union(below, bucket_bounds[b]);
+      for (int b = split + 1; b < N_BUCKETS; ++b)
+        above = Union(above, bucket_bounds[b]);
+
+      const Float cost = evaluateCost(below, bounds, dim) +
+                         evaluateCost(above, bounds, dim);
+      if (cost > 0 && cost < min_cost) {
+        min_cost   = cost;
+        min_bucket = split;
+        min_dim    = dim;
+      }
+    }
+  }
+
+  int middle = (begin + end) / 2;
+  if (min_dim != -1) {
+    const auto *split = std::partition(bvh_lights.data() + begin,
+        bvh_lights.data() + end, [&](const auto &bvh_light) {
+          const int bucket = std::min(N_BUCKETS - 1,
+              static_cast<int>(N_BUCKETS *
+                               (bvh_light.second.getCentroid()[min_dim] -
+                                   centroid_bounds.low_bnd[min_dim]) /
+                               centroid_bounds.getDist(min_dim)));
+          return bucket <= min_bucket;
+        });
+    middle = static_cast<int>(split - bvh_lights.data());
+    if (middle == begin || middle == end) middle = (begin + end) / 2;
+  }
+
+  // Allocate before recursion, which grows nodes
+  nodes.emplace_back();
+  const int first =
+      build(bvh_lights, begin, middle, bit_trail, depth + 1);
+  const int second = build(bvh_lights, middle, end,
+      bit_trail | (uint64_t(1) << depth), depth + 1);
+  assert(first == node_index + 1);
+  nodes[node_index] = {
+      Union(nodes[first].light_bounds, nodes[second].light_bounds), second,
+      false};
+  return node_index;
+}
+
+Float BVHLightSampler::evaluateCost(
+    const LightBounds &light_bounds, const AABB &bounds, int dim) const {
+  if (light_bounds.phi == 0) return 0;
+
+  // The solid angle measure of the cone spread by the emission
+  const Float theta_o = std::acos(std::clamp(light_bounds.cone.cos_theta,
+      -1.0F, 1.0F));
+  const Float theta_e =
+      std::acos(std::clamp(light_bounds.cos_theta_e, -1.0F, 1.0F));
+  const Float theta_w     = std::min(theta_o + theta_e, PI);
+  const Float sin_theta_o = std::sin(theta_o);
+  const Float m_omega =
+      2 * PI * (1 - std::cos(theta_o)) +
+      PI / 2 *
+          (2 * theta_w * sin_theta_o - std::cos(theta_o - 2 * theta_w) -
+              2 * theta_o * sin_theta_o + std::cos(theta_o));
+
+  // Penalize the splits across thin dimensions of the parent
+  const Float k_r = ReduceMax(bounds.getExtent()) / bounds.getDist(dim);
+  return light_bounds.phi * m_omega * k_r *
+         light_bounds.bounds.getSurfaceArea();
+}
+
+Float BVHLightSampler::getFirstChildProbability(
+    int node_index, const Vec3f &p, const Vec3f &n) const {
+  const LightBounds &first  = nodes[node_index + 1].light_bounds;
+  const LightBounds &second =
+      nodes[nodes[node_index].child_or_light_index].light_bounds;
+  const Float importance[2] = {first.importance(p, n), second.importance(p, n)};
+  if (importance[0] + importance[1] > 0)
+    return importance[0] / (importance[0] + importance[1]);
+  // Neither child is estimated to contribute, which the bounds may get wrong
+  // deep in the tree. Fall back to the power, which is never zero
+  return first.phi / (first.phi + second.phi);
+}
+
+ref<Light> BVHLightSampler::sample(
+    const SurfaceInteraction &interaction, Float u, Float *pmf) const {
+  const Float p_infinite = getInfiniteProbability();
+  if (u < p_infinite) {
+    const int index = std::min(
+        static_cast<int>(u / p_infinite * infinite_lights.size()),
+        static_cast<int>(infinite_lights.size()) - 1);
+    *pmf = p_infinite / infinite_lights.size();
+    return infinite_lights[index];
+  }
+  if (nodes.empty()) return nullptr;
+
+  const Vec3f &p = interaction.p;
+  const Vec3f &n = interaction.normal;
+  u = std::min((u - p_infinite) / (1 - p_infinite), 1 - Float_EPSILON);
+  Float result = 1 - p_infinite;
+  int node_index = 0;
+  while (true) {
+    const Node &node = nodes[node_index];
+    if (node.is_leaf) {
+      *pmf = result;
+      return bounded_lights[node.child_or_light_index];
+    }
+
+    // Choose a child and remap u for the next level
+    const Float first_pmf = getFirstChildProbability(node_index, p, n);
+    if (u < first_pmf) {
+      node_index = node_index + 1;
+      u          = std::min(u / first_pmf, 1 - Float_EPSILON);
+      result *= first_pmf;
+    } else {
+      node_index = node.child_or_light_index;
+      u = std::min((u - first_pmf) / (1 - first_pmf), 1 - Float_EPSILON);
+      result *= 1 - first_pmf;
+    }
+  }
+}
+
+Float BVHLightSampler::pmf(
+    const SurfaceInteraction &interaction, const Light *light) const {
+  const auto trail_iterator = bit_trails.find(light);
+  if (trail_iterator == bit_trails.end()) {
+    // Either an infinite light, or a light that is never sampled
+    const bool is_infinite =
+        std::any_of(infinite_lights.begin(), infinite_lights.end(),
+            [light](const ref<Light> &other) { return other.get() == light; });
+    return is_infinite ? getInfiniteProbability() / infinite_lights.size()
+                       : 0;
+  }
+
+  // Replay the choices of sample along the trail
+  const Vec3f &p     = interaction.p;
+  const Vec3f &n     = interaction.normal;
+  uint64_t bit_trail = trail_iterator->second;
+  Float result       = 1 - getInfiniteProbability();
+  int node_index     = 0;
+  while (!nodes[node_index].is_leaf) {
+    const Node &node      = nodes[node_index];
+    const Float first_pmf = getFirstChildProbability(node_index, p, n);
+    const int child       = static_cast<int>(bit_trail & 1);
+    result *= child == 0 ? first_pmf : 1 - first_pmf;
+    node_index = child == 0 ? node_index + 1 : node.child_or_light_index;
+    bit_trail >>= 1;
+  }
+  return result;
+}
+
+RDR_NAMESPACE_END
@@ -0,0 +1,295 @@
+#include "rdr/mesh_cache.h"
+
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "rdr/accel.h"
+#include "rdr/shape.h"
+
+RDR_NAMESPACE_BEGIN
+
+/* ===================================================================== *
+ *
+ * MappedFile
+ *
+ * ===================================================================== */
+
+#if defined(_WIN32)
+MappedFile::MappedFile(const fs::path &path) {
+  file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return;
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return;
+  mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) return;
+  const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (view == nullptr) return;
+  data = static_cast<const uint8_t *>(view);
+  size = static_cast<size_t>(file_size.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+  if (data != nullptr) UnmapViewOfFile(data);
+  if (mapping != nullptr) CloseHandle(mapping);
+  if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const fs::path &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    void *view = mmap(nullptr, static_cast<size_t>(file_stat.st_size),
+        PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view != MAP_FAILED) {
+      data = static_cast<const uint8_t *>(view);
+      size = static_cast<size_t>(file_stat.st_size);
+    }
+  }
+  // The mapping outlives the descriptor
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data != nullptr) munmap(const_cast<uint8_t *>(data), size);
+}
+#endif
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  uint64_t hash     = seed;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/* ===================================================================== *
+ *
+ * MeshCache
+ *
+ * ===================================================================== */
+
+namespace detail_ {
+constexpr char MESH_CACHE_MAGIC[8] = "RDRMESH";
+/// Every section starts on a cache line
+constexpr uint64_t MESH_CACHE_ALIGNMENT = 64;
+
+RDR_FORCEINLINE uint64_t AlignUp(uint64_t offset) {
+  return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+}  // namespace detail_
+
+uint32_t MeshCache::GetLayout() {
+  const uint16_t probe        = 1;
+  const bool is_little_endian = *reinterpret_cast<const uint8_t *>(&probe);
+  return sizeof(Float) | (sizeof(Vec3f) << 8) | (sizeof(Vec2f) << 16) |
+         (uint32_t(is_little_endian) << 24);
+}
+
+MeshCache::MeshCache(const fs::path &path, const MeshCacheKey &key)
+    : file(path) {
+  if (!file.isOpen() || file.getSize() < sizeof(Header)) return;
+
+  std::memcpy(&header, file.getData(), sizeof(Header));
+  if (std::memcmp(header.magic, detail_::MESH_CACHE_MAGIC,
+          sizeof(header.magic)) != 0 ||
+      header.version != VERSION || header.layout != GetLayout()) {
+    Warn_("Mesh cache [ {} ] is of another version, ignored", path.string());
+    return;
+  }
+  if (header.key.source_hash != key.source_hash ||
+      header.key.config_hash != key.config_hash) {
+    Info_("Mesh cache [ {} ] is stale", path.string());
+    return;
+  }
+
+  for (const auto &section : header.sections) {
+    if (section.offset % detail_::MESH_CACHE_ALIGNMENT != 0 ||
+        section.offset > file.getSize() ||
+        section.size > file.getSize() - section.offset) {
+      Warn_("Mesh cache [ {} ] is truncated, ignored", path.string());
+      return;
+    }
+  }
+
+  if (!isConsistent()) {
+    Warn_("Mesh cache [ {} ] is inconsistent, ignored", path.string());
+    return;
+  }
+  valid = true;
+}
+
+bool MeshCache::isConsistent() const {
+  // Every section holds whole elements
+  constexpr size_t ELEMENT_SIZES[N_SECTIONS] = {sizeof(Vec3f), sizeof(Vec3f),
+      sizeof(Vec2f), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t),
+      sizeof(Float), 1};
+  uint64_t counts[N_SECTIONS];
+  for (int i = 0; i < N_SECTIONS; ++i) {
+    if (header.sections[i].size % ELEMENT_SIZES[i] != 0) return false;
+    counts[i] = header.sections[i].size / ELEMENT_SIZES[i];
+  }
+  const auto count = [&](ESection section) {
+    return counts[static_cast<int>(section)];
+  };
+
+  // The index arrays are of the same length, one area per triangle
+  const uint64_t n_indices = count(ESection::EVertexIndices);
+  if (n_indices == 0 || n_indices % 3 != 0 ||
+      count(ESection::ENormalIndices) != n_indices ||
+      count(ESection::ETextureCoordinateIndices) != n_indices ||
+      count(ESection::EAreas) != n_indices / 3)
+    return false;
+
+  // The attributes are present as the flags say
+  if ((header.has_normal != 0) != (count(ESection::ENormals) > 0) ||
+      (header.has_texture != 0) != (count(ESection::ETextureCoordinates) > 0))
+    return false;
+
+  // A corrupted index would otherwise crash the render. The indices of an
+  // absent attribute are never read
+  const auto indices_in_range = [&](ESection indices, uint64_t n_attributes) {
+    BinaryReader reader(file.getData() + getSection(indices).offset,
+        n_indices * sizeof(uint32_t));
+    for (uint64_t i = 0; i < n_indices; ++i) {
+      uint32_t index;
+      reader.read(index);
+      if (index >= n_attributes) return false;
+    }
+    return true;
+  };
+  return indices_in_range(
+             ESection::EVertexIndices, count(ESection::EVertices)) &&
+         (header.has_normal == 0 ||
+             indices_in_range(
+                 ESection::ENormalIndices, count(ESection::ENormals))) &&
+         (header.has_texture == 0 ||
+             indices_in_range(ESection::ETextureCoordinateIndices,
+                 count(ESection::ETextureCoordinates)));
+}
+
+const MeshCache::Section &MeshCache::getSection(ESection section) const {
+  return header.sections[static_cast<int>(section)];
+}
+
+template <typename T>
+void MeshCache::readSection(ESection section, vector<T> &values) const {
+  const Section &range = getSection(section);
+  values.resize(range.size / sizeof(T));
+  std::memcpy(values.data(), file.getData() + range.offset,
+      values.size() * sizeof(T));
+}
+
+void MeshCache::getMesh(
+    TriangleMeshResource &mesh, vector<Float> &areas) const {
+  assert(valid);
+  readSection(ESection::EVertices, mesh.vertices);
+  readSection(ESection::ENormals, mesh.normals);
+  readSection(ESection::ETextureCoordinates, mesh.texture_coordinates);
+  readSection(ESection::EVertexIndices, mesh.v_indices);
+  readSection(ESection::ENormalIndices, mesh.n_indices);
+  readSection(ESection::ETextureCoordinateIndices, mesh.t_indices);
+  readSection(ESection::EAreas, areas);
+  mesh.has_normal  = header.has_normal != 0;
+  mesh.has_texture = header.has_texture != 0;
+}
+
+const uint8_t *MeshCache::getAccelData() const {
+  assert(valid);
+  return file.getData() + getSection(ESection::EAccel).offset;
+}
+
+size_t MeshCache::getAccelSize() const {
+  assert(valid);
+  return getSection(ESection::EAccel).size;
+}
+
+void MeshCache::Save(const fs::path &path, const MeshCacheKey &key,
+    const TriangleMeshResource &mesh, const vector<Float> &areas,
+    const Accel &accel) {
+  vector<uint8_t> accel_data;
+  if (!accel.serialize(accel_data)) accel_data.clear();
+
+  // The bytes of each section, in the order of ESection
+  const std::pair<const void *, uint64_t> contents[N_SECTIONS] = {
+      {mesh.vertices.data(), mesh.vertices.size() * sizeof(Vec3f)},
+      {mesh.normals.data(), mesh.normals.size() * sizeof(Vec3f)},
+      {mesh.texture_coordinates.data(),
+          mesh.texture_coordinates.size() * sizeof(Vec2f)},
+      {mesh.v_indices.data(), mesh.v_indices.size() * sizeof(uint32_t)},
+      {mesh.n_indices.data(), mesh.n_indices.size() * sizeof(uint32_t)},
+      {mesh.t_indices.data(), mesh.t_indices.size() * sizeof(uint32_t)},
+      {areas.data(), areas.size() * sizeof(Float)},
+      {accel_data.data(), accel_data.size()},
+  };
+
+  Header header{};
+  std::memcpy(header.magic, detail_::MESH_CACHE_MAGIC, sizeof(header.magic));
+  header.version     = VERSION;
+  header.layout      = GetLayout();
+  header.key         = key;
+  header.has_normal  = mesh.has_normal;
+  header.has_texture = mesh.has_texture;
+  uint64_t offset    = detail_::AlignUp(sizeof(Header));
+  for (int i = 0; i < N_SECTIONS; ++i) {
+    header.sections[i] = {offset, contents[i].second};
+    offset             = detail_::AlignUp(offset + contents[i].second);
+  }
+
+  // Readers only ever see a complete file
+  fs::path temp_path = path;
+  temp_path += ".tmp";
+  {
+    std::ofstream fout(temp_path, std::ios::binary | std::ios::trunc);
+    if (!fout.is_open()) {
+      Warn_("Can not open [ {} ] to write the mesh cache", temp_path.string());
+      return;
+    }
+    const char padding[detail_::MESH_CACHE_ALIGNMENT] = {};
+    fout.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    uint64_t written = sizeof(Header);
+    for (int i = 0; i < N_SECTIONS; ++i) {
+      fout.write(padding, header.sections[i].offset - written);
+      fout.write(static_cast<const char *>(contents[i].first),
+          static_cast<std::streamsize>(contents[i].second));
+      written = header.sections[i].offset + contents[i].second;
+    }
+    if (!fout.good()) {
+      Warn_("Failed to write the mesh cache [ {} ]", temp_path.string());
+      return;
+    }
+  }
+
+  std::error_code error;
+  fs::rename(temp_path, path, error);
+  if (error) {
+    Warn_("Failed to write the mesh cache [ {} ]: {}", path.string(),
+        error.message());
+    fs::remove(temp_path, error);
+    return;
+  }
+  Info_("Mesh cache written to [ {} ]", path.string());
+}
+
+MeshCacheKey MeshCache::ComputeKey(
+    const fs::path &source, const vector<uint8_t> &config) {
+  const MappedFile source_file(source);
+  if (!source_file.isOpen())
+    Exception_("Can not open [ {} ] to hash", source.string());
+
+  MeshCacheKey key;
+  key.source_hash = HashBytes(source_file.getData(), source_file.getSize());
+  key.config_hash = HashBytes(config.data(), config.size());
+  return key;
+}
+
+RDR_NAMESPACE_END
@@ -1,9 +1,15 @@
 #include "rdr/mipmap.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <exception>
 
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
 #include "rdr/math_aliases.h"
 #include "rdr/platform.h"
 
@@ -11,9 +17,101 @@ RDR_NAMESPACE_BEGIN
 
 Float renderer::MIPMap::gs_weight[renderer::MIPMap::WeightSize] = {};
 
+namespace detail_ {
+/// IEEE 754 binary16 to binary32 conversion, exact
+RDR_FORCEINLINE float HalfToFloat(uint16_t half) {
+#if defined(__F16C__)
+  return _cvtsh_ss(half);
+#else
+  constexpr uint32_t shifted_exponent = 0x7c00u << 13;
+  uint32_t bits                       = (half & 0x7fffu) << 13;
+  const uint32_t exponent             = bits & shifted_exponent;
+  bits += (127 - 15) << 23;
+  if (exponent == shifted_exponent) {
+    // Inf or NaN
+    bits += (128 - 16) << 23;
+  } else if (exponent == 0) {
+    // Subnormal, renormalized by the float subtraction
+    constexpr uint32_t magic_bits = 113u << 23;
+    float magic, value;
+    bits += 1u << 23;
+    std::memcpy(&magic, &magic_bits, sizeof(float));
+    std::memcpy(&value, &bits, sizeof(float));
+    value -= magic;
+    std::memcpy(&bits, &value, sizeof(float));
+  }
+  bits |= (half & 0x8000u) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(float));
+  return result;
+#endif
+}
+
+/// IEEE 754 binary32 to binary16 conversion, rounding to the nearest even.
+/// Values beyond the range of half become infinity
+RDR_FORCEINLINE uint16_t FloatToHalf(float value) {
+#if defined(__F16C__)
+  return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+  constexpr uint32_t infinity_bits = 255u << 23;
+  constexpr uint32_t overflow_bits = (127u + 16) << 23;
+  constexpr uint32_t denormal_bits = ((127u - 15) + (23 - 10) + 1) << 23;
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(float));
+  const uint32_t sign = bits & 0x80000000u;
+  bits ^= sign;
+
+  uint16_t result;
+  if (bits >= overflow_bits) {
+    result = bits > infinity_bits ? 0x7e00 : 0x7c00;
+  } else if (bits < (113u << 23)) {
+    // Subnormal, rounded by the float addition
+    float denormal_magic, rounded;
+    std::memcpy(&denormal_magic, &denormal_bits, sizeof(float));
+    std::memcpy(&rounded, &bits, sizeof(float));
+    rounded += denormal_magic;
+    std::memcpy(&bits, &rounded, sizeof(float));
+    result = static_cast<uint16_t>(bits - denormal_bits);
+  } else {
+    const uint32_t mantissa_odd = (bits >> 13) & 1;
+    bits += ((15u - 127) << 23) + 0xfff + mantissa_odd;
+    result = static_cast<uint16_t>(bits >> 13);
+  }
+  return result | static_cast<uint16_t>(sign >> 16);
+#endif
+}
+
+RDR_FORCEINLINE uint32_t Log2PowerOfTwo(uint32_t value) {
+  uint32_t result = 0;
+  while ((1u << result) < value) ++result;
+  return result;
+}
+
+/**
+ * @brief A direct-mapped cache of the decoded half texels of a thread, shared
+ * by all MIPMaps. The lookups of a pixel and of its neighbours fetch mostly
+ * the same texels, e.g. the overlapping footprints of EWA. Consecutive texels
+ * of a tile fall into different slots
+ */
+struct TexelCache {
+  static constexpr uint32_t SIZE = 256;
+  struct Entry {
+    uint32_t uid;  // 0 for an empty slot
+    uint32_t index;
+    Float value[3];
+  };
+  Entry entries[SIZE];
+};
+
+static std::atomic<uint32_t> n_mipmaps{0};
+}  // namespace detail_
+
 MIPMap::MIPMap(const Vec2u &in_resolution, const vector<Float> &in_data,
-    LookUpMethod in_method, ImageWrap in_wrap_mode)
-    : method(in_method), wrap_mode(in_wrap_mode) {
+    LookUpMethod in_method, ImageWrap in_wrap_mode, TexelFormat in_format)
+    : method(in_method),
+      wrap_mode(in_wrap_mode),
+      format(in_format),
+      uid(++detail_::n_mipmaps) {
   Vec2u res(1, 1);
   for (; res[0] < in_resolution[0]; res[0] <<= 1)
     ;
@@ -23,34 +121,60 @@ MIPMap::MIPMap(const Vec2u &in_resolution, const vector<Float> &in_data,
   const Float *pre_data = in_data.data();
   Vec2u pre_res         = in_resolution;
 
-  // Reverse the memory, or the pointer of data
+  // The levels are filtered from each other in row-major RGBA, then scattered
+  // into their tiles. Reverse the memory, or the pointer of staging
   // will change when you push_back
-  data.reserve(res[0] * res[1] * 6);
+  vector<Float> staging;
+  staging.reserve(res[0] * res[1] * 6);
 
   uint32_t cur_offset = 0;
   while (res[0] != 1 || res[1] != 1) {
-    offset.push_back(cur_offset);
-
-    const auto &cur = resolution.emplace_back(res);
-
+    LevelLayout &level  = levels.emplace_back();
+    level.resolution    = res;
+    level.offset        = cur_offset;
+    level.tile_shift[0] = detail_::Log2PowerOfTwo(std::min(res[0], TILE_SIZE));
+    level.tile_shift[1] = detail_::Log2PowerOfTwo(std::min(res[1], TILE_SIZE));
+    level.row_shift     = detail_::Log2PowerOfTwo(res[0]) - level.tile_shift[0];
+
+    const auto &cur = level.resolution;
     for (uint32_t y = 0; y < cur[1]; y++)
       for (uint32_t x = 0; x < cur[0]; x++) {
         const auto texel =
             Interpolate(pre_data, pre_res, Vec2f(x + 0.5f, y + 0.5f) / cur);
         for (uint32_t index = 0; index < 3; index++)
-          data.push_back(texel[index]);
+          staging.push_back(texel[index]);
         // aligned for alpha
-        data.push_back(0);
+        staging.push_back(0);
       }
 
     cur_offset += cur[0] * cur[1];
-    pre_data = data.data() + 4 * offset.back();
+    pre_data = staging.data() + 4 * level.offset;
     pre_res  = cur;
 
     res[0] = std::max(1u, res[0] >> 1);
     res[1] = std::max(1u, res[1] >> 1);
   }
 
+  // Drop the alpha channel, which is not looked up
+  if (format == TexelFormat::Single)
+    data.resize(3 * cur_offset);
+  else
+    half_data.resize(3 * cur_offset);
+  for (const auto &level : levels) {
+    for (uint32_t y = 0; y < level.resolution[1]; y++)
+      for (uint32_t x = 0; x < level.resolution[0]; x++) {
+        const Float *texel =
+            &staging[4 * (level.offset + y * level.resolution[0] + x)];
+        const uint32_t index = TexelIndex(level, x, y);
+        for (uint32_t c = 0; c < 3; c++) {
+          if (format == TexelFormat::Single)
+            data[3 * index + c] = texel[c];
+          else
+            half_data[3 * index + c] = detail_::FloatToHalf(texel[c]);
+        }
+      }
+  }
+
   // Initialize EWA filter weights (2D Gaussian distribution) if needed
   if (gs_weight[0] == 0.) {
     for (int i = 0; i < WeightSize; ++i) {
@@ -66,9 +190,9 @@ Vec3f MIPMap::Texel(uint32_t l, uint32_t s, uint32_t t) const {
     Exception_("the texel level {} is out of bound {}", l, Level());
     return {0, 0, 0};
   }
-  const auto &width  = resolution[l][0];
-  const auto &height = resolution[l][1];
-  const auto &ofs    = offset[l];
+  const auto &level  = levels[l];
+  const auto &width  = level.resolution[0];
+  const auto &height = level.resolution[1];
   switch (wrap_mode) {
     case ImageWrap::Repeat:
       s %= width;
@@ -81,7 +205,23 @@ Vec3f MIPMap::Texel(uint32_t l, uint32_t s, uint32_t t) const {
     case ImageWrap::Black:
       if (s < 0 || s >= width || t < 0 || t >= height) return {0, 0, 0};
   }
-  return Vec3f(&data[4 * (ofs + t * width + s)]);
+  const uint32_t index = TexelIndex(level, s, t);
+  if (format == TexelFormat::Half) return FetchHalf(index);
+  // A float texel is a single load, which the texel cache would not speed up
+  return Vec3f(&data[3 * index]);
+}
+
+Vec3f MIPMap::FetchHalf(uint32_t index) const noexcept {
+  thread_local detail_::TexelCache cache;
+  auto &entry = cache.entries[index & (detail_::TexelCache::SIZE - 1)];
+  if (entry.uid != uid || entry.index != index) {
+    const uint16_t *texel = &half_data[3 * index];
+    entry.uid             = uid;
+    entry.index           = index;
+    for (uint32_t c = 0; c < 3; c++)
+      entry.value[c] = detail_::HalfToFloat(texel[c]);
+  }
+  return Vec3f(entry.value);
 }
 
 Vec3f MIPMap::LookUp(const Vec2f &st, Float width) const noexcept {
@@ -131,8 +271,9 @@ Vec3f MIPMap::LookUp(const Vec2f &st, Vec2f dstdx, Vec2f dstdy) const noexcept {
 Vec3f MIPMap::TriTexel(uint32_t l, const Vec2f &st) const noexcept {
   l = std::clamp(l, 0u, Level() - 1);
 
-  const Float s = std::max(st[0] * resolution[l][0] - 0.5f, 0.0f);
-  const Float t = std::max(st[1] * resolution[l][1] - 0.5f, 0.0f);
+  const Vec2u &res = levels[l].resolution;
+  const Float s    = std::max(st[0] * res[0] - 0.5f, 0.0f);
+  const Float t    = std::max(st[1] * res[1] - 0.5f, 0.0f);
 
   const uint32_t lo_s = std::floor(s), hi_s = lo_s + 1;
   const uint32_t lo_t = std::floor(t), hi_t = lo_t + 1;
@@ -147,11 +288,12 @@ Vec3f MIPMap::EWA(uint32_t l, const Vec2f &st, const Vec2f &dst0,
     const Vec2f &dst1) const noexcept {
   l = std::clamp(l, 0u, Level() - 1);
 
-  const Float s = std::max(st[0] * resolution[l][0] - 0.5f, 0.0f);
-  const Float t = std::max(st[1] * resolution[l][1] - 0.5f, 0.0f);
+  const Vec2u &res = levels[l].resolution;
+  const Float s    = std::max(st[0] * res[0] - 0.5f, 0.0f);
+  const Float t    = std::max(st[1] * res[1] - 0.5f, 0.0f);
 
-  const auto sdst0 = dst0 * resolution[l];
-  const auto sdst1 = dst1 * resolution[l];
+  const auto sdst0 = dst0 * res;
+  const auto sdst1 = dst1 * res;
 
   Float A = sdst0[1] * sdst0[1] + sdst1[1] * sdst1[1] + 1;
   Float B = -2 * (sdst0[0] * sdst0[1] + sdst1[0] * sdst1[1]);
@@ -0,0 +1,163 @@
+#include "rdr/parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+RDR_NAMESPACE_BEGIN
+
+namespace detail_ {
+/// A contiguous range of work items owned by one worker. Both the owner and
+/// the thieves advance the same cursor, so a range never hands out one item
+/// twice and no lock is required.
+struct alignas(64) WorkRange {
+  std::atomic<int> next{0};
+  int end{0};
+};
+
+/// One call of ParallelFor, run by the calling thread and by the pool threads
+/// that join it. The counters are guarded by the lock of the pool
+struct ParallelJob {
+  ParallelJob(const std::function<void(int, int)> &func, int count,
+      int n_workers)
+      : func(func), n_workers(n_workers), ranges(n_workers) {
+    for (int w = 0; w < n_workers; ++w) {
+      ranges[w].next = static_cast<int>(int64_t(count) * w / n_workers);
+      ranges[w].end  = static_cast<int>(int64_t(count) * (w + 1) / n_workers);
+    }
+  }
+
+  void run(int worker_index) {
+    try {
+      // Drain the own range first, then visit the others in a fixed order
+      for (int k = 0; k < n_workers && !cancelled; ++k) {
+        auto &range = ranges[(worker_index + k) % n_workers];
+        while (!cancelled) {
+          const int index = range.next.fetch_add(1, std::memory_order_relaxed);
+          if (index >= range.end) break;
+          func(index, worker_index);
+        }
+      }
+    } catch (...) {
+      std::scoped_lock<std::mutex> lock(exception_lock);
+      if (exception == nullptr) exception = std::current_exception();
+      cancelled = true;
+    }
+  }
+
+  const std::function<void(int, int)> &func;
+  const int n_workers;
+  vector<WorkRange> ranges;
+
+  int n_joined{1};  // worker indices handed out, the caller being 0
+  int n_running{1};
+
+  std::exception_ptr exception{nullptr};
+  std::mutex exception_lock;
+  std::atomic<bool> cancelled{false};
+};
+
+/**
+ * @brief Threads that are started once and then wait for jobs, so that their
+ * thread-local state, e.g. the scratch arenas and the texel caches, stays warm
+ * between the calls of ParallelFor. Idle threads join the oldest job that is
+ * not yet fully staffed. Since the caller runs its own job as well, a job
+ * completes even if no thread joins it, which makes nested and concurrent
+ * calls safe.
+ */
+class ThreadPool {
+public:
+  /// Never destroyed, since the thread-local destructors of the workers may
+  /// refer to other static objects
+  static ThreadPool &Instance() {
+    static auto *pool = new ThreadPool;
+    return *pool;
+  }
+
+  void run(ParallelJob &job) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (static_cast<int>(threads.size()) < job.n_workers - 1)
+        threads.emplace_back([this] { workerLoop(); });
+      jobs.push_back(&job);
+    }
+    for (int w = 1; w < job.n_workers; ++w) wake.notify_one();
+
+    job.run(0);
+
+    // Every item is handed out, so no more threads may join
+    std::unique_lock<std::mutex> lock(mutex);
+    const auto it = std::find(jobs.begin(), jobs.end(), &job);
+    if (it != jobs.end()) jobs.erase(it);
+    --job.n_running;
+    done.wait(lock, [&] { return job.n_running == 0; });
+  }
+
+private:
+  ThreadPool() = default;
+
+  void workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [&] { return !jobs.empty(); });
+      ParallelJob &job       = *jobs.front();
+      const int worker_index = job.n_joined++;
+      if (job.n_joined == job.n_workers) jobs.pop_front();
+      ++job.n_running;
+
+      lock.unlock();
+      job.run(worker_index);
+      lock.lock();
+      if (--job.n_running == 0) done.notify_all();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  std::deque<ParallelJob *> jobs;
+  vector<std::thread> threads;
+};
+}  // namespace detail_
+
+int GetNumWorkers(int requested) {
+  if (requested > 0) return requested;
+  const unsigned int hardware = std::thread::hardware_concurrency();
+  return hardware == 0 ? 1 : static_cast<int>(hardware);
+}
+
+void ParallelFor(
+    int count, const std::function<void(int, int)> &func, int n_workers) {
+  if (count <= 0) return;
+  n_workers = std::min(GetNumWorkers(n_workers), count);
+  if (n_workers == 1) {
+    for (int i = 0; i < count; ++i) func(i, 0);
+    return;
+  }
+
+  detail_::ParallelJob job(func, count, n_workers);
+  detail_::ThreadPool::Instance().run(job);
+  if (job.exception != nullptr) std::rethrow_exception(job.exception);
+}
+
+void ParallelForTiles(const Vec2i &resolution, int tile_size,
+    const std::function<void(const Vec2i &, const Vec2i &, int)> &func,
+    int n_workers) {
+  if (tile_size <= 0) Exception_("Tile size should be greater than 0");
+  const Vec2i n_tiles((resolution.x + tile_size - 1) / tile_size,
+      (resolution.y + tile_size - 1) / tile_size);
+  ParallelFor(
+      n_tiles.x * n_tiles.y,
+      [&](int tile_index, int worker_index) {
+        const Vec2i tile(tile_index % n_tiles.x, tile_index / n_tiles.x);
+        const Vec2i low_bnd = tile * tile_size;
+        const Vec2i upper_bnd(std::min(low_bnd.x + tile_size, resolution.x),
+            std::min(low_bnd.y + tile_size, resolution.y));
+        func(low_bnd, upper_bnd, worker_index);
+      },
+      n_workers);
+}
+
+RDR_NAMESPACE_END
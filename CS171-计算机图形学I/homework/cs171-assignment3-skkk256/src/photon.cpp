@@ -0,0 +1,621 @@
+#include "rdr/photon.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+#include "rdr/bsdf.h"
+#include "rdr/camera.h"
+#include "rdr/film.h"
+#include "rdr/light.h"
+#include "rdr/parallel.h"
+#include "rdr/properties.h"
+#include "rdr/scene.h"
+
+RDR_NAMESPACE_BEGIN
+
+/* ===================================================================== *
+ *
+ * Photon
+ *
+ * ===================================================================== */
+
+namespace detail_ {
+/// The sines and cosines at the centers of the quantised angles
+struct PhotonDirectionTable {
+  std::array<Float, 256> cos_theta, sin_theta, cos_phi, sin_phi;
+
+  PhotonDirectionTable() {
+    for (int i = 0; i < 256; ++i) {
+      const Float theta = (i + 0.5_F) * PI / 256;
+      const Float phi   = (i + 0.5_F) * 2 * PI / 256 - PI;
+      cos_theta[i]      = std::cos(theta);
+      sin_theta[i]      = std::sin(theta);
+      cos_phi[i]        = std::cos(phi);
+      sin_phi[i]        = std::sin(phi);
+    }
+  }
+};
+
+static const PhotonDirectionTable &GetPhotonDirectionTable() {
+  static const PhotonDirectionTable table;
+  return table;
+}
+}  // namespace detail_
+
+Vec3f Photon::getPower() const {
+  if (power[3] == 0) return Vec3f(0.0);
+  const Float scale = std::ldexp(1.0_F, power[3] - (128 + 8));
+  return {(power[0] + 0.5_F) * scale, (power[1] + 0.5_F) * scale,
+      (power[2] + 0.5_F) * scale};
+}
+
+void Photon::setPower(const Vec3f &in_power) {
+  const Float max_power = ReduceMax(in_power);
+  if (!(max_power > 1e-32F)) {
+    power[0] = power[1] = power[2] = power[3] = 0;
+    return;
+  }
+
+  // The largest component takes the mantissa in [128, 256)
+  int exponent;
+  const Float scale = std::frexp(max_power, &exponent) * 256 / max_power;
+  for (int i = 0; i < 3; ++i)
+    power[i] = static_cast<uint8_t>(
+        std::clamp(in_power[i] * scale, 0.0_F, 255.0_F));
+  power[3] = static_cast<uint8_t>(std::clamp(exponent + 128, 1, 255));
+}
+
+Vec3f Photon::getDirection() const {
+  const auto &table = detail_::GetPhotonDirectionTable();
+  return {table.sin_theta[theta] * table.cos_phi[phi],
+      table.sin_theta[theta] * table.sin_phi[phi], table.cos_theta[theta]};
+}
+
+void Photon::setDirection(const Vec3f &direction) {
+  const Float theta_value = std::acos(std::clamp(direction.z, -1.0_F, 1.0_F));
+  const Float phi_value   = std::atan2(direction.y, direction.x);
+  theta                   = static_cast<uint8_t>(
+      std::clamp(static_cast<int>(theta_value * 256 / PI), 0, 255));
+  phi = static_cast<uint8_t>(std::clamp(
+      static_cast<int>((phi_value + PI) * 256 / (2 * PI)), 0, 255));
+}
+
+/* ===================================================================== *
+ *
+ * PhotonMap
+ *
+ * ===================================================================== */
+
+void PhotonMap::build(vector<Photon> in_photons) {
+  photons = std::move(in_photons);
+  build(0, static_cast<int>(photons.size()));
+}
+
+void PhotonMap::build(int begin, int end) {
+  if (end - begin <= 0) return;
+
+  // Split along the axis where the photons spread the most
+  AABB bounds;
+  for (int i = begin; i < end; ++i) bounds.unionWith(photons[i].position);
+  const int axis   = ArgMax(bounds.getExtent());
+  const int middle = (begin + end) / 2;
+  std::nth_element(photons.begin() + begin, photons.begin() + middle,
+      photons.begin() + end, [axis](const Photon &a, const Photon &b) {
+        return a.position[axis] < b.position[axis];
+      });
+  photons[middle].axis = static_cast<uint8_t>(axis);
+
+  build(begin, middle);
+  build(middle + 1, end);
+}
+
+void PhotonMap::getNearestPhotons(const Vec3f &p, int k, Float max_distance2,
+    vector<NearPhoton> &result) const {
+  result.clear();
+  if (k <= 0) return;
+  getNearestPhotons(
+      0, static_cast<int>(photons.size()), p, k, max_distance2, result);
+}
+
+void PhotonMap::getNearestPhotons(int begin, int end, const Vec3f &p, int k,
+    Float &max_distance2, vector<NearPhoton> &result) const {
+  if (end - begin <= 0) return;
+  const int middle      = (begin + end) / 2;
+  const Photon &photon  = photons[middle];
+  const Float delta     = p[photon.axis] - photon.position[photon.axis];
+  const bool near_first = delta < 0;
+
+  // The half containing p first, which shrinks the radius soonest
+  if (near_first) {
+    getNearestPhotons(begin, middle, p, k, max_distance2, result);
+  } else {
+    getNearestPhotons(middle + 1, end, p, k, max_distance2, result);
+  }
+
+  const Float distance2 = SquareNorm(photon.position - p);
+  if (distance2 < max_distance2) {
+    result.push_back({distance2, &photon});
+    std::push_heap(result.begin(), result.end());
+    if (static_cast<int>(result.size()) > k) {
+      std::pop_heap(result.begin(), result.end());
+      result.pop_back();
+    }
+    if (static_cast<int>(result.size()) == k)
+      max_distance2 = result.front().distance2;
+  }
+
+  // The other half may only hold closer photons across the splitting plane
+  if (delta * delta < max_distance2) {
+    if (near_first) {
+      getNearestPhotons(middle + 1, end, p, k, max_distance2, result);
+    } else {
+      getNearestPhotons(begin, middle, p, k, max_distance2, result);
+    }
+  }
+}
+
+/* ===================================================================== *
+ *
+ * PhotonMappingIntegratorBase
+ *
+ * ===================================================================== */
+
+namespace detail_ {
+constexpr int PHOTON_CHUNK_SIZE = 4096;
+}  // namespace detail_
+
+PhotonMappingIntegratorBase::PhotonMappingIntegratorBase(
+    const Properties &props, int spp, int default_n_iterations)
+    : Integrator(props),
+      max_depth(props.getProperty<int>("max_depth", 12)),
+      spp(spp),
+      rr_threshold(props.getProperty<Float>("rr_threshold", 0.1)),
+      n_photons(props.getProperty<int>("n_photons", 100000)),
+      n_iterations(
+          props.getProperty<int>("n_iterations", default_n_iterations)),
+      threads(props.getProperty<int>("threads", 0)),
+      tile_size(props.getProperty<int>("tile_size", 16)),
+      sampler_type(props.getProperty<Properties>("sampler", Properties{})
+                       .getProperty<std::string>("type", "independent")),
+      sampler(CreateSampler(
+          props.getProperty<Properties>("sampler", Properties{}),
+          spp * n_iterations)) {
+  if (spp <= 0) Exception_("spp should be greater than 0");
+  if (n_photons <= 0) Exception_("n_photons should be greater than 0");
+  if (n_iterations <= 0) Exception_("n_iterations should be greater than 0");
+  if (tile_size <= 0) Exception_("tile_size should be greater than 0");
+}
+
+template <typename Deposit>
+void PhotonMappingIntegratorBase::tracePhotons(
+    const ref<Scene> &scene, int iteration, const Deposit &deposit) const {
+  constexpr int CHUNK_SIZE = detail_::PHOTON_CHUNK_SIZE;
+  const int n_chunks       = (n_photons + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  const Light *infinite_light = scene->getInfiniteLight().get();
+
+  ParallelFor(
+      n_chunks,
+      [&](int chunk, int) {
+        IndependentSampler sampler;
+        const int begin = chunk * CHUNK_SIZE;
+        const int end   = std::min(begin + CHUNK_SIZE, n_photons);
+        for (int i = begin; i < end; ++i) {
+          sampler.startPixelSample(Vec2i(chunk, iteration), i - begin);
+
+          // Choose a light by its power, then a point and a direction on it
+          Float light_pmf = 0;
+          auto light      = scene->sampleEmitterDiscrete(sampler, &light_pmf);
+          if (light.get() == infinite_light) continue;
+          const SurfaceInteraction light_interaction = light->sample(sampler);
+          Float direction_pdf = 0;
+          const Vec3f direction =
+              light->sampleDirection(light_interaction, sampler, direction_pdf);
+          const Float pdf = light_pmf * light_interaction.pdf * direction_pdf;
+          if (!(pdf > 0)) continue;
+
+          Vec3f beta = light->Le(light_interaction, direction) *
+                       std::abs(Dot(direction, light_interaction.normal)) /
+                       (pdf * n_photons);
+          Ray ray = light_interaction.spawnRay(direction);
+          for (int depth = 0; depth < max_depth; ++depth) {
+            SurfaceInteraction interaction;
+            if (!scene->intersect(ray, interaction)) break;
+            if (interaction.isLight() || !interaction.isValid()) break;
+
+            // The direct light is sampled by the camera paths instead
+            if (depth > 0 && !interaction.isSpecular())
+              deposit(chunk, interaction, beta);
+
+            Float bsdf_pdf = 0;
+            const Vec3f f =
+                interaction.bsdf->sample(interaction, sampler, &bsdf_pdf);
+            if (SquareNorm(f) < EPS || !(bsdf_pdf > 0)) break;
+            beta *= f * std::abs(interaction.cosThetaI()) / bsdf_pdf;
+
+            if (depth > 0) {
+              if (sampler.get1D() < rr_threshold) break;
+              beta /= 1.0_F - rr_threshold;
+            }
+            ray = interaction.spawnRay(interaction.wi);
+          }
+        }
+      },
+      threads);
+}
+
+Vec3f PhotonMappingIntegratorBase::traceSpecularChain(
+    const ref<Scene> &scene, DifferentialRay &ray, Sampler &sampler,
+    SurfaceInteraction &interaction, Vec3f &beta) const {
+  Vec3f L(0.0);  // NOLINT
+  beta = Vec3f(1.0);
+  for (int depth = 0; depth < max_depth; ++depth) {
+    interaction = SurfaceInteraction();
+    if (!scene->intersect(ray, interaction)) {
+      if (scene->hasInfiniteLight()) {
+        const auto light_interaction =
+            scene->getInfiniteLight()->sampleFromOutgoingDirection(
+                -ray.direction);
+        L += beta * light_interaction.light->Le(
+                        light_interaction, light_interaction.wo);
+      }
+      break;
+    }
+    if (interaction.isLight()) {
+      L += beta * interaction.light->Le(interaction, interaction.wo);
+      break;
+    }
+    if (!interaction.isValid()) break;
+    if (!interaction.isSpecular()) return L;
+
+    Float bsdf_pdf = 0;
+    const Vec3f f = interaction.bsdf->sample(interaction, sampler, &bsdf_pdf);
+    if (SquareNorm(f) < EPS || !(bsdf_pdf > 0)) break;
+    beta *= f * std::abs(interaction.cosThetaI()) / bsdf_pdf;
+    ray = interaction.spawnRay(interaction.wi);
+  }
+  beta = Vec3f(0.0);
+  return L;
+}
+
+Vec3f PhotonMappingIntegratorBase::estimateDirect(const ref<Scene> &scene,
+    const SurfaceInteraction &interaction, Sampler &sampler) {
+  auto ref_interaction = interaction;
+  const auto light_interaction =
+      scene->sampleEmitterDirect(ref_interaction, sampler);
+  if (!(light_interaction.cosThetaO() > 0)) return Vec3f(0.0);
+
+  const Ray shadow_ray = light_interaction.isInfLight()
+                           ? ref_interaction.spawnRay(ref_interaction.wi)
+                           : ref_interaction.spawnRayTo(light_interaction);
+  if (scene->isBlocked(shadow_ray)) return Vec3f(0.0);
+
+  // The same estimate as Path::estimate on the last two vertices
+  const Float G = std::abs(ref_interaction.cosThetaI()) *
+                  std::abs(light_interaction.cosThetaO()) /
+                  SquareNorm(light_interaction.p - ref_interaction.p);
+  const Float light_pdf = Path::toPdfMeasure(
+      light_interaction, ref_interaction, EMeasure::EArea);
+  if (!(light_pdf > 0)) return Vec3f(0.0);
+  const Vec3f f  = ref_interaction.bsdf->evaluate(ref_interaction);
+  const Vec3f Le =  // NOLINT
+      light_interaction.light->Le(light_interaction, light_interaction.wo);
+  return f * G / light_pdf * Le;
+}
+
+/* ===================================================================== *
+ *
+ * PhotonMappingIntegrator
+ *
+ * ===================================================================== */
+
+PhotonMappingIntegrator::PhotonMappingIntegrator(const Properties &props)
+    : PhotonMappingIntegratorBase(props, props.getProperty<int>("spp", 4), 1),
+      n_near_photons(props.getProperty<int>("n_near_photons", 64)),
+      max_radius(props.getProperty<Float>("max_radius", 0)) {
+  if (n_near_photons <= 0)
+    Exception_("n_near_photons should be greater than 0");
+}
+
+void PhotonMappingIntegrator::render(ref<Camera> camera, ref<Scene> scene) {
+  using Clock = std::chrono::steady_clock;
+
+  ref<Film> film          = camera->getFilm();
+  const Vec2i &resolution = film->getResolution();
+  const int n_workers     = GetNumWorkers(threads);
+  Info_("Rendering {}x{} with {} worker(s), {} iteration(s) of {} photons",
+      resolution.x, resolution.y, n_workers, n_iterations, n_photons);
+  if (scene->hasInfiniteLight())
+    Warn_("Photons are not emitted from the infinite light, whose indirect "
+          "light is missing");
+
+  vector<ref<Sampler>> samplers(n_workers);
+  for (auto &worker_sampler : samplers) worker_sampler = this->sampler->clone();
+  vector<vector<PhotonMap::NearPhoton>> near_photons(n_workers);
+
+  for (int iteration = 0; iteration < n_iterations; ++iteration) {
+    const auto start = Clock::now();
+    emitPhotons(scene, iteration);
+    const auto emitted = Clock::now();
+
+    // Sample indices continue over the iterations
+    ParallelForTiles(
+        resolution, tile_size,
+        [&](const Vec2i &low_bnd, const Vec2i &upper_bnd, int worker_index) {
+          Sampler &sampler = *samplers[worker_index];
+          FilmTile film_tile(*film, low_bnd, upper_bnd);
+          for (int y = low_bnd.y; y < upper_bnd.y; ++y) {
+            for (int x = low_bnd.x; x < upper_bnd.x; ++x) {
+              const Vec2i pixel(x, y);
+              for (int s = iteration * spp; s < (iteration + 1) * spp; ++s) {
+                sampler.startPixelSample(pixel, s);
+                const Vec2f sample = sampler.getPixelSample();
+                DifferentialRay ray =
+                    camera->generateDifferentialRay(sample.x, sample.y);
+                const Vec3f L =
+                    Li(scene, ray, sampler, near_photons[worker_index]);
+                film_tile.commitSample(sample, L);
+                film->commitPixelStatistics(pixel, Luminance(L));
+              }
+            }
+          }
+          sampler.resetAfterIteration();
+          film->mergeTile(film_tile);
+        },
+        n_workers);
+
+    Info_("Iteration {}: {} photons stored in {:.2f}s, gathered in {:.2f}s",
+        iteration, photon_map.size(),
+        std::chrono::duration<Float>(emitted - start).count(),
+        std::chrono::duration<Float>(Clock::now() - emitted).count());
+  }
+}
+
+void PhotonMappingIntegrator::emitPhotons(
+    const ref<Scene> &scene, int iteration) {
+  vector<vector<Photon>> chunk_photons(
+      (n_photons + detail_::PHOTON_CHUNK_SIZE - 1) /
+      detail_::PHOTON_CHUNK_SIZE);
+  tracePhotons(scene, iteration,
+      [&](int chunk, const SurfaceInteraction &interaction, const Vec3f &beta) {
+        Photon photon;
+        photon.position = interaction.p;
+        photon.setDirection(interaction.wo);
+        photon.setPower(beta);
+        chunk_photons[chunk].push_back(photon);
+      });
+
+  // Concatenated in the order of the chunks
+  vector<Photon> photons;
+  for (auto &chunk : chunk_photons)
+    photons.insert(photons.end(), chunk.begin(), chunk.end());
+  photon_map.build(std::move(photons));
+}
+
+Vec3f PhotonMappingIntegrator::Li(const ref<Scene> &scene,  // NOLINT
+    DifferentialRay &ray, Sampler &sampler,
+    vector<PhotonMap::NearPhoton> &near_photons) const {
+  SurfaceInteraction interaction;
+  Vec3f beta;
+  Vec3f L = traceSpecularChain(  // NOLINT
+      scene, ray, sampler, interaction, beta);
+  if (SquareNorm(beta) == 0) return L;
+  return L + beta * (estimateDirect(scene, interaction, sampler) +
+                        estimateIndirect(interaction, near_photons));
+}
+
+Vec3f PhotonMappingIntegrator::estimateIndirect(
+    const SurfaceInteraction &interaction,
+    vector<PhotonMap::NearPhoton> &near_photons) const {
+  const Float max_distance2 =
+      max_radius > 0 ? max_radius * max_radius : Float_INF;
+  photon_map.getNearestPhotons(
+      interaction.p, n_near_photons, max_distance2, near_photons);
+  if (near_photons.empty()) return Vec3f(0.0);
+
+  // The photons within the disk through the farthest one
+  auto gather_interaction = interaction;
+  Vec3f result(0.0);
+  for (const auto &near_photon : near_photons) {
+    gather_interaction.wi = near_photon.photon->getDirection();
+    result += gather_interaction.bsdf->evaluate(gather_interaction) *
+              near_photon.photon->getPower();
+  }
+  // Fewer than k photons within max_radius are spread over its whole disk
+  const Float radius2 =
+      static_cast<int>(near_photons.size()) < n_near_photons && max_radius > 0
+          ? max_distance2
+          : near_photons.front().distance2;
+  return radius2 > 0 ? result / (PI * radius2) : Vec3f(0.0);
+}
+
+/* ===================================================================== *
+ *
+ * StochasticProgressivePhotonMappingIntegrator
+ *
+ * ===================================================================== */
+
+namespace detail_ {
+void SPPMPixel::update(Float alpha) {
+  const int n_received = m.load(std::memory_order_relaxed);
+  if (n_received > 0) {
+    const Float new_n      = n + alpha * n_received;
+    const Float new_radius = radius * std::sqrt(new_n / (n + n_received));
+    tau = (tau + beta * phi) * (new_radius * new_radius) / (radius * radius);
+
+    n      = new_n;
+    radius = new_radius;
+    phi    = Vec3f(0.0);
+    m.store(0, std::memory_order_relaxed);
+  }
+  beta = Vec3f(0.0);
+}
+
+void SPPMGrid::build(const vector<SPPMPixel> &pixels, int threads) {
+  const int n_pixels = static_cast<int>(pixels.size());
+  for (auto &head : heads) head.store(-1, std::memory_order_relaxed);
+
+  bounds           = AABB();
+  Float max_radius = 0;
+  for (const auto &pixel : pixels) {
+    if (SquareNorm(pixel.beta) == 0) continue;
+    bounds.unionWith(pixel.interaction.p - Vec3f(pixel.radius));
+    bounds.unionWith(pixel.interaction.p + Vec3f(pixel.radius));
+    max_radius = std::max(max_radius, pixel.radius);
+  }
+  nodes.clear();
+  if (!(max_radius > 0)) return;
+
+  // Cells about as large as the largest radius
+  const Vec3f extent     = bounds.getExtent();
+  const Float max_extent = ReduceMax(extent);
+  const int base_resolution =
+      std::clamp(static_cast<int>(max_extent / max_radius), 1, 1 << 16);
+  for (int i = 0; i < 3; ++i) {
+    resolution[i] = std::max(
+        static_cast<int>(base_resolution * extent[i] / max_extent), 1);
+  }
+
+  // Count the cells overlapped by each visible point
+  offsets.resize(n_pixels + 1);
+  offsets[0] = 0;
+  for (int i = 0; i < n_pixels; ++i) {
+    const auto &pixel = pixels[i];
+    int n_cells       = 0;
+    if (SquareNorm(pixel.beta) > 0) {
+      const Vec3i low  = getCell(pixel.interaction.p - Vec3f(pixel.radius));
+      const Vec3i high = getCell(pixel.interaction.p + Vec3f(pixel.radius));
+      n_cells          = ReduceProduct(high - low + Vec3i(1));
+    }
+    offsets[i + 1] = offsets[i] + n_cells;
+  }
+  nodes.resize(offsets[n_pixels]);
+
+  ParallelFor(
+      n_pixels,
+      [&](int i, int) {
+        if (offsets[i] == offsets[i + 1]) return;
+        const auto &pixel = pixels[i];
+        const Vec3i low   = getCell(pixel.interaction.p - Vec3f(pixel.radius));
+        const Vec3i high  = getCell(pixel.interaction.p + Vec3f(pixel.radius));
+        int node          = offsets[i];
+        for (int z = low.z; z <= high.z; ++z) {
+          for (int y = low.y; y <= high.y; ++y) {
+            for (int x = low.x; x <= high.x; ++x, ++node) {
+              const Vec3i cell(x, y, z);
+              auto &head  = heads[hash(cell)];
+              nodes[node] = {i, head.load(std::memory_order_relaxed), cell};
+              while (!head.compare_exchange_weak(nodes[node].next, node,
+                  std::memory_order_relaxed)) {
+              }
+            }
+          }
+        }
+      },
+      threads);
+}
+}  // namespace detail_
+
+StochasticProgressivePhotonMappingIntegrator::
+    StochasticProgressivePhotonMappingIntegrator(const Properties &props)
+    : PhotonMappingIntegratorBase(props, 1, 64),
+      initial_radius(props.getProperty<Float>("initial_radius", 0)),
+      alpha(props.getProperty<Float>("alpha", 2.0 / 3.0)) {
+  if (!(alpha > 0 && alpha <= 1)) Exception_("alpha should be in (0, 1]");
+}
+
+void StochasticProgressivePhotonMappingIntegrator::render(
+    ref<Camera> camera, ref<Scene> scene) {
+  using Clock = std::chrono::steady_clock;
+
+  ref<Film> film          = camera->getFilm();
+  const Vec2i &resolution = film->getResolution();
+  const int n_pixels      = resolution.x * resolution.y;
+  const int n_workers     = GetNumWorkers(threads);
+  const Float radius      = initial_radius > 0
+                              ? initial_radius
+                              : 0.01_F * Norm(scene->getBound().getExtent());
+  Info_("Rendering {}x{} with {} worker(s), {} iteration(s) of {} photons, "
+        "initial radius {}",
+      resolution.x, resolution.y, n_workers, n_iterations, n_photons, radius);
+  if (scene->hasInfiniteLight())
+    Warn_("Photons are not emitted from the infinite light, whose indirect "
+          "light is missing");
+
+  vector<detail_::SPPMPixel> pixels(n_pixels);
+  for (auto &pixel : pixels) pixel.radius = radius;
+  detail_::SPPMGrid grid(n_pixels);
+
+  vector<ref<Sampler>> samplers(n_workers);
+  for (auto &worker_sampler : samplers) worker_sampler = this->sampler->clone();
+
+  const auto start = Clock::now();
+  for (int iteration = 0; iteration < n_iterations; ++iteration) {
+    // The light seen directly, and the visible points
+    ParallelForTiles(
+        resolution, tile_size,
+        [&](const Vec2i &low_bnd, const Vec2i &upper_bnd, int worker_index) {
+          Sampler &sampler = *samplers[worker_index];
+          FilmTile film_tile(*film, low_bnd, upper_bnd);
+          for (int y = low_bnd.y; y < upper_bnd.y; ++y) {
+            for (int x = low_bnd.x; x < upper_bnd.x; ++x) {
+              const Vec2i pixel_index(x, y);
+              auto &pixel = pixels[x + resolution.x * y];
+              sampler.startPixelSample(pixel_index, iteration);
+              const Vec2f sample = sampler.getPixelSample();
+              DifferentialRay ray =
+                  camera->generateDifferentialRay(sample.x, sample.y);
+              Vec3f L = traceSpecularChain(  // NOLINT
+                  scene, ray, sampler, pixel.interaction, pixel.beta);
+              if (SquareNorm(pixel.beta) > 0) {
+                L += pixel.beta *
+                     estimateDirect(scene, pixel.interaction, sampler);
+              }
+              film_tile.commitSample(sample, L);
+              film->commitPixelStatistics(pixel_index, Luminance(L));
+            }
+          }
+          sampler.resetAfterIteration();
+          film->mergeTile(film_tile);
+        },
+        n_workers);
+
+    // Splat the photons onto the visible points around them
+    grid.build(pixels, n_workers);
+    tracePhotons(scene, iteration,
+        [&](int, const SurfaceInteraction &interaction, const Vec3f &beta) {
+          grid.forEachPixel(interaction.p, [&](int index) {
+            auto &pixel = pixels[index];
+            if (SquareNorm(pixel.interaction.p - interaction.p) >
+                pixel.radius * pixel.radius)
+              return;
+            auto gather_interaction = pixel.interaction;
+            gather_interaction.wi   = interaction.wo;
+            const Vec3f phi =
+                gather_interaction.bsdf->evaluate(gather_interaction) * beta;
+            for (int i = 0; i < 3; ++i) AtomicAdd(pixel.phi[i], phi[i]);
+            pixel.m.fetch_add(1, std::memory_order_relaxed);
+          });
+        });
+
+    // Shrink the radii by the photons received
+    ParallelFor(
+        n_pixels, [&](int i, int) { pixels[i].update(alpha); }, n_workers);
+
+    if ((iteration + 1) % std::max(n_iterations / 10, 1) == 0) {
+      Info_("Iteration {}/{} done in {:.2f}s", iteration + 1, n_iterations,
+          std::chrono::duration<Float>(Clock::now() - start).count());
+    }
+  }
+
+  // The indirect light is the flux of all of the photon passes over the final
+  // disks, which is not filtered
+  for (int y = 0; y < resolution.y; ++y) {
+    for (int x = 0; x < resolution.x; ++x) {
+      film->getLightPixel(x, y) +=
+          pixels[x + resolution.x * y].getIndirectRadiance(n_iterations);
+    }
+  }
+}
+
+RDR_NAMESPACE_END
@@ -4,6 +4,7 @@
 #include "rdr/bsdf.h"
 #include "rdr/interaction.h"
 #include "rdr/light.h"
+#include "rdr/ray.h"
 #include "rdr/shape.h"
 
 RDR_NAMESPACE_BEGIN
@@ -31,31 +32,48 @@ void Primitive::crossConfiguration(const CrossConfigurationContext &context) {
   clearProperties();
 }
 
+bool Primitive::occluded(const Ray &ray) const {
+  return shape->occluded(ray);
+}
+
 bool Primitive::intersect(Ray &ray, SurfaceInteraction &interaction) const {
   if (shape->intersect(ray, interaction)) {
-    if (bsdf) {
-      // primitive is responsible for setting these
-      if (bsdf->isDelta()) {
-        interaction.type = ESurfaceInteractionType::ESpecular;
-      } else if (dynamic_cast<MicrofacetReflection *>(bsdf.get()) != nullptr) {
-        interaction.type = ESurfaceInteractionType::EGlossy;
-      } else {
-        interaction.type = ESurfaceInteractionType::EDiffuse;
-      }
-    }
+    commitInteraction(ray, interaction);
+    return true;
+  }
 
-    // not for bi-direction method
-    interaction.wo = -ray.direction;
+  return false;
+}
 
-    // set the type of interaction
-    // which is set to GEOMETRY if light is not presented
-    if (area_light) interaction.type = ESurfaceInteractionType::ELight;
-    interaction.setPrimitive(bsdf.get(), area_light.get(), this);
+uint32_t Primitive::intersectPacket(RayPacket &packet, uint32_t mask,
+    SurfaceInteraction *interactions) const {
+  const uint32_t result = shape->intersectPacket(packet, mask, interactions);
+  for (int i = 0; i < packet.n_rays; ++i)
+    if (result & (uint32_t(1) << i))
+      commitInteraction(packet.rays[i], interactions[i]);
+  return result;
+}
 
-    return true;
+void Primitive::commitInteraction(
+    const Ray &ray, SurfaceInteraction &interaction) const {
+  if (bsdf) {
+    // primitive is responsible for setting these
+    if (bsdf->isDelta()) {
+      interaction.type = ESurfaceInteractionType::ESpecular;
+    } else if (dynamic_cast<MicrofacetReflection *>(bsdf.get()) != nullptr) {
+      interaction.type = ESurfaceInteractionType::EGlossy;
+    } else {
+      interaction.type = ESurfaceInteractionType::EDiffuse;
+    }
   }
 
-  return false;
+  // not for bi-direction method
+  interaction.wo = -ray.direction;
+
+  // set the type of interaction
+  // which is set to GEOMETRY if light is not presented
+  if (area_light) interaction.type = ESurfaceInteractionType::ELight;
+  interaction.setPrimitive(bsdf.get(), area_light.get(), this);
 }
 
 AABB Primitive::getBound() const {
@@ -0,0 +1,341 @@
+/**
+ * @file regression.cpp
+ * @brief End-to-end regression harness. Every reference scene is rendered
+ * in-process at a few sample counts and compared with its mitsuba reference,
+ * recording the wall time, the throughput and the error. The results are
+ * written as JSON, to be passed as the baseline of a later run, and as an
+ * equal-time convergence table. The harness fails if the throughput or the
+ * error regresses beyond a tolerance of the baseline.
+ */
+#include <tinyexr.h>
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "nlohmann/json.hpp"
+#include "rdr/render.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+static void printHelp(int, char *argv[]) {  // NOLINT
+  print(
+      "Usage: {} [options] [<scene name>...]\n"
+      "  --help,-h                Print this help text.\n"
+      "  --data <dir>             The directory of the scenes, holding the\n"
+      "                           references in mitsuba/reference/.\n"
+      "  --spp <n,n,...>          The sample counts to render at.\n"
+      "  --output,-o <dir>        Where the images and results are written.\n"
+      "  --baseline <json>        The results.json of an earlier run.\n"
+      "  --time-tolerance <f>     The relative loss of throughput allowed.\n"
+      "  --error-tolerance <f>    The relative growth of relMSE allowed.\n"
+      "The scenes default to those of data/validate.sh.\n",
+      argv[0]);
+}
+
+/// The result of a scene at a sample count
+struct Measurement {
+  int spp{0};
+  /// In seconds; initialize and preprocess, and render
+  Double load_time{0}, render_time{0};
+  Double samples_per_second{0};
+  Double mse{0}, rel_mse{0};
+};
+
+/* ===================================================================== *
+ *
+ * Rendering and Comparison
+ *
+ * ===================================================================== */
+
+static vector<Vec3f> LoadExr(const fs::path &path, int *width, int *height) {
+  float *out      = nullptr;
+  const char *err = nullptr;
+  if (LoadEXR(&out, width, height, path.string().c_str(), &err) !=
+      TINYEXR_SUCCESS) {
+    const std::string message = err;
+    FreeEXRErrorMessage(err);
+    Exception_("Failed to load EXR {}: {}", path.string(), message);
+  }
+
+  vector<Vec3f> result;
+  result.reserve(*width * *height);
+  for (int i = 0; i < *width * *height; ++i)
+    result.emplace_back(out[4 * i + 0], out[4 * i + 1], out[4 * i + 2]);
+  free(out);
+  return result;
+}
+
+/// MSE as exrtools, and the MSE relative to the squared reference
+static void ComputeError(const vector<Vec3f> &image,
+    const vector<Vec3f> &reference, Double *mse, Double *rel_mse) {
+  // Keeps the relative error of the black pixels bounded
+  constexpr Double REL_MSE_EPSILON = 1e-2;
+
+  *mse     = 0;
+  *rel_mse = 0;
+  for (size_t i = 0; i < image.size(); ++i) {
+    for (int c = 0; c < 3; ++c) {
+      const Double difference = Double(image[i][c]) - reference[i][c];
+      const Double squared    = difference * difference;
+      const Double normalizer =
+          Double(reference[i][c]) * reference[i][c] + REL_MSE_EPSILON;
+      *mse += squared;
+      *rel_mse += squared / normalizer;
+    }
+  }
+  *mse /= 3.0 * image.size();
+  *rel_mse /= 3.0 * image.size();
+}
+
+static Measurement RenderScene(const nlohmann::json &scene_json, int spp,
+    const fs::path &image_path, const vector<Vec3f> &reference) {
+  using Clock = std::chrono::steady_clock;
+
+  nlohmann::json root_json       = scene_json;
+  root_json["integrator"]["spp"] = spp;
+  const Vec2i resolution(root_json["film"]["resolution"][0].get<int>(),
+      root_json["film"]["resolution"][1].get<int>());
+
+  Measurement measurement;
+  measurement.spp = spp;
+
+  const auto start            = Clock::now();
+  ref<RenderInterface> render = make_ref<NativeRender>(Properties(root_json));
+  render->initialize();
+  render->preprocess();
+  const auto loaded = Clock::now();
+  render->render();
+  const auto rendered = Clock::now();
+  render->exportImageToDisk(image_path);
+  render->clearRuntimeInfo();
+
+  measurement.load_time = std::chrono::duration<Double>(loaded - start).count();
+  measurement.render_time =
+      std::chrono::duration<Double>(rendered - loaded).count();
+  measurement.samples_per_second =
+      Double(resolution.x) * resolution.y * spp / measurement.render_time;
+
+  int width = 0, height = 0;
+  const vector<Vec3f> image = LoadExr(image_path, &width, &height);
+  if (image.size() != reference.size())
+    Exception_("The resolution of [ {} ] differs from the reference",
+        image_path.string());
+  ComputeError(image, reference, &measurement.mse, &measurement.rel_mse);
+  return measurement;
+}
+
+/* ===================================================================== *
+ *
+ * Reporting
+ *
+ * ===================================================================== */
+
+static nlohmann::json ToJson(const Measurement &measurement) {
+  return {{"spp", measurement.spp}, {"load_time", measurement.load_time},
+      {"render_time", measurement.render_time},
+      {"samples_per_second", measurement.samples_per_second},
+      {"mse", measurement.mse}, {"rel_mse", measurement.rel_mse}};
+}
+
+/// The baseline measurement of scene at spp, or null if there is none
+static const nlohmann::json *FindBaseline(
+    const nlohmann::json &baseline, const std::string &scene, int spp) {
+  if (!baseline.contains("scenes") || !baseline["scenes"].contains(scene))
+    return nullptr;
+  for (const auto &entry : baseline["scenes"][scene])
+    if (entry["spp"].get<int>() == spp) return &entry;
+  return nullptr;
+}
+
+/**
+ * @brief The error of an unbiased estimator falls as 1/t, so relMSE * t is the
+ * relMSE expected after one second of rendering. Comparing it across the rows
+ * and against the baseline compares the scenes and runs at equal time.
+ */
+static std::string ConvergenceTable(
+    const std::map<std::string, vector<Measurement>> &results,
+    const nlohmann::json &baseline) {
+  std::ostringstream oss;
+  oss << "| scene | spp | render (s) | samples/s | MSE | relMSE "
+         "| relMSE x t | baseline relMSE x t |\n"
+      << "|---|---:|---:|---:|---:|---:|---:|---:|\n";
+  for (const auto &[scene, measurements] : results) {
+    for (const auto &m : measurements) {
+      std::string baseline_efficiency = "-";
+      if (const auto *entry = FindBaseline(baseline, scene, m.spp))
+        baseline_efficiency = format("{:.4e}",
+            (*entry)["rel_mse"].get<Double>() *
+                (*entry)["render_time"].get<Double>());
+      oss << format("| {} | {} | {:.3f} | {:.3e} | {:.4e} | {:.4e} | {:.4e} "
+                    "| {} |\n",
+          scene, m.spp, m.render_time, m.samples_per_second, m.mse, m.rel_mse,
+          m.rel_mse * m.render_time, baseline_efficiency);
+    }
+  }
+  return oss.str();
+}
+
+/// Log every measurement regressing beyond the tolerances; return their count
+static int CheckRegressions(
+    const std::map<std::string, vector<Measurement>> &results,
+    const nlohmann::json &baseline, Double time_tolerance,
+    Double error_tolerance) {
+  int n_regressions = 0;
+  for (const auto &[scene, measurements] : results) {
+    for (const auto &m : measurements) {
+      const auto *entry = FindBaseline(baseline, scene, m.spp);
+      if (entry == nullptr) continue;
+
+      const Double throughput = (*entry)["samples_per_second"].get<Double>();
+      if (m.samples_per_second < (1 - time_tolerance) * throughput) {
+        Error_("[ {} @ {} spp ] throughput {:.3e} samples/s is below the "
+               "baseline {:.3e}",
+            scene, m.spp, m.samples_per_second, throughput);
+        ++n_regressions;
+      }
+
+      const Double rel_mse = (*entry)["rel_mse"].get<Double>();
+      if (m.rel_mse > (1 + error_tolerance) * rel_mse) {
+        Error_("[ {} @ {} spp ] relMSE {:.4e} is above the baseline {:.4e}",
+            scene, m.spp, m.rel_mse, rel_mse);
+        ++n_regressions;
+      }
+    }
+  }
+  return n_regressions;
+}
+
+/* ===================================================================== *
+ *
+ * Entry
+ *
+ * ===================================================================== */
+
+static vector<int> ParseSppList(const std::string &list) {
+  vector<int> result;
+  std::istringstream iss(list);
+  for (std::string item; std::getline(iss, item, ',');)
+    result.push_back(std::stoi(item));
+  if (result.empty()) Exception_("No sample count in [ {} ]", list);
+  return result;
+}
+
+int rdr_main(int argc, char *argv[]) {  // NOLINT: alias of main function
+  fs::path data_path = RDR_DATA_DIR;
+  fs::path output_path{"regression"};
+  std::optional<fs::path> baseline_path{};
+  vector<int> spp_list{4, 16, 64};
+  Double time_tolerance  = 0.2;
+  Double error_tolerance = 0.1;
+  vector<std::string> scenes{};
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      printHelp(argc, argv);
+      return 0;
+    }
+
+    // The other options take a value
+    if (arg.rfind("-", 0) == 0 && i + 1 >= argc) {
+      print("Missing value after [ {} ]\n", arg);
+      printHelp(argc, argv);
+      return 1;
+    }
+    if (arg == "--data") {
+      data_path = argv[++i];
+    } else if (arg == "--spp") {
+      spp_list = ParseSppList(argv[++i]);
+    } else if (arg == "--output" || arg == "-o") {
+      output_path = argv[++i];
+    } else if (arg == "--baseline") {
+      baseline_path = argv[++i];
+    } else if (arg == "--time-tolerance") {
+      time_tolerance = std::stod(argv[++i]);
+    } else if (arg == "--error-tolerance") {
+      error_tolerance = std::stod(argv[++i]);
+    } else {
+      scenes.push_back(arg);
+    }
+  }
+  if (scenes.empty())
+    scenes = {"env_sphere_1", "glass_sphere", "cbox", "veach", "matpreview"};
+
+  // The progress of the renders is not of interest
+  InitLogger(true, true);
+  Factory::doRegisterAllClasses();
+  fs::create_directories(output_path);
+
+  nlohmann::json baseline = nlohmann::json::object();
+  if (baseline_path.has_value()) {
+    std::ifstream fin(baseline_path.value());
+    if (!fin.is_open())
+      Exception_("Can not open the baseline [ {} ]",
+          baseline_path.value().string());
+    fin >> baseline;
+  }
+
+  std::map<std::string, vector<Measurement>> results;
+  for (const auto &scene : scenes) {
+    const fs::path scene_path = data_path / (scene + ".json");
+    std::ifstream fin(scene_path);
+    if (!fin.is_open())
+      Exception_("Can not open the JSON file [ {} ]", scene_path.string());
+    nlohmann::json scene_json;
+    fin >> scene_json;
+    FileResolver::setBasePath(data_path);
+
+    int width = 0, height = 0;
+    const vector<Vec3f> reference = LoadExr(
+        data_path / "mitsuba" / "reference" / (scene + ".exr"), &width,
+        &height);
+
+    for (int spp : spp_list) {
+      const fs::path image_path =
+          fs::absolute(output_path / format("{}_{}spp.exr", scene, spp));
+      const Measurement m =
+          RenderScene(scene_json, spp, image_path, reference);
+      print("{:<16} {:>6} spp  {:8.3f}s  {:.3e} samples/s  relMSE {:.4e}\n",
+          scene, spp, m.render_time, m.samples_per_second, m.rel_mse);
+      results[scene].push_back(m);
+    }
+  }
+
+  nlohmann::json output = {{"spp", spp_list}};
+  for (const auto &[scene, measurements] : results)
+    for (const auto &m : measurements)
+      output["scenes"][scene].push_back(ToJson(m));
+  std::ofstream(output_path / "results.json") << output.dump(2) << '\n';
+
+  const std::string table = ConvergenceTable(results, baseline);
+  std::ofstream(output_path / "convergence.md") << table;
+  print("\n{}\n", table);
+
+  const int n_regressions =
+      CheckRegressions(results, baseline, time_tolerance, error_tolerance);
+  if (n_regressions > 0) {
+    Error_("{} regressions against [ {} ]", n_regressions,
+        baseline_path.value().string());
+    return 1;
+  }
+  return 0;
+}
+
+// Wrapped as the renderer, so that the exceptions are printed
+int main(int argc, char *argv[]) {
+  int ret_val = 0;
+
+  try {
+    ret_val = rdr_main(argc, argv);
+  } catch (const rdr_exception &e) {
+    ret_val = 1;
+    Error_("Renderer local exception encountered: {}", e.what());
+  } catch (const std::exception &e) {
+    ret_val = 2;
+    Error_("Renderer non-local exception encountered: {}", e.what());
+  }
+
+  return ret_val;
+}
@@ -1,11 +1,17 @@
 #include "rdr/render.h"
 
+#include <fstream>
+
 #include "rdr/all_integrators.h"
 #include "rdr/film.h"
+#include "rdr/shape.h"
+#include "rdr/stats.h"
 
 RDR_NAMESPACE_BEGIN
 
 void NativeRender::initialize() {
+  RDR_STAT_PHASE(EInitialize);
+
   /* ===================================================================== *
    *
    * Initialize CrossConfigurationContext from Properties
@@ -42,6 +48,14 @@ void NativeRender::initialize() {
           BSDF, material_properties.getProperty<Properties>(name));
   }
 
+  // Shared by the "instance" shapes, hence created prior to the objects
+  if (props.hasProperty("meshes")) {
+    auto mesh_properties = props.getProperty<Properties>("meshes");
+    for (const auto &[name, _] : mesh_properties)
+      cross_context.meshes[name] = RDR_CREATE_CLASS(
+          TriangleMesh, mesh_properties.getProperty<Properties>(name));
+  }
+
   if (props.hasProperty("objects")) {
     auto object_properties = props.getProperty<vector<Properties>>("objects");
     for (const auto &primitive_properties : object_properties)
@@ -71,12 +85,14 @@ void NativeRender::clearRuntimeInfo() {
   cross_context      = CrossConfigurationContext{};
   preprocess_context = PreprocessContext{};
   global_context.clear();
+  Statistics::clear();
 
   // Must be executed in the last since it releases all the memory allocated
   RenderInterface::clearRuntimeInfo();
 }
 
 void NativeRender::preprocess() {
+  RDR_STAT_PHASE(EPreprocess);
   preprocess_context.scene = cross_context.scene;
   for (ConfigurableObject *cobject : global_context)
     cobject->preprocess(preprocess_context);
@@ -89,16 +105,41 @@ void NativeRender::preprocess() {
 }
 
 void NativeRender::render() {
-  // render scene
-  cross_context.integrator->render(cross_context.camera, cross_context.scene);
+  {
+    RDR_STAT_PHASE(ERender);
+    // render scene
+    cross_context.integrator->render(cross_context.camera, cross_context.scene);
+  }
+
+#ifdef USE_STATS
+  Statistics::report(getStatisticsPath());
+#endif
 }
 
 bool NativeRender::exportImageToDisk(const fs::path &path) const {
-  // save image to disk
-  cross_context.film->exportImageToFile(FileResolver::resolveToAbs(path));
+  {
+    RDR_STAT_PHASE(EExport);
+    // save image to disk
+    cross_context.film->exportImageToFile(FileResolver::resolveToAbs(path));
+  }
+
+#ifdef USE_STATS
+  // Rewrite the summary of render() with the export time
+  const fs::path statistics_path = getStatisticsPath();
+  if (!statistics_path.empty()) {
+    std::ofstream fout(statistics_path);
+    fout << Statistics::toJson(Statistics::gather()) << '\n';
+  }
+#endif
   return true;
 }
 
+fs::path NativeRender::getStatisticsPath() const {
+  if (!props.hasProperty("statistics")) return {};
+  return FileResolver::resolveToAbs(
+      props.getProperty<std::string>("statistics"));
+}
+
 vector<Vec3f> NativeRender::exportImageToArray() const {
   vector<Vec3f> result;
   cross_context.film->exportImageToArray(result);
@@ -0,0 +1,237 @@
+#include "rdr/sampler.h"
+
+#include <array>
+
+#include "rdr/properties.h"
+
+RDR_NAMESPACE_BEGIN
+
+namespace detail_ {
+/// The first HaltonSampler::MAX_DIMENSION primes
+static const std::array<int, HaltonSampler::MAX_DIMENSION> &GetPrimes() {
+  static const auto primes = [] {
+    std::array<int, HaltonSampler::MAX_DIMENSION> result{};
+    int n = 0;
+    for (int candidate = 2; n < HaltonSampler::MAX_DIMENSION; ++candidate) {
+      bool is_prime = true;
+      for (int k = 0; k < n && result[k] * result[k] <= candidate; ++k) {
+        if (candidate % result[k] == 0) {
+          is_prime = false;
+          break;
+        }
+      }
+      if (is_prime) result[n++] = candidate;
+    }
+    return result;
+  }();
+  return primes;
+}
+
+/// The direction numbers of the first four Sobol dimensions. The first is
+/// the van der Corput sequence, the others follow Joe and Kuo's new-joe-kuo-6
+/// table, i.e. (s, a, m) = (1, 0, {1}), (2, 1, {1, 3}), (3, 1, {1, 3, 1})
+static const std::array<std::array<uint32_t, 32>, 4> &GetSobolMatrices() {
+  static const auto matrices = [] {
+    struct Primitive {
+      int s;
+      uint32_t a;
+      uint32_t m[3];
+    };
+    const Primitive primitives[3] = {
+        {1, 0, {1}},
+        {2, 1, {1, 3}},
+        {3, 1, {1, 3, 1}},
+    };
+
+    std::array<std::array<uint32_t, 32>, 4> result{};
+    for (int i = 0; i < 32; ++i) result[0][i] = 1U << (31 - i);
+    for (int d = 1; d < 4; ++d) {
+      const auto &[s, a, m] = primitives[d - 1];
+      auto &v               = result[d];
+      for (int i = 0; i < s; ++i) v[i] = m[i] << (31 - i);
+      for (int i = s; i < 32; ++i) {
+        v[i] = v[i - s] ^ (v[i - s] >> s);
+        for (int k = 1; k < s; ++k)
+          if ((a >> (s - 1 - k)) & 1) v[i] ^= v[i - k];
+      }
+    }
+    return result;
+  }();
+  return matrices;
+}
+
+RDR_FORCEINLINE uint32_t ReverseBits(uint32_t x) {
+  x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+  x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fU) | ((x & 0x0f0f0f0fU) << 4);
+  x = ((x >> 8) & 0x00ff00ffU) | ((x & 0x00ff00ffU) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+/// A hash of x that only propagates to the higher bits [Laine and Karras 2011]
+RDR_FORCEINLINE uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed) {
+  x += seed;
+  x ^= x * 0x6c50b47cU;
+  x ^= x * 0xb82f1e52U;
+  x ^= x * 0xc7afe638U;
+  x ^= x * 0x8d22f6e6U;
+  return x;
+}
+}  // namespace detail_
+
+uint32_t PermutationElement(uint32_t i, uint32_t n, uint32_t seed) {
+  assert(n > 0);
+  uint32_t w = n - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  // Cycle-walk a bijection on [0, w] until the result falls into [0, n)
+  do {
+    i ^= seed;
+    i *= 0xe170893dU;
+    i ^= seed >> 16;
+    i ^= (i & w) >> 4;
+    i ^= seed >> 8;
+    i *= 0x0929eb3fU;
+    i ^= seed >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | seed >> 27;
+    i *= 0x6935fa69U;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303U;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3U;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3dfU;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= n);
+  return (i + seed) % n;
+}
+
+uint32_t NestedUniformScramble(uint32_t x, uint32_t seed) {
+  x = detail_::ReverseBits(x);
+  x = detail_::LaineKarrasPermutation(x, seed);
+  return detail_::ReverseBits(x);
+}
+
+uint32_t SobolSample(uint32_t index, int dimension) {
+  assert(dimension >= 0 && dimension < 4);
+  const auto &v   = detail_::GetSobolMatrices()[dimension];
+  uint32_t result = 0;
+  for (int i = 0; index != 0; index >>= 1, ++i)
+    if (index & 1) result ^= v[i];
+  return result;
+}
+
+Float OwenScrambledRadicalInverse(int base_index, uint64_t a, uint32_t seed) {
+  const int base           = detail_::GetPrimes()[base_index];
+  const Float inverse      = 1.0_F / static_cast<Float>(base);
+  uint64_t reversed_digits = 0;
+  Float inverse_base_m     = 1;
+  int digit_index          = 0;
+  // Stop once the remaining digits are below the precision of Float
+  while (1 - inverse_base_m < 1) {
+    const uint64_t next = a / base;
+    const auto digit    = static_cast<uint32_t>(a - next * base);
+    // The permutation of a digit depends on all the digits before it. The
+    // depth is hashed as well, or a run of zeros would share one permutation
+    const uint32_t permuted = PermutationElement(digit, base,
+        static_cast<uint32_t>(Hash(seed, reversed_digits, digit_index++)));
+    reversed_digits = reversed_digits * base + permuted;
+    inverse_base_m *= inverse;
+    a = next;
+  }
+  return std::min(inverse_base_m * reversed_digits, 1 - Float_EPSILON);
+}
+
+/* ===================================================================== *
+ *
+ * Samplers
+ *
+ * ===================================================================== */
+
+StratifiedSampler::StratifiedSampler(int spp, int seed) : PixelSampler(seed) {
+  if (spp <= 0) Exception_("spp should be greater than 0");
+  // The most square grid with exactly spp cells
+  x_samples = static_cast<int>(std::sqrt(static_cast<double>(spp)));
+  while (spp % x_samples != 0) --x_samples;
+  y_samples = spp / x_samples;
+}
+
+Float StratifiedSampler::get1D() {
+  const int spp      = x_samples * y_samples;
+  const uint64_t key = Hash(pixel_hash, dimension++, sample_index / spp);
+  const uint32_t stratum =
+      PermutationElement(sample_index % spp, spp, static_cast<uint32_t>(key));
+  const Float jitter = BitsToFloat(static_cast<uint32_t>(key >> 32) ^
+                                   static_cast<uint32_t>(MixBits(stratum)));
+  return std::min((stratum + jitter) / spp, 1 - Float_EPSILON);
+}
+
+Vec2f StratifiedSampler::get2D() {
+  const int spp      = x_samples * y_samples;
+  const uint64_t key = Hash(pixel_hash, dimension++, sample_index / spp);
+  const uint32_t stratum =
+      PermutationElement(sample_index % spp, spp, static_cast<uint32_t>(key));
+  const uint64_t jitter = MixBits(key ^ stratum);
+  const int x           = static_cast<int>(stratum) % x_samples;
+  const int y           = static_cast<int>(stratum) / x_samples;
+  return {std::min((x + BitsToFloat(static_cast<uint32_t>(jitter))) /
+                       x_samples,
+              1 - Float_EPSILON),
+      std::min((y + BitsToFloat(static_cast<uint32_t>(jitter >> 32))) /
+                   y_samples,
+          1 - Float_EPSILON)};
+}
+
+Float HaltonSampler::get1D() {
+  const int d = dimension++;
+  if (d >= MAX_DIMENSION) {
+    return BitsToFloat(
+        static_cast<uint32_t>(Hash(pixel_hash, sample_index, d) >> 32));
+  }
+  return OwenScrambledRadicalInverse(
+      d, sample_index, static_cast<uint32_t>(Hash(pixel_hash, d)));
+}
+
+uint32_t SobolSampler::sample(int group, int component) const {
+  // All components of a group share the index shuffle, which keeps the 4D
+  // stratification while decorrelating the groups [Burley 2020]
+  const uint64_t group_hash = Hash(pixel_hash, group);
+  const uint32_t index      = NestedUniformScramble(
+      static_cast<uint32_t>(sample_index), static_cast<uint32_t>(group_hash));
+  return NestedUniformScramble(SobolSample(index, component),
+      static_cast<uint32_t>(MixBits(group_hash ^ component)));
+}
+
+Float SobolSampler::get1D() {
+  const int d = dimension++;
+  return BitsToFloat(sample(d / 4, d % 4));
+}
+
+Vec2f SobolSampler::get2D() {
+  // Pair the components as (0, 1) and (2, 3), never across two groups
+  if (dimension % 2 != 0) ++dimension;
+  const int d = dimension;
+  dimension += 2;
+  return {BitsToFloat(sample(d / 4, d % 4)),
+      BitsToFloat(sample(d / 4, d % 4 + 1))};
+}
+
+ref<Sampler> CreateSampler(const Properties &props, int spp) {
+  const auto type = props.getProperty<std::string>("type", "independent");
+  const int seed  = props.getProperty<int>("seed", 0);
+  if (type == "independent") return make_ref<IndependentSampler>(seed);
+  if (type == "stratified") return make_ref<StratifiedSampler>(spp, seed);
+  if (type == "halton") return make_ref<HaltonSampler>(seed);
+  if (type == "sobol") return make_ref<SobolSampler>(seed);
+  Exception_("Sampler type {} not supported; use independent, stratified, "
+             "halton or sobol",
+      type);
+  return nullptr;
+}
+
+RDR_NAMESPACE_END
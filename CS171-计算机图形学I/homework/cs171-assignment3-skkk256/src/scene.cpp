@@ -3,7 +3,9 @@
 #include "rdr/accel.h"
 #include "rdr/integrator.h"
 #include "rdr/light.h"
+#include "rdr/light_sampler.h"
 #include "rdr/primitive.h"
+#include "rdr/stats.h"
 
 RDR_NAMESPACE_BEGIN
 
@@ -18,14 +20,30 @@ void Scene::crossConfiguration(const CrossConfigurationContext &context) {
     addInfiniteLight(context.environment_map);
   }
 
+  const auto accel_props =
+      properties.getProperty<Properties>("accel", Properties{});
+  primitive_tree.setHeuristicProfile(ParseBVHHeuristicProfile(
+      accel_props.getProperty<std::string>("heuristic", "median")));
+
+  const auto light_sampler_name =
+      properties.getProperty<std::string>("light_sampler", "power");
+  if (light_sampler_name == "power") {
+    light_sampler = ELightSampler::EPower;
+  } else if (light_sampler_name == "bvh") {
+    light_sampler = ELightSampler::EBVH;
+  } else {
+    Exception_("Light sampler {} not supported; use power or bvh",
+        light_sampler_name);
+  }
   clearProperties();
+}
 
+void Scene::preprocess(const PreprocessContext &context) {
   // Still, a hack; make sure that scene bound is built prior to other
-  // initialization
+  // initialization. Postponed from crossConfiguration, since the bounds of
+  // the instances are only known after theirs
   primitive_tree.build();
-}
 
-void Scene::preprocess(const PreprocessContext &context) {
   std::vector<Float> weights;
   if (hasInfiniteLight()) {
     for (const auto &_ : lights) weights.push_back(1.0F);
@@ -36,6 +54,8 @@ void Scene::preprocess(const PreprocessContext &context) {
   }
 
   lights_dist = make_ref<Distribution1D>(weights.data(), weights.size());
+  if (light_sampler == ELightSampler::EBVH)
+    light_tree = make_ref<BVHLightSampler>(lights);
 }
 
 void Scene::addPrimitive(ref<Primitive> &primitive) {
@@ -54,16 +74,24 @@ void Scene::addInfiniteLight(const ref<InfiniteAreaLight> &light) {
 }
 
 bool Scene::isBlocked(const Ray &shadow_ray) const {
-  SurfaceInteraction in;
-  return isBlocked(shadow_ray, in);
+  return occluded(shadow_ray);
 }
 
 bool Scene::isBlocked(
     const Ray &shadow_ray, SurfaceInteraction &interaction) const {
-  return intersect(shadow_ray, interaction);
+  // Counted as a shadow ray only
+  const bool blocked = traverse(shadow_ray, interaction);
+  RDR_STAT_INC(EShadowRays);
+  if (blocked) RDR_STAT_INC(EShadowRaysBlocked);
+  return blocked;
 }
 
 bool Scene::intersect(const Ray &ray, SurfaceInteraction &interaction) const {
+  RDR_STAT_INC(ERays);
+  return traverse(ray, interaction);
+}
+
+bool Scene::traverse(const Ray &ray, SurfaceInteraction &interaction) const {
   Ray new_ray      = ray;
   bool intersected = primitive_tree.intersect(new_ray,
       [&interaction](
@@ -75,6 +103,27 @@ bool Scene::intersect(const Ray &ray, SurfaceInteraction &interaction) const {
   return intersected;
 }
 
+uint32_t Scene::intersectPacket(
+    const RayPacket &packet, SurfaceInteraction *interactions) const {
+  RDR_STAT_ADD(ERays, packet.n_rays);
+  RayPacket local_packet = packet;
+  return primitive_tree.intersectPacket(local_packet, local_packet.getMask(),
+      [interactions](RayPacket &internal_packet, uint32_t mask,
+          const ref<Primitive> &primitive) -> uint32_t {
+        return primitive->intersectPacket(internal_packet, mask, interactions);
+      });
+}
+
+bool Scene::occluded(const Ray &ray) const {
+  const bool blocked = primitive_tree.occluded(ray,
+      [](Ray &internal_ray, const ref<Primitive> &primitive) -> bool {
+        return primitive->occluded(internal_ray);
+      });
+  RDR_STAT_INC(EShadowRays);
+  if (blocked) RDR_STAT_INC(EShadowRaysBlocked);
+  return blocked;
+}
+
 Float Scene::pdfEmitterDirect(const SurfaceInteraction &interaction) const {
   assert(interaction.isValid());
 
@@ -99,6 +148,27 @@ Float Scene::pdfEmitterDiscrete(const SurfaceInteraction &interaction) const {
   }
 }
 
+Float Scene::pdfEmitterDirect(const SurfaceInteraction &ref,
+    const SurfaceInteraction &interaction) const {
+  assert(interaction.isValid());
+
+  switch (interaction.type) {
+    case ESurfaceInteractionType::ELight:
+    case ESurfaceInteractionType::EInfLight:
+      return interaction.light->pdf(interaction) *
+             pdfEmitterDiscrete(ref, interaction);
+    default: {
+      Exception_("Unsupported interaction type!");
+    }
+  }
+}
+
+Float Scene::pdfEmitterDiscrete(const SurfaceInteraction &ref,
+    const SurfaceInteraction &interaction) const {
+  if (light_tree == nullptr) return pdfEmitterDiscrete(interaction);
+  return light_tree->pmf(ref, interaction.light);
+}
+
 ref<Light> Scene::sampleEmitterDiscrete(Sampler &sampler, Float *pmf) const {
   if (getLights().empty()) Exception_("No light in the scene!");
 
@@ -109,10 +179,27 @@ ref<Light> Scene::sampleEmitterDiscrete(Sampler &sampler, Float *pmf) const {
   return lights[light_id];
 }
 
+ref<Light> Scene::sampleEmitterDiscrete(
+    const SurfaceInteraction &ref, Sampler &sampler, Float *pmf) const {
+  if (light_tree == nullptr) return sampleEmitterDiscrete(sampler, pmf);
+  if (getLights().empty()) Exception_("No light in the scene!");
+
+  const Float u = sampler.get1D();
+  if (auto light = light_tree->sample(ref, u, pmf); light != nullptr) {
+    AssertAllValid(*pmf);
+    return light;
+  }
+
+  // Only the lights without power are left out of the tree, and any of them
+  // contributes nothing. Still return a light, as the callers expect one
+  const int light_id = lights_dist->sampleDiscrete(u, pmf);
+  return lights[light_id];
+}
+
 SurfaceInteraction Scene::sampleEmitterDirect(
     SurfaceInteraction &interaction, Sampler &sampler) const {
   Float light_pmf        = 0.0;
-  auto light             = sampleEmitterDiscrete(sampler, &light_pmf);
+  auto light = sampleEmitterDiscrete(interaction, sampler, &light_pmf);
   auto light_interaction = light->sample(interaction, sampler);
   light_interaction.setPdf(
       light_interaction.pdf * light_pmf, light_interaction.measure);
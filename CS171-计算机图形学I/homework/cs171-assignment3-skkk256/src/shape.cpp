@@ -2,12 +2,15 @@
 
 #include <math.h>
 
+#include <numeric>
+
 #include "linalg.h"
 #include "rdr/accel.h"
 #include "rdr/bvh_accel.h"
 #include "rdr/canary.h"
 #include "rdr/interaction.h"
 #include "rdr/load_obj.h"
+#include "rdr/mesh_cache.h"
 #include "rdr/ray.h"
 
 RDR_NAMESPACE_BEGIN
@@ -17,14 +20,31 @@ Sphere::Sphere(const Properties &props)
       center(props.getProperty<Vec3f>("center", Vec3f(0, 0, 0))),
       radius(props.getProperty<Float>("radius", 1)) {}
 
-bool Sphere::intersect(Ray &ray, SurfaceInteraction &interaction) const {
+bool Shape::occluded(const Ray &ray) const {
+  Ray local_ray = ray;
+  SurfaceInteraction interaction;
+  return intersect(local_ray, interaction);
+}
+
+uint32_t Shape::intersectPacket(RayPacket &packet, uint32_t mask,
+    SurfaceInteraction *interactions) const {
+  uint32_t result = 0;
+  for (int i = 0; i < packet.n_rays; ++i) {
+    const uint32_t lane = uint32_t(1) << i;
+    if ((mask & lane) && intersect(packet.rays[i], interactions[i]))
+      result |= lane;
+  }
+  return result;
+}
+
+bool Sphere::intersectDistance(const Ray &ray, Double *t) const {
   using InternalScalarType = Double;
   using InternalVecType    = Vec<InternalScalarType, 3>;
   const InternalVecType &o = Cast<InternalScalarType>(ray.origin);
   const InternalVecType &d = Normalize(Cast<InternalScalarType>(ray.direction));
   const InternalVecType &p = Cast<InternalScalarType>(center);
 
-  InternalScalarType t, t1, t2;
+  InternalScalarType t1, t2;
   {  // quadratic
     /* Ray intersect with sphere
     ** ||o + td - p||_2^2 = r^2
@@ -53,10 +73,26 @@ bool Sphere::intersect(Ray &ray, SurfaceInteraction &interaction) const {
 
   assert(t1 <= t2);
   if (ray.withinTimeRange(t1) || ray.withinTimeRange(t2)) {
-    t = ray.withinTimeRange(t1) ? t1 : t2;
-  } else {
-    return false;
+    *t = ray.withinTimeRange(t1) ? t1 : t2;
+    return true;
   }
+  return false;
+}
+
+bool Sphere::occluded(const Ray &ray) const {
+  Double t;
+  return intersectDistance(ray, &t);
+}
+
+bool Sphere::intersect(Ray &ray, SurfaceInteraction &interaction) const {
+  using InternalScalarType = Double;
+  using InternalVecType    = Vec<InternalScalarType, 3>;
+  const InternalVecType &o = Cast<InternalScalarType>(ray.origin);
+  const InternalVecType &d = Normalize(Cast<InternalScalarType>(ray.direction));
+  const InternalVecType &p = Cast<InternalScalarType>(center);
+
+  InternalScalarType t;
+  if (!intersectDistance(ray, &t)) return false;
 
   InternalVecType position = o + t * d;
 
@@ -188,6 +224,55 @@ TriangleMesh::TriangleMesh(const Properties &props)
 
   const auto transform = props.getProperty<Mat4f>("transform", IdentityMatrix4);
   const auto translate = props.getProperty<Vec3f>("translate", Vec3f(0.0));
+
+  const auto accel_props = props.getProperty<Properties>("accel", Properties{});
+
+  // The cache holds the transformed mesh and the built accel, hence is keyed
+  // by their configuration along with the source
+  const bool use_cache      = props.getProperty<bool>("cache", false);
+  const fs::path cache_path = path + ".rdrmesh";
+  MeshCacheKey cache_key;
+  std::optional<MeshCache> cache;
+  if (use_cache) {
+    vector<uint8_t> config;
+    BinaryWriter writer(config);
+    writer.write(transform);
+    writer.write(translate);
+    const std::string accel_config = accel_props.toString();
+    writer.writeArray(accel_config.data(), accel_config.size());
+    cache_key = MeshCache::ComputeKey(path, config);
+    cache.emplace(cache_path, cache_key);
+  }
+
+  const bool cached = cache.has_value() && cache->isValid();
+  if (cached) {
+    Info_("Loading model {} from [ {} ]", path, cache_path.string());
+    cache->getMesh(*mesh, areas);
+  } else {
+    loadObj(path, transform, translate);
+  }
+
+  // The accel copies the vertices, hence is built after the reordering
+  accel = RDR_CREATE_CLASS(Accel, accel_props);
+  accel->setTriangleMesh(mesh.get());
+  if (!cached ||
+      !accel->deserialize(cache->getAccelData(), cache->getAccelSize())) {
+    accel->build();
+    if (use_cache) {
+      // The file can not be replaced while mapped on some platforms
+      cache.reset();
+      MeshCache::Save(cache_path, cache_key, *mesh, areas, *accel);
+    }
+  }
+
+  // Initialize the distribution.
+  total_area = std::accumulate(areas.begin(), areas.end(), Float(0));
+  dist       = make_ref<Distribution1D>(
+      areas.data(), static_cast<int>(areas.size()));
+}
+
+void TriangleMesh::loadObj(
+    const std::string &path, const Mat4f &transform, const Vec3f &translate) {
   const auto normal_transform = Transpose(Inverse(transform));
 
   LoadObj(path, mesh->vertices, mesh->normals, mesh->texture_coordinates,
@@ -207,15 +292,6 @@ TriangleMesh::TriangleMesh(const Properties &props)
   mesh->has_normal  = !mesh->normals.empty();
   mesh->has_texture = !mesh->texture_coordinates.empty();
 
-#ifdef USE_EMBREE
-  accel = make_ref<ExternalBVHAccel>();
-#else
-  accel = make_ref<BVHAccel>();
-#endif
-
-  accel->setTriangleMesh(mesh.get());
-  accel->build();
-
   // Calculate the area of each triangle.
   int n_triangles = mesh->v_indices.size() / 3;
   for (int i = 0; i < n_triangles; ++i) {
@@ -224,7 +300,6 @@ TriangleMesh::TriangleMesh(const Properties &props)
     Vec3f v2 = mesh->getVertex(i * 3 + 2);
     areas.push_back(0.5f * Norm(Cross(v1 - v0, v2 - v0)));
     AssertAllPositive(areas.back());
-    total_area += areas.back();
   }
 
   // Reorder vertices to ensure correct normal interpolation
@@ -248,9 +323,6 @@ TriangleMesh::TriangleMesh(const Properties &props)
       }
     }
   }
-
-  // Initialize the distribution.
-  dist = make_ref<Distribution1D>(areas.data(), n_triangles);
 }
 
 bool TriangleMesh::intersect(Ray &ray, SurfaceInteraction &interaction) const {
@@ -258,6 +330,15 @@ bool TriangleMesh::intersect(Ray &ray, SurfaceInteraction &interaction) const {
   return intersect;
 }
 
+bool TriangleMesh::occluded(const Ray &ray) const {
+  return accel->occluded(ray);
+}
+
+uint32_t TriangleMesh::intersectPacket(RayPacket &packet, uint32_t mask,
+    SurfaceInteraction *interactions) const {
+  return accel->intersectPacket(packet, mask, interactions);
+}
+
 Float TriangleMesh::area() const {
   return total_area;
 }
@@ -293,4 +374,124 @@ Float TriangleMesh::pdf(const SurfaceInteraction &) const {
   return 1.0_F / total_area;
 }
 
+DirectionCone TriangleMesh::getNormalCone() const {
+  // The same geometric normals as the ones of sample()
+  DirectionCone cone;
+  const auto &v = mesh->vertices;
+  for (size_t i = 0; i < mesh->v_indices.size(); i += 3) {
+    const Vec3f &v0    = v[mesh->v_indices[i]];
+    const Vec3f normal = Cross(v[mesh->v_indices[i + 1]] - v0,
+        v[mesh->v_indices[i + 2]] - v0);
+    if (SquareNorm(normal) == 0) continue;
+    cone = Union(cone, DirectionCone(normal));
+    if (cone.cos_theta == -1) break;
+  }
+  return cone.isEmpty() ? DirectionCone::EntireSphere() : cone;
+}
+
+TriangleMeshInstance::TriangleMeshInstance(const Properties &props)
+    : Shape(props) {
+  const auto transform = props.getProperty<Mat4f>("transform", IdentityMatrix4);
+  const auto translate = props.getProperty<Vec3f>("translate", Vec3f(0.0));
+
+  // Applied in the same order as TriangleMesh, i.e. transform then translate
+  object_to_world = transform;
+  object_to_world[3] += Vec4f(translate, 0);
+  world_to_object = Inverse(object_to_world);
+  normal_to_world = Transpose(world_to_object);
+}
+
+void TriangleMeshInstance::crossConfiguration(
+    const CrossConfigurationContext &context) {
+  const auto mesh_name = properties.getProperty<std::string>("mesh_name");
+  const auto mesh_ptr  = context.meshes.find(mesh_name);
+  if (mesh_ptr == context.meshes.end())
+    Exception_("Mesh [ {} ] is not found in \"meshes\"", mesh_name);
+  instanced_mesh = mesh_ptr->second;
+
+  // The world space bound and area, without storing a transformed copy
+  const auto &resource = instanced_mesh->getResource();
+  for (std::size_t i = 0; i < resource->v_indices.size(); i += 3) {
+    const Vec3f v0 = pointToWorld(resource->getVertex(i));
+    const Vec3f v1 = pointToWorld(resource->getVertex(i + 1));
+    const Vec3f v2 = pointToWorld(resource->getVertex(i + 2));
+    bound.unionWith(AABB(v0, v1, v2));
+    total_area += 0.5f * Norm(Cross(v1 - v0, v2 - v0));
+  }
+
+  // Uniform area sampling carries over to the world space only if the
+  // transform is a similarity, i.e. its axes are orthogonal and equally long
+  const Vec3f x         = vectorToWorld(Vec3f(1, 0, 0));
+  const Vec3f y         = vectorToWorld(Vec3f(0, 1, 0));
+  const Vec3f z         = vectorToWorld(Vec3f(0, 0, 1));
+  const Float scale     = Dot(x, x);
+  const Float tolerance = 1e-4_F * scale;
+  if (std::abs(Dot(y, y) - scale) > tolerance ||
+      std::abs(Dot(z, z) - scale) > tolerance ||
+      std::abs(Dot(x, y)) > tolerance || std::abs(Dot(y, z)) > tolerance ||
+      std::abs(Dot(z, x)) > tolerance)
+    Warn_("Instance of [ {} ] is not uniformly scaled, area light sampling on "
+          "it will be biased",
+        mesh_name);
+}
+
+Float TriangleMeshInstance::toObject(const Ray &ray, Ray &object_ray) const {
+  const Vec3f origin = Mul(world_to_object, Vec4f(ray.origin, 1)).xyz();
+  Vec3f direction    = Mul(world_to_object, Vec4f(ray.direction, 0)).xyz();
+  const Float ratio  = Norm(direction);
+  direction /= ratio;
+  object_ray = Ray(origin, direction, ray.t_min * ratio, ray.t_max * ratio);
+  return ratio;
+}
+
+bool TriangleMeshInstance::intersect(
+    Ray &ray, SurfaceInteraction &interaction) const {
+  Ray object_ray;
+  const Float ratio = toObject(ray, object_ray);
+  SurfaceInteraction object_interaction;
+  if (!instanced_mesh->intersect(object_ray, object_interaction)) return false;
+
+  const auto &shading = object_interaction.shading;
+  interaction.setDifferential(pointToWorld(object_interaction.p),
+      Normalize(normalToWorld(object_interaction.normal)),
+      object_interaction.uv, vectorToWorld(object_interaction.dpdu),
+      vectorToWorld(object_interaction.dpdv),
+      normalToWorld(object_interaction.dndu),
+      normalToWorld(object_interaction.dndv));
+  interaction.setShading(Normalize(normalToWorld(shading.n)),
+      vectorToWorld(shading.dpdu), vectorToWorld(shading.dpdv),
+      normalToWorld(shading.dndu), normalToWorld(shading.dndv));
+  ray.setTimeMax(object_ray.t_max / ratio);
+  return true;
+}
+
+bool TriangleMeshInstance::occluded(const Ray &ray) const {
+  Ray object_ray;
+  toObject(ray, object_ray);
+  return instanced_mesh->occluded(object_ray);
+}
+
+Float TriangleMeshInstance::area() const {
+  return total_area;
+}
+
+SurfaceInteraction TriangleMeshInstance::sample(Sampler &sampler) const {
+  // Exact for rigid transforms with uniform scaling, where the area
+  // distribution over the triangles is preserved
+  const SurfaceInteraction object_interaction = instanced_mesh->sample(sampler);
+  SurfaceInteraction interaction;
+  interaction.setGeneral(pointToWorld(object_interaction.p),
+      Normalize(normalToWorld(object_interaction.normal)));
+  interaction.setPdf(1.0_F / total_area, EMeasure::EArea);
+  return interaction;
+}
+
+AABB TriangleMeshInstance::getBound() const {
+  return bound;
+}
+
+Float TriangleMeshInstance::pdf(const SurfaceInteraction &) const {
+  return 1.0_F / total_area;
+}
+
 RDR_NAMESPACE_END
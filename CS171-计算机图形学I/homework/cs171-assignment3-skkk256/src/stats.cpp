@@ -0,0 +1,177 @@
+#include "rdr/stats.h"
+
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+RDR_NAMESPACE_BEGIN
+
+void StatCounters::merge(const StatCounters &other) {
+  for (int i = 0; i < N_COUNTERS; ++i) counters[i] += other.counters[i];
+  for (size_t i = 0; i < path_lengths.size(); ++i)
+    path_lengths[i] += other.path_lengths[i];
+  for (int i = 0; i < N_PHASES; ++i) phase_times[i] += other.phase_times[i];
+}
+
+Statistics::LocalCounters::LocalCounters() {
+  Statistics &instance = Instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+  instance.live.push_back(this);
+}
+
+Statistics::LocalCounters::~LocalCounters() {
+  Statistics &instance = Instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+  instance.retired.merge(counters);
+  instance.live.erase(
+      std::find(instance.live.begin(), instance.live.end(), this));
+}
+
+StatCounters &Statistics::Local() {
+  thread_local LocalCounters local;
+  return local.counters;
+}
+
+void Statistics::addPhaseTime(EStatPhase phase, Double seconds) {
+  Statistics &instance = Instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+  instance.retired.phase_times[static_cast<int>(phase)] += seconds;
+}
+
+StatCounters Statistics::gather() {
+  Statistics &instance = Instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+  StatCounters result = instance.retired;
+  for (const LocalCounters *local : instance.live)
+    result.merge(local->counters);
+  return result;
+}
+
+void Statistics::clear() {
+  Statistics &instance = Instance();
+  std::lock_guard<std::mutex> lock(instance.mutex);
+  instance.retired = StatCounters{};
+  for (LocalCounters *local : instance.live) local->counters = StatCounters{};
+}
+
+const char *Statistics::GetCounterName(EStatCounter counter) {
+  switch (counter) {
+    case EStatCounter::ERays:
+      return "rays";
+    case EStatCounter::EShadowRays:
+      return "shadow_rays";
+    case EStatCounter::EShadowRaysBlocked:
+      return "shadow_rays_blocked";
+    case EStatCounter::EBVHNodesVisited:
+      return "bvh_nodes_visited";
+    case EStatCounter::ETriangleTests:
+      return "triangle_tests";
+    default:
+      Exception_("Unknown statistics counter {}", static_cast<int>(counter));
+  }
+}
+
+const char *Statistics::GetPhaseName(EStatPhase phase) {
+  switch (phase) {
+    case EStatPhase::EInitialize:
+      return "initialize";
+    case EStatPhase::EPreprocess:
+      return "preprocess";
+    case EStatPhase::ERender:
+      return "render";
+    case EStatPhase::EExport:
+      return "export";
+    default:
+      Exception_("Unknown statistics phase {}", static_cast<int>(phase));
+  }
+}
+
+namespace detail_ {
+/// The fraction, or 0 if there is nothing to divide
+RDR_FORCEINLINE Double SafeRatio(uint64_t numerator, uint64_t denominator) {
+  return denominator == 0 ? 0.0
+                          : static_cast<Double>(numerator) / denominator;
+}
+
+/// The average of the histogram, counting the overflow bucket as its lower
+/// bound
+RDR_FORCEINLINE Double AveragePathLength(const StatCounters &stats) {
+  uint64_t n_paths = 0, total = 0;
+  for (size_t i = 0; i < stats.path_lengths.size(); ++i) {
+    n_paths += stats.path_lengths[i];
+    total += stats.path_lengths[i] * i;
+  }
+  return SafeRatio(total, n_paths);
+}
+}  // namespace detail_
+
+std::string Statistics::toString(const StatCounters &stats) {
+  const uint64_t n_rays        = stats.get(EStatCounter::ERays);
+  const uint64_t n_shadow_rays = stats.get(EStatCounter::EShadowRays);
+  const uint64_t n_blocked     = stats.get(EStatCounter::EShadowRaysBlocked);
+  const uint64_t n_nodes       = stats.get(EStatCounter::EBVHNodesVisited);
+  const uint64_t n_triangles   = stats.get(EStatCounter::ETriangleTests);
+  const uint64_t n_all_rays    = n_rays + n_shadow_rays;
+  const Double render_time =
+      stats.phase_times[static_cast<int>(EStatPhase::ERender)];
+
+  std::ostringstream oss;
+  oss << "Statistics[\n";
+  for (int i = 0; i < StatCounters::N_PHASES; ++i)
+    oss << format("  {:<24}= {:.3f}s\n",
+        format("time.{}", GetPhaseName(static_cast<EStatPhase>(i))),
+        stats.phase_times[i]);
+  oss << format("  {:<24}= {}\n", "rays", n_rays)
+      << format("  {:<24}= {}\n", "shadow_rays", n_shadow_rays)
+      << format("  {:<24}= {:.2f}%\n", "shadow_ray_hit_rate",
+             100 * detail_::SafeRatio(n_blocked, n_shadow_rays))
+      << format("  {:<24}= {:.3f}M/s\n", "ray_throughput",
+             render_time > 0 ? n_all_rays / render_time / 1e6 : 0.0)
+      << format("  {:<24}= {:.2f}\n", "nodes_per_ray",
+             detail_::SafeRatio(n_nodes, n_all_rays))
+      << format("  {:<24}= {:.2f}\n", "triangles_per_ray",
+             detail_::SafeRatio(n_triangles, n_all_rays))
+      << format("  {:<24}= {:.2f}\n", "average_path_length",
+             detail_::AveragePathLength(stats));
+
+  // Only the non-empty buckets of the histogram
+  oss << "  path_lengths            =";
+  for (size_t i = 0; i < stats.path_lengths.size(); ++i) {
+    if (stats.path_lengths[i] == 0) continue;
+    const bool overflow = i == stats.path_lengths.size() - 1;
+    oss << format(" {}{}:{}", i, overflow ? "+" : "", stats.path_lengths[i]);
+  }
+  oss << "\n]";
+  return oss.str();
+}
+
+std::string Statistics::toJson(const StatCounters &stats) {
+  nlohmann::json json;
+  for (int i = 0; i < StatCounters::N_COUNTERS; ++i)
+    json["counters"][GetCounterName(static_cast<EStatCounter>(i))] =
+        stats.counters[i];
+  for (int i = 0; i < StatCounters::N_PHASES; ++i)
+    json["phase_times"][GetPhaseName(static_cast<EStatPhase>(i))] =
+        stats.phase_times[i];
+  json["shadow_ray_hit_rate"] =
+      detail_::SafeRatio(stats.get(EStatCounter::EShadowRaysBlocked),
+          stats.get(EStatCounter::EShadowRays));
+  // The last bucket holds the paths longer than MAX_PATH_LENGTH
+  json["path_lengths"] = stats.path_lengths;
+  return json.dump(2);
+}
+
+void Statistics::report(const fs::path &json_path) {
+  const StatCounters stats = gather();
+  Info_("{}", toString(stats));
+  if (json_path.empty()) return;
+
+  std::ofstream fout(json_path);
+  if (!fout.is_open())
+    Exception_("Can not open [ {} ] to write the statistics",
+        json_path.string());
+  fout << toJson(stats) << '\n';
+  Info_("Statistics written to [ {} ]", json_path.string());
+}
+
+RDR_NAMESPACE_END
@@ -32,11 +32,17 @@ ImageTexture::ImageTexture(const Properties &props) : Texture(props) {
     FreeEXRErrorMessage(err);
 
   } else {
-    data = vector<Float>(out, out + 4 * width * height);
+    const vector<Float> data(out, out + 4 * width * height);
     free(out);
+    const auto format = props.getProperty<bool>("half", false)
+                            ? MIPMap::TexelFormat::Half
+                            : MIPMap::TexelFormat::Single;
     Info_("Start building MIPMap of [ {} ]...", path);
-    mipmap = make_ref<MIPMap>(Vec2u(width, height), data);
-    Info_("Finished building MIPMap");
+    mipmap = make_ref<MIPMap>(Vec2u(width, height), data,
+        MIPMap::LookUpMethod::TriLinearInterpolation, MIPMap::ImageWrap::Repeat,
+        format);
+    Info_("Finished building MIPMap, {:.1f} MiB",
+        mipmap->MemoryUsage() / 1048576.0);
   }
 }
 
@@ -0,0 +1,337 @@
+#include "rdr/wavefront.h"
+
+#include <algorithm>
+
+#include "rdr/bsdf.h"
+#include "rdr/camera.h"
+#include "rdr/film.h"
+#include "rdr/light.h"
+#include "rdr/parallel.h"
+#include "rdr/properties.h"
+#include "rdr/scene.h"
+
+RDR_NAMESPACE_BEGIN
+
+namespace detail_ {
+/// The power heuristic of IncrementalPathIntegrator
+RDR_FORCEINLINE Float PowerHeuristic(Float pdf_a, Float pdf_b) {
+  pdf_a *= pdf_a;
+  pdf_b *= pdf_b;
+  return pdf_a / (pdf_a + pdf_b);
+}
+}  // namespace detail_
+
+void WavefrontPathStates::resize(int n_paths) {
+  pixel.resize(n_paths);
+  sample_index.resize(n_paths);
+  dimension.resize(n_paths);
+  pixel_sample.resize(n_paths);
+  ray.resize(n_paths);
+  interaction.resize(n_paths);
+  bounces.resize(n_paths);
+  bsdf_pdf.resize(n_paths);
+  beta.resize(n_paths);
+  L.resize(n_paths);
+  shadow_ray.resize(n_paths);
+  shadow_L.resize(n_paths);
+  active.resize(n_paths);
+}
+
+WavefrontPathIntegrator::WavefrontPathIntegrator(const Properties &props)
+    : Integrator(props),
+      max_depth(props.getProperty<int>("max_depth", 12)),
+      spp(props.getProperty<int>("spp", 32)),
+      rr_threshold(props.getProperty<Float>("rr_threshold", 0.1)),
+      profile(IncrementalPathIntegrator::ParseProfile(
+          props.getProperty<std::string>("profile", "NEE"))),
+      threads(props.getProperty<int>("threads", 0)),
+      wave_size(props.getProperty<int>("wave_size", 1 << 16)),
+      sampler_type(props.getProperty<Properties>("sampler", Properties{})
+                       .getProperty<std::string>("type", "independent")),
+      sampler(CreateSampler(
+          props.getProperty<Properties>("sampler", Properties{}), spp)) {
+  if (wave_size <= 0) Exception_("wave_size should be greater than 0");
+}
+
+void WavefrontPathIntegrator::render(ref<Camera> camera, ref<Scene> scene) {
+  ref<Film> film          = camera->getFilm();
+  const Vec2i &resolution = film->getResolution();
+  const int n_workers     = GetNumWorkers(threads);
+  const int64_t n_pixels  = int64_t(resolution.x) * resolution.y;
+  const int64_t n_paths   = n_pixels * spp;
+  Info_("Rendering {}x{} with {} worker(s) in waves of {} paths",
+      resolution.x, resolution.y, n_workers, wave_size);
+
+  vector<ref<Sampler>> samplers(n_workers);
+  for (auto &worker_sampler : samplers) worker_sampler = this->sampler->clone();
+  states.resize(static_cast<int>(std::min<int64_t>(wave_size, n_paths)));
+
+  for (int64_t begin = 0; begin < n_paths; begin += wave_size) {
+    const auto n =
+        static_cast<int>(std::min<int64_t>(wave_size, n_paths - begin));
+    generateCameraRays(*camera, resolution, begin, n, samplers);
+    for (bool camera_rays = true; !ray_queue.empty(); camera_rays = false) {
+      intersect(scene, camera_rays);
+      if (hit_queue.empty()) break;
+      shade(scene, samplers);
+      traceShadowRays(scene);
+    }
+    commitWave(*film, resolution, begin, n);
+  }
+}
+
+void WavefrontPathIntegrator::commitWave(
+    Film &film, const Vec2i &resolution, int64_t begin, int n) {
+  const int64_t n_pixels = int64_t(resolution.x) * resolution.y;
+  const int64_t first    = begin % n_pixels;
+
+  // The wave is sample-major, so unless it wraps around the image it covers
+  // the rows from its first pixel to its last one
+  int row_begin = 0, row_end = resolution.y;
+  if (first + n <= n_pixels) {
+    row_begin = static_cast<int>(first / resolution.x);
+    row_end   = static_cast<int>((first + n - 1) / resolution.x) + 1;
+  }
+
+  // Every pixel is owned by one tile, which visits the paths of the pixel in
+  // the order of their samples
+  const Vec2i offset(0, row_begin);
+  ParallelForTiles(
+      Vec2i(resolution.x, row_end - row_begin), FILM_TILE_SIZE,
+      [&](const Vec2i &low_bnd, const Vec2i &upper_bnd, int) {
+        FilmTile film_tile(film, low_bnd + offset, upper_bnd + offset);
+        for (int y = low_bnd.y + row_begin; y < upper_bnd.y + row_begin; ++y) {
+          for (int x = low_bnd.x; x < upper_bnd.x; ++x) {
+            const int64_t pixel_index = int64_t(y) * resolution.x + x;
+            for (int64_t i = (pixel_index - first + n_pixels) % n_pixels;
+                 i < n; i += n_pixels) {
+              film_tile.commitSample(states.pixel_sample[i], states.L[i]);
+              film.commitPixelStatistics(Vec2i(x, y), Luminance(states.L[i]));
+            }
+          }
+        }
+        film.mergeTile(film_tile);
+      },
+      threads);
+}
+
+void WavefrontPathIntegrator::generateCameraRays(const Camera &camera,
+    const Vec2i &resolution, int64_t begin, int n,
+    vector<ref<Sampler>> &samplers) {
+  const int64_t n_pixels = int64_t(resolution.x) * resolution.y;
+  ParallelFor(
+      n,
+      [&](int i, int worker_index) {
+        // Sample-major order, so that a wave sweeps over the whole image
+        const int64_t path_index = begin + i;
+        const auto pixel_index   = static_cast<int>(path_index % n_pixels);
+        const Vec2i pixel(
+            pixel_index % resolution.x, pixel_index / resolution.x);
+        const int sample_index = static_cast<int>(path_index / n_pixels);
+
+        Sampler &sampler = *samplers[worker_index];
+        sampler.startPixelSample(pixel, sample_index);
+        const Vec2f sample = sampler.getPixelSample();
+
+        states.pixel[i]        = pixel;
+        states.sample_index[i] = sample_index;
+        states.pixel_sample[i] = sample;
+        states.bounces[i]      = 1;
+        states.beta[i]         = Vec3f(1.0);
+        states.L[i]            = Vec3f(0.0);
+        states.dimension[i]    = sampler.getDimension();
+        states.ray[i] = camera.generateDifferentialRay(sample.x, sample.y);
+      },
+      threads);
+
+  ray_queue.resize(n);
+  for (int i = 0; i < n; ++i) ray_queue[i] = i;
+}
+
+void WavefrontPathIntegrator::intersect(
+    const ref<Scene> &scene, bool camera_rays) {
+  const bool mis = profile >= IntegratorProfile::EMultipleImportanceSampling;
+  const bool random_walk = profile == IntegratorProfile::ERandomWalk;
+  ParallelFor(
+      static_cast<int>(ray_queue.size()),
+      [&](int queue_index, int) {
+        const int i          = ray_queue[queue_index];
+        DifferentialRay &ray = states.ray[i];
+        states.active[i]     = false;
+
+        SurfaceInteraction new_interaction{};
+        const bool intersected = scene->intersect(ray, new_interaction);
+        if (camera_rays) {
+          // Le(p1 -> p0) of the emitters seen directly
+          if (intersected && new_interaction.isLight()) {
+            states.L[i] +=
+                new_interaction.light->Le(new_interaction, new_interaction.wo);
+            return;
+          }
+          if (!intersected) {
+            if (scene->hasInfiniteLight()) {
+              const auto light_interaction =
+                  scene->getInfiniteLight()->sampleFromOutgoingDirection(
+                      -ray.direction);
+              states.L[i] += light_interaction.light->Le(
+                  light_interaction, light_interaction.wo);
+            }
+            return;
+          }
+
+          new_interaction.setPdf(1.0, EMeasure::EUnknownMeasure);
+          new_interaction.CalculateRayDifferentials(ray);
+          states.interaction[i] = new_interaction;
+          states.active[i]      = true;
+          return;
+        }
+
+        const Float bsdf_pdf = states.bsdf_pdf[i];
+        if (intersected) {
+          new_interaction.setPdf(bsdf_pdf, EMeasure::ESolidAngle);
+        } else if (scene->hasInfiniteLight()) {
+          new_interaction =
+              scene->getInfiniteLight()->sampleFromOutgoingDirection(
+                  -ray.direction);
+          new_interaction.setPdf(bsdf_pdf, EMeasure::ESolidAngle);
+        } else {
+          return;
+        }
+
+        const SurfaceInteraction &interaction = states.interaction[i];
+        if (new_interaction.isLight()) {
+          if (!random_walk && !mis && !interaction.isSpecular()) return;
+
+          Float weight = 1;
+          if (mis) {
+            Float emitter_pdf =
+                interaction.isSpecular()
+                    ? 0
+                    : scene->pdfEmitterDirect(interaction, new_interaction);
+
+            // Convert area light's area PDF to solid angle PDF
+            if (!new_interaction.isInfLight()) {
+              auto query_interaction = new_interaction;
+              query_interaction.setPdf(emitter_pdf, EMeasure::EArea);
+              emitter_pdf = Path::toPdfMeasure(
+                  query_interaction, interaction, EMeasure::ESolidAngle);
+            }
+            weight = detail_::PowerHeuristic(bsdf_pdf, emitter_pdf);
+          }
+
+          states.L[i] += states.beta[i] *
+                         new_interaction.light->Le(
+                             new_interaction, new_interaction.wo) *
+                         weight;
+          return;
+        }
+
+        new_interaction.CalculateRayDifferentials(ray);
+        states.interaction[i] = new_interaction;
+        ++states.bounces[i];
+        states.active[i] = true;
+      },
+      threads);
+
+  compact(ray_queue, hit_queue);
+  ray_queue.clear();
+
+  // Shade the hits material by material, each batch running the same code
+  std::stable_sort(hit_queue.begin(), hit_queue.end(), [this](int a, int b) {
+    return states.interaction[a].bsdf < states.interaction[b].bsdf;
+  });
+}
+
+void WavefrontPathIntegrator::shade(
+    const ref<Scene> &scene, vector<ref<Sampler>> &samplers) {
+  const bool nee = profile >= IntegratorProfile::ENextEventEstimation;
+  const bool mis = profile >= IntegratorProfile::EMultipleImportanceSampling;
+  shadow_queue.clear();
+  ParallelFor(
+      static_cast<int>(hit_queue.size()),
+      [&](int queue_index, int worker_index) {
+        const int i                     = hit_queue[queue_index];
+        SurfaceInteraction &interaction = states.interaction[i];
+        states.active[i]                = false;
+        states.shadow_L[i]              = Vec3f(0.0);
+        if (states.bounces[i] >= max_depth || !interaction.isValid()) return;
+
+        // Restore the sampler of the path
+        Sampler &sampler = *samplers[worker_index];
+        sampler.startPixelSample(states.pixel[i], states.sample_index[i]);
+        sampler.setDimension(states.dimension[i]);
+
+        if (sampler.get1D() < rr_threshold) return;
+        states.beta[i] /= 1.0_F - rr_threshold;
+
+        // Sample a light, whose visibility is tested in the shadow stage
+        auto ref_interaction = interaction;
+        auto light_interaction =
+            scene->sampleEmitterDirect(ref_interaction, sampler);
+        if (nee && light_interaction.cosThetaO() > 0) {
+          Float weight = 1;
+          if (mis) {
+            const Float light_pdf = Path::toPdfMeasure(
+                light_interaction, ref_interaction, EMeasure::ESolidAngle);
+            const Float bsdf_pdf = ref_interaction.bsdf->pdf(ref_interaction);
+            weight = detail_::PowerHeuristic(light_pdf, bsdf_pdf);
+          }
+
+          // The same estimate as Path::estimate on the last two vertices
+          const Float G = std::abs(ref_interaction.cosThetaI()) *
+                          std::abs(light_interaction.cosThetaO()) /
+                          SquareNorm(light_interaction.p - ref_interaction.p);
+          const Float light_pdf = Path::toPdfMeasure(
+              light_interaction, ref_interaction, EMeasure::EArea);
+          const Vec3f f  = ref_interaction.bsdf->evaluate(ref_interaction);
+          const Vec3f Le = light_interaction.light->Le(  // NOLINT
+              light_interaction, light_interaction.wo);
+          states.shadow_L[i] = states.beta[i] * f * G / light_pdf * Le * weight;
+          states.shadow_ray[i] =
+              light_interaction.isInfLight()
+                  ? ref_interaction.spawnRay(ref_interaction.wi)
+                  : ref_interaction.spawnRayTo(light_interaction);
+        }
+
+        // Sample the next direction
+        Float bsdf_pdf        = 0;
+        const auto bsdf_cache =
+            interaction.bsdf->sample(interaction, sampler, &bsdf_pdf);
+        states.dimension[i] = sampler.getDimension();
+        if (SquareNorm(bsdf_cache) < EPS) return;
+        states.ray[i] = interaction.spawnRay(interaction.wi);
+        if (!states.ray[i].isValid()) return;
+        if (interaction.isSpecular()) interaction.setBSDFCache(bsdf_cache);
+
+        states.beta[i] *=
+            bsdf_cache * std::abs(interaction.cosThetaI()) / bsdf_pdf;
+        states.bsdf_pdf[i] = bsdf_pdf;
+        states.active[i]   = true;
+      },
+      threads);
+
+  compact(hit_queue, ray_queue);
+  for (int i : hit_queue)
+    if (states.shadow_L[i] != Vec3f(0.0)) shadow_queue.push_back(i);
+  hit_queue.clear();
+}
+
+void WavefrontPathIntegrator::traceShadowRays(const ref<Scene> &scene) {
+  ParallelFor(
+      static_cast<int>(shadow_queue.size()),
+      [&](int queue_index, int) {
+        const int i = shadow_queue[queue_index];
+        if (!scene->isBlocked(states.shadow_ray[i]))
+          states.L[i] += states.shadow_L[i];
+      },
+      threads);
+}
+
+void WavefrontPathIntegrator::compact(
+    const vector<int> &queue, vector<int> &target) const {
+  target.clear();
+  for (int i : queue)
+    if (states.active[i]) target.push_back(i);
+}
+
+RDR_NAMESPACE_END
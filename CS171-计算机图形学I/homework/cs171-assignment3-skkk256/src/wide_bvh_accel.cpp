@@ -0,0 +1,344 @@
+#include <chrono>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "rdr/bvh_accel.h"
+#include "rdr/interaction.h"
+#include "rdr/mesh_cache.h"
+#include "rdr/ray.h"
+#include "rdr/shape.h"
+#include "rdr/stats.h"
+
+RDR_NAMESPACE_BEGIN
+
+namespace detail_ {
+/// The per-ray constants of the slab test. near[d] is the row of
+/// WideBVHNode::bounds holding the plane entered first along axis d
+struct WideRayContext {
+  Float origin[3];
+  Float inverse_direction[3];
+  int near[3];
+  int far[3];
+
+  explicit WideRayContext(const Ray &ray) {
+    for (int d = 0; d < 3; ++d) {
+      origin[d]            = ray.origin[d];
+      inverse_direction[d] = ray.safe_inverse_direction[d];
+      near[d]              = inverse_direction[d] >= 0 ? d : d + 3;
+      far[d]               = inverse_direction[d] >= 0 ? d + 3 : d;
+    }
+  }
+};
+
+/// Test the ray against all children of a node. Return the bitmask of the
+/// children hit within [t_min, t_max], and their entry distance in t_near
+template <int Width>
+int IntersectChildren(const WideBVHNode<Width> &node,
+    const WideRayContext &context, Float t_min, Float t_max, Float *t_near) {
+#if defined(__AVX2__)
+  if constexpr (Width == 8) {
+    __m256 t_in  = _mm256_set1_ps(t_min);
+    __m256 t_out = _mm256_set1_ps(t_max);
+    for (int d = 0; d < 3; ++d) {
+      const __m256 origin  = _mm256_set1_ps(context.origin[d]);
+      const __m256 inverse = _mm256_set1_ps(context.inverse_direction[d]);
+      const __m256 near    = _mm256_load_ps(node.bounds[context.near[d]]);
+      const __m256 far     = _mm256_load_ps(node.bounds[context.far[d]]);
+      t_in  = _mm256_max_ps(
+          t_in, _mm256_mul_ps(_mm256_sub_ps(near, origin), inverse));
+      t_out = _mm256_min_ps(
+          t_out, _mm256_mul_ps(_mm256_sub_ps(far, origin), inverse));
+    }
+    _mm256_store_ps(t_near, t_in);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t_in, t_out, _CMP_LE_OQ));
+  }
+#endif
+#if defined(__SSE2__)
+  // 4 children at a time; the 8-wide node takes two rounds without AVX2
+  int mask = 0;
+  for (int k = 0; k < Width; k += 4) {
+    __m128 t_in  = _mm_set1_ps(t_min);
+    __m128 t_out = _mm_set1_ps(t_max);
+    for (int d = 0; d < 3; ++d) {
+      const __m128 origin  = _mm_set1_ps(context.origin[d]);
+      const __m128 inverse = _mm_set1_ps(context.inverse_direction[d]);
+      const __m128 near    = _mm_load_ps(node.bounds[context.near[d]] + k);
+      const __m128 far     = _mm_load_ps(node.bounds[context.far[d]] + k);
+      t_in  = _mm_max_ps(t_in, _mm_mul_ps(_mm_sub_ps(near, origin), inverse));
+      t_out = _mm_min_ps(t_out, _mm_mul_ps(_mm_sub_ps(far, origin), inverse));
+    }
+    _mm_storeu_ps(t_near + k, t_in);
+    mask |= _mm_movemask_ps(_mm_cmple_ps(t_in, t_out)) << k;
+  }
+  return mask;
+#else
+  int mask = 0;
+  for (int i = 0; i < Width; ++i) {
+    Float t_in  = t_min;
+    Float t_out = t_max;
+    for (int d = 0; d < 3; ++d) {
+      const Float origin  = context.origin[d];
+      const Float inverse = context.inverse_direction[d];
+      t_in  = max(t_in, (node.bounds[context.near[d]][i] - origin) * inverse);
+      t_out = min(t_out, (node.bounds[context.far[d]][i] - origin) * inverse);
+    }
+    t_near[i] = t_in;
+    if (t_in <= t_out) mask |= 1 << i;
+  }
+  return mask;
+#endif
+}
+}  // namespace detail_
+
+template <int Width>
+WideBVHAccel<Width>::WideBVHAccel(const Properties &props) : Accel(props) {
+  // SAH matters more here, since the collapse keeps the binary partitioning
+  triangle_tree.setHeuristicProfile(ParseBVHHeuristicProfile(
+      props.getProperty<std::string>("heuristic", "sah")));
+}
+
+template <int Width>
+void WideBVHAccel<Width>::setTriangleMesh(
+    const ref<TriangleMeshResource> &mesh) {
+  Accel::setTriangleMesh(mesh);
+  const uint32_t &num_triangles = mesh->v_indices.size() / 3;
+  assert(mesh->v_indices.size() % 3 == 0);
+  for (uint32_t i = 0; i < num_triangles; ++i)
+    triangle_tree.push_back(detail_::Triangle(i, mesh));
+}
+
+template <int Width>
+void WideBVHAccel<Width>::build() {
+  // The binary tree is released after the first build
+  if (!nodes.empty()) return;
+
+  const auto start = std::chrono::steady_clock::now();
+  triangle_tree.build();
+
+  triangle_indices.clear();
+  const auto &data_nodes = triangle_tree.getNodes();
+  triangle_indices.reserve(data_nodes.size());
+  for (const auto &node : data_nodes)
+    triangle_indices.push_back(node.getData().getIndex());
+  if (!triangle_tree.getLinearNodes().empty()) collapse(0);
+
+  const Float sah_cost = triangle_tree.getSAHCost();
+  triangle_tree.clear();
+
+  const auto end = std::chrono::steady_clock::now();
+  Info_("{}-wide BVH built over {} triangles in {:.2f} ms, {} nodes, binary "
+        "SAH cost {:.2f}",
+      Width, triangle_indices.size(),
+      std::chrono::duration<double, std::milli>(end - start).count(),
+      nodes.size(), sah_cost);
+}
+
+template <int Width>
+int WideBVHAccel<Width>::collapse(int index) {
+  const auto &linear_nodes = triangle_tree.getLinearNodes();
+
+  // Repeatedly open the interior child of the largest surface area, which is
+  // the most likely one to be visited, until the node is full
+  int children[Width] = {index};
+  int n_children      = 1;
+  while (n_children < Width) {
+    int largest        = -1;
+    Float largest_area = -1;
+    for (int i = 0; i < n_children; ++i) {
+      const auto &child = linear_nodes[children[i]];
+      if (child.isLeaf()) continue;
+      const Float area = child.aabb.getSurfaceArea();
+      if (area > largest_area) {
+        largest      = i;
+        largest_area = area;
+      }
+    }
+    if (largest == -1) break;
+
+    const int opened       = children[largest];
+    children[largest]      = opened + 1;
+    children[n_children++] = linear_nodes[opened].second_child_index;
+  }
+
+  // Allocate before recursion, which grows nodes
+  const int node_index = static_cast<int>(nodes.size());
+  nodes.emplace_back();
+  NodeType node;
+  for (int i = 0; i < Width; ++i) {
+    for (int d = 0; d < 3; ++d) {
+      node.bounds[d][i]     = std::numeric_limits<Float>::infinity();
+      node.bounds[d + 3][i] = -std::numeric_limits<Float>::infinity();
+    }
+    node.child[i]       = -1;
+    node.n_triangles[i] = 0;
+  }
+
+  for (int i = 0; i < n_children; ++i) {
+    const auto &child = linear_nodes[children[i]];
+    for (int d = 0; d < 3; ++d) {
+      node.bounds[d][i]     = child.aabb.low_bnd[d];
+      node.bounds[d + 3][i] = child.aabb.upper_bnd[d];
+    }
+    if (child.isLeaf()) {
+      node.child[i]       = child.span_left;
+      node.n_triangles[i] = child.n_data;
+    } else {
+      node.child[i] = collapse(children[i]);
+    }
+  }
+
+  nodes[node_index] = node;
+  return node_index;
+}
+
+template <int Width>
+AABB WideBVHAccel<Width>::getBound() const {
+  return bound;
+}
+
+template <int Width>
+bool WideBVHAccel<Width>::intersect(
+    Ray &ray, SurfaceInteraction &interaction) const {
+  TriangleHit hit;
+  if (!traverse<false>(ray, hit)) return false;
+  commitHit(hit, interaction);
+  return true;
+}
+
+template <int Width>
+bool WideBVHAccel<Width>::occluded(const Ray &ray) const {
+  Ray local_ray = ray;
+  TriangleHit hit;
+  return traverse<true>(local_ray, hit);
+}
+
+template <int Width>
+bool WideBVHAccel<Width>::serialize(vector<uint8_t> &data) const {
+  BinaryWriter writer(data);
+  writer.write(SERIAL_TAG);
+  writer.write(static_cast<uint32_t>(nodes.size()));
+  writer.write(static_cast<uint32_t>(triangle_indices.size()));
+  writer.writeArray(nodes.data(), nodes.size());
+  writer.writeArray(triangle_indices.data(), triangle_indices.size());
+  return true;
+}
+
+template <int Width>
+bool WideBVHAccel<Width>::deserialize(const uint8_t *data, size_t size) {
+  const uint32_t num_triangles = mesh->v_indices.size() / 3;
+
+  BinaryReader reader(data, size);
+  uint32_t tag, n_nodes, n_triangles;
+  vector<NodeType> wide_nodes;
+  vector<uint32_t> indices;
+  if (!reader.read(tag) || tag != SERIAL_TAG || !reader.read(n_nodes) ||
+      !reader.read(n_triangles) || n_triangles != num_triangles ||
+      !reader.readVector(wide_nodes, n_nodes) ||
+      !reader.readVector(indices, n_triangles) || !reader.isEnd())
+    return false;
+  if ((n_nodes == 0) != (n_triangles == 0)) return false;
+  for (const uint32_t index : indices)
+    if (index >= num_triangles) return false;
+
+  // The interior children follow their parent, and no path may overflow the
+  // traversal stack. Empty slots are never hit
+  constexpr Float INF = std::numeric_limits<Float>::infinity();
+  vector<int> depths(n_nodes, 0);
+  for (uint32_t i = 0; i < n_nodes; ++i) {
+    const NodeType &node = wide_nodes[i];
+    if (depths[i] >= 64) return false;
+    for (int k = 0; k < Width; ++k) {
+      const int32_t child  = node.child[k];
+      const uint32_t count = node.n_triangles[k];
+      if (count > 0) {
+        if (child < 0 || uint64_t(child) + count > n_triangles) return false;
+      } else if (child >= 0) {
+        if (uint32_t(child) <= i || uint32_t(child) >= n_nodes) return false;
+        depths[child] = depths[i] + 1;
+      } else {
+        for (int d = 0; d < 3; ++d)
+          if (node.bounds[d][k] != INF || node.bounds[d + 3][k] != -INF)
+            return false;
+      }
+    }
+  }
+
+  nodes            = std::move(wide_nodes);
+  triangle_indices = std::move(indices);
+  // The binary tree is not needed any more
+  triangle_tree.clear();
+  return true;
+}
+
+template <int Width>
+template <bool AnyHit>
+bool WideBVHAccel<Width>::traverse(Ray &ray, TriangleHit &hit) const {
+  if (nodes.empty()) return false;
+
+  /// A node or leaf to be visited, with the distance the ray enters it
+  struct StackEntry {
+    int32_t child;
+    uint32_t n_triangles;
+    Float t_near;
+  };
+  constexpr int STACK_SIZE = 64 * Width;
+
+  const detail_::WideRayContext context(ray);
+  const WatertightRay watertight_ray(ray);
+  StackEntry stack[STACK_SIZE];
+  int stack_top      = 0;
+  stack[stack_top++] = {0, 0, ray.t_min};
+
+  bool result        = false;
+  uint64_t n_visited = 0;
+  while (stack_top > 0) {
+    const StackEntry entry = stack[--stack_top];
+    // ray.t_max shrinks along the traversal; skip the entries behind it
+    if (entry.t_near > ray.t_max) continue;
+
+    if (entry.n_triangles > 0) {
+      for (uint32_t i = entry.child; i < entry.child + entry.n_triangles;
+           ++i) {
+        if constexpr (AnyHit) {
+          if (triangles.occluded(watertight_ray, ray, triangle_indices[i])) {
+            RDR_STAT_ADD(EBVHNodesVisited, n_visited);
+            return true;
+          }
+        } else {
+          result |= triangles.intersect(
+              watertight_ray, ray, triangle_indices[i], hit);
+        }
+      }
+      continue;
+    }
+
+    ++n_visited;
+    alignas(32) Float t_near[Width];
+    const NodeType &node = nodes[entry.child];
+    const int mask = detail_::IntersectChildren<Width>(
+        node, context, ray.t_min, ray.t_max, t_near);
+
+    // Push the hit children far to near, so that the nearest is popped first
+    const int base = stack_top;
+    for (int i = 0; i < Width; ++i) {
+      if ((mask & (1 << i)) == 0) continue;
+      assert(stack_top < STACK_SIZE);
+      StackEntry pushed{node.child[i], node.n_triangles[i], t_near[i]};
+      int k = stack_top++;
+      for (; k > base && stack[k - 1].t_near < pushed.t_near; --k)
+        stack[k] = stack[k - 1];
+      stack[k] = pushed;
+    }
+  }
+
+  RDR_STAT_ADD(EBVHNodesVisited, n_visited);
+  return result;
+}
+
+template class WideBVHAccel<4>;
+template class WideBVHAccel<8>;
+
+RDR_NAMESPACE_END
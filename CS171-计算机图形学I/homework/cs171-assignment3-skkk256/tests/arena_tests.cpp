@@ -0,0 +1,122 @@
+/**
+ * @file arena_tests.cpp
+ * @brief Check that the ScratchArena, and the path tracer drawing from it,
+ * stop allocating once warmed up, by counting the calls to the global
+ * operator new of this executable.
+ */
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "rdr/film.h"
+#include "rdr/integrator.h"
+#include "rdr/rdr.h"
+#include "rdr/render.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+static std::atomic<size_t> n_allocations{0};
+
+void *operator new(size_t size) {
+  ++n_allocations;
+  if (void *result = std::malloc(size == 0 ? 1 : size)) return result;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+/// The temporaries of a sample as the path tracer grows them: a vector
+/// pushed into bounce by bounce, and copied at every bounce
+static size_t DrawSample(ScratchArena &arena, int n_bounces) {
+  std::pmr::vector<Vec3f> base(&arena);
+  std::pmr::vector<std::pmr::vector<Vec3f>> paths(&arena);
+  size_t total = 0;
+  for (int i = 0; i < n_bounces; ++i) {
+    base.push_back(Vec3f(static_cast<Float>(i)));
+    std::pmr::vector<Vec3f> copy(base, base.get_allocator());
+    total += copy.size();
+    paths.push_back(std::move(copy));
+  }
+  return total;
+}
+
+TEST(ScratchArena, NoAllocationInSteadyState) {
+  ScratchArena arena(4096);
+
+  // Warm up with the longest sample
+  DrawSample(arena, 64);
+  arena.reset();
+  const size_t n_blocks = arena.getNumUpstreamAllocations();
+  EXPECT_GT(n_blocks, 0u);
+
+  const size_t before = n_allocations.load();
+  for (int sample = 0; sample < 1000; ++sample) {
+    DrawSample(arena, 1 + sample % 64);
+    arena.reset();
+  }
+  EXPECT_EQ(n_allocations.load(), before);
+  EXPECT_EQ(arena.getNumUpstreamAllocations(), n_blocks);
+}
+
+TEST(ScratchArena, NoAllocationWhileRendering) {
+  spdlog::set_level(spdlog::level::err);
+  Factory::doRegisterAllClasses();
+  ref<NativeRender> render = make_ref<NativeRender>(
+      Properties(MakeLightOverSphereConfig("path", 4, Vec2i(16, 16))));
+  render->initialize();
+  render->preprocess();
+
+  {
+    const auto &context = render->getContext();
+    const auto *integrator =
+        dynamic_cast<const PathIntegrator *>(context.integrator.get());
+    ASSERT_NE(integrator, nullptr);
+    Film &film              = *context.film;
+    const Vec2i &resolution = film.getResolution();
+    FilmTile film_tile(film, Vec2i(0, 0), resolution);
+    Sampler sampler;
+
+    // A single sample warms up the arena, the counters and the caches of
+    // this thread
+    integrator->renderPixel(*context.camera, context.scene, film, film_tile,
+        sampler, resolution / 2, 0, 1);
+    ScratchArena &arena   = ScratchArena::ThreadLocal();
+    const size_t n_blocks = arena.getNumUpstreamAllocations();
+
+    const size_t before = n_allocations.load();
+    for (int y = 0; y < resolution.y; ++y)
+      for (int x = 0; x < resolution.x; ++x)
+        integrator->renderPixel(*context.camera, context.scene, film,
+            film_tile, sampler, Vec2i(x, y), 1, 4);
+    EXPECT_EQ(n_allocations.load(), before);
+    EXPECT_EQ(arena.getNumUpstreamAllocations(), n_blocks);
+  }
+
+  render->clearRuntimeInfo();
+}
+
+TEST(ScratchArena, Alignment) {
+  ScratchArena arena(256);
+  for (size_t alignment : {1, 4, 16, 64}) {
+    for (int i = 0; i < 100; ++i) {
+      void *p = arena.allocate(1 + i % 37, alignment);
+      EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) % alignment, 0u);
+    }
+  }
+
+  // Larger than a block
+  void *p = arena.allocate(1000, 64);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) % 64, 0u);
+  EXPECT_GE(arena.getFootprint(), 1000u);
+}
+
+TEST(ScratchArena, ResetReusesMemory) {
+  ScratchArena arena(1024);
+  void *first = arena.allocate(100, 16);
+  arena.allocate(100, 16);
+  arena.reset();
+  EXPECT_EQ(arena.allocate(100, 16), first);
+}
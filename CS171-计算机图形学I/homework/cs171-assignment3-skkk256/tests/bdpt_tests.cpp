@@ -0,0 +1,24 @@
+/**
+ * @file bdpt_tests.cpp
+ * @brief Check that the bidirectional path tracer converges to the same image
+ * as the path tracer, which only holds if the MIS weights of the strategies
+ * producing a path sum to one and the light image is scaled right.
+ */
+#include <gtest/gtest.h>
+
+#include "rdr/rdr.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+TEST(BDPT, MatchesPathTracer) {
+  const Vec2i resolution(32, 32);
+  const Vec3f reference =
+      GetMean(RenderImage(MakeLightOverSphereConfig("path", 64, resolution)));
+  const Vec3f mean =
+      GetMean(RenderImage(MakeLightOverSphereConfig("bdpt", 64, resolution)));
+  for (int k = 0; k < 3; ++k) {
+    ASSERT_GT(reference[k], 0);
+    EXPECT_NEAR(mean[k] / reference[k], 1.0_F, 0.05_F) << "channel " << k;
+  }
+}
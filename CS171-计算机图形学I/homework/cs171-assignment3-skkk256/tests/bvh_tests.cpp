@@ -0,0 +1,249 @@
+/**
+ * @file bvh_tests.cpp
+ * @brief Check the acceleration structures against brute-force intersection
+ * on a random triangle soup, and the triangle intersector itself. Check the
+ * packet traversal against single rays, and compare their timing.
+ */
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "rdr/bvh_accel.h"
+#include "rdr/interaction.h"
+#include "rdr/ray.h"
+#include "rdr/shape.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+static Ray MakeRandomRay(Sampler &sampler) {
+  const Vec3f origin = 3.0_F * UniformSampleSphere(sampler.get2D());
+  const Vec3f target(sampler.get1D() - 0.5_F, sampler.get1D() - 0.5_F,
+      sampler.get1D() - 0.5_F);
+  return {origin, Normalize(target - origin)};
+}
+
+static void CompareWithBruteForce(Accel &accel, int n_triangles) {
+  Sampler sampler;
+  auto mesh = MakeTriangleSoup(sampler, n_triangles);
+
+  Accel brute_force;
+  brute_force.setTriangleMesh(mesh);
+  accel.setTriangleMesh(mesh);
+  accel.build();
+
+  int n_hits = 0;
+  for (int i = 0; i < 2000; ++i) {
+    const Ray original = MakeRandomRay(sampler);
+    Ray ray = original, reference_ray = original;
+    SurfaceInteraction interaction, reference_interaction;
+    const bool hit = accel.intersect(ray, interaction);
+    const bool reference_hit =
+        brute_force.intersect(reference_ray, reference_interaction);
+    ASSERT_EQ(hit, reference_hit);
+    // The any-hit query agrees with the closest-hit one
+    ASSERT_EQ(accel.occluded(original), hit);
+    ASSERT_EQ(brute_force.occluded(original), hit);
+    EXPECT_FLOAT_EQ(ray.t_max, reference_ray.t_max);
+    n_hits += hit;
+  }
+
+  // Make sure the test is not trivial
+  EXPECT_GT(n_hits, 100);
+}
+
+TEST(BVH, MedianHeuristic) {
+  BVHAccel accel;
+  CompareWithBruteForce(accel, 1000);
+}
+
+TEST(BVH, SurfaceAreaHeuristic) {
+  Properties props;
+  props.setProperty("heuristic", std::string("sah"));
+  BVHAccel accel(props);
+  CompareWithBruteForce(accel, 1000);
+}
+
+TEST(BVH, WideBVH4) {
+  WideBVHAccel<4> accel(Properties{});
+  CompareWithBruteForce(accel, 1000);
+}
+
+TEST(BVH, WideBVH8) {
+  WideBVHAccel<8> accel(Properties{});
+  CompareWithBruteForce(accel, 1000);
+}
+
+TEST(BVH, Factory) {
+  Factory::doRegisterAllClasses();
+  Properties props;
+  props.setProperty("type", std::string("bvh"));
+  EXPECT_NE(dynamic_cast<BVHAccel *>(RDR_CREATE_CLASS(Accel, props).get()),
+      nullptr);
+
+  props.setProperty("type", std::string("wide_bvh"));
+  props.setProperty("width", 4);
+  EXPECT_NE(
+      dynamic_cast<WideBVHAccel<4> *>(RDR_CREATE_CLASS(Accel, props).get()),
+      nullptr);
+  props.setProperty("width", 8);
+  EXPECT_NE(
+      dynamic_cast<WideBVHAccel<8> *>(RDR_CREATE_CLASS(Accel, props).get()),
+      nullptr);
+}
+
+TEST(BVH, SurfaceAreaHeuristicCost) {
+  Sampler sampler;
+  auto mesh = MakeTriangleSoup(sampler, 5000);
+
+  Float cost[2];
+  for (int i = 0; i < 2; ++i) {
+    BVHTree<detail_::BVHTriangleNode> tree;
+    tree.setHeuristicProfile(i == 0 ? EBVHHeuristicProfile::EMedianHeuristic
+                                    : EBVHHeuristicProfile::ESurfaceAreaHeuristic);
+    for (int k = 0; k < 5000; ++k) tree.push_back(detail_::Triangle(k, mesh));
+    tree.build();
+    cost[i] = tree.getSAHCost();
+  }
+
+  EXPECT_LT(cost[1], cost[0]);
+}
+
+TEST(BVH, LinearNodeLayout) {
+  using TreeType = BVHTree<detail_::BVHTriangleNode>;
+  EXPECT_EQ(sizeof(TreeType::LinearNode), 32);
+}
+
+TEST(BVH, ParallelBuildIsDeterministic) {
+  constexpr int N = 200000;
+  Sampler sampler;
+  auto mesh = MakeTriangleSoup(sampler, N);
+
+  BVHTree<detail_::BVHTriangleNode> trees[2];
+  for (int i = 0; i < 2; ++i) {
+    trees[i].setHeuristicProfile(EBVHHeuristicProfile::ESurfaceAreaHeuristic);
+    trees[i].setNumWorkers(i == 0 ? 1 : 8);
+    for (int k = 0; k < N; ++k) trees[i].push_back(detail_::Triangle(k, mesh));
+    trees[i].build();
+  }
+  EXPECT_EQ(trees[0].getSAHCost(), trees[1].getSAHCost());
+
+  // The data nodes are visited in the same order by both trees
+  for (int i = 0; i < 500; ++i) {
+    const Ray ray = MakeRandomRay(sampler);
+    vector<int> visited[2];
+    for (int k = 0; k < 2; ++k) {
+      Ray local_ray = ray;
+      trees[k].intersect(local_ray,
+          [&](Ray &, const detail_::Triangle &triangle) {
+            visited[k].push_back(triangle.getIndex());
+            return false;
+          });
+    }
+    ASSERT_EQ(visited[0], visited[1]);
+  }
+}
+
+TEST(BVH, PacketMatchesSingleRays) {
+  constexpr int N_TRIANGLES = 100000;
+  constexpr int N_PACKETS   = 20000;
+  Sampler sampler;
+  // Small triangles, which leave the traversal rather than the triangle tests
+  // dominating as in a finely tessellated scene
+  auto mesh = MakeTriangleSoup(sampler, N_TRIANGLES, 0.02_F);
+  Properties props;
+  props.setProperty("heuristic", std::string("sah"));
+  BVHAccel accel(props);
+  accel.setTriangleMesh(mesh);
+  accel.build();
+
+  // Coherent packets, spread like the camera rays of a pixel, and incoherent
+  // ones falling back to single rays
+  for (const bool coherent : {true, false}) {
+    vector<RayPacket> packets(N_PACKETS);
+    for (auto &packet : packets) {
+      const Ray center = MakeRandomRay(sampler);
+      packet.n_rays    = RayPacket::SIZE;
+      for (auto &ray : packet.rays) {
+        const Vec3f jitter(sampler.get1D() - 0.5_F, sampler.get1D() - 0.5_F,
+            sampler.get1D() - 0.5_F);
+        ray = coherent ? Ray(center.origin,
+                             Normalize(center.direction + 1e-3_F * jitter))
+                       : MakeRandomRay(sampler);
+      }
+    }
+
+    // Trace all packets single-ray, then all as packets
+    vector<RayPacket> single_packets = packets;
+    vector<uint32_t> single_hits(N_PACKETS, 0);
+    SurfaceInteraction interactions[RayPacket::SIZE];
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < N_PACKETS; ++k) {
+      for (int i = 0; i < RayPacket::SIZE; ++i)
+        if (accel.intersect(single_packets[k].rays[i], interactions[i]))
+          single_hits[k] |= uint32_t(1) << i;
+    }
+    auto end = std::chrono::steady_clock::now();
+    const double single_ms =
+        std::chrono::duration<double, std::milli>(end - start).count();
+
+    vector<uint32_t> packet_hits(N_PACKETS);
+    start = std::chrono::steady_clock::now();
+    for (int k = 0; k < N_PACKETS; ++k)
+      packet_hits[k] = accel.intersectPacket(
+          packets[k], packets[k].getMask(), interactions);
+    end = std::chrono::steady_clock::now();
+    const double packet_ms =
+        std::chrono::duration<double, std::milli>(end - start).count();
+
+    int n_hits = 0;
+    for (int k = 0; k < N_PACKETS; ++k) {
+      ASSERT_EQ(packet_hits[k], single_hits[k]) << k;
+      for (int i = 0; i < RayPacket::SIZE; ++i) {
+        EXPECT_FLOAT_EQ(
+            packets[k].rays[i].t_max, single_packets[k].rays[i].t_max);
+        n_hits += (packet_hits[k] >> i) & 1;
+      }
+    }
+    Info_("{} packets: {:.2f} ms single, {:.2f} ms packet",
+        coherent ? "coherent" : "incoherent", single_ms, packet_ms);
+    EXPECT_GT(n_hits, N_PACKETS);
+  }
+}
+
+TEST(Triangle, WatertightSharedEdges) {
+  // A fan around the origin facing +z. Rays aimed at the shared vertex and
+  // edges must never slip through
+  constexpr int N = 16;
+  auto mesh       = make_ref<TriangleMeshResource>();
+  mesh->vertices.push_back(Vec3f(0.0));
+  for (int i = 0; i < N; ++i) {
+    const Float phi = 2 * PI * i / N;
+    mesh->vertices.push_back(Vec3f(std::cos(phi), std::sin(phi), 0));
+  }
+  for (int i = 0; i < N; ++i) {
+    mesh->v_indices.push_back(0);
+    mesh->v_indices.push_back(1 + i);
+    mesh->v_indices.push_back(1 + (i + 1) % N);
+  }
+
+  Accel accel;
+  accel.setTriangleMesh(mesh);
+  Sampler sampler;
+  for (int i = 0; i < 10000; ++i) {
+    const Vec3f target =
+        (i % 4 == 0) ? Vec3f(0.0)
+                     : sampler.get1D() * mesh->vertices[1 + i % N];
+    Vec3f origin = 3.0_F * UniformSampleHemisphere(sampler.get2D());
+    origin.z     = std::max(origin.z, 0.1_F);
+
+    SurfaceInteraction interaction;
+    Ray front(origin, Normalize(target - origin));
+    ASSERT_TRUE(accel.intersect(front, interaction));
+
+    // Single-sided: the back faces are culled
+    const Vec3f below(origin.x, origin.y, -origin.z);
+    Ray back(below, Normalize(target - below));
+    ASSERT_FALSE(accel.intersect(back, interaction));
+  }
+}
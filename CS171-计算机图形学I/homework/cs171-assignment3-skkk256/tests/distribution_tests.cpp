@@ -31,4 +31,35 @@ TEST(Distribution, Distribution1D) {
 
   for (int i = 0; i < M; ++i)
     EXPECT_NEAR(pool[i] / (float)N, arr[i] / sum, 1e-3);
-}
\ No newline at end of file
+}
+TEST(Distribution, Distribution2D) {
+  constexpr int N  = 1000000;
+  constexpr int NU = 16;
+  constexpr int NV = 8;
+  Sampler       sampler;
+  Float         sum = 0;
+
+  std::array<float, NU * NV> arr;
+  std::array<int, NU * NV>   pool;
+  for (int i = 0; i < NU * NV; ++i) {
+    // Leave a few cells empty, which must never be sampled
+    arr[i]  = (i % 7 == 3) ? 0 : sampler.get1D();
+    pool[i] = 0;
+    sum += arr[i];
+  }
+
+  Distribution2D dist(arr.data(), NU, NV);
+  for (int sample_id = 0; sample_id < N; sample_id++) {
+    Float        pdf;
+    const Vec2f &p = dist.sampleContinuous(sampler.get2D(), &pdf);
+    ASSERT_TRUE(0 <= p.x && p.x < 1 && 0 <= p.y && p.y < 1);
+    const int i = static_cast<int>(p.x * NU) + static_cast<int>(p.y * NV) * NU;
+    // The density over [0, 1]^2 is the normalized cell value times the count
+    EXPECT_NEAR(pdf, arr[i] / sum * NU * NV, 1e-3);
+    EXPECT_NEAR(dist.pdf(p), pdf, 1e-3);
+    pool[i]++;
+  }
+
+  for (int i = 0; i < NU * NV; ++i)
+    EXPECT_NEAR(pool[i] / (float)N, arr[i] / sum, 1e-3);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file film_tests.cpp
+ * @brief Check that the tiled accumulation of the film matches the locked one
+ * at any number of workers, and compare their timing. Check the per-pixel
+ * statistics driving the progressive mode.
+ */
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "rdr/film.h"
+#include "rdr/parallel.h"
+#include "rdr/properties.h"
+#include "rdr/sampler.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+static ref<Film> MakeFilm(const std::string &accumulation) {
+  return MakeFilm(accumulation, Vec2i(128, 96));
+}
+
+/// Splat spp samples per pixel in tiles; return the time taken in ms
+static double RenderFilm(Film &film, int spp, int n_workers) {
+  const auto start = std::chrono::steady_clock::now();
+  ParallelForTiles(
+      film.getResolution(), 16,
+      [&](const Vec2i &low_bnd, const Vec2i &upper_bnd, int) {
+        IndependentSampler sampler;
+        FilmTile film_tile(film, low_bnd, upper_bnd);
+        for (int y = low_bnd.y; y < upper_bnd.y; ++y) {
+          for (int x = low_bnd.x; x < upper_bnd.x; ++x) {
+            for (int s = 0; s < spp; ++s) {
+              sampler.startPixelSample(Vec2i(x, y), s);
+              const Vec2f sample = sampler.getPixelSample();
+              film_tile.commitSample(sample, Vec3f(sample.x, sample.y, 1));
+              // Cross-tile splats, e.g. from light tracing
+              film.commitLightImageSplat(
+                  Vec2f(sample.y, sample.x) * 0.75_F, Vec3f(0.01_F));
+            }
+          }
+        }
+        film.mergeTile(film_tile);
+      },
+      n_workers);
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+TEST(Film, TiledMatchesLocked) {
+  constexpr int SPP = 16;
+  vector<Vec3f> reference;
+  auto reference_film = MakeFilm("locked");
+  RenderFilm(*reference_film, SPP, 1);
+  reference_film->exportImageToArray(reference);
+
+  for (int n_workers = 1; n_workers <= 64; n_workers *= 4) {
+    for (const char *accumulation : {"locked", "tiled"}) {
+      auto film     = MakeFilm(accumulation);
+      const auto ms = RenderFilm(*film, SPP, n_workers);
+      Info_("{} accumulation with {} worker(s): {:.2f} ms", accumulation,
+          n_workers, ms);
+
+      // Only the order of the additions differs
+      vector<Vec3f> result;
+      film->exportImageToArray(result);
+      ASSERT_EQ(result.size(), reference.size());
+      for (size_t i = 0; i < result.size(); ++i) {
+        for (int c = 0; c < 3; ++c)
+          ASSERT_NEAR(result[i][c], reference[i][c],
+              1e-4 * std::max(1.0_F, std::abs(reference[i][c])))
+              << accumulation << " " << n_workers << " " << i;
+      }
+    }
+  }
+}
+
+TEST(Film, PixelStatistics) {
+  auto film = MakeFilm("tiled");
+  EXPECT_EQ(film->getPixelStatistics(3, 4).getRelativeError(), Float_INF);
+
+  // Luminances alternating between 1 and 3 have a mean of 2 and a sample
+  // variance of n / (n - 1)
+  constexpr int N = 100;
+  for (int i = 0; i < N; ++i)
+    film->commitPixelStatistics(Vec2i(3, 4), i % 2 == 0 ? 1.0_F : 3.0_F);
+  const auto &statistics = film->getPixelStatistics(3, 4);
+  EXPECT_EQ(statistics.n_samples, N);
+  EXPECT_NEAR(statistics.getRelativeError(),
+      std::sqrt(1.0 / (N - 1)) / 2, 1e-6);
+
+  // Constant pixels are converged, black ones included
+  for (int i = 0; i < 4; ++i) {
+    film->commitPixelStatistics(Vec2i(0, 0), 0.5_F);
+    film->commitPixelStatistics(Vec2i(1, 0), 0);
+  }
+  EXPECT_EQ(film->getPixelStatistics(0, 0).getRelativeError(), 0);
+  EXPECT_EQ(film->getPixelStatistics(1, 0).getRelativeError(), 0);
+
+  film->clear();
+  EXPECT_EQ(film->getPixelStatistics(3, 4).n_samples, 0);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file guiding_tests.cpp
+ * @brief Check that the directional quadtree samples by the pdf it reports,
+ * and that the SD-tree splits where the records are.
+ */
+#include <gtest/gtest.h>
+
+#include "rdr/guiding.h"
+#include "rdr/sampler.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+/// A quadtree learnt from radiance concentrated around +z
+static DirectionalQuadTree BuildPeakedTree(Sampler &sampler) {
+  DirectionalQuadTree recording, sampling;
+  for (int pass = 0; pass < 3; ++pass) {
+    for (int i = 0; i < 20000; ++i) {
+      const Vec3f w = UniformSampleSphere(sampler.get2D());
+      recording.record(w, w.z > 0.8_F ? 10.0_F : 0.1_F);
+    }
+    sampling = recording;
+    recording.refine(sampling, 0.01);
+  }
+  return sampling;
+}
+
+TEST(Guiding, CanonicalRoundTrip) {
+  Sampler sampler;
+  for (int i = 0; i < 1000; ++i) {
+    const Vec3f w      = UniformSampleSphere(sampler.get2D());
+    const Vec3f mapped = DirectionalQuadTree::CanonicalToDirection(
+        DirectionalQuadTree::DirectionToCanonical(w));
+    EXPECT_NEAR(mapped.x, w.x, 1e-4);
+    EXPECT_NEAR(mapped.y, w.y, 1e-4);
+    EXPECT_NEAR(mapped.z, w.z, 1e-4);
+  }
+}
+
+TEST(Guiding, EmptyTreeIsUniform) {
+  DirectionalQuadTree tree;
+  EXPECT_NEAR(tree.pdf(Vec3f(0, 0, 1)), 1 / (4 * PI), 1e-6);
+}
+
+TEST(Guiding, PdfIntegratesToOne) {
+  Sampler sampler;
+  const DirectionalQuadTree tree = BuildPeakedTree(sampler);
+  EXPECT_GT(tree.getNumNodes(), 1);
+
+  const int n   = 200000;
+  Float average = 0;
+  for (int i = 0; i < n; ++i)
+    average += tree.pdf(UniformSampleSphere(sampler.get2D())) * 4 * PI / n;
+  EXPECT_NEAR(average, 1, 0.02);
+}
+
+TEST(Guiding, SamplesFollowPdf) {
+  Sampler sampler;
+  const DirectionalQuadTree tree = BuildPeakedTree(sampler);
+
+  // The probability of the cap around +z, by sampling the tree and by
+  // integrating its pdf
+  const int n    = 200000;
+  Float sampled  = 0;
+  Float integral = 0;
+  for (int i = 0; i < n; ++i) {
+    const Vec3f w = tree.sample(sampler.get2D());
+    EXPECT_GT(tree.pdf(w), 0);
+    sampled += (w.z > 0.8_F) / static_cast<Float>(n);
+
+    const Vec3f u = UniformSampleSphere(sampler.get2D());
+    integral += (u.z > 0.8_F) * tree.pdf(u) * 4 * PI / n;
+  }
+  EXPECT_GT(sampled, 0.5);
+  EXPECT_NEAR(sampled, integral, 0.02);
+}
+
+TEST(Guiding, SDTreeSplitsWhereRecorded) {
+  SDTree tree(AABB(Vec3f(-1.0), Vec3f(1.0)));
+  EXPECT_EQ(tree.getNumRegions(), 1);
+
+  const Vec3f p(0.5, 0.5, 0.5), q(-0.5, -0.5, -0.5);
+  for (int i = 0; i < 100; ++i) {
+    GuidingRegion &region = tree.getRegion(p);
+    region.recording.record(Vec3f(0, 0, 1), 1);
+    region.n_records.fetch_add(1, std::memory_order_relaxed);
+  }
+  tree.refine(10, 0.01, 1);
+
+  // Each split halves the records, so 100 of them are split 4 times down to
+  // 6 per region
+  EXPECT_EQ(tree.getNumRegions(), 16);
+  EXPECT_NE(&tree.getRegion(p), &tree.getRegion(q));
+  // The recordings become the sampling distributions
+  EXPECT_GT(tree.getRegion(p).sampling.pdf(Vec3f(0, 0, 1)), 1 / (4 * PI));
+  EXPECT_EQ(tree.getRegion(p).n_records.load(), 0u);
+}
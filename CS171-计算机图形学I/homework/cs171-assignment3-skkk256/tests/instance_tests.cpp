@@ -0,0 +1,121 @@
+/**
+ * @file instance_tests.cpp
+ * @brief Check that instances of a shared mesh, translated, scaled and
+ * rotated, are intersected and rendered as the copies of the mesh that are
+ * transformed on loading.
+ */
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+#include "rdr/interaction.h"
+#include "rdr/ray.h"
+#include "rdr/rdr.h"
+#include "rdr/render.h"
+#include "rdr/scene.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+/// An octahedron, written out as the instanced mesh
+static std::string WriteOctahedron() {
+  const fs::path path = fs::temp_directory_path() / "rdr_instance_tests.obj";
+  std::ofstream fout(path);
+  fout << "v 1 0 0\nv -1 0 0\nv 0 1 0\nv 0 -1 0\nv 0 0 1\nv 0 0 -1\n"
+       << "f 1 3 5\nf 3 2 5\nf 2 4 5\nf 4 1 5\n"
+       << "f 3 1 6\nf 2 3 6\nf 4 2 6\nf 1 4 6\n";
+  return path.string();
+}
+
+/// The transforms of the three objects, row by row, with their translations
+static const std::pair<vector<Float>, Vec3f> TRANSFORMS[] = {
+    // Scaled uniformly
+    {{0.4_F, 0, 0, 0, 0, 0.4_F, 0, 0, 0, 0, 0.4_F, 0, 0, 0, 0, 1},
+        Vec3f(-0.8_F, 0.2_F, 0)},
+    // Scaled along the axes
+    {{0.5_F, 0, 0, 0, 0, 0.25_F, 0, 0, 0, 0, 0.3_F, 0, 0, 0, 0, 1},
+        Vec3f(0, -0.3_F, 0.2_F)},
+    // Rotated by 40 degrees around y, and scaled
+    {{0.2681_F, 0, 0.2250_F, 0, 0, 0.35_F, 0, 0, -0.2250_F, 0, 0.2681_F, 0, 0,
+         0, 0, 1},
+        Vec3f(0.8_F, 0.4_F, -0.1_F)},
+};
+
+/// The light over three diffuse objects, which are either instances of the
+/// octahedron or copies of it
+static nlohmann::json MakeConfig(const std::string &obj_path, bool instanced) {
+  auto config = MakeLightOverSphereConfig("path", 16, Vec2i(16, 16));
+  config["objects"].erase(1);
+  if (instanced) config["meshes"]["octahedron"] = {{"path", obj_path}};
+  for (const auto &[transform, translate] : TRANSFORMS) {
+    nlohmann::json object = {{"transform", transform},
+        {"translate", {translate.x, translate.y, translate.z}},
+        {"material_name", "diffuse"}};
+    if (instanced) {
+      object["type"]      = "instance";
+      object["mesh_name"] = "octahedron";
+    } else {
+      object["type"] = "mesh";
+      object["path"] = obj_path;
+    }
+    config["objects"].push_back(object);
+  }
+  return config;
+}
+
+TEST(TriangleMeshInstance, MatchesCopies) {
+  spdlog::set_level(spdlog::level::err);
+  Factory::doRegisterAllClasses();
+  const std::string obj_path = WriteOctahedron();
+
+  ref<NativeRender> instances =
+      make_ref<NativeRender>(Properties(MakeConfig(obj_path, true)));
+  ref<NativeRender> copies =
+      make_ref<NativeRender>(Properties(MakeConfig(obj_path, false)));
+  for (const auto &render : {instances, copies}) {
+    render->initialize();
+    render->preprocess();
+  }
+
+  const Scene &instance_scene = *instances->getContext().scene;
+  const Scene &copy_scene     = *copies->getContext().scene;
+  Sampler sampler;
+  int n_hits = 0;
+  for (int i = 0; i < 2000; ++i) {
+    // From around the objects towards them
+    const Vec3f origin =
+        4.0_F * UniformSampleSphere(sampler.get2D()) + Vec3f(0, 0.2_F, 0);
+    const Vec3f target(sampler.get1D() * 2.4_F - 1.2_F,
+        sampler.get1D() * 1.2_F - 0.6_F, sampler.get1D() * 0.8_F - 0.4_F);
+    const Ray ray(origin, Normalize(target - origin));
+
+    SurfaceInteraction instance_interaction, copy_interaction;
+    const bool instance_hit =
+        instance_scene.intersect(ray, instance_interaction);
+    ASSERT_EQ(instance_hit, copy_scene.intersect(ray, copy_interaction))
+        << "ray " << i;
+    if (!instance_hit) continue;
+    ++n_hits;
+
+    EXPECT_NEAR(Norm(instance_interaction.p - origin),
+        Norm(copy_interaction.p - origin), 1e-4_F);
+    for (int k = 0; k < 3; ++k) {
+      EXPECT_NEAR(instance_interaction.p[k], copy_interaction.p[k], 1e-4_F);
+      EXPECT_NEAR(
+          instance_interaction.normal[k], copy_interaction.normal[k], 1e-4_F);
+    }
+  }
+  EXPECT_GT(n_hits, 100);
+
+  // The same samples are drawn for both
+  vector<Vec3f> means;
+  for (const auto &render : {instances, copies}) {
+    render->render();
+    means.push_back(GetMean(render->exportImageToArray()));
+    render->clearRuntimeInfo();
+  }
+  for (int k = 0; k < 3; ++k) {
+    ASSERT_GT(means[1][k], 0);
+    EXPECT_NEAR(means[0][k] / means[1][k], 1.0_F, 0.01_F) << "channel " << k;
+  }
+}
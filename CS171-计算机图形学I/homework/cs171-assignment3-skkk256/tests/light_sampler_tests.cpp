@@ -0,0 +1,86 @@
+/**
+ * @file light_sampler_tests.cpp
+ * @brief Check the direction cones, and that the light BVH samples with the
+ * probabilities it reports for any reference point.
+ */
+#include <gtest/gtest.h>
+
+#include "rdr/light_sampler.h"
+#include "rdr/primitive.h"
+#include "rdr/properties.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+TEST(LightSampler, DirectionConeUnion) {
+  Sampler sampler;
+  for (int i = 0; i < 1000; ++i) {
+    const DirectionCone a(UniformSampleSphere(sampler.get2D()),
+        sampler.get1D() * 2 - 1);
+    const DirectionCone b(UniformSampleSphere(sampler.get2D()),
+        sampler.get1D() * 2 - 1);
+    const DirectionCone c = Union(a, b);
+
+    // The union contains the directions of both cones, sampled on their rims
+    for (const auto &cone : {a, b}) {
+      const Frame frame(cone.w);
+      const Float sin_theta =
+          std::sqrt(std::max(0.0_F, 1 - cone.cos_theta * cone.cos_theta));
+      for (int k = 0; k < 8; ++k) {
+        const Float phi = 2 * PI * k / 8;
+        const Vec3f w   = frame.LocalToWorld(Vec3f(sin_theta * std::cos(phi),
+            sin_theta * std::sin(phi), cone.cos_theta));
+        EXPECT_GE(Dot(c.w, w), c.cos_theta - 1e-4) << i;
+      }
+    }
+  }
+
+  EXPECT_TRUE(DirectionCone().isEmpty());
+  const DirectionCone up(Vec3f(0, 0, 1));
+  EXPECT_EQ(Union(DirectionCone(), up).cos_theta, 1);
+}
+
+TEST(LightSampler, PmfMatchesSample) {
+  Factory::doRegisterAllClasses();
+
+  // A grid of spherical lights of varying power
+  vector<ref<Primitive>> primitives;
+  vector<ref<Light>> lights;
+  Sampler sampler;
+  for (int i = 0; i < 64; ++i) {
+    Properties light_props;
+    light_props.setProperty("radiance", Vec3f(sampler.get1D() * 10 + 0.1_F));
+    Properties props;
+    props.setProperty("type", std::string("sphere"));
+    props.setProperty("center",
+        Vec3f(static_cast<Float>(i % 4), static_cast<Float>(i / 4 % 4),
+            static_cast<Float>(i / 16)) *
+            3);
+    props.setProperty("radius", 0.1_F + sampler.get1D() * 0.5_F);
+    props.setProperty("light", light_props);
+    primitives.push_back(make_ref<Primitive>(props));
+    lights.push_back(primitives.back()->getAreaLight());
+  }
+  const BVHLightSampler light_sampler(lights);
+
+  for (int r = 0; r < 16; ++r) {
+    SurfaceInteraction interaction;
+    const Vec3f u = {sampler.get1D(), sampler.get1D(), sampler.get1D()};
+    interaction.setGeneral(u * 12 - 2, UniformSampleSphere(sampler.get2D()));
+
+    Float sum = 0;
+    for (const auto &light : lights) {
+      const Float pmf = light_sampler.pmf(interaction, light.get());
+      EXPECT_GE(pmf, 0);
+      sum += pmf;
+    }
+    EXPECT_NEAR(sum, 1, 1e-4) << r;
+
+    for (int s = 0; s < 256; ++s) {
+      Float pmf  = 0;
+      auto light = light_sampler.sample(interaction, sampler.get1D(), &pmf);
+      ASSERT_NE(light, nullptr);
+      EXPECT_GT(pmf, 0);
+      EXPECT_NEAR(pmf, light_sampler.pmf(interaction, light.get()), 1e-6);
+    }
+  }
+}
@@ -0,0 +1,189 @@
+/**
+ * @file mesh_cache_tests.cpp
+ * @brief Check that a cached mesh and its acceleration structure are restored
+ * as they were saved, and that stale or corrupted caches are rejected.
+ */
+#include <gtest/gtest.h>
+
+#include "rdr/bvh_accel.h"
+#include "rdr/interaction.h"
+#include "rdr/mesh_cache.h"
+#include "rdr/ray.h"
+#include "rdr/shape.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+/// A triangle soup, and the area of each triangle
+static ref<TriangleMeshResource> MakeTriangleSoup(
+    Sampler &sampler, int n_triangles, vector<Float> &areas) {
+  auto mesh = MakeTriangleSoup(sampler, n_triangles);
+  for (int i = 0; i < n_triangles; ++i) {
+    const Vec3f v0 = mesh->getVertex(3 * i), v1 = mesh->getVertex(3 * i + 1),
+                v2 = mesh->getVertex(3 * i + 2);
+    areas.push_back(0.5_F * Norm(Cross(v1 - v0, v2 - v0)));
+  }
+  return mesh;
+}
+
+static fs::path GetCachePath() {
+  return fs::temp_directory_path() / "rdr_mesh_cache_tests.rdrmesh";
+}
+
+/// Save the accel built over a soup, then restore it into restored
+static void SaveAndRestore(Accel &accel, Accel &restored) {
+  Sampler sampler;
+  vector<Float> areas;
+  auto mesh = MakeTriangleSoup(sampler, 1000, areas);
+  accel.setTriangleMesh(mesh);
+  accel.build();
+
+  const MeshCacheKey key{1, 2};
+  MeshCache::Save(GetCachePath(), key, *mesh, areas, accel);
+
+  const MeshCache cache(GetCachePath(), key);
+  ASSERT_TRUE(cache.isValid());
+  auto cached_mesh = make_ref<TriangleMeshResource>();
+  vector<Float> cached_areas;
+  cache.getMesh(*cached_mesh, cached_areas);
+  EXPECT_EQ(cached_mesh->v_indices, mesh->v_indices);
+  EXPECT_EQ(cached_areas, areas);
+  ASSERT_EQ(cached_mesh->vertices.size(), mesh->vertices.size());
+  for (size_t i = 0; i < mesh->vertices.size(); ++i)
+    EXPECT_EQ(cached_mesh->vertices[i], mesh->vertices[i]);
+
+  restored.setTriangleMesh(cached_mesh);
+  ASSERT_TRUE(restored.deserialize(cache.getAccelData(), cache.getAccelSize()));
+  restored.build();  // a no-op on the restored structure
+
+  for (int i = 0; i < 2000; ++i) {
+    const Vec3f origin = 3.0_F * UniformSampleSphere(sampler.get2D());
+    const Vec3f target(sampler.get1D() - 0.5_F, sampler.get1D() - 0.5_F,
+        sampler.get1D() - 0.5_F);
+    Ray ray(origin, Normalize(target - origin)), restored_ray = ray;
+    SurfaceInteraction interaction, restored_interaction;
+    ASSERT_EQ(accel.intersect(ray, interaction),
+        restored.intersect(restored_ray, restored_interaction));
+    EXPECT_EQ(ray.t_max, restored_ray.t_max);
+  }
+}
+
+TEST(MeshCache, BVHRoundTrip) {
+  Properties props;
+  props.setProperty("heuristic", std::string("sah"));
+  BVHAccel accel(props), restored(props);
+  SaveAndRestore(accel, restored);
+}
+
+TEST(MeshCache, WideBVHRoundTrip) {
+  WideBVHAccel<4> accel{Properties{}}, restored{Properties{}};
+  SaveAndRestore(accel, restored);
+}
+
+TEST(MeshCache, RejectStaleAndCorrupted) {
+  Sampler sampler;
+  vector<Float> areas;
+  auto mesh = MakeTriangleSoup(sampler, 100, areas);
+  WideBVHAccel<4> accel{Properties{}};
+  accel.setTriangleMesh(mesh);
+  accel.build();
+  MeshCache::Save(GetCachePath(), {1, 2}, *mesh, areas, accel);
+
+  EXPECT_FALSE(MeshCache(GetCachePath(), {1, 3}).isValid());
+  EXPECT_FALSE(MeshCache(GetCachePath(), {4, 2}).isValid());
+
+  {
+    // Another accel does not take the bytes, nor does a truncated one
+    const MeshCache cache(GetCachePath(), {1, 2});
+    ASSERT_TRUE(cache.isValid());
+    BVHAccel other;
+    other.setTriangleMesh(mesh);
+    EXPECT_FALSE(other.deserialize(cache.getAccelData(), cache.getAccelSize()));
+    WideBVHAccel<4> truncated{Properties{}};
+    truncated.setTriangleMesh(mesh);
+    EXPECT_FALSE(
+        truncated.deserialize(cache.getAccelData(), cache.getAccelSize() - 1));
+  }
+
+  // Truncate the file itself, which must not be mapped meanwhile
+  const auto size = fs::file_size(GetCachePath());
+  fs::resize_file(GetCachePath(), size / 2);
+  EXPECT_FALSE(MeshCache(GetCachePath(), {1, 2}).isValid());
+  fs::remove(GetCachePath());
+  EXPECT_FALSE(MeshCache(GetCachePath(), {1, 2}).isValid());
+}
+
+TEST(MeshCache, RejectCorruptedLeaf) {
+  Sampler sampler;
+  vector<Float> areas;
+  auto mesh = MakeTriangleSoup(sampler, 100, areas);
+  WideBVHAccel<4> accel{Properties{}};
+  accel.setTriangleMesh(mesh);
+  accel.build();
+  vector<uint8_t> data;
+  ASSERT_TRUE(accel.serialize(data));
+
+  // The nodes follow the tag and the two counts. Give the first leaf found
+  // more triangles than the mesh has
+  using NodeType               = detail_::WideBVHNode<4>;
+  constexpr size_t NODES_BEGIN = 3 * sizeof(uint32_t);
+  uint32_t n_nodes;
+  std::memcpy(&n_nodes, data.data() + sizeof(uint32_t), sizeof(uint32_t));
+  bool corrupted = false;
+  for (uint32_t i = 0; i < n_nodes && !corrupted; ++i) {
+    NodeType node;
+    uint8_t *bytes = data.data() + NODES_BEGIN + i * sizeof(NodeType);
+    std::memcpy(&node, bytes, sizeof(NodeType));
+    for (int k = 0; k < 4 && !corrupted; ++k) {
+      if (node.n_triangles[k] == 0) continue;
+      node.n_triangles[k] = 0xFFFFFFF0;
+      corrupted           = true;
+    }
+    std::memcpy(bytes, &node, sizeof(NodeType));
+  }
+  ASSERT_TRUE(corrupted);
+
+  WideBVHAccel<4> restored{Properties{}};
+  restored.setTriangleMesh(mesh);
+  EXPECT_FALSE(restored.deserialize(data.data(), data.size()));
+}
+
+TEST(MeshCache, RejectOutOfRangeAttributes) {
+  Sampler sampler;
+  vector<Float> areas;
+  auto mesh = MakeTriangleSoup(sampler, 10, areas);
+  BVHAccel accel;
+  accel.setTriangleMesh(mesh);
+  accel.build();
+
+  const auto is_valid = [&]() {
+    MeshCache::Save(GetCachePath(), {1, 2}, *mesh, areas, accel);
+    return MeshCache(GetCachePath(), {1, 2}).isValid();
+  };
+  ASSERT_TRUE(is_valid());
+
+  // A normal claimed but not stored
+  mesh->has_normal = true;
+  EXPECT_FALSE(is_valid());
+  mesh->normals.push_back(Vec3f(0, 0, 1));
+  EXPECT_TRUE(is_valid());
+  // An index past the stored normals
+  mesh->n_indices[5] = 1;
+  EXPECT_FALSE(is_valid());
+  mesh->n_indices[5] = 0;
+
+  mesh->has_texture = true;
+  mesh->texture_coordinates.push_back(Vec2f(0, 0));
+  EXPECT_TRUE(is_valid());
+  mesh->t_indices.back() = 0xFFFFFFFF;
+  EXPECT_FALSE(is_valid());
+  fs::remove(GetCachePath());
+}
+
+TEST(MeshCache, HashBytes) {
+  // The reference values of 64-bit FNV-1a
+  EXPECT_EQ(HashBytes("", 0), 0xcbf29ce484222325ULL);
+  EXPECT_EQ(HashBytes("a", 1), 0xaf63dc4c8601ec8cULL);
+  // Chaining equals hashing the concatenation
+  EXPECT_EQ(HashBytes("b", 1, HashBytes("a", 1)), HashBytes("ab", 2));
+}
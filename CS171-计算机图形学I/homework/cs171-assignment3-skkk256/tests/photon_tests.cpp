@@ -0,0 +1,182 @@
+/**
+ * @file photon_tests.cpp
+ * @brief Check the compact photon storage against the values it quantises,
+ * the kd-tree gathering of the photon map and the SPPM grid against brute
+ * force, the SPPM radius update, and SPPM against the path tracer.
+ */
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <set>
+
+#include "rdr/photon.h"
+#include "rdr/sampler.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+TEST(Photon, PowerRoundTrip) {
+  Sampler sampler;
+  for (int i = 0; i < 1000; ++i) {
+    // Components spread over many magnitudes, sharing one exponent
+    const Float scale = std::pow(10.0_F, sampler.get1D() * 8 - 6);
+    const Vec3f power =
+        scale * Vec3f(sampler.get1D(), sampler.get1D(), sampler.get1D());
+    Photon photon;
+    photon.setPower(power);
+    const Vec3f decoded = photon.getPower();
+    const Float max_power = ReduceMax(power);
+    for (int k = 0; k < 3; ++k)
+      EXPECT_NEAR(decoded[k], power[k], max_power / 128);
+  }
+
+  Photon photon;
+  photon.setPower(Vec3f(0.0));
+  EXPECT_EQ(photon.getPower(), Vec3f(0.0));
+}
+
+TEST(Photon, DirectionRoundTrip) {
+  Sampler sampler;
+  const Float max_error = std::cos(Radians(1.5_F));
+  for (int i = 0; i < 1000; ++i) {
+    const Vec3f direction = UniformSampleSphere(sampler.get2D());
+    Photon photon;
+    photon.setDirection(direction);
+    const Vec3f decoded = photon.getDirection();
+    EXPECT_NEAR(Norm(decoded), 1.0_F, 1e-4F);
+    EXPECT_GT(Dot(decoded, direction), max_error);
+  }
+}
+
+TEST(PhotonMap, NearestMatchesBruteForce) {
+  Sampler sampler;
+  vector<Photon> photons(5000);
+  for (auto &photon : photons) {
+    photon.position =
+        Vec3f(sampler.get1D(), sampler.get1D(), sampler.get1D() * 0.1_F);
+  }
+
+  PhotonMap photon_map;
+  photon_map.build(photons);
+  ASSERT_EQ(photon_map.size(), photons.size());
+
+  vector<PhotonMap::NearPhoton> result;
+  for (int i = 0; i < 200; ++i) {
+    const Vec3f p(sampler.get1D(), sampler.get1D(), sampler.get1D() * 0.1_F);
+    const int k = 1 + static_cast<int>(sampler.get1D() * 50);
+    // Every other query limits the radius, so that fewer than k may be found
+    const Float max_distance2 = i % 2 == 0 ? Float_INF : 0.0005_F;
+
+    vector<Float> reference;
+    for (const auto &photon : photons) {
+      const Float distance2 = SquareNorm(photon.position - p);
+      if (distance2 < max_distance2) reference.push_back(distance2);
+    }
+    std::sort(reference.begin(), reference.end());
+    if (static_cast<int>(reference.size()) > k) reference.resize(k);
+
+    photon_map.getNearestPhotons(p, k, max_distance2, result);
+    ASSERT_EQ(result.size(), reference.size());
+    ASSERT_TRUE(std::is_heap(result.begin(), result.end()));
+    std::sort_heap(result.begin(), result.end());
+    for (size_t j = 0; j < result.size(); ++j) {
+      EXPECT_FLOAT_EQ(result[j].distance2, reference[j]);
+      EXPECT_FLOAT_EQ(
+          SquareNorm(result[j].photon->position - p), result[j].distance2);
+    }
+  }
+}
+
+TEST(SPPMGrid, MatchesBruteForce) {
+  Sampler sampler;
+  vector<detail_::SPPMPixel> pixels(2000);
+  for (auto &pixel : pixels) {
+    pixel.interaction.p =
+        Vec3f(sampler.get1D(), sampler.get1D(), sampler.get1D() * 0.1_F);
+    pixel.radius = 0.005_F + sampler.get1D() * 0.03_F;
+    // Some of the pixels have no visible point
+    pixel.beta = sampler.get1D() < 0.8_F ? Vec3f(1.0) : Vec3f(0.0);
+  }
+
+  // Few buckets, so that the cells collide
+  detail_::SPPMGrid grid(64);
+  grid.build(pixels, 4);
+
+  for (int i = 0; i < 500; ++i) {
+    const Vec3f p(sampler.get1D(), sampler.get1D(), sampler.get1D() * 0.1_F);
+    vector<int> visited;
+    grid.forEachPixel(p, [&](int index) { visited.push_back(index); });
+    const std::set<int> visited_set(visited.begin(), visited.end());
+    ASSERT_EQ(visited_set.size(), visited.size()) << "a pixel is visited twice";
+
+    for (int j = 0; j < static_cast<int>(pixels.size()); ++j) {
+      const auto &pixel = pixels[j];
+      if (SquareNorm(pixel.beta) == 0) {
+        EXPECT_EQ(visited_set.count(j), 0);
+      } else if (SquareNorm(pixel.interaction.p - p) <=
+                 pixel.radius * pixel.radius) {
+        EXPECT_EQ(visited_set.count(j), 1) << "pixel " << j << " is missed";
+      }
+    }
+  }
+}
+
+TEST(SPPMPixel, Update) {
+  detail_::SPPMPixel pixel;
+  pixel.radius = 1;
+  pixel.beta   = Vec3f(0.5);
+  pixel.phi    = Vec3f(2.0, 4.0, 6.0);
+  pixel.m      = 4;
+
+  // N = 0 + 2/3 * 4 of the M = 4 photons are kept, and the disk shrinks with
+  // them
+  pixel.update(2.0_F / 3.0_F);
+  EXPECT_FLOAT_EQ(pixel.n, 8.0_F / 3.0_F);
+  EXPECT_FLOAT_EQ(pixel.radius, std::sqrt(2.0_F / 3.0_F));
+  for (int k = 0; k < 3; ++k)
+    EXPECT_FLOAT_EQ(pixel.tau[k], (k + 1) * 2.0_F / 3.0_F);
+  EXPECT_EQ(pixel.phi, Vec3f(0.0));
+  EXPECT_EQ(pixel.m.load(), 0);
+  EXPECT_EQ(pixel.beta, Vec3f(0.0));
+
+  // A pass without photons only clears the visible point
+  const Vec3f tau = pixel.tau;
+  pixel.beta      = Vec3f(1.0);
+  pixel.update(2.0_F / 3.0_F);
+  EXPECT_FLOAT_EQ(pixel.n, 8.0_F / 3.0_F);
+  EXPECT_FLOAT_EQ(pixel.radius, std::sqrt(2.0_F / 3.0_F));
+  EXPECT_EQ(pixel.tau, tau);
+  EXPECT_EQ(pixel.beta, Vec3f(0.0));
+
+  // tau / (N_iterations * pi * r^2)
+  const Vec3f radiance = pixel.getIndirectRadiance(10);
+  for (int k = 0; k < 3; ++k)
+    EXPECT_FLOAT_EQ(radiance[k], tau[k] / (10 * PI * 2.0_F / 3.0_F));
+
+  detail_::SPPMPixel empty_pixel;
+  EXPECT_EQ(empty_pixel.getIndirectRadiance(10), Vec3f(0.0));
+}
+
+TEST(SPPM, MatchesPathTracer) {
+  const Vec2i resolution(32, 32);
+  // A wall behind the sphere, lit indirectly
+  const nlohmann::json wall = {{"type", "sphere"},
+      {"center", {0.0, 0.0, -102.0}}, {"radius", 100.0},
+      {"material_name", "diffuse"}};
+
+  auto config = MakeLightOverSphereConfig("path", 64, resolution);
+  config["objects"].push_back(wall);
+  const Vec3f reference = GetMean(RenderImage(config));
+
+  config = MakeLightOverSphereConfig("sppm", 1, resolution);
+  config["objects"].push_back(wall);
+  config["integrator"]["n_iterations"]   = 64;
+  config["integrator"]["n_photons"]      = 20000;
+  config["integrator"]["initial_radius"] = 0.1;
+  const Vec3f mean = GetMean(RenderImage(config));
+
+  for (int k = 0; k < 3; ++k) {
+    ASSERT_GT(reference[k], 0);
+    EXPECT_NEAR(mean[k] / reference[k], 1.0_F, 0.1_F) << "channel " << k;
+  }
+}
@@ -0,0 +1,58 @@
+/**
+ * @file progressive_tests.cpp
+ * @brief Check that the progressive mode of the path tracer stops the pixels
+ * of constant radiance at min_spp, keeps sampling the noisy ones, and never
+ * draws more than spp samples for a pixel.
+ */
+#include <gtest/gtest.h>
+
+#include "rdr/film.h"
+#include "rdr/rdr.h"
+#include "rdr/render.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+TEST(Progressive, StopsAtTargetError) {
+  constexpr int SPP         = 30;
+  constexpr int MIN_SPP     = 8;
+  constexpr Float MAX_ERROR = 0.01_F;
+  spdlog::set_level(spdlog::level::err);
+  Factory::doRegisterAllClasses();
+
+  // spp is not a multiple of pass_spp, so the last pass is cut short
+  auto config = MakeLightOverSphereConfig("path", SPP, Vec2i(16, 16));
+
+  config["integrator"]["progressive"] = {
+      {"pass_spp", 4}, {"min_spp", MIN_SPP}, {"target_error", MAX_ERROR}};
+
+  ref<NativeRender> render = make_ref<NativeRender>(Properties(config));
+  render->initialize();
+  render->preprocess();
+  render->render();
+
+  const Film &film        = *render->getContext().film;
+  const Vec2i &resolution = film.getResolution();
+
+  int n_constant = 0, n_noisy = 0;
+  for (int y = 0; y < resolution.y; ++y) {
+    for (int x = 0; x < resolution.x; ++x) {
+      const auto &statistics = film.getPixelStatistics(x, y);
+      EXPECT_GE(statistics.n_samples, MIN_SPP);
+      EXPECT_LE(statistics.n_samples, SPP);
+      // The background has no radiance at all, and no error
+      if (statistics.square_sum == 0) {
+        EXPECT_EQ(statistics.n_samples, MIN_SPP) << x << ", " << y;
+        ++n_constant;
+      } else if (statistics.n_samples > MIN_SPP) {
+        ++n_noisy;
+      }
+      // A pixel only stops early once it is converged
+      if (statistics.n_samples < SPP)
+        EXPECT_LE(statistics.getRelativeError(), MAX_ERROR) << x << ", " << y;
+    }
+  }
+  EXPECT_GT(n_constant, 0);
+  EXPECT_GT(n_noisy, 0);
+  render->clearRuntimeInfo();
+}
@@ -0,0 +1,99 @@
+/**
+ * @file sampler_tests.cpp
+ * @brief Check the determinism, the range and the stratification of the
+ * samplers selectable by the integrators.
+ */
+#include <gtest/gtest.h>
+
+#include "rdr/properties.h"
+#include "rdr/sampler.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+static const char *const SAMPLER_TYPES[] = {
+    "independent", "stratified", "halton", "sobol"};
+
+static ref<Sampler> MakeSampler(const std::string &type, int spp) {
+  Properties props;
+  props.setProperty("type", type);
+  return CreateSampler(props, spp);
+}
+
+TEST(Sampler, DeterministicAndCloneable) {
+  for (const char *type : SAMPLER_TYPES) {
+    auto sampler = MakeSampler(type, 16);
+    auto clone   = sampler->clone();
+    // Visit the samples in a different order on the clone
+    for (int s = 15; s >= 0; --s) {
+      for (int k = 0; k < 2; ++k) {
+        sampler->startPixelSample(Vec2i(3, 7), s);
+        clone->startPixelSample(Vec2i(3, 7), s);
+        for (int d = 0; d < 20; ++d) {
+          ASSERT_EQ(sampler->get1D(), clone->get1D()) << type;
+          ASSERT_EQ(sampler->get2D(), clone->get2D()) << type;
+        }
+      }
+    }
+
+    // Neighbouring pixels are decorrelated
+    sampler->startPixelSample(Vec2i(3, 7), 0);
+    clone->startPixelSample(Vec2i(4, 7), 0);
+    EXPECT_NE(sampler->get1D(), clone->get1D()) << type;
+  }
+}
+
+TEST(Sampler, Range) {
+  for (const char *type : SAMPLER_TYPES) {
+    auto sampler = MakeSampler(type, 64);
+    for (int s = 0; s < 256; ++s) {
+      sampler->startPixelSample(Vec2i(s % 5, s % 3), s);
+      for (int d = 0; d < 200; ++d) {
+        const Float u = sampler->get1D();
+        ASSERT_TRUE(0 <= u && u < 1) << type;
+      }
+      EXPECT_EQ(sampler->getDimension(), 200);
+    }
+  }
+}
+
+TEST(Sampler, Stratification) {
+  // Each of the N strata of every dimension receives exactly one sample
+  constexpr int N = 64;
+  for (const char *type : {"stratified", "sobol"}) {
+    auto sampler = MakeSampler(type, N);
+    for (int d = 0; d < 12; ++d) {
+      vector<int> counts(N, 0);
+      for (int s = 0; s < N; ++s) {
+        sampler->startPixelSample(Vec2i(11, 5), s);
+        sampler->setDimension(d);
+        ++counts[static_cast<int>(sampler->get1D() * N)];
+      }
+      for (int i = 0; i < N; ++i) ASSERT_EQ(counts[i], 1) << type << " " << d;
+    }
+  }
+}
+
+TEST(Sampler, IntegrationError) {
+  // A smooth 2D integrand with a known integral of 1/4
+  auto f = [](const Vec2f &u) { return u.x * u.y; };
+  constexpr int N      = 256;
+  constexpr int PIXELS = 64;
+
+  Float error[4];
+  for (int t = 0; t < 4; ++t) {
+    auto sampler = MakeSampler(SAMPLER_TYPES[t], N);
+    error[t]     = 0;
+    for (int p = 0; p < PIXELS; ++p) {
+      Float sum = 0;
+      for (int s = 0; s < N; ++s) {
+        sampler->startPixelSample(Vec2i(p, 0), s);
+        sampler->get2D();  // The pixel sample
+        sum += f(sampler->get2D());
+      }
+      error[t] += std::abs(sum / N - 0.25_F);
+    }
+  }
+
+  // The low-discrepancy samplers converge much faster than independent ones
+  for (int t = 1; t < 4; ++t) EXPECT_LT(error[t] * 4, error[0]) << t;
+}
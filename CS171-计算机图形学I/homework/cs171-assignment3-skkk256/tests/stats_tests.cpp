@@ -0,0 +1,58 @@
+/**
+ * @file stats_tests.cpp
+ * @brief Check that the counters of the workers are gathered, including those
+ * of the exited threads, and that the summaries hold them.
+ */
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include "rdr/parallel.h"
+#include "rdr/stats.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+TEST(Statistics, GatherWorkers) {
+  Statistics::clear();
+  // The workers of the pool are still alive after ParallelFor returns
+  ParallelFor(
+      1000,
+      [](int index, int) {
+        Statistics::Local().add(EStatCounter::ERays, 2);
+        Statistics::Local().addPathLength(index % 4);
+      },
+      4);
+  Statistics::Local().add(EStatCounter::ETriangleTests, 5);
+  std::thread([] {
+    Statistics::Local().add(EStatCounter::ETriangleTests, 3);
+  }).join();
+
+  const StatCounters stats = Statistics::gather();
+  EXPECT_EQ(stats.get(EStatCounter::ERays), 2000u);
+  EXPECT_EQ(stats.get(EStatCounter::ETriangleTests), 8u);
+  for (int i = 0; i < 4; ++i) EXPECT_EQ(stats.path_lengths[i], 250u);
+
+  Statistics::clear();
+  EXPECT_EQ(Statistics::gather().get(EStatCounter::ETriangleTests), 0u);
+}
+
+TEST(Statistics, PathLengthOverflow) {
+  StatCounters stats;
+  stats.addPathLength(StatCounters::MAX_PATH_LENGTH);
+  stats.addPathLength(StatCounters::MAX_PATH_LENGTH + 100);
+  EXPECT_EQ(stats.path_lengths[StatCounters::MAX_PATH_LENGTH], 1u);
+  EXPECT_EQ(stats.path_lengths[StatCounters::MAX_PATH_LENGTH + 1], 1u);
+}
+
+TEST(Statistics, JsonSummary) {
+  StatCounters stats;
+  stats.add(EStatCounter::EShadowRays, 4);
+  stats.add(EStatCounter::EShadowRaysBlocked, 1);
+  stats.phase_times[static_cast<int>(EStatPhase::ERender)] = 2.5;
+
+  const auto json = nlohmann::json::parse(Statistics::toJson(stats));
+  EXPECT_EQ(json["counters"]["shadow_rays"], 4);
+  EXPECT_DOUBLE_EQ(json["shadow_ray_hit_rate"].get<double>(), 0.25);
+  EXPECT_DOUBLE_EQ(json["phase_times"]["render"].get<double>(), 2.5);
+  EXPECT_EQ(json["path_lengths"].size(), StatCounters::MAX_PATH_LENGTH + 2u);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file test_utils.h
+ * @brief Synthetic inputs shared by the tests and the benchmarks, and a small
+ * in-memory scene to compare the integrators on.
+ */
+#ifndef __TEST_UTILS_H__
+#define __TEST_UTILS_H__
+
+#include <numeric>
+
+#include "nlohmann/json.hpp"
+#include "rdr/film.h"
+#include "rdr/properties.h"
+#include "rdr/render.h"
+#include "rdr/rfilter.h"
+#include "rdr/shape.h"
+
+RDR_NAMESPACE_BEGIN
+
+/// A soup of n_triangles random triangles of the given size, centered in the
+/// cube [-1, 1]^3. The normal and texture coordinate indices are 0, though the
+/// mesh has neither attribute
+inline ref<TriangleMeshResource> MakeTriangleSoup(
+    Sampler &sampler, int n_triangles, Float size = 0.2_F) {
+  auto mesh = make_ref<TriangleMeshResource>();
+  for (int i = 0; i < n_triangles; ++i) {
+    const Vec3f center(sampler.get1D() * 2 - 1, sampler.get1D() * 2 - 1,
+        sampler.get1D() * 2 - 1);
+    for (int k = 0; k < 3; ++k) {
+      const Vec3f offset(sampler.get1D() - 0.5_F, sampler.get1D() - 0.5_F,
+          sampler.get1D() - 0.5_F);
+      mesh->vertices.push_back(center + size * offset);
+      mesh->v_indices.push_back(3 * i + k);
+      mesh->n_indices.push_back(0);
+      mesh->t_indices.push_back(0);
+    }
+  }
+  return mesh;
+}
+
+/// A preprocessed film with a Gaussian filter of radius 1.5
+inline ref<Film> MakeFilm(
+    const std::string &accumulation, const Vec2i &resolution) {
+  Properties filter_props;
+  filter_props.setProperty("radius", 1.5_F);
+  CrossConfigurationContext context;
+  context.filter = make_ref<GaussianFilter>(filter_props);
+
+  Properties props;
+  props.setProperty("resolution", resolution);
+  props.setProperty("accumulation", accumulation);
+  auto film = make_ref<Film>(props);
+  film->crossConfiguration(context);
+  film->preprocess(PreprocessContext{});
+  return film;
+}
+
+/// An area light above a diffuse sphere, rendered by the integrator of type
+/// with the MIS profile. The other properties of the integrator are left to
+/// the tests
+inline nlohmann::json MakeLightOverSphereConfig(
+    const std::string &type, int spp, const Vec2i &resolution) {
+  nlohmann::json config = nlohmann::json::parse(R"({
+    "camera": {
+      "position": [0.0, 1.0, 6.8],
+      "look_at": [0.0, 1.0, 0.0],
+      "ref_up": [0.0, 1.0, 0.0],
+      "fov": 19.5,
+      "focal_length": 1.0 },
+    "textures": { "white": { "type": "constant", "color": [0.8, 0.8, 0.8] } },
+    "materials": { "diffuse": { "type": "diffuse", "texture_name": "white" } },
+    "objects": [
+      { "type": "sphere", "center": [0.0, 1.4, 0.0], "radius": 0.3,
+        "light": { "type": "area", "radiance": [5.0, 5.0, 5.0] } },
+      { "type": "sphere", "center": [0.0, 0.0, 0.0], "radius": 1.0,
+        "material_name": "diffuse" } ]
+  })");
+  config["integrator"] = {{"type", type}, {"spp", spp}, {"max_depth", 8},
+      {"rr_threshold", 0.1}, {"profile", "MIS"}};
+  config["film"]["resolution"] = {resolution.x, resolution.y};
+  return config;
+}
+
+/// Render the scene of config and return the image
+inline vector<Vec3f> RenderImage(const nlohmann::json &config) {
+  spdlog::set_level(spdlog::level::err);
+  Factory::doRegisterAllClasses();
+
+  ref<RenderInterface> render = make_ref<NativeRender>(Properties(config));
+  render->initialize();
+  render->preprocess();
+  render->render();
+  vector<Vec3f> image = render->exportImageToArray();
+  render->clearRuntimeInfo();
+  return image;
+}
+
+/// The mean radiance over the image
+inline Vec3f GetMean(const vector<Vec3f> &image) {
+  return std::reduce(image.begin(), image.end(), Vec3f(0.0_F)) / image.size();
+}
+
+RDR_NAMESPACE_END
+
+#endif
@@ -12,9 +12,84 @@
 #include <gtest/gtest.h>
 
 #include "rdr/light.h"
+#include "rdr/mipmap.h"
 #include "rdr/rdr.h"
 #include "rdr/texture.h"
 
 using namespace RDR_NAMESPACE_NAME;
 
-// Temporarily deleted
\ No newline at end of file
+// Temporarily deleted
+
+static vector<Float> MakeRandomImage(
+    Sampler &sampler, const Vec2u &resolution) {
+  vector<Float> image(4 * resolution[0] * resolution[1]);
+  for (auto &channel : image) channel = sampler.get1D();
+  return image;
+}
+
+TEST(MIPMap, TiledLevels) {
+  Sampler sampler;
+  const Vec2u resolution(64, 32);
+  const auto image = MakeRandomImage(sampler, resolution);
+  const MIPMap mipmap(resolution, image);
+  ASSERT_EQ(mipmap.Width(), 64u);
+  ASSERT_EQ(mipmap.Height(), 32u);
+  ASSERT_EQ(mipmap.Level(), 6u);
+
+  // The first level of a power-of-two image is the image itself
+  for (uint32_t t = 0; t < resolution[1]; ++t)
+    for (uint32_t s = 0; s < resolution[0]; ++s)
+      EXPECT_EQ(mipmap.Texel(0, s, t),
+          Vec3f(&image[4 * (t * resolution[0] + s)]));
+
+  // 3 channels of all levels, down to 2x1
+  uint32_t n_texels = 0;
+  for (Vec2u res = resolution; res[0] * res[1] > 1;
+       res = Vec2u(std::max(1u, res[0] / 2), std::max(1u, res[1] / 2)))
+    n_texels += res[0] * res[1];
+  EXPECT_EQ(mipmap.MemoryUsage(), 3 * sizeof(Float) * n_texels);
+}
+
+TEST(MIPMap, HalfTexels) {
+  Sampler sampler;
+  const Vec2u resolution(128, 64);
+  const auto image = MakeRandomImage(sampler, resolution);
+  const MIPMap single(resolution, image, MIPMap::LookUpMethod::EWA);
+  const MIPMap half(resolution, image, MIPMap::LookUpMethod::EWA,
+      MIPMap::ImageWrap::Repeat, MIPMap::TexelFormat::Half);
+  EXPECT_EQ(half.MemoryUsage() * 2, single.MemoryUsage());
+
+  // Half floats keep 11 significant bits
+  for (uint32_t l = 0; l < single.Level(); ++l)
+    for (uint32_t t = 0; t < 8; ++t)
+      for (uint32_t s = 0; s < 8; ++s)
+        for (int c = 0; c < 3; ++c)
+          EXPECT_NEAR(half.Texel(l, s, t)[c], single.Texel(l, s, t)[c], 1e-3);
+
+  const Vec2f dstdx(4.0_F / resolution[0], 0);
+  const Vec2f dstdy(0, 1.0_F / resolution[1]);
+  for (int i = 0; i < 100; ++i) {
+    const Vec2f st = sampler.get2D();
+    const Vec3f expected = single.LookUp(st, dstdx, dstdy);
+    const Vec3f value    = half.LookUp(st, dstdx, dstdy);
+    for (int c = 0; c < 3; ++c) EXPECT_NEAR(value[c], expected[c], 1e-3);
+  }
+}
+
+TEST(MIPMap, TexelCacheOwners) {
+  // Interleaved fetches of the same texels of two MIPMaps do not mix up
+  const Vec2u resolution(16, 16);
+  const vector<Float> zeros(4 * 16 * 16, 0), ones(4 * 16 * 16, 1);
+  const MIPMap zero(resolution, zeros, MIPMap::LookUpMethod::EWA,
+      MIPMap::ImageWrap::Repeat, MIPMap::TexelFormat::Half);
+  const MIPMap one(resolution, ones, MIPMap::LookUpMethod::EWA,
+      MIPMap::ImageWrap::Repeat, MIPMap::TexelFormat::Half);
+  for (int i = 0; i < 2; ++i) {
+    for (uint32_t t = 0; t < 16; ++t) {
+      for (uint32_t s = 0; s < 16; ++s) {
+        EXPECT_EQ(zero.Texel(0, s, t), Vec3f(0));
+        EXPECT_EQ(one.Texel(0, s, t), Vec3f(1));
+      }
+    }
+  }
+}
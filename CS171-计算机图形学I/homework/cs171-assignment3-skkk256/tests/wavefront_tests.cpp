@@ -0,0 +1,32 @@
+/**
+ * @file wavefront_tests.cpp
+ * @brief Check that the wavefront path tracer renders the same image as the
+ * path tracer. Both draw the samples of each path in the same order, so the
+ * images only differ by the order the samples are summed in.
+ */
+#include <gtest/gtest.h>
+
+#include "rdr/rdr.h"
+#include "test_utils.h"
+
+using namespace RDR_NAMESPACE_NAME;
+
+TEST(Wavefront, MatchesPathTracer) {
+  auto config = MakeLightOverSphereConfig("path", 8, Vec2i(16, 16));
+
+  const vector<Vec3f> reference = RenderImage(config);
+
+  // The waves wrap around the image and start in the middle of rows
+  config["integrator"]["type"]      = "wavefront";
+  config["integrator"]["wave_size"] = 100;
+  const vector<Vec3f> image         = RenderImage(config);
+
+  ASSERT_EQ(image.size(), reference.size());
+  Float error = 0, norm = 0;
+  for (size_t i = 0; i < image.size(); ++i) {
+    error += SquareNorm(image[i] - reference[i]);
+    norm += SquareNorm(reference[i]);
+  }
+  ASSERT_GT(norm, 0);
+  EXPECT_LT(error / norm, 1e-8_F);
+}